@@ -0,0 +1,349 @@
+/*
+ * pace2_compressed_log.c
+ *
+ * Compressed, rotating block log, see pace2_compressed_log.h.
+ */
+
+#include "pace2_compressed_log.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* "-YYYYmmdd-HHMMSS-<sequence>.gz.idx" */
+#define PACE2_COMPRESSED_LOG_SUFFIX_LENGTH 64
+
+static u64 pace2_compressed_log_now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    return (u64)ts.tv_sec * 1000 + (u64)ts.tv_nsec / 1000000;
+}
+
+/* deletes the oldest file of this run if max_files are kept, then remembers the new one */
+static void pace2_compressed_log_keep(struct pace2_compressed_log *log, const char *path)
+{
+    char *index_path;
+
+    if (0 == log->config.max_files) {
+        return;
+    }
+
+    if (log->kept_count == log->config.max_files) {
+        index_path = malloc(strlen(log->kept[0]) + 5);
+        if (NULL != index_path) {
+            sprintf(index_path, "%s.idx", log->kept[0]);
+            unlink(index_path);
+            free(index_path);
+        }
+        unlink(log->kept[0]);
+        free(log->kept[0]);
+
+        memmove(log->kept, log->kept + 1, (log->kept_count - 1) * sizeof(*log->kept));
+        log->kept_count--;
+    }
+
+    log->kept[log->kept_count] = strdup(path);
+    if (NULL != log->kept[log->kept_count]) {
+        log->kept_count++;
+    }
+}
+
+static u8 pace2_compressed_log_open_file(struct pace2_compressed_log *log)
+{
+    struct pace2_compressed_log_index_header header;
+    const size_t prefix_length = strlen(log->config.prefix);
+    const u64 now = pace2_compressed_log_now_ms();
+    const time_t seconds = (time_t)(now / 1000);
+    struct tm tm;
+
+    localtime_r(&seconds, &tm);
+    strcpy(log->path, log->config.prefix);
+    strftime(log->path + prefix_length, PACE2_COMPRESSED_LOG_SUFFIX_LENGTH, "-%Y%m%d-%H%M%S", &tm);
+    sprintf(log->path + strlen(log->path), "-%06llu.gz", (unsigned long long)log->file_sequence++);
+
+    log->file = fopen(log->path, "wb");
+    if (NULL == log->file) {
+        perror(log->path);
+        log->errors++;
+        return 1;
+    }
+
+    strcat(log->path, ".idx");
+    log->index = fopen(log->path, "wb");
+    log->path[strlen(log->path) - 4] = '\0';
+    if (NULL == log->index) {
+        perror(log->path);
+        fclose(log->file);
+        log->file = NULL;
+        log->errors++;
+        return 1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PACE2_COMPRESSED_LOG_INDEX_MAGIC, sizeof(header.magic));
+    header.version = PACE2_COMPRESSED_LOG_INDEX_VERSION;
+    header.block_size = log->config.block_size;
+    fwrite(&header, sizeof(header), 1, log->index);
+
+    log->file_bytes = 0;
+    log->file_uncompressed_bytes = 0;
+    log->file_records = 0;
+    log->file_opened_ms = now;
+    log->files++;
+
+    pace2_compressed_log_keep(log, log->path);
+
+    return 0;
+}
+
+/* compresses the block as one gzip member and appends it to the file and the index */
+static void pace2_compressed_log_write_block(struct pace2_compressed_log *log)
+{
+    struct pace2_compressed_log_index_entry entry;
+    u32 length;
+
+    if (0 == log->block_used || NULL == log->file) {
+        return;
+    }
+
+    deflateReset(&log->stream);
+    log->stream.next_in = log->block;
+    log->stream.avail_in = log->block_used;
+    log->stream.next_out = log->compressed;
+    log->stream.avail_out = log->compressed_size;
+
+    if (deflate(&log->stream, Z_FINISH) != Z_STREAM_END) {
+        log->errors++;
+        log->block_used = 0;
+        log->block_first_ms = 0;
+        return;
+    }
+    length = log->compressed_size - log->stream.avail_out;
+
+    entry.offset = log->file_bytes;
+    entry.uncompressed_offset = log->file_uncompressed_bytes;
+    entry.compressed_length = length;
+    entry.length = log->block_used;
+    entry.first_ms = log->block_first_ms;
+    entry.last_ms = log->block_last_ms;
+
+    /* the block has to be in the file before a reader finds it in the index */
+    if (fwrite(log->compressed, 1, length, log->file) != length || fflush(log->file) != 0 ||
+        fwrite(&entry, sizeof(entry), 1, log->index) != 1 || fflush(log->index) != 0) {
+        log->errors++;
+    }
+
+    log->blocks++;
+    log->bytes_in += log->block_used;
+    log->bytes_out += length;
+    log->file_bytes += length;
+    log->file_uncompressed_bytes += log->block_used;
+    log->block_used = 0;
+    log->block_first_ms = 0;
+}
+
+static void pace2_compressed_log_close_file(struct pace2_compressed_log *log)
+{
+    if (NULL == log->file) {
+        return;
+    }
+
+    pace2_compressed_log_write_block(log);
+
+    fclose(log->file);
+    fclose(log->index);
+    log->file = NULL;
+    log->index = NULL;
+}
+
+/* opens the next file, its header is a block of its own which readers of a time range always take */
+static void pace2_compressed_log_start_file(struct pace2_compressed_log *log)
+{
+    if (pace2_compressed_log_open_file(log) != 0 || 0 == log->file_header_length) {
+        return;
+    }
+
+    memcpy(log->block, log->file_header, log->file_header_length);
+    log->block_used = log->file_header_length;
+    pace2_compressed_log_write_block(log);
+}
+
+static void pace2_compressed_log_rotate(struct pace2_compressed_log *log)
+{
+    pace2_compressed_log_close_file(log);
+    pace2_compressed_log_start_file(log);
+}
+
+/* writes the block, starts a new file if the current one reached its size */
+static void pace2_compressed_log_end_block(struct pace2_compressed_log *log)
+{
+    pace2_compressed_log_write_block(log);
+
+    if (0 != log->config.max_file_size && log->file_bytes >= log->config.max_file_size) {
+        pace2_compressed_log_rotate(log);
+    }
+}
+
+void pace2_compressed_log_init_default_config(struct pace2_compressed_log_config *config, const char *prefix)
+{
+    if (NULL == config) {
+        return;
+    }
+
+    config->prefix = prefix;
+    config->block_size = PACE2_COMPRESSED_LOG_DEFAULT_BLOCK_SIZE;
+    config->level = PACE2_COMPRESSED_LOG_DEFAULT_LEVEL;
+    config->max_file_size = PACE2_COMPRESSED_LOG_DEFAULT_MAX_FILE_SIZE;
+    config->max_file_seconds = PACE2_COMPRESSED_LOG_DEFAULT_MAX_FILE_SECONDS;
+    config->max_files = 0;
+    config->block_timeout_ms = PACE2_COMPRESSED_LOG_DEFAULT_BLOCK_TIMEOUT_MS;
+}
+
+u8 pace2_compressed_log_open(struct pace2_compressed_log *log, const struct pace2_compressed_log_config *config,
+                             const void *file_header, u32 file_header_length)
+{
+    if (NULL == log || NULL == config || NULL == config->prefix) {
+        return 1;
+    }
+
+    memset(log, 0, sizeof(*log));
+    log->config = *config;
+    if (0 == log->config.block_size) {
+        log->config.block_size = PACE2_COMPRESSED_LOG_DEFAULT_BLOCK_SIZE;
+    }
+    if (file_header_length >= log->config.block_size) {
+        return 1;
+    }
+
+    if (deflateInit2(&log->stream, log->config.level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return 1;
+    }
+    log->compressed_size = (u32)deflateBound(&log->stream, log->config.block_size);
+
+    log->block = malloc(log->config.block_size);
+    log->compressed = malloc(log->compressed_size);
+    log->path = malloc(strlen(config->prefix) + PACE2_COMPRESSED_LOG_SUFFIX_LENGTH);
+    if (0 != log->config.max_files) {
+        log->kept = calloc(log->config.max_files, sizeof(*log->kept));
+    }
+    if (0 != file_header_length) {
+        log->file_header = malloc(file_header_length);
+    }
+
+    if (NULL == log->block || NULL == log->compressed || NULL == log->path ||
+        (0 != log->config.max_files && NULL == log->kept) ||
+        (0 != file_header_length && NULL == log->file_header)) {
+        pace2_compressed_log_close(log);
+        return 1;
+    }
+
+    if (0 != file_header_length) {
+        memcpy(log->file_header, file_header, file_header_length);
+        log->file_header_length = file_header_length;
+    }
+
+    pace2_compressed_log_start_file(log);
+    if (NULL == log->file) {
+        pace2_compressed_log_close(log);
+        return 1;
+    }
+
+    return 0;
+}
+
+void pace2_compressed_log_write(struct pace2_compressed_log *log, const void *data, u32 length)
+{
+    const u64 now = pace2_compressed_log_now_ms();
+
+    if (0 != log->config.max_file_seconds && NULL != log->file &&
+        now - log->file_opened_ms >= log->config.max_file_seconds * 1000ull) {
+        pace2_compressed_log_rotate(log);
+    }
+
+    /* a cut record would corrupt a binary log */
+    if (NULL == log->file || length > log->config.block_size) {
+        log->errors++;
+        return;
+    }
+
+    /* a record never spans two blocks */
+    if (log->block_used + (u64)length > log->config.block_size) {
+        pace2_compressed_log_end_block(log);
+        if (NULL == log->file) {
+            log->errors++;
+            return;
+        }
+    }
+
+    memcpy(log->block + log->block_used, data, length);
+    log->block_used += length;
+
+    if (0 == log->block_first_ms) {
+        log->block_first_ms = now;
+    }
+    log->block_last_ms = now;
+    log->records++;
+    log->file_records++;
+}
+
+void pace2_compressed_log_tick(struct pace2_compressed_log *log)
+{
+    const u64 now = pace2_compressed_log_now_ms();
+
+    if (NULL == log->file) {
+        return;
+    }
+
+    /* files without records are not rotated */
+    if (0 != log->config.max_file_seconds && now - log->file_opened_ms >= log->config.max_file_seconds * 1000ull &&
+        0 != log->file_records) {
+        pace2_compressed_log_rotate(log);
+        return;
+    }
+
+    if (0 != log->config.block_timeout_ms && 0 != log->block_first_ms &&
+        now - log->block_first_ms >= log->config.block_timeout_ms) {
+        pace2_compressed_log_end_block(log);
+    }
+}
+
+void pace2_compressed_log_close(struct pace2_compressed_log *log)
+{
+    u32 k;
+
+    if (NULL == log) {
+        return;
+    }
+
+    pace2_compressed_log_close_file(log);
+
+    deflateEnd(&log->stream);
+
+    for (k = 0; k < log->kept_count; k++) {
+        free(log->kept[k]);
+    }
+    free(log->kept);
+    free(log->file_header);
+    free(log->path);
+    free(log->compressed);
+    free(log->block);
+
+    log->kept = NULL;
+    log->kept_count = 0;
+    log->file_header = NULL;
+    log->path = NULL;
+    log->compressed = NULL;
+    log->block = NULL;
+}
+
+void pace2_compressed_log_print_stats(const struct pace2_compressed_log *log, FILE *f)
+{
+    fprintf(f, "  compressed log %s: %llu records, %llu blocks, %llu files, %llu bytes in, %llu bytes out (%.1f%%), %llu errors\n",
+            log->config.prefix, (unsigned long long)log->records, (unsigned long long)log->blocks,
+            (unsigned long long)log->files, (unsigned long long)log->bytes_in, (unsigned long long)log->bytes_out,
+            log->bytes_in > 0 ? 100.0 * log->bytes_out / log->bytes_in : 0.0, (unsigned long long)log->errors);
+}
@@ -0,0 +1,170 @@
+/*
+ * pace2_compressed_log.h
+ *
+ * Compressed, rotating output of the event sink writer. Records are
+ * collected in a block of fixed size; a full block is compressed with zlib
+ * as a gzip member of its own and appended to the current file, so zcat
+ * reads a whole file and every block can be decompressed on its own. A
+ * record never spans two blocks. A file header, e.g. of a binary event
+ * log, is the first block of every file.
+ *
+ * Every file <prefix>-<start time>-<sequence>.gz has a block index
+ * <file>.idx: a header and one entry per block with its offset, its
+ * lengths and the wall clock time of its first and last record. Readers
+ * find the blocks of a time range in the index and decompress only these,
+ * see pace2_log_reader.c.
+ *
+ * A new file is started when the compressed size of the current one
+ * reaches max_file_size or when it is older than max_file_seconds. With
+ * max_files only the newest files of this run are kept.
+ */
+
+#ifndef PACE2_COMPRESSED_LOG_H
+#define PACE2_COMPRESSED_LOG_H
+
+#include <stdio.h>
+#include <zlib.h>
+#include <pace2.h>
+
+#define PACE2_COMPRESSED_LOG_DEFAULT_BLOCK_SIZE (1024 * 1024)
+#define PACE2_COMPRESSED_LOG_DEFAULT_LEVEL Z_BEST_SPEED
+#define PACE2_COMPRESSED_LOG_DEFAULT_MAX_FILE_SIZE (64ull * 1024 * 1024)
+#define PACE2_COMPRESSED_LOG_DEFAULT_MAX_FILE_SECONDS 3600
+#define PACE2_COMPRESSED_LOG_DEFAULT_BLOCK_TIMEOUT_MS 5000
+
+#define PACE2_COMPRESSED_LOG_INDEX_MAGIC "P2LOGIDX"
+#define PACE2_COMPRESSED_LOG_INDEX_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* start of an index file, host byte order */
+struct pace2_compressed_log_index_header {
+    char magic[8];
+    u32 version;
+    u32 block_size;
+};
+
+/* index entry of one block, host byte order */
+struct pace2_compressed_log_index_entry {
+    /* position of the gzip member in the file */
+    u64 offset;
+    /* position of the block in the uncompressed content of the file */
+    u64 uncompressed_offset;
+    u32 compressed_length;
+    u32 length;
+    /* wall clock time in ms when the first and the last record were written, 0 for the file header */
+    u64 first_ms;
+    u64 last_ms;
+};
+
+struct pace2_compressed_log_config {
+    /* path and name prefix of the files */
+    const char *prefix;
+    /* uncompressed bytes per block, at least the largest record */
+    u32 block_size;
+    /* zlib level, 1 (fastest) to 9 */
+    int level;
+    /* compressed bytes per file, 0 for no limit */
+    u64 max_file_size;
+    /* age of a file in seconds, 0 for no limit */
+    u32 max_file_seconds;
+    /* number of files kept, the oldest one is deleted; 0 to keep all */
+    u32 max_files;
+    /* a partial block is written when its first record is older, 0 to write only full blocks */
+    u32 block_timeout_ms;
+};
+
+struct pace2_compressed_log {
+    struct pace2_compressed_log_config config;
+
+    /* content of every file before the first record, e.g. the header of a binary event log */
+    u8 *file_header;
+    u32 file_header_length;
+
+    /* current file and its index */
+    FILE *file;
+    FILE *index;
+    char *path;
+    u64 file_sequence;
+    u64 file_bytes;
+    u64 file_uncompressed_bytes;
+    u64 file_records;
+    u64 file_opened_ms;
+
+    /* block being filled */
+    u8 *block;
+    u32 block_used;
+    u64 block_first_ms;
+    u64 block_last_ms;
+
+    z_stream stream;
+    u8 *compressed;
+    u32 compressed_size;
+
+    /* files of this run, deleted when more than max_files exist */
+    char **kept;
+    u32 kept_count;
+
+    /* statistics */
+    u64 records;
+    u64 blocks;
+    u64 files;
+    u64 bytes_in;
+    u64 bytes_out;
+    u64 errors;
+};
+
+/**
+ * fills a configuration with default values
+ * (1 MiB blocks, zlib level 1, 64 MiB or one hour per file, all files kept)
+ * @param config configuration to initialize
+ * @param prefix path and name prefix of the files
+ */
+void pace2_compressed_log_init_default_config(struct pace2_compressed_log_config *config, const char *prefix);
+
+/**
+ * allocates the buffers and opens the first file
+ * @param log log to initialize
+ * @param config configuration
+ * @param file_header written at the start of every file; NULL for none
+ * @param file_header_length length of the file header, less than the block size
+ * @return 0 on success; !=0 on error
+ */
+u8 pace2_compressed_log_open(struct pace2_compressed_log *log, const struct pace2_compressed_log_config *config,
+                             const void *file_header, u32 file_header_length);
+
+/**
+ * appends a record, writes the block first if the record does not fit into it
+ * @param log log
+ * @param data record
+ * @param length length of the record, records longer than the block size are not written and counted as errors
+ */
+void pace2_compressed_log_write(struct pace2_compressed_log *log, const void *data, u32 length);
+
+/**
+ * writes a partial block after the block timeout and starts a new file after max_file_seconds,
+ * called regularly while no records are written
+ * @param log log
+ */
+void pace2_compressed_log_tick(struct pace2_compressed_log *log);
+
+/**
+ * writes the last block, closes the files and frees the log
+ * @param log log
+ */
+void pace2_compressed_log_close(struct pace2_compressed_log *log);
+
+/**
+ * prints the counters of the log
+ * @param log log
+ * @param f output
+ */
+void pace2_compressed_log_print_stats(const struct pace2_compressed_log *log, FILE *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PACE2_COMPRESSED_LOG_H */
@@ -0,0 +1,318 @@
+/*
+ * pace2_event_ring.c
+ *
+ * Shared memory event rings, see pace2_event_ring.h for the layout.
+ */
+
+#include "pace2_event_ring.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define PACE2_EVENT_RING_ALIGN(x) (((x) + 63) & ~63ull)
+
+static u8 pace2_event_ring_map(struct pace2_event_ring *ring, int prot)
+{
+    void *base = mmap(NULL, ring->size, prot, MAP_SHARED, ring->fd, 0);
+    u32 r;
+
+    if (base == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    ring->hdr = base;
+    ring->rings = calloc(ring->hdr->ring_count, sizeof(struct pace2_event_ring_handle));
+
+    if (NULL == ring->rings) {
+        munmap(base, ring->size);
+        return 1;
+    }
+
+    for (r = 0; r < ring->hdr->ring_count; r++) {
+        u8 * const start = (u8 *)base + ring->hdr->ring_offset + (u64)r * ring->hdr->ring_stride;
+
+        ring->rings[r].control = (struct pace2_event_ring_control *)start;
+        ring->rings[r].slots = (struct pace2_event_record *)(start + sizeof(struct pace2_event_ring_control));
+        ring->rings[r].mask = ring->hdr->slots - 1;
+        ring->rings[r].cached_tail = ring->rings[r].control->tail;
+    }
+
+    return 0;
+}
+
+u8 pace2_event_ring_create(struct pace2_event_ring *ring, const char *name, u32 ring_count, u32 slots)
+{
+    struct pace2_event_ring_header hdr;
+    u32 s = 1;
+
+    if (NULL == ring || NULL == name || 0 == ring_count || 0 == slots) {
+        return 1;
+    }
+
+    while (s < slots) {
+        s <<= 1;
+    }
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&hdr, 0, sizeof(hdr));
+    strncpy(ring->name, name, sizeof(ring->name) - 1);
+
+    hdr.magic = PACE2_EVENT_RING_MAGIC;
+    hdr.version_major = PACE2_EVENT_RING_VERSION_MAJOR;
+    hdr.version_minor = PACE2_EVENT_RING_VERSION_MINOR;
+    hdr.ring_count = ring_count;
+    hdr.slots = s;
+    hdr.record_size = sizeof(struct pace2_event_record);
+    hdr.ring_offset = PACE2_EVENT_RING_ALIGN(sizeof(struct pace2_event_ring_header));
+    hdr.ring_stride = sizeof(struct pace2_event_ring_control) + s * sizeof(struct pace2_event_record);
+    hdr.writer_pid = getpid();
+    hdr.total_size = hdr.ring_offset + (u64)ring_count * hdr.ring_stride;
+    ring->size = hdr.total_size;
+
+    shm_unlink(name);
+
+    ring->fd = shm_open(name, O_CREAT | O_RDWR, 0666);
+    if (ring->fd < 0) {
+        perror("shm_open");
+        return 1;
+    }
+
+    if (ftruncate(ring->fd, ring->size) != 0) {
+        perror("ftruncate");
+        close(ring->fd);
+        shm_unlink(name);
+        return 1;
+    }
+
+    if (pwrite(ring->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+        pace2_event_ring_map(ring, PROT_READ | PROT_WRITE) != 0) {
+        close(ring->fd);
+        shm_unlink(name);
+        return 1;
+    }
+
+    ring->writable = 1;
+
+    return 0;
+}
+
+u8 pace2_event_ring_open(struct pace2_event_ring *ring, const char *name)
+{
+    struct pace2_event_ring_header hdr;
+
+    if (NULL == ring || NULL == name) {
+        return 1;
+    }
+
+    memset(ring, 0, sizeof(*ring));
+    strncpy(ring->name, name, sizeof(ring->name) - 1);
+
+    /* the consumer writes the tail, so the mapping has to be writable */
+    ring->fd = shm_open(name, O_RDWR, 0);
+    if (ring->fd < 0) {
+        perror("shm_open");
+        return 1;
+    }
+
+    if (pread(ring->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+        hdr.magic != PACE2_EVENT_RING_MAGIC ||
+        hdr.version_major != PACE2_EVENT_RING_VERSION_MAJOR ||
+        hdr.record_size != sizeof(struct pace2_event_record)) {
+        fprintf(stderr, "%s is not a compatible event ring segment.\n", name);
+        close(ring->fd);
+        return 1;
+    }
+
+    ring->size = hdr.total_size;
+
+    if (pace2_event_ring_map(ring, PROT_READ | PROT_WRITE) != 0) {
+        close(ring->fd);
+        return 1;
+    }
+
+    return 0;
+}
+
+void pace2_event_ring_close(struct pace2_event_ring *ring)
+{
+    if (NULL == ring || NULL == ring->hdr) {
+        return;
+    }
+
+    free(ring->rings);
+    munmap(ring->hdr, ring->size);
+    close(ring->fd);
+
+    if (ring->writable) {
+        shm_unlink(ring->name);
+    }
+
+    ring->hdr = NULL;
+    ring->rings = NULL;
+}
+
+struct pace2_event_record *pace2_event_ring_reserve(struct pace2_event_ring *ring, u32 thread_id)
+{
+    struct pace2_event_ring_handle *h;
+    u64 head;
+
+    if (NULL == ring->hdr || thread_id >= ring->hdr->ring_count) {
+        return NULL;
+    }
+
+    h = &ring->rings[thread_id];
+    head = h->control->head;
+
+    if (head - h->cached_tail > h->mask) {
+        /* looks full, fetch the real tail of the consumer */
+        h->cached_tail = h->control->tail;
+        __sync_synchronize();
+
+        if (head - h->cached_tail > h->mask) {
+            h->control->drops++;
+            return NULL;
+        }
+    }
+
+    return &h->slots[head & h->mask];
+}
+
+void pace2_event_ring_commit(struct pace2_event_ring *ring, u32 thread_id)
+{
+    struct pace2_event_ring_handle * const h = &ring->rings[thread_id];
+    const u64 head = h->control->head;
+
+    h->slots[head & h->mask].seq = head;
+    h->control->produced++;
+
+    /* the record has to be complete before the consumer sees the new head */
+    __sync_synchronize();
+    h->control->head = head + 1;
+}
+
+u8 pace2_event_ring_push_event(struct pace2_event_ring *ring, u32 thread_id,
+                               PACE2_event const * const event,
+                               PACE2_packet_descriptor const * const pd)
+{
+    struct pace2_event_record *record;
+
+    switch (event->header.type) {
+        case PACE2_CLASSIFICATION_RESULT:
+        case PACE2_FLOW_STARTED_EVENT:
+        case PACE2_FLOW_DROPPED_EVENT:
+        case PACE2_FLOW_INFO_EVENT:
+        case PACE2_FLOW_PROCESS_EVENT:
+            break;
+        default:
+            return 2;
+    }
+
+    if ((record = pace2_event_ring_reserve(ring, thread_id)) == NULL) {
+        return 1;
+    }
+
+    record->type = event->header.type;
+    record->thread_id = thread_id;
+    record->flags = 0;
+    record->timestamp = pd ? pd->packet_ts : 0;
+    record->packet_id = pd ? pd->packet_id : 0;
+    record->flow_id = pd ? pd->flow_id : 0;
+    memset(&record->data, 0, sizeof(record->data));
+
+    switch (event->header.type) {
+        case PACE2_CLASSIFICATION_RESULT: {
+            PACE2_classification_result_event const * const c = &event->classification_result_data;
+            u8 i;
+
+            for (i = 0; i < c->protocol.stack.length && i < PACE2_PROTOCOL_STACK_MAX_DEPTH; i++) {
+                record->data.classification.stack[i] = c->protocol.stack.entry[i];
+            }
+            record->data.classification.stack_length = c->protocol.stack.length;
+            record->data.classification.finished = c->application.classification_finished;
+            record->data.classification.application = c->application.type;
+            record->data.classification.attribute_count = c->application.attributes.length;
+            for (i = 0; i < c->application.attributes.length && i < PACE2_EVENT_RECORD_MAX_ATTRIBUTES; i++) {
+                record->data.classification.attributes[i] = c->application.attributes.list[i];
+            }
+            break;
+        }
+        case PACE2_FLOW_STARTED_EVENT:
+            record->flow_id = event->flow_started.flow_id;
+            break;
+        case PACE2_FLOW_DROPPED_EVENT:
+            record->flow_id = event->flow_dropped.flow_id;
+            record->data.flow_dropped.removal_reason = event->flow_dropped.removal_reason;
+            break;
+        case PACE2_FLOW_INFO_EVENT:
+            record->flow_id = event->flow_info.flow_id;
+            record->data.flow_info.src_id = event->flow_info.src_id;
+            record->data.flow_info.dst_id = event->flow_info.dst_id;
+            record->data.flow_info.src_port = event->flow_info.src_port;
+            record->data.flow_info.dst_port = event->flow_info.dst_port;
+            break;
+        case PACE2_FLOW_PROCESS_EVENT:
+            record->flow_id = event->flow_process.flow_id;
+            record->timestamp = event->flow_process.last_packet_ts;
+            record->data.flow_process.bytes = event->flow_process.bytes;
+            record->data.flow_process.total_bytes = event->flow_process.total_bytes;
+            record->data.flow_process.missing_bytes = event->flow_process.missing_bytes;
+            break;
+        default:
+            break;
+    }
+
+    pace2_event_ring_commit(ring, thread_id);
+
+    return 0;
+}
+
+u32 pace2_event_ring_consume(struct pace2_event_ring *ring, u32 thread_id,
+                             struct pace2_event_record *records, u32 max_records, u64 *lost)
+{
+    struct pace2_event_ring_handle *h;
+    u64 head, tail;
+    u32 n = 0;
+
+    if (NULL == ring->hdr || thread_id >= ring->hdr->ring_count) {
+        return 0;
+    }
+
+    h = &ring->rings[thread_id];
+    tail = h->control->tail;
+    head = h->control->head;
+    __sync_synchronize();
+
+    /* a consumer that restarted may be more than one ring behind */
+    if (head - tail > h->mask + 1) {
+        if (lost != NULL) {
+            *lost += head - tail - (h->mask + 1);
+        }
+        tail = head - (h->mask + 1);
+    }
+
+    while (tail != head && n < max_records) {
+        const struct pace2_event_record * const record = &h->slots[tail & h->mask];
+
+        if (record->seq != tail) {
+            /* slot was not written for this lap */
+            if (lost != NULL) {
+                (*lost)++;
+            }
+        } else {
+            records[n++] = *record;
+        }
+        tail++;
+    }
+
+    /* the copies have to be done before the producer may reuse the slots */
+    __sync_synchronize();
+    h->control->tail = tail;
+
+    return n;
+}
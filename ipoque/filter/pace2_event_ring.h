@@ -0,0 +1,181 @@
+/*
+ * pace2_event_ring.h
+ *
+ * Shared memory rings of fixed size binary event records. Every packet
+ * thread owns one ring and is its only producer, the control plane is the
+ * only consumer. A full ring never blocks the producer, the record is
+ * dropped and counted instead.
+ *
+ * layout of the segment:
+ * 1) header (versioned, describes number and size of the rings)
+ * 2) per ring: producer cache line, consumer cache line, array of slots
+ */
+
+#ifndef PACE2_EVENT_RING_H
+#define PACE2_EVENT_RING_H
+
+#include <stddef.h>
+#include <pace2.h>
+
+#define PACE2_EVENT_RING_DEFAULT_NAME "/pace2_events"
+#define PACE2_EVENT_RING_DEFAULT_SLOTS (64 * 1024)
+
+#define PACE2_EVENT_RING_MAGIC 0x50324552 /* "P2ER" */
+#define PACE2_EVENT_RING_VERSION_MAJOR 1
+#define PACE2_EVENT_RING_VERSION_MINOR 0
+
+#define PACE2_EVENT_RECORD_MAX_ATTRIBUTES 5
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* 64 byte record, the data union depends on the PACE 2 event type */
+struct pace2_event_record {
+    /* running number of the record in its ring, used to detect wraparound */
+    u64 seq;
+    u64 timestamp;
+    u64 flow_id;
+    u64 packet_id;
+    u16 type;
+    u16 thread_id;
+    u32 flags;
+    union {
+        struct {
+            u16 stack[PACE2_PROTOCOL_STACK_MAX_DEPTH];
+            u8 stack_length;
+            u8 finished;
+            u16 application;
+            u16 attribute_count;
+            u16 attributes[PACE2_EVENT_RECORD_MAX_ATTRIBUTES];
+        } classification;
+        struct {
+            u32 removal_reason;
+        } flow_dropped;
+        struct {
+            u64 src_id;
+            u64 dst_id;
+            u16 src_port;
+            u16 dst_port;
+        } flow_info;
+        struct {
+            u64 bytes;
+            u64 total_bytes;
+            u64 missing_bytes;
+        } flow_process;
+        u8 raw[24];
+    } data;
+};
+
+struct pace2_event_ring_header {
+    u32 magic;
+    u16 version_major;
+    u16 version_minor;
+    u32 ring_count;
+    /* number of slots per ring, power of two */
+    u32 slots;
+    u32 record_size;
+    /* offset of the first ring and distance between two rings */
+    u32 ring_offset;
+    u32 ring_stride;
+    u32 writer_pid;
+    u64 total_size;
+};
+
+/* control block in front of the slots of every ring */
+struct pace2_event_ring_control {
+    /* written by the producer only */
+    volatile u64 head;
+    u64 drops;
+    u64 produced;
+    u64 producer_pad[5];
+    /* written by the consumer only */
+    volatile u64 tail;
+    u64 consumer_pad[7];
+};
+
+struct pace2_event_ring_handle {
+    struct pace2_event_ring_control *control;
+    struct pace2_event_record *slots;
+    u64 mask;
+    /* last tail seen by the producer, avoids touching the consumer line per record */
+    u64 cached_tail;
+};
+
+struct pace2_event_ring {
+    int fd;
+    u8 writable;
+    size_t size;
+    char name[64];
+    struct pace2_event_ring_header *hdr;
+    struct pace2_event_ring_handle *rings;
+};
+
+/**
+ * creates (or recreates) the named segment with one ring per packet thread
+ * @param ring ring set to initialize
+ * @param name shm name of the segment, e.g. PACE2_EVENT_RING_DEFAULT_NAME
+ * @param ring_count number of producer threads
+ * @param slots records per ring, rounded up to a power of two
+ * @return 0 on success; !=0 on error
+ */
+u8 pace2_event_ring_create(struct pace2_event_ring *ring, const char *name, u32 ring_count, u32 slots);
+
+/**
+ * attaches to an existing segment as consumer
+ * @param ring ring set to initialize
+ * @param name shm name of the segment
+ * @return 0 on success; !=0 on error (missing segment or version mismatch)
+ */
+u8 pace2_event_ring_open(struct pace2_event_ring *ring, const char *name);
+
+/**
+ * unmaps the segment; the producer also unlinks the name
+ * @param ring ring set to close
+ */
+void pace2_event_ring_close(struct pace2_event_ring *ring);
+
+/**
+ * returns a free slot of the ring of the given thread
+ * @param ring ring set
+ * @param thread_id producer thread, only this thread may call the function for this ring
+ * @return pointer to the slot or NULL if the ring is full (the drop is counted)
+ */
+struct pace2_event_record *pace2_event_ring_reserve(struct pace2_event_ring *ring, u32 thread_id);
+
+/**
+ * makes the slot returned by pace2_event_ring_reserve visible to the consumer
+ * @param ring ring set
+ * @param thread_id producer thread
+ */
+void pace2_event_ring_commit(struct pace2_event_ring *ring, u32 thread_id);
+
+/**
+ * encodes a PACE 2 event into the ring of the given thread
+ * @param ring ring set
+ * @param thread_id producer thread
+ * @param event event to encode
+ * @param pd packet descriptor of the packet that caused the event, may be NULL
+ * @return 0 if stored; 1 if dropped because the ring is full; 2 if the event type is not exported
+ */
+u8 pace2_event_ring_push_event(struct pace2_event_ring *ring, u32 thread_id,
+                               PACE2_event const * const event,
+                               PACE2_packet_descriptor const * const pd);
+
+/**
+ * copies up to max_records records of a ring and releases their slots
+ * @param ring ring set opened with pace2_event_ring_open
+ * @param thread_id ring to read
+ * @param records destination array
+ * @param max_records size of the destination array
+ * @param lost incremented by the number of records overwritten before they were read
+ * @return number of copied records
+ */
+u32 pace2_event_ring_consume(struct pace2_event_ring *ring, u32 thread_id,
+                             struct pace2_event_record *records, u32 max_records, u64 *lost);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PACE2_EVENT_RING_H */
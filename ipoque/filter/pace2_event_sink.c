@@ -0,0 +1,612 @@
+/*
+ * pace2_event_sink.c
+ *
+ * Asynchronous event output, see pace2_event_sink.h for the ring layout.
+ */
+
+#include "pace2_event_sink.h"
+#include "event_handler.h"
+#include "event_encoder.h"
+#include "event_json.h"
+#include "event_store.h"
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define PACE2_EVENT_SINK_ALIGN(x) (((x) + 7) & ~7ull)
+
+enum pace2_event_sink_record_kind {
+    PACE2_EVENT_SINK_PADDING = 0,
+    PACE2_EVENT_SINK_BINARY_RECORD,
+    PACE2_EVENT_SINK_TEXT_RECORD,
+    PACE2_EVENT_SINK_FLOW_RECORD
+};
+
+struct pace2_event_sink_record_header {
+    u32 length;
+    u32 kind;
+};
+
+/* payload of a PACE2_EVENT_SINK_FLOW_RECORD */
+struct pace2_event_sink_flow_record {
+    u32 reason;
+    u32 reserved;
+    struct pace2_flow_record record;
+};
+
+void pace2_event_sink_init_default_config(struct pace2_event_sink_config *config, u32 thread_count)
+{
+    if (NULL == config) {
+        return;
+    }
+
+    config->thread_count = thread_count;
+    config->buffer_size = PACE2_EVENT_SINK_DEFAULT_BUFFER_SIZE;
+    config->batch_size = PACE2_EVENT_SINK_DEFAULT_BATCH_SIZE;
+    config->idle_us = PACE2_EVENT_SINK_DEFAULT_IDLE_US;
+    config->overflow = PACE2_EVENT_SINK_DROP_NEWEST;
+    config->format = PACE2_EVENT_SINK_TEXT;
+}
+
+int pace2_event_sink_open_output(const char *spec)
+{
+    if (NULL == spec) {
+        return -1;
+    }
+
+    if (0 == strcmp(spec, "-")) {
+        return dup(STDOUT_FILENO);
+    }
+
+    if (0 == strncmp(spec, "unix:", 5)) {
+        struct sockaddr_un addr;
+        int fd;
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(spec + 5) >= sizeof(addr.sun_path)) {
+            return -1;
+        }
+        strcpy(addr.sun_path, spec + 5);
+
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            perror("socket");
+            return -1;
+        }
+
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+            perror("connect");
+            close(fd);
+            return -1;
+        }
+
+        return fd;
+    }
+
+    return open(spec, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+}
+
+/* returns room for a record of need bytes, skips the end of the ring if the record does not fit there */
+static u8 *pace2_event_sink_reserve(struct pace2_event_sink_ring *ring, u64 need, u64 *head)
+{
+    const u64 size = ring->mask + 1;
+    const u64 pos = ring->head & ring->mask;
+    const u64 contiguous = size - pos;
+    const u64 total = need > contiguous ? contiguous + need : need;
+
+    if (size - (ring->head - ring->cached_tail) < total) {
+        /* looks full, fetch the real tail of the writer */
+        ring->cached_tail = ring->tail;
+        __sync_synchronize();
+
+        if (size - (ring->head - ring->cached_tail) < total) {
+            return NULL;
+        }
+    }
+
+    *head = ring->head;
+
+    if (need > contiguous) {
+        struct pace2_event_sink_record_header * const padding = (struct pace2_event_sink_record_header *)(ring->buffer + pos);
+
+        padding->length = contiguous - sizeof(*padding);
+        padding->kind = PACE2_EVENT_SINK_PADDING;
+        *head += contiguous;
+    }
+
+    return ring->buffer + (*head & ring->mask);
+}
+
+/* copies a record into the ring, waits for room or drops it if the ring is full */
+static u8 pace2_event_sink_store(struct pace2_event_sink *sink, struct pace2_event_sink_ring *ring,
+                                 const struct pace2_event_sink_record_header *header, const void *payload)
+{
+    const u64 need = PACE2_EVENT_SINK_ALIGN(sizeof(*header) + header->length);
+    u64 head;
+    u8 *slot;
+
+    while ((slot = pace2_event_sink_reserve(ring, need, &head)) == NULL) {
+        if (PACE2_EVENT_SINK_DROP_NEWEST == sink->config.overflow || !sink->running) {
+            ring->drops++;
+            return 1;
+        }
+
+        ring->waits++;
+        sched_yield();
+    }
+
+    memcpy(slot, header, sizeof(*header));
+    memcpy(slot + sizeof(*header), payload, header->length);
+
+    ring->records++;
+    ring->bytes += header->length;
+
+    /* the record has to be complete before the writer sees the new head */
+    __sync_synchronize();
+    ring->head = head + need;
+
+    return 0;
+}
+
+u8 pace2_event_sink_push(struct pace2_event_sink *sink, u32 thread_id, PACE2_event const * const event,
+                         PACE2_packet_descriptor const * const pd)
+{
+    struct pace2_event_sink_ring *ring;
+    struct pace2_event_sink_record_header header;
+
+    if (NULL == sink->rings || thread_id >= sink->config.thread_count || NULL == event) {
+        return 2;
+    }
+
+    ring = &sink->rings[thread_id];
+
+    if (PACE2_EVENT_SINK_JSON == sink->config.format) {
+        header.length = pace2_event_to_json(event, pd, (char *)ring->scratch, PACE2_EVENT_SINK_MAX_RECORD);
+        header.kind = PACE2_EVENT_SINK_TEXT_RECORD;
+
+        if (0 == header.length) {
+            ring->skipped++;
+            return 2;
+        }
+    } else if (PACE2_EVENT_SINK_STORE == sink->config.format) {
+        header.length = pace2_event_store_encode(event, pd, ring->scratch, PACE2_EVENT_SINK_MAX_RECORD);
+        header.kind = PACE2_EVENT_SINK_BINARY_RECORD;
+
+        if (0 == header.length) {
+            ring->skipped++;
+            return 2;
+        }
+    } else {
+        /* basic and engine events are encoded, the others are printed on this thread */
+        header.length = pace2_encode_event(event, ring->scratch, PACE2_EVENT_SINK_MAX_RECORD);
+        header.kind = PACE2_EVENT_SINK_BINARY_RECORD;
+    }
+
+    if (0 == header.length) {
+        long length;
+
+        if (PACE2_EVENT_SINK_BINARY == sink->config.format || NULL == ring->text) {
+            ring->skipped++;
+            return 2;
+        }
+
+        rewind(ring->text);
+        pace2_debug_advanced_event(ring->text, event);
+        fflush(ring->text);
+        length = ftell(ring->text);
+
+        if (length <= 0) {
+            ring->skipped++;
+            return 2;
+        }
+
+        header.length = length < PACE2_EVENT_SINK_MAX_RECORD ? (u32)length : PACE2_EVENT_SINK_MAX_RECORD;
+        header.kind = PACE2_EVENT_SINK_TEXT_RECORD;
+    }
+
+    return pace2_event_sink_store(sink, ring, &header, ring->scratch);
+}
+
+u8 pace2_event_sink_push_flow_record(struct pace2_event_sink *sink, u32 thread_id, const struct pace2_flow_record *record,
+                                     enum pace2_flow_record_reason reason)
+{
+    struct pace2_event_sink_record_header header;
+    struct pace2_event_sink_flow_record payload;
+
+    if (NULL == sink->rings || thread_id >= sink->config.thread_count || NULL == record) {
+        return 2;
+    }
+
+    if (PACE2_EVENT_SINK_BINARY == sink->config.format || PACE2_EVENT_SINK_STORE == sink->config.format) {
+        sink->rings[thread_id].skipped++;
+        return 2;
+    }
+
+    payload.reason = reason;
+    payload.reserved = 0;
+    payload.record = *record;
+
+    header.length = sizeof(payload);
+    header.kind = PACE2_EVENT_SINK_FLOW_RECORD;
+
+    return pace2_event_sink_store(sink, &sink->rings[thread_id], &header, &payload);
+}
+
+/* writes one record to the output */
+static void pace2_event_sink_write_record(struct pace2_event_sink *sink, u32 kind, const u8 *payload, u32 length)
+{
+    /* the compressed log gets every record with one write */
+    FILE * const out = sink->compressed ? sink->record_text : sink->out;
+
+    if (sink->stored) {
+        pace2_event_store_append(&sink->store, payload, length);
+    } else if (PACE2_EVENT_SINK_TEXT_RECORD == kind || PACE2_EVENT_SINK_BINARY == sink->config.format) {
+        if (sink->compressed) {
+            pace2_compressed_log_write(&sink->log, payload, length);
+        } else {
+            fwrite(payload, 1, length, sink->out);
+        }
+    } else {
+        if (sink->compressed) {
+            rewind(out);
+        }
+
+        if (PACE2_EVENT_SINK_FLOW_RECORD == kind) {
+            const struct pace2_event_sink_flow_record * const flow_record = (const struct pace2_event_sink_flow_record *)payload;
+
+            if (length != sizeof(*flow_record)) {
+                sink->invalid_records++;
+                return;
+            }
+            if (PACE2_EVENT_SINK_JSON == sink->config.format) {
+                pace2_flow_record_print_json(out, &flow_record->record, flow_record->reason);
+            } else {
+                pace2_flow_record_print(out, &flow_record->record, flow_record->reason);
+            }
+        } else {
+            PACE2_event event;
+
+            if (pace2_decode_event(payload, length, &event) != length) {
+                sink->invalid_records++;
+                return;
+            }
+            pace2_debug_event(out, &event);
+        }
+
+        if (sink->compressed) {
+            const long text_length = (fflush(out), ftell(out));
+
+            if (text_length > 0) {
+                pace2_compressed_log_write(&sink->log, sink->record_buffer, (u32)text_length);
+            }
+        }
+    }
+
+    sink->written_records++;
+    sink->written_bytes += length;
+}
+
+/* writes the records of a ring, at most about one batch; returns the number of consumed bytes */
+static u64 pace2_event_sink_drain_ring(struct pace2_event_sink *sink, struct pace2_event_sink_ring *ring)
+{
+    const u64 head = ring->head;
+    u64 tail = ring->tail;
+    const u64 start = tail;
+
+    __sync_synchronize();
+
+    while (tail != head && tail - start < sink->config.batch_size) {
+        const u8 * const slot = ring->buffer + (tail & ring->mask);
+        struct pace2_event_sink_record_header header;
+
+        memcpy(&header, slot, sizeof(header));
+
+        if (PACE2_EVENT_SINK_PADDING != header.kind) {
+            pace2_event_sink_write_record(sink, header.kind, slot + sizeof(header), header.length);
+        }
+
+        tail += PACE2_EVENT_SINK_ALIGN(sizeof(header) + header.length);
+    }
+
+    /* the records have to be written before the producer may reuse their room */
+    __sync_synchronize();
+    ring->tail = tail;
+
+    return tail - start;
+}
+
+static void *pace2_event_sink_writer(void *arg)
+{
+    struct pace2_event_sink * const sink = arg;
+    u8 pending = 0;
+
+    for (;;) {
+        const u8 running = sink->running;
+        u64 consumed = 0;
+        u32 r;
+
+        __sync_synchronize();
+
+        for (r = 0; r < sink->config.thread_count; r++) {
+            consumed += pace2_event_sink_drain_ring(sink, &sink->rings[r]);
+        }
+
+        if (consumed > 0) {
+            pending = 1;
+            continue;
+        }
+
+        /* the rings are empty: hand out what is buffered, then wait */
+        if (sink->stored) {
+            pace2_event_store_tick(&sink->store);
+        } else if (sink->compressed) {
+            pace2_compressed_log_tick(&sink->log);
+        } else if (pending) {
+            if (fflush(sink->out) != 0 || ferror(sink->out)) {
+                sink->write_errors++;
+                clearerr(sink->out);
+            }
+            sink->flushes++;
+            pending = 0;
+        }
+
+        if (!running) {
+            break;
+        }
+
+        {
+            struct timespec ts;
+
+            ts.tv_sec = sink->config.idle_us / 1000000;
+            ts.tv_nsec = (sink->config.idle_us % 1000000) * 1000;
+            nanosleep(&ts, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+static void pace2_event_sink_free(struct pace2_event_sink *sink)
+{
+    u32 r;
+
+    if (NULL != sink->rings) {
+        for (r = 0; r < sink->config.thread_count; r++) {
+            if (NULL != sink->rings[r].text) {
+                fclose(sink->rings[r].text);
+            }
+            free(sink->rings[r].scratch);
+            free(sink->rings[r].buffer);
+        }
+        free(sink->rings);
+        sink->rings = NULL;
+    }
+
+    if (NULL != sink->out) {
+        fclose(sink->out);
+        sink->out = NULL;
+    }
+
+    if (sink->compressed) {
+        pace2_compressed_log_close(&sink->log);
+        sink->compressed = 0;
+    }
+    if (sink->stored) {
+        pace2_event_store_close(&sink->store);
+        sink->stored = 0;
+    }
+    if (NULL != sink->record_text) {
+        fclose(sink->record_text);
+        sink->record_text = NULL;
+    }
+    free(sink->record_buffer);
+    sink->record_buffer = NULL;
+
+    free(sink->out_buffer);
+    sink->out_buffer = NULL;
+}
+
+/* allocates the rings and starts the writer, the output is already open */
+static u8 pace2_event_sink_start(struct pace2_event_sink *sink)
+{
+    u64 size = 1;
+    u32 r;
+
+    /* a ring holds at least a few records of maximum size */
+    while (size < sink->config.buffer_size || size < 4 * PACE2_EVENT_SINK_MAX_RECORD) {
+        size <<= 1;
+    }
+
+    sink->rings = calloc(sink->config.thread_count, sizeof(*sink->rings));
+    if (NULL == sink->rings) {
+        pace2_event_sink_free(sink);
+        return 1;
+    }
+
+    for (r = 0; r < sink->config.thread_count; r++) {
+        struct pace2_event_sink_ring * const ring = &sink->rings[r];
+
+        ring->buffer = malloc(size);
+        ring->scratch = malloc(PACE2_EVENT_SINK_MAX_RECORD);
+        if (NULL == ring->buffer || NULL == ring->scratch) {
+            pace2_event_sink_free(sink);
+            return 1;
+        }
+        ring->mask = size - 1;
+
+        if (PACE2_EVENT_SINK_TEXT == sink->config.format) {
+            ring->text = fmemopen(ring->scratch, PACE2_EVENT_SINK_MAX_RECORD, "w");
+        }
+    }
+
+    sink->running = 1;
+    if (pthread_create(&sink->writer, NULL, pace2_event_sink_writer, sink) != 0) {
+        sink->running = 0;
+        pace2_event_sink_free(sink);
+        return 1;
+    }
+
+    return 0;
+}
+
+u8 pace2_event_sink_create(struct pace2_event_sink *sink, const struct pace2_event_sink_config *config, int fd)
+{
+    if (NULL == sink || NULL == config || 0 == config->thread_count || fd < 0 ||
+        PACE2_EVENT_SINK_STORE == config->format) {
+        return 1;
+    }
+
+    memset(sink, 0, sizeof(*sink));
+    sink->config = *config;
+    if (0 == sink->config.batch_size) {
+        sink->config.batch_size = PACE2_EVENT_SINK_DEFAULT_BATCH_SIZE;
+    }
+
+    sink->out = fdopen(fd, "w");
+    if (NULL == sink->out) {
+        close(fd);
+        return 1;
+    }
+
+    sink->out_buffer = malloc(sink->config.batch_size);
+    if (NULL != sink->out_buffer) {
+        setvbuf(sink->out, sink->out_buffer, _IOFBF, sink->config.batch_size);
+    }
+
+    if (PACE2_EVENT_SINK_BINARY == config->format) {
+        struct pace2_event_log_header header;
+
+        pace2_init_event_log_header(&header);
+        fwrite(&header, sizeof(header), 1, sink->out);
+    }
+
+    return pace2_event_sink_start(sink);
+}
+
+u8 pace2_event_sink_create_compressed(struct pace2_event_sink *sink, const struct pace2_event_sink_config *config,
+                                      const struct pace2_compressed_log_config *log_config)
+{
+    struct pace2_event_log_header header;
+    u8 result;
+
+    if (NULL == sink || NULL == config || 0 == config->thread_count || NULL == log_config ||
+        PACE2_EVENT_SINK_STORE == config->format) {
+        return 1;
+    }
+
+    memset(sink, 0, sizeof(*sink));
+    sink->config = *config;
+    if (0 == sink->config.batch_size) {
+        sink->config.batch_size = PACE2_EVENT_SINK_DEFAULT_BATCH_SIZE;
+    }
+
+    /* every file of a binary log is an event log of its own */
+    if (PACE2_EVENT_SINK_BINARY == config->format) {
+        pace2_init_event_log_header(&header);
+        result = pace2_compressed_log_open(&sink->log, log_config, &header, sizeof(header));
+    } else {
+        result = pace2_compressed_log_open(&sink->log, log_config, NULL, 0);
+    }
+    if (0 != result) {
+        return 1;
+    }
+    sink->compressed = 1;
+
+    sink->record_buffer = malloc(PACE2_EVENT_SINK_MAX_RECORD);
+    if (NULL != sink->record_buffer) {
+        sink->record_text = fmemopen(sink->record_buffer, PACE2_EVENT_SINK_MAX_RECORD, "w");
+    }
+    if (NULL == sink->record_text) {
+        pace2_event_sink_free(sink);
+        return 1;
+    }
+
+    return pace2_event_sink_start(sink);
+}
+
+u8 pace2_event_sink_create_store(struct pace2_event_sink *sink, const struct pace2_event_sink_config *config,
+                                 const struct pace2_event_store_config *store_config)
+{
+    if (NULL == sink || NULL == config || 0 == config->thread_count || NULL == store_config ||
+        PACE2_EVENT_SINK_STORE != config->format) {
+        return 1;
+    }
+
+    memset(sink, 0, sizeof(*sink));
+    sink->config = *config;
+    if (0 == sink->config.batch_size) {
+        sink->config.batch_size = PACE2_EVENT_SINK_DEFAULT_BATCH_SIZE;
+    }
+
+    if (pace2_event_store_open(&sink->store, store_config) != 0) {
+        return 1;
+    }
+    sink->stored = 1;
+
+    return pace2_event_sink_start(sink);
+}
+
+void pace2_event_sink_stop(struct pace2_event_sink *sink)
+{
+    if (NULL == sink || NULL == sink->rings || !sink->running) {
+        return;
+    }
+
+    /* the writer drains the rings once more before it stops */
+    __sync_synchronize();
+    sink->running = 0;
+    pthread_join(sink->writer, NULL);
+}
+
+void pace2_event_sink_destroy(struct pace2_event_sink *sink)
+{
+    if (NULL == sink || NULL == sink->rings) {
+        return;
+    }
+
+    pace2_event_sink_stop(sink);
+    pace2_event_sink_free(sink);
+}
+
+void pace2_event_sink_print_stats(const struct pace2_event_sink *sink, FILE *f)
+{
+    static const char * const format_names[] = { "text", "binary", "json", "store" };
+    u32 r;
+
+    if (NULL == sink->rings) {
+        return;
+    }
+
+    fprintf(f, "Event sink (%s, %s):\n",
+            format_names[sink->config.format],
+            PACE2_EVENT_SINK_DROP_NEWEST == sink->config.overflow ? "drop newest" : "block");
+
+    for (r = 0; r < sink->config.thread_count; r++) {
+        const struct pace2_event_sink_ring * const ring = &sink->rings[r];
+
+        fprintf(f, "  thread %u: %llu records, %llu bytes, %llu dropped, %llu waits, %llu not exported\n", r,
+                (unsigned long long)ring->records, (unsigned long long)ring->bytes,
+                (unsigned long long)ring->drops, (unsigned long long)ring->waits,
+                (unsigned long long)ring->skipped);
+    }
+
+    fprintf(f, "  writer: %llu records, %llu bytes, %llu flushes, %llu invalid records, %llu write errors\n",
+            (unsigned long long)sink->written_records, (unsigned long long)sink->written_bytes,
+            (unsigned long long)sink->flushes, (unsigned long long)sink->invalid_records,
+            (unsigned long long)sink->write_errors);
+
+    if (sink->compressed) {
+        pace2_compressed_log_print_stats(&sink->log, f);
+    }
+    if (sink->stored) {
+        pace2_event_store_print_stats(&sink->store, f);
+    }
+    fprintf(f, "\n");
+}
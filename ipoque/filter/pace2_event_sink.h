@@ -0,0 +1,230 @@
+/*
+ * pace2_event_sink.h
+ *
+ * Takes the writing of PACE 2 events off the packet path. Every packet
+ * thread puts its events into its own lock-free byte ring, a writer thread
+ * drains the rings and writes the events in large batches to a file, a pipe
+ * or a socket. A slow reader of the output then fills the rings instead of
+ * stalling the packet threads; whether a full ring drops the newest event
+ * or blocks its producer is configurable.
+ *
+ * Events supported by event_encoder.h are stored as binary records, the
+ * writer turns them into the text of pace2_debug_event or writes them
+ * unchanged as an event log for pace2_event_decoder. Advanced and class
+ * events reference decoder memory, the packet thread has to print them
+ * into the ring as text with pace2_debug_advanced_event; they are only
+ * written in text format.
+ *
+ * In JSON format the packet thread encodes the events of event_json.h
+ * itself, one NDJSON line per event into its preallocated scratch buffer,
+ * and the writer copies the lines unchanged. Other event types and events
+ * whose line exceeds PACE2_EVENT_SINK_MAX_RECORD are not exported, a
+ * truncated line would not be valid JSON.
+ *
+ * Flow records of pace2_flow_record.h are copied into the ring as they
+ * are and printed by the writer as text or JSON; the binary event log has
+ * no record for them.
+ *
+ * Instead of a file descriptor the writer can feed a compressed, rotating
+ * log of pace2_compressed_log.h, one ring record at a time, so a record
+ * never spans two compressed blocks.
+ *
+ * In store format the packet thread encodes the events of event_encoder.h
+ * with the timestamp, flow ID and addresses of their packet as records of
+ * event_store.h, and the writer appends them to the indexed segments of
+ * the store, which pace2_event_query searches by flow, address and time.
+ *
+ * layout of a ring: records of an 8 byte header (length, kind) and the
+ * payload, padded to 8 bytes. A record never wraps, the rest of the ring is
+ * skipped with a padding record instead.
+ */
+
+#ifndef PACE2_EVENT_SINK_H
+#define PACE2_EVENT_SINK_H
+
+#include <stdio.h>
+#include <pthread.h>
+#include <pace2.h>
+#include "pace2_compressed_log.h"
+#include "pace2_flow_record.h"
+#include "event_store.h"
+
+#define PACE2_EVENT_SINK_DEFAULT_BUFFER_SIZE (1024 * 1024)
+#define PACE2_EVENT_SINK_DEFAULT_BATCH_SIZE (256 * 1024)
+#define PACE2_EVENT_SINK_DEFAULT_IDLE_US 1000
+
+/* largest record, text of longer events is truncated */
+#define PACE2_EVENT_SINK_MAX_RECORD (16 * 1024)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum pace2_event_sink_overflow {
+    /* a full ring drops the new event and counts it, the packet thread never waits */
+    PACE2_EVENT_SINK_DROP_NEWEST = 0,
+    /* the packet thread waits until the writer has made room */
+    PACE2_EVENT_SINK_BLOCK
+};
+
+enum pace2_event_sink_format {
+    /* text of pace2_debug_event and pace2_debug_advanced_event */
+    PACE2_EVENT_SINK_TEXT = 0,
+    /* event log of event_encoder.h, advanced and class events are not exported */
+    PACE2_EVENT_SINK_BINARY,
+    /* NDJSON of event_json.h, events it does not support are not exported */
+    PACE2_EVENT_SINK_JSON,
+    /* indexed segments of event_store.h, only written by a sink of pace2_event_sink_create_store */
+    PACE2_EVENT_SINK_STORE
+};
+
+struct pace2_event_sink_config {
+    /* number of packet threads, one ring each */
+    u32 thread_count;
+    /* bytes per ring, rounded up to a power of two */
+    u32 buffer_size;
+    /* output buffer of the writer, written with one call when full or when the rings are empty */
+    u32 batch_size;
+    /* sleep of the writer when all rings are empty */
+    u32 idle_us;
+    enum pace2_event_sink_overflow overflow;
+    enum pace2_event_sink_format format;
+};
+
+/* producer and consumer state of the ring of one packet thread */
+struct pace2_event_sink_ring {
+    u8 *buffer;
+    u64 mask;
+    /* encoding and text buffer of the producer */
+    u8 *scratch;
+    FILE *text;
+
+    /* written by the producer only */
+    volatile u64 head __attribute__((aligned(64)));
+    u64 cached_tail;
+    u64 records;
+    u64 bytes;
+    u64 drops;
+    u64 waits;
+    u64 skipped;
+
+    /* written by the consumer only */
+    volatile u64 tail __attribute__((aligned(64)));
+};
+
+struct pace2_event_sink {
+    struct pace2_event_sink_config config;
+    struct pace2_event_sink_ring *rings;
+
+    FILE *out;
+    char *out_buffer;
+    /* compressed output instead of out, records are formatted into record_text first */
+    u8 compressed;
+    struct pace2_compressed_log log;
+    FILE *record_text;
+    char *record_buffer;
+    /* event store instead of out, the records are appended unchanged */
+    u8 stored;
+    struct pace2_event_store store;
+    pthread_t writer;
+    volatile u8 running;
+
+    /* written by the writer thread only */
+    u64 written_records;
+    u64 written_bytes;
+    u64 invalid_records;
+    u64 write_errors;
+    u64 flushes;
+};
+
+/**
+ * fills a configuration with default values for the given number of packet threads
+ * (1 MiB per ring, 256 KiB batches, drop newest, text)
+ * @param config configuration to initialize
+ * @param thread_count number of packet threads
+ */
+void pace2_event_sink_init_default_config(struct pace2_event_sink_config *config, u32 thread_count);
+
+/**
+ * opens an output for the sink
+ * @param spec "-" for stdout, "unix:<path>" for a unix stream socket, otherwise a file name
+ * @return file descriptor; -1 on error
+ */
+int pace2_event_sink_open_output(const char *spec);
+
+/**
+ * allocates the rings and starts the writer thread
+ * @param sink sink to initialize
+ * @param config configuration
+ * @param fd output, owned and closed by the sink
+ * @return 0 on success; !=0 on error
+ */
+u8 pace2_event_sink_create(struct pace2_event_sink *sink, const struct pace2_event_sink_config *config, int fd);
+
+/**
+ * allocates the rings and starts the writer thread, which writes to a compressed, rotating log
+ * @param sink sink to initialize
+ * @param config configuration
+ * @param log_config files, block size and rotation of the log
+ * @return 0 on success; !=0 on error
+ */
+u8 pace2_event_sink_create_compressed(struct pace2_event_sink *sink, const struct pace2_event_sink_config *config,
+                                      const struct pace2_compressed_log_config *log_config);
+
+/**
+ * allocates the rings and starts the writer thread, which appends the events to an indexed event store
+ * @param sink sink to initialize
+ * @param config configuration, the format has to be PACE2_EVENT_SINK_STORE
+ * @param store_config segments and index of the store
+ * @return 0 on success; !=0 on error
+ */
+u8 pace2_event_sink_create_store(struct pace2_event_sink *sink, const struct pace2_event_sink_config *config,
+                                 const struct pace2_event_store_config *store_config);
+
+/**
+ * writes the remaining events and stops the writer thread, the statistics are complete afterwards;
+ * no events may be put into the sink anymore
+ * @param sink sink to stop
+ */
+void pace2_event_sink_stop(struct pace2_event_sink *sink);
+
+/**
+ * writes the remaining events, stops the writer thread if it still runs and frees the sink
+ * @param sink sink to destroy
+ */
+void pace2_event_sink_destroy(struct pace2_event_sink *sink);
+
+/**
+ * puts an event into the ring of a packet thread
+ * @param sink sink
+ * @param thread_id packet thread, only this thread may call the function for this ring
+ * @param event event to write
+ * @param pd packet which generated the event, adds its time stamp and addresses to JSON and store records; NULL if not known
+ * @return 0 if stored; 1 if dropped because the ring is full; 2 if the event is not exported in this format
+ */
+u8 pace2_event_sink_push(struct pace2_event_sink *sink, u32 thread_id, PACE2_event const * const event,
+                         PACE2_packet_descriptor const * const pd);
+
+/**
+ * puts a flow record into the ring of a packet thread
+ * @param sink sink
+ * @param thread_id packet thread, only this thread may call the function for this ring
+ * @param record record to write
+ * @param reason why the record was emitted
+ * @return 0 if stored; 1 if dropped because the ring is full; 2 in binary and store format
+ */
+u8 pace2_event_sink_push_flow_record(struct pace2_event_sink *sink, u32 thread_id, const struct pace2_flow_record *record,
+                                     enum pace2_flow_record_reason reason);
+
+/**
+ * prints the counters of the rings and of the writer
+ * @param sink sink
+ * @param f output
+ */
+void pace2_event_sink_print_stats(const struct pace2_event_sink *sink, FILE *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PACE2_EVENT_SINK_H */
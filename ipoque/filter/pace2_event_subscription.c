@@ -0,0 +1,319 @@
+/*
+ * pace2_event_subscription.c
+ *
+ * Event policy from the subscriptions of the consumers, see
+ * pace2_event_subscription.h.
+ */
+
+#include "pace2_event_subscription.h"
+
+#include <string.h>
+
+static u32 pace2_event_subscription_count(const PACE2_epol_structure *policy)
+{
+    return (u32)__builtin_popcountll((unsigned long long)policy->event_types);
+}
+
+/* returns the policy of a consumer for an application, adds it if it is new */
+static PACE2_epol_structure *pace2_event_subscription_policy(struct pace2_event_subscription_consumer *consumer,
+                                                             u32 application)
+{
+    u32 a;
+
+    if (PACE2_EVENT_SUBSCRIPTION_ALL_FLOWS == application) {
+        return &consumer->events;
+    }
+
+    for (a = 0; a < consumer->application_count; a++) {
+        if (consumer->applications[a].application == application) {
+            return &consumer->applications[a].events;
+        }
+    }
+
+    if (consumer->application_count == PACE2_EVENT_SUBSCRIPTION_MAX_APPLICATIONS) {
+        return NULL;
+    }
+
+    a = consumer->application_count++;
+    consumer->applications[a].application = application;
+    pace2_epol_set_policy(&consumer->applications[a].events, IPQ_FALSE);
+
+    return &consumer->applications[a].events;
+}
+
+static struct pace2_event_subscription_consumer *pace2_event_subscription_consumer(struct pace2_event_subscription *sub,
+                                                                                   int consumer, u32 application)
+{
+    if (consumer < 0 || (u32)consumer >= sub->consumer_count || application > PACE2_EVENT_SUBSCRIPTION_ALL_FLOWS) {
+        return NULL;
+    }
+
+    return &sub->consumers[consumer];
+}
+
+/* builds the global and the application policies from the active consumers */
+static void pace2_event_subscription_merge(struct pace2_event_subscription *sub)
+{
+    u32 c;
+    u32 a;
+
+    pace2_epol_set_policy(&sub->global, IPQ_FALSE);
+    memset(sub->application_used, 0, sizeof(sub->application_used));
+    sub->applications_used = 0;
+
+    for (c = 0; c < sub->consumer_count; c++) {
+        const struct pace2_event_subscription_consumer * const consumer = &sub->consumers[c];
+
+        if (!consumer->active) {
+            continue;
+        }
+
+        sub->global.event_types |= consumer->events.event_types;
+
+        for (a = 0; a < consumer->application_count; a++) {
+            const struct pace2_event_subscription_application * const entry = &consumer->applications[a];
+
+            if (0 == pace2_event_subscription_count(&entry->events)) {
+                continue;
+            }
+
+            if (!sub->application_used[entry->application]) {
+                pace2_epol_set_policy(&sub->application[entry->application], IPQ_FALSE);
+                sub->application_used[entry->application] = 1;
+            }
+            sub->application[entry->application].event_types |= entry->events.event_types;
+            sub->applications_used = 1;
+        }
+    }
+
+    /* the flow policies are deployed on the classification results */
+    if (sub->applications_used) {
+        pace2_epol_set_policy_of_event(&sub->global, PACE2_CLASSIFICATION_RESULT, IPQ_TRUE);
+    }
+}
+
+void pace2_event_subscription_init(struct pace2_event_subscription *sub)
+{
+    memset(sub, 0, sizeof(*sub));
+
+    pace2_epol_set_policy(&sub->global, IPQ_FALSE);
+    pace2_epol_set_policy(&sub->empty, IPQ_FALSE);
+    sub->generation = 1;
+}
+
+int pace2_event_subscription_add_consumer(struct pace2_event_subscription *sub, const char *name)
+{
+    struct pace2_event_subscription_consumer *consumer;
+
+    if (sub->consumer_count == PACE2_EVENT_SUBSCRIPTION_MAX_CONSUMERS) {
+        return -1;
+    }
+
+    consumer = &sub->consumers[sub->consumer_count];
+    memset(consumer, 0, sizeof(*consumer));
+    strncpy(consumer->name, name, sizeof(consumer->name) - 1);
+    consumer->active = 1;
+    pace2_epol_set_policy(&consumer->events, IPQ_FALSE);
+
+    return (int)sub->consumer_count++;
+}
+
+u8 pace2_event_subscription_subscribe_event(struct pace2_event_subscription *sub, int consumer,
+                                            PACE2_event_type type, u32 application)
+{
+    struct pace2_event_subscription_consumer * const c = pace2_event_subscription_consumer(sub, consumer, application);
+    PACE2_epol_structure *policy;
+
+    if (NULL == c || type <= PACE2_NO_EVENT || type >= PACE2_NUMBER_OF_EVENTS) {
+        return 1;
+    }
+
+    policy = pace2_event_subscription_policy(c, application);
+    if (NULL == policy || pace2_epol_set_policy_of_event(policy, type, IPQ_TRUE) != PACE2_EPOL_SUCCESS) {
+        return 1;
+    }
+
+    sub->changed = 1;
+
+    return 0;
+}
+
+u8 pace2_event_subscription_subscribe_group(struct pace2_event_subscription *sub, int consumer,
+                                            PACE2_event_groups group, u32 application)
+{
+    struct pace2_event_subscription_consumer * const c = pace2_event_subscription_consumer(sub, consumer, application);
+    PACE2_epol_structure *policy;
+
+    if (NULL == c) {
+        return 1;
+    }
+
+    policy = pace2_event_subscription_policy(c, application);
+    if (NULL == policy || pace2_epol_set_policy_of_group(policy, group, IPQ_TRUE) != PACE2_EPOL_SUCCESS) {
+        return 1;
+    }
+
+    sub->changed = 1;
+
+    return 0;
+}
+
+void pace2_event_subscription_set_active(struct pace2_event_subscription *sub, int consumer, u8 active)
+{
+    struct pace2_event_subscription_consumer * const c = pace2_event_subscription_consumer(sub, consumer,
+                                                                                           PACE2_EVENT_SUBSCRIPTION_ALL_FLOWS);
+
+    if (NULL == c || c->active == (active != 0)) {
+        return;
+    }
+
+    c->active = active != 0;
+    sub->changed = 1;
+}
+
+u8 pace2_event_subscription_configure(struct pace2_event_subscription *sub, struct PACE2_global_config *config)
+{
+    pace2_event_subscription_merge(sub);
+    sub->changed = 0;
+
+    config->general.event.policy_op_mode = PACE2_PROGRESSIVE;
+
+    if (pace2_epol_copy_config_policy(config, &sub->global) != PACE2_EPOL_SUCCESS) {
+        sub->deployment_errors++;
+        return 1;
+    }
+
+    return 0;
+}
+
+u8 pace2_event_subscription_apply(struct pace2_event_subscription *sub, PACE2_module *pace2)
+{
+    if (!sub->changed) {
+        return 0;
+    }
+
+    pace2_event_subscription_merge(sub);
+    sub->changed = 0;
+
+    /* flows with a flow policy of an older generation are updated on their next classification result */
+    sub->generation++;
+    if (0 == sub->generation) {
+        sub->generation = 1;
+    }
+
+    if (pace2_epol_deploy_global_policy(pace2, &sub->global) != PACE2_EPOL_SUCCESS) {
+        sub->deployment_errors++;
+        return 1;
+    }
+    sub->global_deployments++;
+
+    return 0;
+}
+
+void pace2_event_subscription_flow_started(struct pace2_event_subscription *sub, void *flow,
+                                           struct pace2_event_subscription_flow *state)
+{
+    state->generation = 0;
+    state->application = PACE2_EVENT_SUBSCRIPTION_ALL_FLOWS;
+
+    if (pace2_epol_deploy_flow_policy(flow, &sub->empty) != PACE2_EPOL_SUCCESS) {
+        sub->deployment_errors++;
+        return;
+    }
+    sub->flow_deployments++;
+}
+
+void pace2_event_subscription_flow_classified(struct pace2_event_subscription *sub, void *flow,
+                                              struct pace2_event_subscription_flow *state, u32 application)
+{
+    PACE2_epol_structure *policy;
+
+    if (application >= PACE2_APPLICATIONS_COUNT) {
+        return;
+    }
+
+    if (state->generation == sub->generation && state->application == application) {
+        return;
+    }
+
+    /* the flow still has the empty policy of its start */
+    if (0 == state->generation && !sub->application_used[application]) {
+        return;
+    }
+
+    policy = sub->application_used[application] ? &sub->application[application] : &sub->empty;
+
+    if (pace2_epol_deploy_flow_policy(flow, policy) != PACE2_EPOL_SUCCESS) {
+        sub->deployment_errors++;
+        return;
+    }
+    sub->flow_deployments++;
+
+    state->generation = sub->application_used[application] ? sub->generation : 0;
+    state->application = application;
+}
+
+static u8 pace2_event_subscription_has_event(const PACE2_epol_structure *policy, PACE2_event_type type)
+{
+    return (u8)(((unsigned long long)policy->event_types >> type) & 1);
+}
+
+u8 pace2_event_subscription_consumes(const struct pace2_event_subscription *sub, int consumer,
+                                     PACE2_event_type type, const struct pace2_event_subscription_flow *state)
+{
+    const struct pace2_event_subscription_consumer *c;
+    u32 a;
+
+    if (consumer < 0 || (u32)consumer >= sub->consumer_count || type <= PACE2_NO_EVENT ||
+        type >= PACE2_NUMBER_OF_EVENTS) {
+        return 0;
+    }
+
+    c = &sub->consumers[consumer];
+    if (!c->active) {
+        return 0;
+    }
+
+    if (pace2_event_subscription_has_event(&c->events, type)) {
+        return 1;
+    }
+
+    /* the application of the flow is known once its flow policy was deployed */
+    if (NULL == state || PACE2_EVENT_SUBSCRIPTION_ALL_FLOWS == state->application) {
+        return 0;
+    }
+
+    for (a = 0; a < c->application_count; a++) {
+        if (c->applications[a].application == state->application) {
+            return pace2_event_subscription_has_event(&c->applications[a].events, type);
+        }
+    }
+
+    return 0;
+}
+
+void pace2_event_subscription_print_stats(const struct pace2_event_subscription *sub, FILE *f)
+{
+    u32 c;
+    u32 a;
+    u32 applications = 0;
+
+    for (a = 0; a < PACE2_APPLICATIONS_COUNT; a++) {
+        applications += sub->application_used[a];
+    }
+
+    fprintf(f, "Event subscriptions: %u of %u event types for all flows, flow policies for %u applications\n",
+            pace2_event_subscription_count(&sub->global), PACE2_NUMBER_OF_EVENTS - 1, applications);
+
+    for (c = 0; c < sub->consumer_count; c++) {
+        const struct pace2_event_subscription_consumer * const consumer = &sub->consumers[c];
+
+        fprintf(f, "  %-20s %-8s %u event types for all flows, %u applications\n", consumer->name,
+                consumer->active ? "active" : "inactive",
+                pace2_event_subscription_count(&consumer->events), consumer->application_count);
+    }
+
+    fprintf(f, "  %llu global deployments, %llu flow deployments, %llu errors\n\n",
+            (unsigned long long)sub->global_deployments, (unsigned long long)sub->flow_deployments,
+            (unsigned long long)sub->deployment_errors);
+}
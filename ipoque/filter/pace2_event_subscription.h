@@ -0,0 +1,189 @@
+/*
+ * pace2_event_subscription.h
+ *
+ * Generates only the PACE 2 events somebody consumes. Every consumer of
+ * events (counters, exporters, outputs) registers the event types it
+ * handles, either for all flows or only for the flows of an application.
+ * The union of the subscriptions of all active consumers becomes the event
+ * policy of PACE 2:
+ *
+ * - events for all flows form the global policy
+ * - events for an application form the flow policy of the flows classified
+ *   as this application; new flows start with an empty flow policy
+ *
+ * PACE 2 runs in PACE2_PROGRESSIVE mode, an event is generated if the global
+ * or the flow policy enables it. Events of an application specific
+ * subscription which occur before the flow is classified are not generated.
+ *
+ * Consumers can be added and switched on and off at runtime. A change is
+ * deployed by pace2_event_subscription_apply on the packet thread; flows
+ * which already have a flow policy get the new one with their next
+ * classification result.
+ */
+
+#ifndef PACE2_EVENT_SUBSCRIPTION_H
+#define PACE2_EVENT_SUBSCRIPTION_H
+
+#include <stdio.h>
+#include <pace2.h>
+
+#define PACE2_EVENT_SUBSCRIPTION_MAX_CONSUMERS 16
+#define PACE2_EVENT_SUBSCRIPTION_MAX_APPLICATIONS 32
+#define PACE2_EVENT_SUBSCRIPTION_NAME_LENGTH 32
+
+/* application of subscriptions which are valid for every flow */
+#define PACE2_EVENT_SUBSCRIPTION_ALL_FLOWS PACE2_APPLICATIONS_COUNT
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct pace2_event_subscription_application {
+    u32 application;
+    PACE2_epol_structure events;
+};
+
+struct pace2_event_subscription_consumer {
+    char name[PACE2_EVENT_SUBSCRIPTION_NAME_LENGTH];
+    u8 active;
+    /* events for every flow */
+    PACE2_epol_structure events;
+    /* additional events for the flows of single applications */
+    struct pace2_event_subscription_application applications[PACE2_EVENT_SUBSCRIPTION_MAX_APPLICATIONS];
+    u32 application_count;
+};
+
+/* per flow state, kept in the flow user data */
+struct pace2_event_subscription_flow {
+    /* generation of the subscriptions the flow policy was deployed from, 0 if none */
+    u32 generation;
+    u32 application;
+};
+
+struct pace2_event_subscription {
+    struct pace2_event_subscription_consumer consumers[PACE2_EVENT_SUBSCRIPTION_MAX_CONSUMERS];
+    u32 consumer_count;
+
+    /* deployed policies */
+    PACE2_epol_structure global;
+    PACE2_epol_structure application[PACE2_APPLICATIONS_COUNT];
+    u8 application_used[PACE2_APPLICATIONS_COUNT];
+    u8 applications_used;
+    PACE2_epol_structure empty;
+
+    /* incremented with every deployed change, starts at 1 */
+    u32 generation;
+    u8 changed;
+
+    /* statistics */
+    u64 global_deployments;
+    u64 flow_deployments;
+    u64 deployment_errors;
+};
+
+/**
+ * initializes a subscription manager without consumers
+ * @param sub subscription manager
+ */
+void pace2_event_subscription_init(struct pace2_event_subscription *sub);
+
+/**
+ * registers a consumer, it is active and has no subscriptions
+ * @param sub subscription manager
+ * @param name name of the consumer for the statistics
+ * @return consumer id; -1 if there are too many consumers
+ */
+int pace2_event_subscription_add_consumer(struct pace2_event_subscription *sub, const char *name);
+
+/**
+ * subscribes a consumer to an event type
+ * @param sub subscription manager
+ * @param consumer consumer id
+ * @param type event type
+ * @param application application whose flows generate the event; PACE2_EVENT_SUBSCRIPTION_ALL_FLOWS for all flows
+ * @return 0 on success; !=0 if the parameters are invalid or the consumer has too many applications
+ */
+u8 pace2_event_subscription_subscribe_event(struct pace2_event_subscription *sub, int consumer,
+                                            PACE2_event_type type, u32 application);
+
+/**
+ * subscribes a consumer to all event types of a group
+ * @param sub subscription manager
+ * @param consumer consumer id
+ * @param group event group
+ * @param application application whose flows generate the events; PACE2_EVENT_SUBSCRIPTION_ALL_FLOWS for all flows
+ * @return 0 on success; !=0 if the parameters are invalid or the consumer has too many applications
+ */
+u8 pace2_event_subscription_subscribe_group(struct pace2_event_subscription *sub, int consumer,
+                                            PACE2_event_groups group, u32 application);
+
+/**
+ * switches a consumer on or off, the events of an inactive consumer are not generated
+ * @param sub subscription manager
+ * @param consumer consumer id
+ * @param active 1 to activate; 0 to deactivate
+ */
+void pace2_event_subscription_set_active(struct pace2_event_subscription *sub, int consumer, u8 active);
+
+/**
+ * sets the global event policy of a configuration before the module is initialized
+ * @param sub subscription manager
+ * @param config PACE 2 configuration
+ * @return 0 on success; !=0 on error
+ */
+u8 pace2_event_subscription_configure(struct pace2_event_subscription *sub, struct PACE2_global_config *config);
+
+/**
+ * deploys the global event policy if the subscriptions changed since the last call;
+ * cheap if nothing changed, call it from the packet thread
+ * @param sub subscription manager
+ * @param pace2 PACE 2 module
+ * @return 0 on success; !=0 on error
+ */
+u8 pace2_event_subscription_apply(struct pace2_event_subscription *sub, PACE2_module *pace2);
+
+/**
+ * clears the flow policy of a new flow
+ * @param sub subscription manager
+ * @param flow PACE 2 flow, flow_data of the packet descriptor
+ * @param state per flow state of the subscription manager
+ */
+void pace2_event_subscription_flow_started(struct pace2_event_subscription *sub, void *flow,
+                                           struct pace2_event_subscription_flow *state);
+
+/**
+ * deploys the flow policy of the application of a classified flow,
+ * nothing is done if the flow already has the current policy
+ * @param sub subscription manager
+ * @param flow PACE 2 flow, flow_data of the packet descriptor
+ * @param state per flow state of the subscription manager
+ * @param application application of the classification result
+ */
+void pace2_event_subscription_flow_classified(struct pace2_event_subscription *sub, void *flow,
+                                              struct pace2_event_subscription_flow *state, u32 application);
+
+/**
+ * checks if a consumer takes an event of a flow; PACE 2 generates the events of
+ * all active consumers, so every consumer has to check the events it is handed
+ * @param sub subscription manager
+ * @param consumer consumer id
+ * @param type event type
+ * @param state per flow state of the subscription manager; NULL if the event has no flow
+ * @return 1 if the consumer is active and subscribed the event for all flows or
+ *         for the application of the flow; 0 otherwise
+ */
+u8 pace2_event_subscription_consumes(const struct pace2_event_subscription *sub, int consumer,
+                                     PACE2_event_type type, const struct pace2_event_subscription_flow *state);
+
+/**
+ * prints the consumers and the number of deployments
+ * @param sub subscription manager
+ * @param f output
+ */
+void pace2_event_subscription_print_stats(const struct pace2_event_subscription *sub, FILE *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PACE2_EVENT_SUBSCRIPTION_H */
@@ -0,0 +1,239 @@
+/*
+ * pace2_flow_record.c
+ *
+ * Per flow records, see pace2_flow_record.h.
+ */
+
+#include "pace2_flow_record.h"
+
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+
+/* takes addresses and ports of the record from the innermost IP frame of a packet */
+static void pace2_flow_record_set_key(struct pace2_flow_record *record, const PACE2_packet_descriptor *pd)
+{
+    const PACE2_packet_stack * const framing = pd->framing;
+    const PACE2_packet_frame_descriptor *frame;
+
+    if (NULL == framing || framing->inner_ip_index >= framing->stack_size) {
+        return;
+    }
+
+    frame = &framing->stack[framing->inner_ip_index];
+    if (IPv4 == frame->type) {
+        record->src.address.ipv4.s_addr = frame->frame_data.ipv4->saddr;
+        record->dst.address.ipv4.s_addr = frame->frame_data.ipv4->daddr;
+        record->l4_protocol = frame->frame_data.ipv4->protocol;
+    } else if (IPv6 == frame->type) {
+        record->src.is_ip_v6 = 1;
+        record->dst.is_ip_v6 = 1;
+        record->src.address.ipv6 = frame->frame_data.ipv6->ip6_src;
+        record->dst.address.ipv6 = frame->frame_data.ipv6->ip6_dst;
+        record->l4_protocol = (u8)frame->frame_layer_protocol;
+    } else {
+        return;
+    }
+
+    if ((u32)framing->inner_ip_index + 1 >= framing->stack_size) {
+        return;
+    }
+
+    frame = &framing->stack[framing->inner_ip_index + 1];
+    if (TCP == frame->type) {
+        record->l4_protocol = IPPROTO_TCP;
+        record->src_port = ntohs(frame->frame_data.tcp->source);
+        record->dst_port = ntohs(frame->frame_data.tcp->dest);
+    } else if (UDP == frame->type) {
+        record->l4_protocol = IPPROTO_UDP;
+        record->src_port = ntohs(frame->frame_data.udp->source);
+        record->dst_port = ntohs(frame->frame_data.udp->dest);
+    }
+}
+
+static void pace2_flow_record_emit(struct pace2_flow_records *records, struct pace2_flow_record *record,
+                                   enum pace2_flow_record_reason reason)
+{
+    records->records[reason]++;
+
+    if (NULL != records->handler) {
+        records->handler(record, reason, records->user_data);
+    }
+
+    record->sequence++;
+}
+
+void pace2_flow_records_init(struct pace2_flow_records *records, PACE2_timestamp active_timeout,
+                             pace2_flow_record_handler handler, void *user_data)
+{
+    memset(records, 0, sizeof(*records));
+
+    records->active_timeout = active_timeout;
+    records->handler = handler;
+    records->user_data = user_data;
+}
+
+void pace2_flow_record_start(struct pace2_flow_records *records, struct pace2_flow_record *record,
+                             const PACE2_packet_descriptor *pd)
+{
+    memset(record, 0, sizeof(*record));
+
+    record->flow_id = pd->flow_id;
+    record->first_ts = pd->packet_ts;
+    record->last_ts = pd->packet_ts;
+    record->first_direction = pd->direction;
+    record->active = 1;
+
+    pace2_flow_record_set_key(record, pd);
+
+    records->flows++;
+}
+
+void pace2_flow_record_packet(struct pace2_flow_records *records, struct pace2_flow_record *record,
+                              const PACE2_packet_descriptor *pd)
+{
+    const u32 length = pd->framing->stack[0].frame_length;
+    const u32 direction = pd->direction != record->first_direction;
+
+    if (!record->active) {
+        return;
+    }
+
+    /* a long running flow reports every active timeout interval separately */
+    if (records->active_timeout != 0 && pd->packet_ts - record->first_ts >= records->active_timeout) {
+        pace2_flow_record_emit(records, record, PACE2_FLOW_RECORD_ACTIVE_TIMEOUT);
+
+        record->first_ts = pd->packet_ts;
+        memset(record->packets, 0, sizeof(record->packets));
+        memset(record->bytes, 0, sizeof(record->bytes));
+    }
+
+    record->last_ts = pd->packet_ts;
+    record->packets[direction]++;
+    record->bytes[direction] += length;
+
+    records->packets++;
+    records->bytes += length;
+}
+
+void pace2_flow_record_classified(struct pace2_flow_record *record,
+                                  const PACE2_classification_result_event *classification)
+{
+    u8 i;
+
+    if (!record->active) {
+        return;
+    }
+
+    record->protocol_stack_length = 0;
+    for (i = 0; i < classification->protocol.stack.length && i < PACE2_PROTOCOL_STACK_MAX_DEPTH; i++) {
+        record->protocol_stack[i] = classification->protocol.stack.entry[i];
+        record->protocol_stack_length++;
+    }
+
+    record->application = classification->application.type;
+    record->attribute_count = 0;
+    for (i = 0; i < classification->application.attributes.length && i < PACE2_FLOW_RECORD_MAX_ATTRIBUTES; i++) {
+        record->attributes[i] = classification->application.attributes.list[i];
+        record->attribute_count++;
+    }
+
+    record->classified = record->protocol_stack_length > 0;
+}
+
+void pace2_flow_record_end(struct pace2_flow_records *records, struct pace2_flow_record *record,
+                           enum pace2_pht_removal_reason removal_reason)
+{
+    if (NULL == record || !record->active) {
+        return;
+    }
+
+    record->removal_reason = removal_reason;
+
+    pace2_flow_record_emit(records, record, PACE2_FLOW_RECORD_END);
+    record->active = 0;
+}
+
+static const char *pace2_flow_record_address(const PACE2_ip_address *address, char *buffer)
+{
+    if (address->is_ip_v6) {
+        return inet_ntop(AF_INET6, &address->address.ipv6, buffer, INET6_ADDRSTRLEN);
+    }
+
+    return inet_ntop(AF_INET, &address->address.ipv4, buffer, INET6_ADDRSTRLEN);
+}
+
+static const char * const pace2_flow_record_reason_names[] = { "end", "active_timeout" };
+
+void pace2_flow_record_print(FILE *f, const struct pace2_flow_record *record, enum pace2_flow_record_reason reason)
+{
+    char src[INET6_ADDRSTRLEN];
+    char dst[INET6_ADDRSTRLEN];
+    u8 i;
+
+    fprintf(f, "Flow record %llu/%u (%s): %s:%u -> %s:%u l4 %u, %llu/%llu packets, %llu/%llu bytes, ts %llu - %llu",
+            (unsigned long long)record->flow_id, record->sequence, pace2_flow_record_reason_names[reason],
+            pace2_flow_record_address(&record->src, src), record->src_port,
+            pace2_flow_record_address(&record->dst, dst), record->dst_port, record->l4_protocol,
+            (unsigned long long)record->packets[0], (unsigned long long)record->packets[1],
+            (unsigned long long)record->bytes[0], (unsigned long long)record->bytes[1],
+            (unsigned long long)record->first_ts, (unsigned long long)record->last_ts);
+
+    if (record->classified) {
+        fprintf(f, ", protocol ");
+        for (i = 0; i < record->protocol_stack_length; i++) {
+            fprintf(f, "%s%s", i > 0 ? "/" : "", pace2_get_protocol_short_str(record->protocol_stack[i]));
+        }
+        fprintf(f, ", application %s", pace2_get_application_short_str(record->application));
+        for (i = 0; i < record->attribute_count; i++) {
+            fprintf(f, "%s%s", i > 0 ? "," : " ", pace2_get_application_attribute_str(record->attributes[i]));
+        }
+    }
+
+    fprintf(f, "\n");
+}
+
+void pace2_flow_record_print_json(FILE *f, const struct pace2_flow_record *record, enum pace2_flow_record_reason reason)
+{
+    char src[INET6_ADDRSTRLEN];
+    char dst[INET6_ADDRSTRLEN];
+    u8 i;
+
+    fprintf(f, "{\"type\":\"flow_record\",\"flow_id\":%llu,\"sequence\":%u,\"reason\":\"%s\","
+            "\"src_ip\":\"%s\",\"dst_ip\":\"%s\",\"src_port\":%u,\"dst_port\":%u,\"l4_protocol\":%u,"
+            "\"packets\":[%llu,%llu],\"bytes\":[%llu,%llu],\"first_ts\":%llu,\"last_ts\":%llu",
+            (unsigned long long)record->flow_id, record->sequence, pace2_flow_record_reason_names[reason],
+            pace2_flow_record_address(&record->src, src), pace2_flow_record_address(&record->dst, dst),
+            record->src_port, record->dst_port, record->l4_protocol,
+            (unsigned long long)record->packets[0], (unsigned long long)record->packets[1],
+            (unsigned long long)record->bytes[0], (unsigned long long)record->bytes[1],
+            (unsigned long long)record->first_ts, (unsigned long long)record->last_ts);
+
+    /* the names of the library contain no characters which need escaping */
+    if (record->classified) {
+        fprintf(f, ",\"protocol_stack\":[");
+        for (i = 0; i < record->protocol_stack_length; i++) {
+            fprintf(f, "%s\"%s\"", i > 0 ? "," : "", pace2_get_protocol_short_str(record->protocol_stack[i]));
+        }
+        fprintf(f, "],\"application\":\"%s\",\"application_attributes\":[",
+                pace2_get_application_short_str(record->application));
+        for (i = 0; i < record->attribute_count; i++) {
+            fprintf(f, "%s\"%s\"", i > 0 ? "," : "", pace2_get_application_attribute_str(record->attributes[i]));
+        }
+        fprintf(f, "]");
+    }
+
+    fprintf(f, "}\n");
+}
+
+void pace2_flow_records_print_stats(const struct pace2_flow_records *records, FILE *f)
+{
+    fprintf(f, "Flow records: %llu flows, %llu records at flow end, %llu records at active timeout, %llu packets, %llu bytes\n\n",
+            (unsigned long long)records->flows, (unsigned long long)records->records[PACE2_FLOW_RECORD_END],
+            (unsigned long long)records->records[PACE2_FLOW_RECORD_ACTIVE_TIMEOUT],
+            (unsigned long long)records->packets, (unsigned long long)records->bytes);
+}
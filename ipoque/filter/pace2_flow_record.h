@@ -0,0 +1,162 @@
+/*
+ * pace2_flow_record.h
+ *
+ * NetFlow style records of the flows. The counters of a flow are kept in
+ * its flow user data and updated per packet with a few additions; the
+ * classification is stored on its classification results. A record is
+ * handed to the record handler once, when the flow is dropped, instead of
+ * updating shared counters per packet. Flows running longer than the active
+ * timeout emit an intermediate record after every timeout interval, the
+ * counters of the next record start at 0.
+ *
+ * The key of a record (addresses, ports, layer 4 protocol) is taken from the
+ * innermost IP frame of the first packet, its source is the initiator of
+ * the flow. Packets and bytes are split into the direction of the first
+ * packet (0) and the opposite direction (1).
+ */
+
+#ifndef PACE2_FLOW_RECORD_H
+#define PACE2_FLOW_RECORD_H
+
+#include <stdio.h>
+#include <pace2.h>
+
+#define PACE2_FLOW_RECORD_MAX_ATTRIBUTES PACE2_APPLICATION_ATTRIBUTE_LIST_MAX_SIZE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum pace2_flow_record_reason {
+    /* the flow was dropped, last record of the flow */
+    PACE2_FLOW_RECORD_END = 0,
+    /* the flow is still active, the record covers one active timeout interval */
+    PACE2_FLOW_RECORD_ACTIVE_TIMEOUT
+};
+
+struct pace2_flow_record {
+    u64 flow_id;
+    PACE2_timestamp first_ts;
+    PACE2_timestamp last_ts;
+    u64 packets[2];
+    u64 bytes[2];
+
+    PACE2_ip_address src;
+    PACE2_ip_address dst;
+    /* host byte order, 0 if the flow is neither TCP nor UDP */
+    u16 src_port;
+    u16 dst_port;
+    u8 l4_protocol;
+
+    u8 first_direction;
+    u8 active;
+    u8 classified;
+
+    u16 protocol_stack[PACE2_PROTOCOL_STACK_MAX_DEPTH];
+    u8 protocol_stack_length;
+    u8 attribute_count;
+    u16 application;
+    u16 attributes[PACE2_FLOW_RECORD_MAX_ATTRIBUTES];
+
+    /* number of records emitted for the flow before this one */
+    u32 sequence;
+    /* why the flow was removed, set for the last record */
+    enum pace2_pht_removal_reason removal_reason;
+};
+
+/**
+ * receives an emitted record
+ * @param record record, valid until the handler returns
+ * @param reason why the record was emitted
+ * @param user_data user data of the record collection
+ */
+typedef void (*pace2_flow_record_handler)(const struct pace2_flow_record *record,
+                                          enum pace2_flow_record_reason reason, void *user_data);
+
+/* settings and statistics of the records of one packet thread */
+struct pace2_flow_records {
+    /* in clock ticks, 0 to emit records only at the end of a flow */
+    PACE2_timestamp active_timeout;
+    pace2_flow_record_handler handler;
+    void *user_data;
+
+    u64 flows;
+    u64 records[2];
+    u64 packets;
+    u64 bytes;
+};
+
+/**
+ * initializes the record collection of a packet thread
+ * @param records record collection
+ * @param active_timeout interval of intermediate records in clock ticks; 0 for none
+ * @param handler receives the emitted records
+ * @param user_data passed to the handler
+ */
+void pace2_flow_records_init(struct pace2_flow_records *records, PACE2_timestamp active_timeout,
+                             pace2_flow_record_handler handler, void *user_data);
+
+/**
+ * starts the record of a new flow with the key of its first packet
+ * @param records record collection
+ * @param record record in the flow user data
+ * @param pd first packet of the flow
+ */
+void pace2_flow_record_start(struct pace2_flow_records *records, struct pace2_flow_record *record,
+                             const PACE2_packet_descriptor *pd);
+
+/**
+ * counts a packet of the flow, emits the record first if its active timeout expired
+ * @param records record collection
+ * @param record record in the flow user data
+ * @param pd packet
+ */
+void pace2_flow_record_packet(struct pace2_flow_records *records, struct pace2_flow_record *record,
+                              const PACE2_packet_descriptor *pd);
+
+/**
+ * stores the classification of the flow, the last one before the record is emitted is reported
+ * @param record record in the flow user data
+ * @param classification classification result of the flow
+ */
+void pace2_flow_record_classified(struct pace2_flow_record *record,
+                                  const PACE2_classification_result_event *classification);
+
+/**
+ * emits the last record of a dropped flow
+ * @param records record collection
+ * @param record record in the flow user data, flow_user_data of the PACE2_FLOW_DROPPED_EVENT
+ * @param removal_reason removal_reason of the PACE2_FLOW_DROPPED_EVENT; PHT_NONE if the record is
+ *                       ended without the flow being dropped, e.g. at exit
+ */
+void pace2_flow_record_end(struct pace2_flow_records *records, struct pace2_flow_record *record,
+                           enum pace2_pht_removal_reason removal_reason);
+
+/**
+ * prints a record as one line of text
+ * @param f output
+ * @param record record
+ * @param reason why the record was emitted
+ */
+void pace2_flow_record_print(FILE *f, const struct pace2_flow_record *record, enum pace2_flow_record_reason reason);
+
+/**
+ * prints a record as one line of JSON, with the keys of the events of event_json.h
+ * @param f output
+ * @param record record
+ * @param reason why the record was emitted
+ */
+void pace2_flow_record_print_json(FILE *f, const struct pace2_flow_record *record, enum pace2_flow_record_reason reason);
+
+/**
+ * prints the number of flows and emitted records
+ * @param records record collection
+ * @param f output
+ */
+void pace2_flow_records_print_stats(const struct pace2_flow_records *records, FILE *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PACE2_FLOW_RECORD_H */
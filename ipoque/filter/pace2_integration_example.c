@@ -19,21 +19,82 @@
 #include <pace2.h>
 #include "event_handler.h"
 #include "pace2_netfilter.h"
+#include "pace2_shm_stats.h"
+#include "pace2_event_ring.h"
+#include "pace2_event_sink.h"
+#include "pace2_ipfix.h"
+#include "pace2_event_subscription.h"
+#include "pace2_flow_record.h"
+#include "event_encoder.h"
+#include "event_batch.h"
+#include "event_json.h"
 
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <signal.h>
 
 #include <getopt.h>
 
 static u8 running = 1;
 static int full_features = 0;
+static const char *stats_name = PACE2_SHM_STATS_DEFAULT_NAME;
+static const char *events_name = PACE2_EVENT_RING_DEFAULT_NAME;
+static const char *sink_output = "-";
+static enum pace2_event_sink_format sink_format = PACE2_EVENT_SINK_TEXT;
+static enum pace2_event_sink_overflow sink_overflow = PACE2_EVENT_SINK_DROP_NEWEST;
+/* compressed files rotated by size and age instead of one output */
+static int sink_compressed = 0;
+static u64 log_max_file_mb = PACE2_COMPRESSED_LOG_DEFAULT_MAX_FILE_SIZE / ( 1024 * 1024 );
+static u32 log_max_file_seconds = PACE2_COMPRESSED_LOG_DEFAULT_MAX_FILE_SECONDS;
+/* the flow records are written to the event output as well */
+static int output_flow_records = 0;
+/* applications whose decoder events are written, all if none is given */
+static u32 output_applications[PACE2_EVENT_SUBSCRIPTION_MAX_APPLICATIONS];
+static u32 output_application_count = 0;
+/* interval of the intermediate records of long running flows */
+static u32 active_timeout_seconds = 60;
+/* IPFIX collector of the flow records, no export if NULL */
+static char *ipfix_host = NULL;
+static u16 ipfix_port = PACE2_IPFIX_DEFAULT_PORT;
+/* set by SIGUSR1, switches the decoder event output on and off */
+static volatile sig_atomic_t toggle_output = 0;
+
+/* Events are drained from the queue in batches of at most this size */
+#define EVENT_BATCH_SIZE 64
+
+/* flow user data */
+struct flow_user_data {
+	struct pace2_event_subscription_flow subscription;
+	struct pace2_flow_record record;
+};
 
 /* content struct */
 typedef struct {
 	
 	struct pace2_netfilter netfilter;
+	/* shared memory segment the counters are published to */
+	struct pace2_shm_stats stats;
+	/* shared memory ring the classification and flow events are exported to */
+	struct pace2_event_ring events;
+	/* decoder events are written by the writer thread of the sink */
+	struct pace2_event_sink sink;
+	/* only the events of the consumers below are generated */
+	struct pace2_event_subscription subscription;
+	int counters_consumer;
+	int ring_consumer;
+	int output_consumer;
+	/* events generated for other consumers which the output is not subscribed to */
+	u64 filtered_output_events;
+	/* the events of a type are handed to the handlers of all its consumers */
+	struct event_batch dispatch;
+	/* per flow counters, the result counters are updated from the emitted records */
+	struct pace2_flow_records flow_records;
+	/* flow records are exported by the thread of the IPFIX exporter */
+	struct pace2_ipfix_exporter ipfix;
+	int ipfix_enabled;
 	/* PACE 2 module pointer */
 	 PACE2_module *pace2;
 
@@ -141,11 +202,287 @@ static void pace_print_results( content_t * const content )
     fprintf( stderr, "Packet counter: %llu\n", content->packet_counter );
     fprintf( stderr, "\n" );
 
+    pace2_flow_records_print_stats( &content->flow_records, stderr );
+
     if ( content->license_exceeded_packets > 0 ) {
         fprintf( stderr, "License exceeded packets: %llu.\n\n", content->license_exceeded_packets );
     }
 } /* pace_print_results */
 
+/* Copy all counters into the shared memory segment, readers never see a partial update */
+static void pace_publish_results( content_t * const content, PACE2_timestamp timestamp )
+{
+    u32 c;
+
+    pace2_shm_stats_write_begin( &content->stats );
+
+    for ( c = 0; c < PACE2_PROTOCOL_COUNT; c++ ) {
+        pace2_shm_stats_set( &content->stats, PACE2_SHM_STATS_PROTOCOLS, c,
+                             content->protocol_counter[c], content->protocol_counter_bytes[c] );
+    }
+    for ( c = 0; c < PACE2_PROTOCOL_STACK_MAX_DEPTH; c++ ) {
+        pace2_shm_stats_set( &content->stats, PACE2_SHM_STATS_STACK_LENGTHS, c,
+                             content->protocol_stack_length_counter[c], content->protocol_stack_length_counter_bytes[c] );
+    }
+    for ( c = 0; c < PACE2_APPLICATIONS_COUNT; c++ ) {
+        pace2_shm_stats_set( &content->stats, PACE2_SHM_STATS_APPLICATIONS, c,
+                             content->application_counter[c], content->application_counter_bytes[c] );
+    }
+    for ( c = 0; c < PACE2_APPLICATION_ATTRIBUTES_COUNT; c++ ) {
+        pace2_shm_stats_set( &content->stats, PACE2_SHM_STATS_ATTRIBUTES, c,
+                             content->attribute_counter[c], content->attribute_counter_bytes[c] );
+    }
+
+    if ( content->stats.hdr != NULL ) {
+        content->stats.hdr->packet_counter = content->packet_counter;
+        content->stats.hdr->byte_counter = content->byte_counter;
+        content->stats.hdr->http_response_payload_bytes = content->http_response_payload_bytes;
+        content->stats.hdr->license_exceeded_packets = content->license_exceeded_packets;
+    }
+
+    pace2_shm_stats_write_end( &content->stats, timestamp );
+
+    content->last_output_ts = timestamp;
+} /* pace_publish_results */
+
+/* Export an emitted flow record and add it to the result counters */
+static void pace_account_flow_record( const struct pace2_flow_record * const record,
+                                      enum pace2_flow_record_reason reason,
+                                      void * const user_data )
+{
+    content_t * const content = user_data;
+    const u64 packets = record->packets[0] + record->packets[1];
+    const u64 bytes = record->bytes[0] + record->bytes[1];
+    u32 protocol;
+    u8 attribute_iterator;
+
+    if ( content->ipfix_enabled ) {
+        pace2_ipfix_export( &content->ipfix, record, reason );
+    }
+    if ( output_flow_records ) {
+        pace2_event_sink_push_flow_record( &content->sink, 0, record, reason );
+    }
+
+    /* like before, only classified traffic is counted */
+    if ( !record->classified || record->protocol_stack_length == 0 ) {
+        return;
+    }
+    protocol = record->protocol_stack[record->protocol_stack_length - 1];
+
+    content->protocol_counter[protocol] += packets;
+    content->protocol_counter_bytes[protocol] += bytes;
+    content->protocol_stack_length_counter[record->protocol_stack_length - 1] += packets;
+    content->protocol_stack_length_counter_bytes[record->protocol_stack_length - 1] += bytes;
+
+    content->application_counter[record->application] += packets;
+    content->application_counter_bytes[record->application] += bytes;
+
+    for ( attribute_iterator = 0; attribute_iterator < record->attribute_count; attribute_iterator++ ) {
+        content->attribute_counter[record->attributes[attribute_iterator]] += packets;
+        content->attribute_counter_bytes[record->attributes[attribute_iterator]] += bytes;
+    }
+} /* pace_account_flow_record */
+
+/* Emit the last record of the dropped flows */
+static void pace_flow_dropped( PACE2_event * const *events, u32 count, PACE2_packet_descriptor const * const pd, void * const user_data )
+{
+    content_t * const content = user_data;
+    u32 i;
+
+    (void)pd;
+
+    for ( i = 0; i < count; i++ ) {
+        struct flow_user_data * const flow = events[i]->flow_dropped.flow_user_data;
+
+        if ( flow != NULL ) {
+            pace2_flow_record_end( &content->flow_records, &flow->record, events[i]->flow_dropped.removal_reason );
+        }
+    }
+} /* pace_flow_dropped */
+
+/* End the record of a flow which is still tracked at exit */
+static PACE2_foreach_callback_return_state pace_end_flow_record( PACE2_module * const pace,
+                                                                 const int thread_ID,
+                                                                 const ipoque_unique_flow_ipv4_and_6_struct_t * const key,
+                                                                 void * const flow_data,
+                                                                 const PACE2_timestamp last_timestamp,
+                                                                 void * const userptr )
+{
+    content_t * const content = userptr;
+    struct flow_user_data * const flow = flow_data;
+
+    (void)pace;
+    (void)thread_ID;
+    (void)key;
+    (void)last_timestamp;
+
+    if ( flow != NULL ) {
+        /* The flow is not dropped, its record is ended by force */
+        pace2_flow_record_end( &content->flow_records, &flow->record, PHT_NONE );
+    }
+
+    return PACE2_FOREACH_NEXT;
+} /* pace_end_flow_record */
+
+/* Store the classification in the flow record, the counters are updated once per flow record, not per packet */
+static void pace_flow_classified( PACE2_event * const *events, u32 count, PACE2_packet_descriptor const * const pd, void * const user_data )
+{
+    struct flow_user_data * const flow = pd != NULL ? pd->flow_user_data : NULL;
+    u32 i;
+
+    (void)user_data;
+
+    if ( flow == NULL ) {
+        return;
+    }
+
+    for ( i = 0; i < count; i++ ) {
+        pace2_flow_record_classified( &flow->record, &events[i]->classification_result_data );
+    }
+} /* pace_flow_classified */
+
+static void pace_license_exceeded( PACE2_event * const *events, u32 count, PACE2_packet_descriptor const * const pd, void * const user_data )
+{
+    content_t * const content = user_data;
+
+    (void)events;
+    (void)pd;
+
+    content->license_exceeded_packets += count;
+} /* pace_license_exceeded */
+
+static void pace_count_http_payload( PACE2_event * const *events, u32 count, PACE2_packet_descriptor const * const pd, void * const user_data )
+{
+    content_t * const content = user_data;
+    u32 i;
+
+    (void)pd;
+
+    for ( i = 0; i < count; i++ ) {
+        const PACE2_class_HTTP_event * const http_event = &events[i]->http_class_meta_data;
+
+        if ( http_event->meta_data_type == PACE2_CLASS_HTTP_RESPONSE_DATA_TRANSFER ) {
+            const struct ipd_class_http_transfer_payload_struct * const http_payload = &http_event->event_data.response_data_transfer;
+            content->http_response_payload_bytes += http_payload->data.content.length;
+        }
+    }
+} /* pace_count_http_payload */
+
+/* Generate the events subscribed for the application of a classified flow */
+static void pace_apply_flow_policy( PACE2_event * const *events, u32 count, PACE2_packet_descriptor const * const pd, void * const user_data )
+{
+    content_t * const content = user_data;
+    struct flow_user_data * const flow = pd != NULL ? pd->flow_user_data : NULL;
+    u32 i;
+
+    if ( flow == NULL ) {
+        return;
+    }
+
+    for ( i = 0; i < count; i++ ) {
+        pace2_event_subscription_flow_classified( &content->subscription, pd->flow_data, &flow->subscription,
+                                                  events[i]->classification_result_data.application.type );
+    }
+} /* pace_apply_flow_policy */
+
+static void pace_export_event( PACE2_event * const *events, u32 count, PACE2_packet_descriptor const * const pd, void * const user_data )
+{
+    content_t * const content = user_data;
+    u32 i;
+
+    for ( i = 0; i < count; i++ ) {
+        pace2_event_ring_push_event( &content->events, 0, events[i], pd );
+    }
+} /* pace_export_event */
+
+/* Write the decoder events the output is subscribed to; PACE 2 generates the events of all consumers,
+ * the output may be switched off or subscribed to other applications than the one of the flow */
+static void pace_write_event( PACE2_event * const *events, u32 count, PACE2_packet_descriptor const * const pd, void * const user_data )
+{
+    content_t * const content = user_data;
+    struct flow_user_data * const flow = pd != NULL ? pd->flow_user_data : NULL;
+    u32 i;
+
+    /* the events of a batch have the same type and packet */
+    if ( !pace2_event_subscription_consumes( &content->subscription, content->output_consumer, events[0]->header.type,
+                                             flow != NULL ? &flow->subscription : NULL ) ) {
+        content->filtered_output_events += count;
+        return;
+    }
+
+    for ( i = 0; i < count; i++ ) {
+        pace2_event_sink_push( &content->sink, 0, events[i], pd );
+    }
+} /* pace_write_event */
+
+/* Register the event consumers of this program and their handlers, PACE 2 generates no other events */
+static void pace_subscribe_events( content_t * const content )
+{
+    struct pace2_event_subscription * const sub = &content->subscription;
+    struct event_batch * const eb = &content->dispatch;
+    int consumer;
+    int type;
+    u32 a;
+
+    pace2_event_subscription_init( sub );
+    /* the module is set once it is initialized, it needs the event policy of the consumers */
+    if ( eb_init( eb, NULL, 0, EVENT_BATCH_SIZE ) != 0 ) {
+        panic( "Allocation of the event batch failed\n" );
+    }
+
+    /* result counters */
+    content->counters_consumer = pace2_event_subscription_add_consumer( sub, "counters" );
+    consumer = eb_add_consumer( eb, "counters" );
+    eb_subscribe( eb, consumer, PACE2_CLASSIFICATION_RESULT, pace_flow_classified, content );
+    eb_subscribe( eb, consumer, PACE2_LICENSE_EXCEEDED_EVENT, pace_license_exceeded, content );
+    eb_subscribe( eb, consumer, PACE2_CLASS_HTTP_EVENT, pace_count_http_payload, content );
+    eb_subscribe( eb, consumer, PACE2_FLOW_DROPPED_EVENT, pace_flow_dropped, content );
+    pace2_event_subscription_subscribe_event( sub, content->counters_consumer, PACE2_CLASSIFICATION_RESULT, PACE2_EVENT_SUBSCRIPTION_ALL_FLOWS );
+    pace2_event_subscription_subscribe_event( sub, content->counters_consumer, PACE2_LICENSE_EXCEEDED_EVENT, PACE2_EVENT_SUBSCRIPTION_ALL_FLOWS );
+    pace2_event_subscription_subscribe_event( sub, content->counters_consumer, PACE2_CLASS_HTTP_EVENT, PACE2_EVENT_SUBSCRIPTION_ALL_FLOWS );
+    pace2_event_subscription_subscribe_event( sub, content->counters_consumer, PACE2_FLOW_DROPPED_EVENT, PACE2_EVENT_SUBSCRIPTION_ALL_FLOWS );
+
+    /* flow policy, uses the classification results of the counters */
+    consumer = eb_add_consumer( eb, "flow policy" );
+    eb_subscribe( eb, consumer, PACE2_CLASSIFICATION_RESULT, pace_apply_flow_policy, content );
+
+    /* shared memory event ring, the types of pace2_event_ring_push_event */
+    content->ring_consumer = pace2_event_subscription_add_consumer( sub, "event ring" );
+    consumer = eb_add_consumer( eb, "event ring" );
+    eb_subscribe( eb, consumer, PACE2_CLASSIFICATION_RESULT, pace_export_event, content );
+    eb_subscribe( eb, consumer, PACE2_FLOW_STARTED_EVENT, pace_export_event, content );
+    eb_subscribe( eb, consumer, PACE2_FLOW_DROPPED_EVENT, pace_export_event, content );
+    eb_subscribe( eb, consumer, PACE2_FLOW_INFO_EVENT, pace_export_event, content );
+    eb_subscribe( eb, consumer, PACE2_FLOW_PROCESS_EVENT, pace_export_event, content );
+    pace2_event_subscription_subscribe_event( sub, content->ring_consumer, PACE2_CLASSIFICATION_RESULT, PACE2_EVENT_SUBSCRIPTION_ALL_FLOWS );
+    pace2_event_subscription_subscribe_event( sub, content->ring_consumer, PACE2_FLOW_STARTED_EVENT, PACE2_EVENT_SUBSCRIPTION_ALL_FLOWS );
+    pace2_event_subscription_subscribe_event( sub, content->ring_consumer, PACE2_FLOW_DROPPED_EVENT, PACE2_EVENT_SUBSCRIPTION_ALL_FLOWS );
+    pace2_event_subscription_subscribe_event( sub, content->ring_consumer, PACE2_FLOW_INFO_EVENT, PACE2_EVENT_SUBSCRIPTION_ALL_FLOWS );
+    pace2_event_subscription_subscribe_event( sub, content->ring_consumer, PACE2_FLOW_PROCESS_EVENT, PACE2_EVENT_SUBSCRIPTION_ALL_FLOWS );
+
+    /* decoder event output: every type it can write, for all flows or the selected applications */
+    content->output_consumer = pace2_event_subscription_add_consumer( sub, "event output" );
+    consumer = eb_add_consumer( eb, "event output" );
+    for ( type = PACE2_NO_EVENT + 1; type < PACE2_NUMBER_OF_EVENTS; type++ ) {
+        if ( ( sink_format == PACE2_EVENT_SINK_BINARY || sink_format == PACE2_EVENT_SINK_STORE ) &&
+             !pace2_can_encode_event_type( type ) ) {
+            continue;
+        }
+        if ( sink_format == PACE2_EVENT_SINK_JSON && !pace2_can_json_event_type( type ) ) {
+            continue;
+        }
+
+        eb_subscribe( eb, consumer, type, pace_write_event, content );
+
+        if ( output_application_count == 0 ) {
+            pace2_event_subscription_subscribe_event( sub, content->output_consumer, type, PACE2_EVENT_SUBSCRIPTION_ALL_FLOWS );
+        }
+        for ( a = 0; a < output_application_count; a++ ) {
+            pace2_event_subscription_subscribe_event( sub, content->output_consumer, type, output_applications[a] );
+        }
+    }
+} /* pace_subscribe_events */
+
 /* Configure and initialize PACE 2 module */
 static void pace_configure_and_initialize( content_t * const content, const char * const license_file )
 {
@@ -203,6 +540,17 @@ static void pace_configure_and_initialize( content_t * const content, const char
         printf("Using minimal feature set.\n\n");
     }
 
+    /* Generate only the subscribed events, the flow user data holds the flow policy state */
+    pace_subscribe_events( content );
+    if ( pace2_event_subscription_configure( &content->subscription, &content->config ) != 0 ) {
+        fprintf( stderr, "Could not set the event policy, all events are generated.\n" );
+    }
+    content->config.tracking.flow.generic.user_data_size = sizeof(struct flow_user_data);
+
+    pace2_flow_records_init( &content->flow_records,
+                             (PACE2_timestamp)active_timeout_seconds * content->config.general.clock_ticks_per_second,
+                             pace_account_flow_record, content );
+
     /* uncomment the following line to only activate classification of protocol HTTP */
     // PACE2_PROTOCOLS_BITMASK_RESET(config.s3_classification.active_classifications.bitmask);
     // content->config.s3_classification.active_classifications.protocols.http = IPQ_TRUE;
@@ -217,6 +565,7 @@ static void pace_configure_and_initialize( content_t * const content, const char
     if ( content->pace2 == NULL ) {
         panic( "Initialization of PACE module failed\n" );
     }
+    content->dispatch.pace2 = content->pace2;
 
     /* Licensing */
     if ( license_file != NULL ) {
@@ -230,34 +579,101 @@ static void pace_configure_and_initialize( content_t * const content, const char
             pace2_debug_event(stdout, (PACE2_event const * const) &lic_event);
         }
     }
-} /* pace_configure_and_initialize */
 
-/* Print out all PACE 2 events currently in the event queue */
-static void process_events( content_t * const content )
-{
-    PACE2_event *event;
-
-    while ( ( event = pace2_get_next_event( content->pace2, 0 ) ) ) {
-        /* some additional processing is necessary */
-        if ( event->header.type == PACE2_CLASS_HTTP_EVENT ) {
-            const PACE2_class_HTTP_event * const http_event = &event->http_class_meta_data;
-            if (http_event->meta_data_type == PACE2_CLASS_HTTP_RESPONSE_DATA_TRANSFER) {
-                const struct ipd_class_http_transfer_payload_struct * const http_payload = &http_event->event_data.response_data_transfer;
-                content->http_response_payload_bytes += http_payload->data.content.length;
+    /* Shared memory segment for the result counters */
+    {
+        const u32 section_count[PACE2_SHM_STATS_NUMBER_OF_SECTIONS] = {
+            PACE2_PROTOCOL_COUNT,
+            PACE2_PROTOCOL_STACK_MAX_DEPTH,
+            PACE2_APPLICATIONS_COUNT,
+            PACE2_APPLICATION_ATTRIBUTES_COUNT
+        };
+
+        if ( pace2_shm_stats_create( &content->stats, stats_name, section_count ) != 0 ) {
+            fprintf( stderr, "Could not create statistics segment %s, counters are not published.\n", stats_name );
+        }
+    }
+
+    /* Shared memory ring for the event export, one ring for the single packet thread */
+    if ( pace2_event_ring_create( &content->events, events_name, 1, PACE2_EVENT_RING_DEFAULT_SLOTS ) != 0 ) {
+        fprintf( stderr, "Could not create event ring %s, events are not exported.\n", events_name );
+        pace2_event_subscription_set_active( &content->subscription, content->ring_consumer, 0 );
+    }
+
+    /* Asynchronous output of the decoder events, one ring for the single packet thread */
+    {
+        struct pace2_event_sink_config sink_config;
+
+        pace2_event_sink_init_default_config( &sink_config, 1 );
+        sink_config.format = sink_format;
+        sink_config.overflow = sink_overflow;
+
+        if ( sink_format == PACE2_EVENT_SINK_STORE ) {
+            struct pace2_event_store_config store_config;
+
+            pace2_event_store_init_default_config( &store_config, strcmp( sink_output, "-" ) == 0 ? "pace2_events" : sink_output,
+                                                   content->config.general.clock_ticks_per_second );
+            store_config.max_segment_seconds = log_max_file_seconds;
+
+            if ( pace2_event_sink_create_store( &content->sink, &sink_config, &store_config ) != 0 ) {
+                panic( "Could not open the event store\n" );
             }
+        } else if ( sink_compressed ) {
+            struct pace2_compressed_log_config log_config;
+
+            pace2_compressed_log_init_default_config( &log_config, strcmp( sink_output, "-" ) == 0 ? "pace2_events" : sink_output );
+            log_config.max_file_size = log_max_file_mb * 1024 * 1024;
+            log_config.max_file_seconds = log_max_file_seconds;
+
+            if ( pace2_event_sink_create_compressed( &content->sink, &sink_config, &log_config ) != 0 ) {
+                panic( "Could not open the compressed event log\n" );
+            }
+        } else {
+            const int fd = pace2_event_sink_open_output( sink_output );
+
+            if ( fd < 0 || pace2_event_sink_create( &content->sink, &sink_config, fd ) != 0 ) {
+                panic( "Could not open the event output\n" );
+            }
+        }
+    }
+
+    /* IPFIX export of the flow records */
+    if ( ipfix_host != NULL ) {
+        struct pace2_ipfix_config ipfix_config;
+
+        pace2_ipfix_init_default_config( &ipfix_config, ipfix_host, content->config.general.clock_ticks_per_second );
+        ipfix_config.port = ipfix_port;
+
+        if ( pace2_ipfix_create( &content->ipfix, &ipfix_config ) != 0 ) {
+            panic( "Could not open the IPFIX export\n" );
         }
-        pace2_debug_advanced_event(stdout, event);
+        content->ipfix_enabled = 1;
     }
+} /* pace_configure_and_initialize */
+
+/* Hand all PACE 2 events currently in the event queue to their consumers,
+ * pd is the packet which caused them or NULL for the events of the timeout handling */
+static void process_events( content_t * const content, PACE2_packet_descriptor const * const pd )
+{
+    eb_drain( &content->dispatch, pd );
 } /* process_events */
 
 static void stage3_to_5( content_t * const content )
 {
-    const PACE2_event *event;
     PACE2_bitmask pace2_event_mask;
     PACE2_packet_descriptor *out_pd;
 
+    /* Deploy the event policy if a consumer was switched on or off */
+    if ( toggle_output ) {
+        toggle_output = 0;
+        pace2_event_subscription_set_active( &content->subscription, content->output_consumer,
+                                             !content->subscription.consumers[content->output_consumer].active );
+    }
+    pace2_event_subscription_apply( &content->subscription, content->pace2 );
+
     /* Process stage 3 and 4 as long as packets are available from stage 2 */
     while ( (out_pd = pace2_s2_get_next_packet(content->pace2, 0)) ) {
+        struct flow_user_data * const flow = out_pd->flow_user_data;
 
         /* Account every processed packet */
         content->packet_counter++;
@@ -268,29 +684,18 @@ static void stage3_to_5( content_t * const content )
             continue;
         } /* Stage 3 processing */
 
-        /* Get all thrown events of stage 3 */
-        while ( ( event = pace2_get_next_event(content->pace2, 0) ) ) {
-            /* some additional processing is necessary */
-            if ( event->header.type == PACE2_CLASSIFICATION_RESULT ) {
-                PACE2_classification_result_event const * const classification = &event->classification_result_data;
-                u8 attribute_iterator;
-
-                content->protocol_counter[classification->protocol.stack.entry[classification->protocol.stack.length-1]]++;
-                content->protocol_counter_bytes[classification->protocol.stack.entry[classification->protocol.stack.length-1]] += out_pd->framing->stack[0].frame_length;
-                content->protocol_stack_length_counter[classification->protocol.stack.length - 1]++;
-                content->protocol_stack_length_counter_bytes[classification->protocol.stack.length - 1] += out_pd->framing->stack[0].frame_length;
+        if ( flow != NULL ) {
+            /* New flows start without flow policy, only the events for all flows are generated */
+            if ( out_pd->new_flow ) {
+                pace2_event_subscription_flow_started( &content->subscription, out_pd->flow_data, &flow->subscription );
+                pace2_flow_record_start( &content->flow_records, &flow->record, out_pd );
+            }
 
-                content->application_counter[classification->application.type]++;
-                content->application_counter_bytes[classification->application.type] += out_pd->framing->stack[0].frame_length;
+            pace2_flow_record_packet( &content->flow_records, &flow->record, out_pd );
+        }
 
-                for ( attribute_iterator = 0; attribute_iterator < classification->application.attributes.length; attribute_iterator++) {
-                    content->attribute_counter[classification->application.attributes.list[attribute_iterator]]++;
-                    content->attribute_counter_bytes[classification->application.attributes.list[attribute_iterator]] += out_pd->framing->stack[0].frame_length;
-                }
-            } else if ( event->header.type == PACE2_LICENSE_EXCEEDED_EVENT ) {
-                content->license_exceeded_packets++;
-            }
-        } /* Stage 3 event processing */
+        /* Hand all thrown events of stage 3 to their consumers */
+        process_events( content, out_pd );
 
         /* Process stage 4: protocol decoding */
         if ( pace2_s4_process_packet( content->pace2, 0, out_pd, NULL, &pace2_event_mask ) != PACE2_S4_SUCCESS ) {
@@ -298,7 +703,7 @@ static void stage3_to_5( content_t * const content )
         }
 
         /* Print out decoder events */
-        process_events(content);
+        process_events( content, out_pd );
 
     } /* Stage 2 packets */
 
@@ -308,7 +713,7 @@ static void stage3_to_5( content_t * const content )
     }
 
     /* Print out decoder events generated while cleaning up flows that timed out */
-    process_events( content );
+    process_events( content, NULL );
 
 } /* stage3_to_5 */
 
@@ -355,6 +760,12 @@ static void stage1_and_2( const struct timeval * const time,
     }
 
     stage3_to_5(content);
+
+    /* Publish the counters once per second */
+    if ( timestamp - content->last_output_ts >= content->config.general.clock_ticks_per_second ) {
+        pace_publish_results( content, timestamp );
+    }
+
         nfq_set_verdict( content->netfilter.nfq_q_h, *packet_id, PACE2_NF_ACCEPT, 
                 
                            payload_len, 
@@ -366,22 +777,72 @@ static void pace_cleanup_and_exit( content_t * const content )
     if ( content == NULL ) return;
     pace2_netfilter_exit( &content->netfilter );
     /* Flush any remaining packets from the buffers */
-    pace2_flush_engine( content->pace2, 0 );
+    pace2_flush_packets( content->pace2, 0 );
 
     /* Process packets which are ejected after flushing */
     stage3_to_5( content );
 
+    /* The counters are only updated by emitted records, the flows which are still active end now */
+    pace2_foreach_flow( content->pace2, 0, pace_end_flow_record, content );
+
+    /* Clear the flow tables, the timeout handling drops the remaining flows */
+    pace2_flush_tables( content->pace2, 0 );
+    stage3_to_5( content );
+
     /* Output detection results */
     pace_print_results( content );
+    pace_publish_results( content, content->last_output_ts );
+    pace2_shm_stats_close( &content->stats );
+
+    pace2_event_subscription_print_stats( &content->subscription, stderr );
+    fprintf( stderr, "Events not written for the event output: %llu\n\n", content->filtered_output_events );
+    eb_print_stats( &content->dispatch, stderr );
+    eb_destroy( &content->dispatch );
+    /* The writer drains the rings when it stops, the statistics are complete afterwards */
+    pace2_event_sink_stop( &content->sink );
+    pace2_event_sink_print_stats( &content->sink, stderr );
+    pace2_event_sink_destroy( &content->sink );
+
+    if ( content->ipfix_enabled ) {
+        pace2_ipfix_destroy( &content->ipfix );
+        pace2_ipfix_print_stats( &content->ipfix, stderr );
+    }
+
+    if ( content->events.hdr != NULL ) {
+        fprintf( stderr, "Exported events: %llu, dropped events: %llu\n\n",
+                 content->events.rings[0].control->produced, content->events.rings[0].control->drops );
+    }
+    pace2_event_ring_close( &content->events );
 
     /* Destroy PACE 2 module and free memory */
     pace2_exit_module( content->pace2 );
 } /* pace_cleanup_and_exit */
 
+static void toggle_output_handler( int signum )
+{
+    (void)signum;
+    toggle_output = 1;
+}
+
 void print_help_and_exit(void) {
     printf("Usage: pace2_integration_example [options]\n\n");
     printf("  -a\tEnable full PACE feature set.\n");
     printf("  -l\tUse a specific license file.\n");
+    printf("  -r\tName of the event ring shared memory segment (default %s).\n", PACE2_EVENT_RING_DEFAULT_NAME);
+    printf("  -s\tName of the statistics shared memory segment (default %s).\n", PACE2_SHM_STATS_DEFAULT_NAME);
+    printf("  -o\tOutput of the decoder events: - (stdout, default), unix:<path> or a file name.\n");
+    printf("  -b\tWrite the decoder events as binary event log instead of text.\n");
+    printf("  -j\tWrite the flow, classification, HTTP, DNS and SSL events as NDJSON instead of text.\n");
+    printf("  -E\tWrite the decoder events to an indexed event store <-o prefix>-<time>-<n>.seg for pace2_event_query (default prefix pace2_events).\n");
+    printf("  -z\tWrite the event output compressed to rotating files <-o prefix>-<time>-<n>.gz with a block index (default prefix pace2_events).\n");
+    printf("  -Z\tStart a new compressed file after this many MiB (default %llu, 0 for no limit).\n", PACE2_COMPRESSED_LOG_DEFAULT_MAX_FILE_SIZE / ( 1024 * 1024 ));
+    printf("  -I\tStart a new compressed file or store segment after this many seconds (default %u, 0 for no limit).\n", PACE2_COMPRESSED_LOG_DEFAULT_MAX_FILE_SECONDS);
+    printf("  -F\tWrite the flow records to the text or JSON event output as well (not with -b or -E).\n");
+    printf("  -w\tWait for the event writer instead of dropping events when its buffer is full.\n");
+    printf("  -t\tActive timeout of long running flows in seconds, 0 to report flows only at their end (default 60).\n");
+    printf("  -x\tExport the flow records as IPFIX to the collector host[:port] (default port %u).\n", PACE2_IPFIX_DEFAULT_PORT);
+    printf("  -A\tWrite only the decoder events of flows of this application, can be given more than once.\n");
+    printf("    \tSIGUSR1 switches the decoder event output off and on.\n");
     printf("  -h\tPrint this help message\n\n");
     printf("  -n\tNetfilter\n\n");
     exit(0);
@@ -394,7 +855,7 @@ int main( int argc, char **argv )
     const char * license_file = NULL;
     int c = 0;
 
-    while ((c = getopt(argc, argv, "ahn:l:")) != -1) {
+    while ((c = getopt(argc, argv, "abhjwzEFn:l:o:r:s:t:x:A:I:Z:")) != -1) {
         switch (c) {
             case 'a':
                 full_features = 1;
@@ -402,6 +863,70 @@ int main( int argc, char **argv )
             case 'l':
                 license_file = optarg;
                 break;
+            case 'r':
+                events_name = optarg;
+                break;
+            case 's':
+                stats_name = optarg;
+                break;
+            case 'o':
+                sink_output = optarg;
+                break;
+            case 'b':
+                sink_format = PACE2_EVENT_SINK_BINARY;
+                break;
+            case 'j':
+                sink_format = PACE2_EVENT_SINK_JSON;
+                break;
+            case 'E':
+                sink_format = PACE2_EVENT_SINK_STORE;
+                break;
+            case 'w':
+                sink_overflow = PACE2_EVENT_SINK_BLOCK;
+                break;
+            case 'z':
+                sink_compressed = 1;
+                break;
+            case 'Z':
+                log_max_file_mb = strtoull( optarg, NULL, 10 );
+                break;
+            case 'I':
+                log_max_file_seconds = strtoul( optarg, NULL, 10 );
+                break;
+            case 'F':
+                output_flow_records = 1;
+                break;
+            case 't':
+                active_timeout_seconds = strtoul( optarg, NULL, 10 );
+                break;
+            case 'x': {
+                /* a port is only split off host names and IPv4 addresses */
+                char * const colon = strchr( optarg, ':' );
+
+                ipfix_host = optarg;
+                if ( colon != NULL && strchr( colon + 1, ':' ) == NULL ) {
+                    *colon = '\0';
+                    ipfix_port = atoi( colon + 1 );
+                }
+                break;
+            }
+            case 'A': {
+                u32 a;
+
+                for ( a = 0; a < PACE2_APPLICATIONS_COUNT; a++ ) {
+                    if ( strcasecmp( optarg, app_str[a] ) == 0 ) {
+                        break;
+                    }
+                }
+                if ( a == PACE2_APPLICATIONS_COUNT ) {
+                    fprintf( stderr, "Unknown application %s\n", optarg );
+                    exit( 1 );
+                }
+                if ( output_application_count < PACE2_EVENT_SUBSCRIPTION_MAX_APPLICATIONS ) {
+                    output_applications[output_application_count++] = a;
+                }
+                break;
+            }
             case 'h':
                 print_help_and_exit();
                 break;
@@ -414,6 +939,14 @@ int main( int argc, char **argv )
         print_help_and_exit();
     }
 
+    /* the binary event log and the event store have no record for flows */
+    if ( output_flow_records && ( sink_format == PACE2_EVENT_SINK_BINARY || sink_format == PACE2_EVENT_SINK_STORE ) ) {
+        fprintf( stderr, "-F needs the text or the JSON output, not -b or -E\n" );
+        exit( 1 );
+    }
+
+    signal( SIGUSR1, toggle_output_handler );
+
     /* Initialize PACE 2 */
     pace2_netfilter_initialize( &content.netfilter, stage1_and_2, &content );
     pace_configure_and_initialize( &content, license_file );
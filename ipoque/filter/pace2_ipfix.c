@@ -0,0 +1,494 @@
+/*
+ * pace2_ipfix.c
+ *
+ * IPFIX exporter of the flow records, see pace2_ipfix.h.
+ */
+
+#include "pace2_ipfix.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+/* room for the IPv6 and the UDP header */
+#define PACE2_IPFIX_IP_UDP_OVERHEAD 48
+/* smallest message which holds the headers, both templates and a record */
+#define PACE2_IPFIX_MIN_MESSAGE_SIZE 512
+
+enum pace2_ipfix_scope {
+    PACE2_IPFIX_IANA = 0,
+    PACE2_IPFIX_REVERSE,
+    PACE2_IPFIX_ENTERPRISE
+};
+
+struct pace2_ipfix_field {
+    u16 id;
+    u16 length;
+    enum pace2_ipfix_scope scope;
+};
+
+/* order of the fields in the templates and in pace2_ipfix_put_record */
+#define PACE2_IPFIX_COMMON_FIELDS \
+    { PACE2_IPFIX_IE_SOURCE_TRANSPORT_PORT, 2, PACE2_IPFIX_IANA }, \
+    { PACE2_IPFIX_IE_DESTINATION_TRANSPORT_PORT, 2, PACE2_IPFIX_IANA }, \
+    { PACE2_IPFIX_IE_PROTOCOL_IDENTIFIER, 1, PACE2_IPFIX_IANA }, \
+    { PACE2_IPFIX_IE_FLOW_START_MILLISECONDS, 8, PACE2_IPFIX_IANA }, \
+    { PACE2_IPFIX_IE_FLOW_END_MILLISECONDS, 8, PACE2_IPFIX_IANA }, \
+    { PACE2_IPFIX_IE_OCTET_DELTA_COUNT, 8, PACE2_IPFIX_IANA }, \
+    { PACE2_IPFIX_IE_PACKET_DELTA_COUNT, 8, PACE2_IPFIX_IANA }, \
+    { PACE2_IPFIX_IE_OCTET_DELTA_COUNT, 8, PACE2_IPFIX_REVERSE }, \
+    { PACE2_IPFIX_IE_PACKET_DELTA_COUNT, 8, PACE2_IPFIX_REVERSE }, \
+    { PACE2_IPFIX_IE_FLOW_END_REASON, 1, PACE2_IPFIX_IANA }, \
+    { PACE2_IPFIX_IE_PROTOCOL_STACK_LENGTH, 1, PACE2_IPFIX_ENTERPRISE }, \
+    { PACE2_IPFIX_IE_PROTOCOL_STACK, 2 * PACE2_PROTOCOL_STACK_MAX_DEPTH, PACE2_IPFIX_ENTERPRISE }, \
+    { PACE2_IPFIX_IE_APPLICATION, 2, PACE2_IPFIX_ENTERPRISE }, \
+    { PACE2_IPFIX_IE_ATTRIBUTE_COUNT, 1, PACE2_IPFIX_ENTERPRISE }, \
+    { PACE2_IPFIX_IE_ATTRIBUTES, 2 * PACE2_FLOW_RECORD_MAX_ATTRIBUTES, PACE2_IPFIX_ENTERPRISE }
+
+static const struct pace2_ipfix_field pace2_ipfix_ipv4_fields[] = {
+    { PACE2_IPFIX_IE_SOURCE_IPV4_ADDRESS, 4, PACE2_IPFIX_IANA },
+    { PACE2_IPFIX_IE_DESTINATION_IPV4_ADDRESS, 4, PACE2_IPFIX_IANA },
+    PACE2_IPFIX_COMMON_FIELDS
+};
+
+static const struct pace2_ipfix_field pace2_ipfix_ipv6_fields[] = {
+    { PACE2_IPFIX_IE_SOURCE_IPV6_ADDRESS, 16, PACE2_IPFIX_IANA },
+    { PACE2_IPFIX_IE_DESTINATION_IPV6_ADDRESS, 16, PACE2_IPFIX_IANA },
+    PACE2_IPFIX_COMMON_FIELDS
+};
+
+#define PACE2_IPFIX_FIELD_COUNT(fields) (sizeof(fields) / sizeof((fields)[0]))
+
+static u32 pace2_ipfix_record_length(const struct pace2_ipfix_field *fields, u32 count)
+{
+    u32 length = 0;
+    u32 i;
+
+    for (i = 0; i < count; i++) {
+        length += fields[i].length;
+    }
+
+    return length;
+}
+
+static u64 pace2_ipfix_now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (u64)ts.tv_sec * 1000 + (u64)ts.tv_nsec / 1000000;
+}
+
+/* big endian writers */
+static u8 *pace2_ipfix_put_u8(u8 *p, u8 value)
+{
+    *p = value;
+    return p + 1;
+}
+
+static u8 *pace2_ipfix_put_u16(u8 *p, u16 value)
+{
+    p[0] = value >> 8;
+    p[1] = value;
+    return p + 2;
+}
+
+static u8 *pace2_ipfix_put_u32(u8 *p, u32 value)
+{
+    p = pace2_ipfix_put_u16(p, value >> 16);
+    return pace2_ipfix_put_u16(p, value);
+}
+
+static u8 *pace2_ipfix_put_u64(u8 *p, u64 value)
+{
+    p = pace2_ipfix_put_u32(p, value >> 32);
+    return pace2_ipfix_put_u32(p, value);
+}
+
+static u8 *pace2_ipfix_put_template(const struct pace2_ipfix_exporter *exporter, u8 *p, u16 template_id,
+                                    const struct pace2_ipfix_field *fields, u32 count)
+{
+    u32 i;
+
+    p = pace2_ipfix_put_u16(p, template_id);
+    p = pace2_ipfix_put_u16(p, count);
+
+    for (i = 0; i < count; i++) {
+        if (PACE2_IPFIX_IANA == fields[i].scope) {
+            p = pace2_ipfix_put_u16(p, fields[i].id);
+            p = pace2_ipfix_put_u16(p, fields[i].length);
+        } else {
+            p = pace2_ipfix_put_u16(p, fields[i].id | PACE2_IPFIX_ENTERPRISE_BIT);
+            p = pace2_ipfix_put_u16(p, fields[i].length);
+            p = pace2_ipfix_put_u32(p, PACE2_IPFIX_REVERSE == fields[i].scope ?
+                                       PACE2_IPFIX_REVERSE_ENTERPRISE_NUMBER : exporter->config.enterprise_number);
+        }
+    }
+
+    return p;
+}
+
+static u64 pace2_ipfix_ms(const struct pace2_ipfix_exporter *exporter, PACE2_timestamp ts)
+{
+    return ts * 1000 / exporter->config.ticks_per_second;
+}
+
+/* flowEndReason of a record: the removal reason of PACE 2 for the last record of a flow */
+static u8 pace2_ipfix_end_reason(const struct pace2_ipfix_queue_entry *entry)
+{
+    if (PACE2_FLOW_RECORD_ACTIVE_TIMEOUT == entry->reason) {
+        return PACE2_IPFIX_END_ACTIVE_TIMEOUT;
+    }
+
+    switch (entry->record.removal_reason) {
+        case PHT_TIMEOUT:
+            return PACE2_IPFIX_END_IDLE_TIMEOUT;
+        case PHT_DELETED:
+            return PACE2_IPFIX_END_OF_FLOW;
+        default:
+            /* pushed out of a full table or still active at exit */
+            return PACE2_IPFIX_END_FORCED;
+    }
+}
+
+/* writes a data record in the field order of the templates */
+static u8 *pace2_ipfix_put_record(const struct pace2_ipfix_exporter *exporter, u8 *p,
+                                  const struct pace2_ipfix_queue_entry *entry)
+{
+    const struct pace2_flow_record * const record = &entry->record;
+    u32 i;
+
+    if (record->src.is_ip_v6) {
+        memcpy(p, &record->src.address.ipv6, 16);
+        memcpy(p + 16, &record->dst.address.ipv6, 16);
+        p += 32;
+    } else {
+        /* the addresses are stored in network byte order already */
+        memcpy(p, &record->src.address.ipv4, 4);
+        memcpy(p + 4, &record->dst.address.ipv4, 4);
+        p += 8;
+    }
+
+    p = pace2_ipfix_put_u16(p, record->src_port);
+    p = pace2_ipfix_put_u16(p, record->dst_port);
+    p = pace2_ipfix_put_u8(p, record->l4_protocol);
+    p = pace2_ipfix_put_u64(p, pace2_ipfix_ms(exporter, record->first_ts));
+    p = pace2_ipfix_put_u64(p, pace2_ipfix_ms(exporter, record->last_ts));
+    p = pace2_ipfix_put_u64(p, record->bytes[0]);
+    p = pace2_ipfix_put_u64(p, record->packets[0]);
+    p = pace2_ipfix_put_u64(p, record->bytes[1]);
+    p = pace2_ipfix_put_u64(p, record->packets[1]);
+    p = pace2_ipfix_put_u8(p, pace2_ipfix_end_reason(entry));
+
+    p = pace2_ipfix_put_u8(p, record->protocol_stack_length);
+    for (i = 0; i < PACE2_PROTOCOL_STACK_MAX_DEPTH; i++) {
+        p = pace2_ipfix_put_u16(p, i < record->protocol_stack_length ? record->protocol_stack[i] : 0);
+    }
+    p = pace2_ipfix_put_u16(p, record->classified ? record->application : 0);
+    p = pace2_ipfix_put_u8(p, record->attribute_count);
+    for (i = 0; i < PACE2_FLOW_RECORD_MAX_ATTRIBUTES; i++) {
+        p = pace2_ipfix_put_u16(p, i < record->attribute_count ? record->attributes[i] : 0);
+    }
+
+    return p;
+}
+
+static void pace2_ipfix_close_set(struct pace2_ipfix_exporter *exporter)
+{
+    if (0 == exporter->set_offset) {
+        return;
+    }
+
+    pace2_ipfix_put_u16(exporter->message + exporter->set_offset + 2, exporter->message_length - exporter->set_offset);
+    exporter->set_offset = 0;
+    exporter->set_template = 0;
+}
+
+static void pace2_ipfix_send_message(struct pace2_ipfix_exporter *exporter)
+{
+    u8 *p = exporter->message;
+
+    if (0 == exporter->message_length) {
+        return;
+    }
+
+    pace2_ipfix_close_set(exporter);
+
+    p = pace2_ipfix_put_u16(p, PACE2_IPFIX_VERSION);
+    p = pace2_ipfix_put_u16(p, exporter->message_length);
+    p = pace2_ipfix_put_u32(p, (u32)time(NULL));
+    p = pace2_ipfix_put_u32(p, exporter->sequence);
+    pace2_ipfix_put_u32(p, exporter->config.observation_domain);
+
+    if (send(exporter->fd, exporter->message, exporter->message_length, 0) != (ssize_t)exporter->message_length) {
+        exporter->send_errors++;
+    } else {
+        exporter->messages++;
+        exporter->bytes += exporter->message_length;
+    }
+
+    /* records of a lost message count nonetheless, the collector sees the gap */
+    exporter->sequence += exporter->message_records;
+    exporter->records += exporter->message_records;
+
+    exporter->message_length = 0;
+    exporter->message_records = 0;
+}
+
+/* starts a message, with the template set first if the refresh interval expired */
+static void pace2_ipfix_begin_message(struct pace2_ipfix_exporter *exporter, u64 now)
+{
+    exporter->message_length = PACE2_IPFIX_MESSAGE_HEADER_LENGTH;
+    exporter->message_records = 0;
+    exporter->message_start_ms = now;
+
+    if (now >= exporter->next_template_ms) {
+        u8 * const set = exporter->message + exporter->message_length;
+        u8 *p = set + PACE2_IPFIX_SET_HEADER_LENGTH;
+
+        p = pace2_ipfix_put_template(exporter, p, PACE2_IPFIX_TEMPLATE_IPV4, pace2_ipfix_ipv4_fields,
+                                     PACE2_IPFIX_FIELD_COUNT(pace2_ipfix_ipv4_fields));
+        p = pace2_ipfix_put_template(exporter, p, PACE2_IPFIX_TEMPLATE_IPV6, pace2_ipfix_ipv6_fields,
+                                     PACE2_IPFIX_FIELD_COUNT(pace2_ipfix_ipv6_fields));
+
+        pace2_ipfix_put_u16(set, PACE2_IPFIX_TEMPLATE_SET_ID);
+        pace2_ipfix_put_u16(set + 2, p - set);
+        exporter->message_length += p - set;
+
+        exporter->next_template_ms = now + (u64)exporter->config.template_refresh * 1000;
+        exporter->template_messages++;
+    }
+}
+
+static void pace2_ipfix_add_record(struct pace2_ipfix_exporter *exporter, const struct pace2_ipfix_queue_entry *entry,
+                                   u64 now)
+{
+    const u16 template_id = entry->record.src.is_ip_v6 ? PACE2_IPFIX_TEMPLATE_IPV6 : PACE2_IPFIX_TEMPLATE_IPV4;
+    const u32 length = entry->record.src.is_ip_v6 ?
+        pace2_ipfix_record_length(pace2_ipfix_ipv6_fields, PACE2_IPFIX_FIELD_COUNT(pace2_ipfix_ipv6_fields)) :
+        pace2_ipfix_record_length(pace2_ipfix_ipv4_fields, PACE2_IPFIX_FIELD_COUNT(pace2_ipfix_ipv4_fields));
+    const u32 set_header = exporter->set_template == template_id ? 0 : PACE2_IPFIX_SET_HEADER_LENGTH;
+
+    if (exporter->message_length != 0 && exporter->message_length + set_header + length > exporter->message_size) {
+        pace2_ipfix_send_message(exporter);
+    }
+
+    if (0 == exporter->message_length) {
+        pace2_ipfix_begin_message(exporter, now);
+    }
+
+    if (exporter->set_template != template_id) {
+        pace2_ipfix_close_set(exporter);
+
+        exporter->set_offset = exporter->message_length;
+        exporter->set_template = template_id;
+        pace2_ipfix_put_u16(exporter->message + exporter->message_length, template_id);
+        exporter->message_length += PACE2_IPFIX_SET_HEADER_LENGTH;
+    }
+
+    pace2_ipfix_put_record(exporter, exporter->message + exporter->message_length, entry);
+    exporter->message_length += length;
+    exporter->message_records++;
+}
+
+static void *pace2_ipfix_thread(void *arg)
+{
+    struct pace2_ipfix_exporter * const exporter = arg;
+
+    for (;;) {
+        const u8 running = exporter->running;
+        const u32 head = exporter->head;
+        u32 tail = exporter->tail;
+        const u32 drained = head - tail;
+        u64 now;
+
+        __sync_synchronize();
+
+        now = pace2_ipfix_now_ms();
+        while (tail != head) {
+            pace2_ipfix_add_record(exporter, &exporter->queue[tail & exporter->mask], now);
+            tail++;
+        }
+
+        /* the records have to be copied before the producer may reuse their entries */
+        __sync_synchronize();
+        exporter->tail = tail;
+
+        if (exporter->message_records > 0 &&
+            (!running || now - exporter->message_start_ms >= exporter->config.flush_ms)) {
+            pace2_ipfix_send_message(exporter);
+        }
+
+        if (!running) {
+            break;
+        }
+
+        if (0 == drained) {
+            struct timespec ts;
+
+            ts.tv_sec = 0;
+            ts.tv_nsec = (exporter->config.flush_ms < 10 ? exporter->config.flush_ms : 10) * 1000000L;
+            nanosleep(&ts, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+/* opens a UDP socket connected to the collector */
+static int pace2_ipfix_connect(const char *host, u16 port)
+{
+    struct addrinfo hints;
+    struct addrinfo *result;
+    struct addrinfo *ai;
+    char service[8];
+    int fd = -1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    snprintf(service, sizeof(service), "%u", port);
+
+    if (getaddrinfo(host, service, &hints, &result) != 0) {
+        return -1;
+    }
+
+    for (ai = result; ai != NULL; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+
+    freeaddrinfo(result);
+
+    return fd;
+}
+
+void pace2_ipfix_init_default_config(struct pace2_ipfix_config *config, const char *host, u32 ticks_per_second)
+{
+    memset(config, 0, sizeof(*config));
+
+    config->host = host;
+    config->port = PACE2_IPFIX_DEFAULT_PORT;
+    config->mtu = PACE2_IPFIX_DEFAULT_MTU;
+    config->queue_size = PACE2_IPFIX_DEFAULT_QUEUE_SIZE;
+    config->enterprise_number = PACE2_IPFIX_DEFAULT_ENTERPRISE_NUMBER;
+    config->template_refresh = PACE2_IPFIX_DEFAULT_TEMPLATE_REFRESH;
+    config->flush_ms = PACE2_IPFIX_DEFAULT_FLUSH_MS;
+    config->ticks_per_second = ticks_per_second;
+}
+
+u8 pace2_ipfix_create(struct pace2_ipfix_exporter *exporter, const struct pace2_ipfix_config *config)
+{
+    u32 size = 1;
+
+    memset(exporter, 0, sizeof(*exporter));
+    exporter->fd = -1;
+
+    if (NULL == config->host || 0 == config->ticks_per_second ||
+        config->mtu < PACE2_IPFIX_MIN_MESSAGE_SIZE + PACE2_IPFIX_IP_UDP_OVERHEAD) {
+        return 1;
+    }
+
+    exporter->config = *config;
+    exporter->message_size = config->mtu - PACE2_IPFIX_IP_UDP_OVERHEAD;
+    if (exporter->message_size > 0xffff) {
+        exporter->message_size = 0xffff;
+    }
+
+    while (size < config->queue_size) {
+        size <<= 1;
+    }
+    exporter->mask = size - 1;
+
+    exporter->queue = malloc(size * sizeof(*exporter->queue));
+    exporter->message = malloc(exporter->message_size);
+    if (NULL == exporter->queue || NULL == exporter->message) {
+        pace2_ipfix_destroy(exporter);
+        return 1;
+    }
+
+    exporter->fd = pace2_ipfix_connect(config->host, config->port);
+    if (exporter->fd < 0) {
+        pace2_ipfix_destroy(exporter);
+        return 1;
+    }
+
+    exporter->running = 1;
+    if (pthread_create(&exporter->thread, NULL, pace2_ipfix_thread, exporter) != 0) {
+        exporter->running = 0;
+        pace2_ipfix_destroy(exporter);
+        return 1;
+    }
+
+    return 0;
+}
+
+void pace2_ipfix_destroy(struct pace2_ipfix_exporter *exporter)
+{
+    if (exporter->running) {
+        /* the thread sends the queued records once more before it stops */
+        __sync_synchronize();
+        exporter->running = 0;
+        pthread_join(exporter->thread, NULL);
+    }
+
+    if (exporter->fd >= 0) {
+        close(exporter->fd);
+        exporter->fd = -1;
+    }
+
+    free(exporter->queue);
+    exporter->queue = NULL;
+    free(exporter->message);
+    exporter->message = NULL;
+}
+
+u8 pace2_ipfix_export(struct pace2_ipfix_exporter *exporter, const struct pace2_flow_record *record,
+                      enum pace2_flow_record_reason reason)
+{
+    const u32 head = exporter->head;
+    struct pace2_ipfix_queue_entry *entry;
+
+    if (head - exporter->cached_tail > exporter->mask) {
+        /* looks full, fetch the real tail of the exporter thread */
+        exporter->cached_tail = exporter->tail;
+        __sync_synchronize();
+
+        if (head - exporter->cached_tail > exporter->mask) {
+            exporter->drops++;
+            return 1;
+        }
+    }
+
+    entry = &exporter->queue[head & exporter->mask];
+    entry->record = *record;
+    entry->reason = reason;
+
+    /* the entry has to be complete before the exporter thread sees the new head */
+    __sync_synchronize();
+    exporter->head = head + 1;
+    exporter->queued++;
+
+    return 0;
+}
+
+void pace2_ipfix_print_stats(const struct pace2_ipfix_exporter *exporter, FILE *f)
+{
+    fprintf(f, "IPFIX export to %s:%u: %llu records queued, %llu dropped, %llu exported in %llu messages (%llu bytes, %llu with templates), %llu send errors\n\n",
+            exporter->config.host, exporter->config.port,
+            (unsigned long long)exporter->queued, (unsigned long long)exporter->drops,
+            (unsigned long long)exporter->records, (unsigned long long)exporter->messages,
+            (unsigned long long)exporter->bytes, (unsigned long long)exporter->template_messages,
+            (unsigned long long)exporter->send_errors);
+}
@@ -0,0 +1,185 @@
+/*
+ * pace2_ipfix.h
+ *
+ * IPFIX (RFC 7011) export of the flow records over UDP. The packet thread
+ * only copies a record into a single producer queue; the exporter thread
+ * encodes the records as data records, packs them into messages of at most
+ * one MTU and sends them to the collector.
+ *
+ * Two templates describe the records, one for IPv4 and one for IPv6 flows:
+ * the 5-tuple, flow start and end, packets and bytes of both directions
+ * (reverse counters of RFC 5103), the flow end reason and the PACE 2
+ * classification as enterprise specific elements. The templates are sent
+ * in the first message and again every template refresh interval, as UDP
+ * requires. The sequence number of a message counts the data records sent
+ * before it.
+ */
+
+#ifndef PACE2_IPFIX_H
+#define PACE2_IPFIX_H
+
+#include <stdio.h>
+#include <pthread.h>
+#include <pace2.h>
+
+#include "pace2_flow_record.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PACE2_IPFIX_VERSION 10
+#define PACE2_IPFIX_DEFAULT_PORT 4739
+#define PACE2_IPFIX_DEFAULT_MTU 1500
+#define PACE2_IPFIX_DEFAULT_QUEUE_SIZE 4096
+#define PACE2_IPFIX_DEFAULT_TEMPLATE_REFRESH 60
+#define PACE2_IPFIX_DEFAULT_FLUSH_MS 1000
+
+/* example enterprise number of RFC 5612, set the own one for production */
+#define PACE2_IPFIX_DEFAULT_ENTERPRISE_NUMBER 32473
+/* enterprise number of the reverse information elements, RFC 5103 */
+#define PACE2_IPFIX_REVERSE_ENTERPRISE_NUMBER 29305
+
+#define PACE2_IPFIX_MESSAGE_HEADER_LENGTH 16
+#define PACE2_IPFIX_SET_HEADER_LENGTH 4
+#define PACE2_IPFIX_TEMPLATE_SET_ID 2
+#define PACE2_IPFIX_TEMPLATE_IPV4 256
+#define PACE2_IPFIX_TEMPLATE_IPV6 257
+#define PACE2_IPFIX_ENTERPRISE_BIT 0x8000
+
+/* IANA information elements */
+#define PACE2_IPFIX_IE_OCTET_DELTA_COUNT 1
+#define PACE2_IPFIX_IE_PACKET_DELTA_COUNT 2
+#define PACE2_IPFIX_IE_PROTOCOL_IDENTIFIER 4
+#define PACE2_IPFIX_IE_SOURCE_TRANSPORT_PORT 7
+#define PACE2_IPFIX_IE_SOURCE_IPV4_ADDRESS 8
+#define PACE2_IPFIX_IE_DESTINATION_TRANSPORT_PORT 11
+#define PACE2_IPFIX_IE_DESTINATION_IPV4_ADDRESS 12
+#define PACE2_IPFIX_IE_SOURCE_IPV6_ADDRESS 27
+#define PACE2_IPFIX_IE_DESTINATION_IPV6_ADDRESS 28
+#define PACE2_IPFIX_IE_FLOW_END_REASON 136
+#define PACE2_IPFIX_IE_FLOW_START_MILLISECONDS 152
+#define PACE2_IPFIX_IE_FLOW_END_MILLISECONDS 153
+
+/* enterprise specific information elements of the PACE 2 classification */
+#define PACE2_IPFIX_IE_PROTOCOL_STACK_LENGTH 1
+/* PACE2_PROTOCOL_STACK_MAX_DEPTH protocols of 2 bytes, unused entries are 0 */
+#define PACE2_IPFIX_IE_PROTOCOL_STACK 2
+#define PACE2_IPFIX_IE_APPLICATION 3
+#define PACE2_IPFIX_IE_ATTRIBUTE_COUNT 4
+/* PACE2_FLOW_RECORD_MAX_ATTRIBUTES attributes of 2 bytes, unused entries are 0 */
+#define PACE2_IPFIX_IE_ATTRIBUTES 5
+
+/* flowEndReason values */
+#define PACE2_IPFIX_END_IDLE_TIMEOUT 0x01
+#define PACE2_IPFIX_END_ACTIVE_TIMEOUT 0x02
+#define PACE2_IPFIX_END_OF_FLOW 0x03
+#define PACE2_IPFIX_END_FORCED 0x04
+
+struct pace2_ipfix_config {
+    /* collector, host name or address */
+    const char *host;
+    u16 port;
+    /* largest IP packet, messages leave room for an IPv6 and a UDP header */
+    u32 mtu;
+    /* records waiting for the exporter thread, rounded up to a power of two */
+    u32 queue_size;
+    u32 observation_domain;
+    u32 enterprise_number;
+    /* seconds between two transmissions of the templates */
+    u32 template_refresh;
+    /* longest time a record waits in a message which is not full */
+    u32 flush_ms;
+    /* clock ticks per second of the record timestamps */
+    u32 ticks_per_second;
+};
+
+struct pace2_ipfix_queue_entry {
+    struct pace2_flow_record record;
+    enum pace2_flow_record_reason reason;
+};
+
+struct pace2_ipfix_exporter {
+    struct pace2_ipfix_config config;
+    int fd;
+
+    /* single producer queue of the packet thread */
+    struct pace2_ipfix_queue_entry *queue;
+    u32 mask;
+
+    /* written by the producer only */
+    volatile u32 head __attribute__((aligned(64)));
+    u32 cached_tail;
+    u64 queued;
+    u64 drops;
+
+    /* written by the exporter thread only */
+    volatile u32 tail __attribute__((aligned(64)));
+
+    pthread_t thread;
+    volatile u8 running;
+
+    /* message in construction, owned by the exporter thread */
+    u8 *message;
+    u32 message_size;
+    u32 message_length;
+    u32 message_records;
+    /* offset of the open data set and its template, 0 if none */
+    u32 set_offset;
+    u16 set_template;
+    u64 message_start_ms;
+    u64 next_template_ms;
+    u32 sequence;
+
+    /* statistics of the exporter thread */
+    u64 records;
+    u64 messages;
+    u64 template_messages;
+    u64 bytes;
+    u64 send_errors;
+};
+
+/**
+ * fills a configuration with default values
+ * @param config configuration to initialize
+ * @param host collector
+ * @param ticks_per_second clock ticks per second of the record timestamps
+ */
+void pace2_ipfix_init_default_config(struct pace2_ipfix_config *config, const char *host, u32 ticks_per_second);
+
+/**
+ * opens the socket to the collector and starts the exporter thread
+ * @param exporter exporter to initialize
+ * @param config configuration
+ * @return 0 on success; !=0 on error
+ */
+u8 pace2_ipfix_create(struct pace2_ipfix_exporter *exporter, const struct pace2_ipfix_config *config);
+
+/**
+ * sends the queued records, stops the exporter thread and frees the exporter
+ * @param exporter exporter
+ */
+void pace2_ipfix_destroy(struct pace2_ipfix_exporter *exporter);
+
+/**
+ * queues a record for the export, called by the packet thread only; usable as part of a pace2_flow_record_handler
+ * @param exporter exporter
+ * @param record flow record
+ * @param reason why the record was emitted
+ * @return 0 if queued; 1 if dropped because the queue is full
+ */
+u8 pace2_ipfix_export(struct pace2_ipfix_exporter *exporter, const struct pace2_flow_record *record,
+                      enum pace2_flow_record_reason reason);
+
+/**
+ * prints the counters of the queue and of the exporter thread
+ * @param exporter exporter
+ * @param f output
+ */
+void pace2_ipfix_print_stats(const struct pace2_ipfix_exporter *exporter, FILE *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PACE2_IPFIX_H */
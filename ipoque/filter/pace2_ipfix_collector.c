@@ -0,0 +1,392 @@
+/********************************************************************************/
+/**
+ ** \file       pace2_ipfix_collector.c
+ ** \brief      Minimal IPFIX collector for the export of pace2_integration_example.
+ **
+ ** The tool receives IPFIX messages over UDP and checks them strictly: the
+ ** message and set lengths, the templates, the data records against their
+ ** template, the set padding and the sequence numbers. The decoded records
+ ** are printed unless -q is given. It stops after -c messages or on SIGINT
+ ** and exits with 1 if any message was malformed or records were lost.
+ **/
+/********************************************************************************/
+
+#include <pace2.h>
+#include "pace2_ipfix.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <getopt.h>
+
+#define MAX_TEMPLATES 16
+#define MAX_FIELDS 64
+
+struct template_field {
+    u16 id;
+    u16 length;
+    u32 enterprise;
+};
+
+struct template {
+    u16 id;
+    u16 field_count;
+    u32 record_length;
+    struct template_field fields[MAX_FIELDS];
+};
+
+static struct template templates[MAX_TEMPLATES];
+static u32 template_count = 0;
+
+static volatile sig_atomic_t running = 1;
+static int quiet = 0;
+
+static u64 messages = 0;
+static u64 records = 0;
+static u64 errors = 0;
+static u64 lost_records = 0;
+static u8 have_sequence = 0;
+static u32 expected_sequence = 0;
+
+static void stop( int signum )
+{
+    (void)signum;
+    running = 0;
+}
+
+static u16 get_u16( const u8 *p )
+{
+    return (u16)( p[0] << 8 | p[1] );
+}
+
+static u32 get_u32( const u8 *p )
+{
+    return (u32)get_u16( p ) << 16 | get_u16( p + 2 );
+}
+
+static u64 get_u64( const u8 *p )
+{
+    return (u64)get_u32( p ) << 32 | get_u32( p + 4 );
+}
+
+static void error( const char * const msg, u32 value )
+{
+    fprintf( stderr, "message %llu: %s (%u)\n", messages, msg, value );
+    errors++;
+}
+
+static struct template *find_template( u16 id )
+{
+    u32 t;
+
+    for ( t = 0; t < template_count; t++ ) {
+        if ( templates[t].id == id ) {
+            return &templates[t];
+        }
+    }
+
+    return NULL;
+}
+
+/* stores the templates of a template set, returns 0 if the set is malformed */
+static int parse_template_set( const u8 *p, const u8 * const end )
+{
+    while ( end - p >= 4 ) {
+        struct template tmpl;
+        struct template *stored;
+        u16 f;
+
+        memset( &tmpl, 0, sizeof( tmpl ) );
+        tmpl.id = get_u16( p );
+        tmpl.field_count = get_u16( p + 2 );
+        p += 4;
+
+        /* padding at the end of the set */
+        if ( tmpl.id == 0 && tmpl.field_count == 0 ) {
+            break;
+        }
+
+        if ( tmpl.id < 256 || tmpl.field_count == 0 || tmpl.field_count > MAX_FIELDS ) {
+            error( "invalid template", tmpl.id );
+            return 0;
+        }
+
+        for ( f = 0; f < tmpl.field_count; f++ ) {
+            struct template_field * const field = &tmpl.fields[f];
+
+            if ( end - p < 4 ) {
+                error( "truncated template", tmpl.id );
+                return 0;
+            }
+            field->id = get_u16( p );
+            field->length = get_u16( p + 2 );
+            p += 4;
+
+            if ( field->id & PACE2_IPFIX_ENTERPRISE_BIT ) {
+                if ( end - p < 4 ) {
+                    error( "truncated template", tmpl.id );
+                    return 0;
+                }
+                field->id &= ~PACE2_IPFIX_ENTERPRISE_BIT;
+                field->enterprise = get_u32( p );
+                p += 4;
+            }
+
+            if ( field->length == 0xffff ) {
+                error( "variable length fields are not supported", field->id );
+                return 0;
+            }
+            tmpl.record_length += field->length;
+        }
+
+        stored = find_template( tmpl.id );
+        if ( stored == NULL ) {
+            if ( template_count == MAX_TEMPLATES ) {
+                error( "too many templates", tmpl.id );
+                return 0;
+            }
+            stored = &templates[template_count++];
+        }
+        *stored = tmpl;
+    }
+
+    return 1;
+}
+
+static void print_field( const struct template_field * const field, const u8 * const value )
+{
+    char address[INET6_ADDRSTRLEN];
+    u16 i;
+
+    if ( field->enterprise == 0 && ( field->id == PACE2_IPFIX_IE_SOURCE_IPV4_ADDRESS ||
+                                     field->id == PACE2_IPFIX_IE_DESTINATION_IPV4_ADDRESS ) ) {
+        printf( " %s=%s", field->id == PACE2_IPFIX_IE_SOURCE_IPV4_ADDRESS ? "src" : "dst",
+                inet_ntop( AF_INET, value, address, sizeof( address ) ) );
+        return;
+    }
+    if ( field->enterprise == 0 && ( field->id == PACE2_IPFIX_IE_SOURCE_IPV6_ADDRESS ||
+                                     field->id == PACE2_IPFIX_IE_DESTINATION_IPV6_ADDRESS ) ) {
+        printf( " %s=%s", field->id == PACE2_IPFIX_IE_SOURCE_IPV6_ADDRESS ? "src" : "dst",
+                inet_ntop( AF_INET6, value, address, sizeof( address ) ) );
+        return;
+    }
+
+    if ( field->enterprise == 0 ) {
+        printf( " %u=", field->id );
+    } else {
+        printf( " %u/%u=", field->enterprise, field->id );
+    }
+
+    /* the protocol stack and the attributes are arrays of 2 byte values */
+    if ( field->enterprise != 0 && field->enterprise != PACE2_IPFIX_REVERSE_ENTERPRISE_NUMBER &&
+         ( field->id == PACE2_IPFIX_IE_PROTOCOL_STACK || field->id == PACE2_IPFIX_IE_ATTRIBUTES ) ) {
+        for ( i = 0; i + 1 < field->length; i += 2 ) {
+            printf( "%s%u", i == 0 ? "" : ",", get_u16( value + i ) );
+        }
+        return;
+    }
+
+    switch ( field->length ) {
+        case 1:
+            printf( "%u", value[0] );
+            break;
+        case 2:
+            printf( "%u", get_u16( value ) );
+            break;
+        case 4:
+            printf( "%u", get_u32( value ) );
+            break;
+        case 8:
+            printf( "%llu", (unsigned long long)get_u64( value ) );
+            break;
+        default:
+            for ( i = 0; i < field->length; i++ ) {
+                printf( "%02x", value[i] );
+            }
+            break;
+    }
+}
+
+/* decodes the records of a data set, returns the number of records; -1 if the set is malformed */
+static int parse_data_set( u16 set_id, const u8 *p, const u8 * const end )
+{
+    const struct template * const tmpl = find_template( set_id );
+    int count = 0;
+
+    if ( tmpl == NULL ) {
+        error( "data set without template", set_id );
+        return -1;
+    }
+
+    while ( (u32)( end - p ) >= tmpl->record_length ) {
+        u16 f;
+
+        if ( !quiet ) {
+            printf( "template %u:", tmpl->id );
+        }
+        for ( f = 0; f < tmpl->field_count; f++ ) {
+            if ( !quiet ) {
+                print_field( &tmpl->fields[f], p );
+            }
+            p += tmpl->fields[f].length;
+        }
+        if ( !quiet ) {
+            printf( "\n" );
+        }
+        count++;
+    }
+
+    /* the rest can only be padding */
+    while ( p < end ) {
+        if ( *p++ != 0 ) {
+            error( "data set with trailing bytes", set_id );
+            return -1;
+        }
+    }
+
+    return count;
+}
+
+static void parse_message( const u8 * const message, u32 length )
+{
+    const u8 *p = message + PACE2_IPFIX_MESSAGE_HEADER_LENGTH;
+    const u8 * const end = message + length;
+    u32 sequence;
+    u32 message_records = 0;
+
+    messages++;
+
+    if ( length < PACE2_IPFIX_MESSAGE_HEADER_LENGTH ) {
+        error( "message shorter than its header", length );
+        return;
+    }
+    if ( get_u16( message ) != PACE2_IPFIX_VERSION ) {
+        error( "wrong version", get_u16( message ) );
+        return;
+    }
+    if ( get_u16( message + 2 ) != length ) {
+        error( "message length differs from the datagram", get_u16( message + 2 ) );
+        return;
+    }
+
+    sequence = get_u32( message + 8 );
+    if ( have_sequence && sequence != expected_sequence ) {
+        error( "unexpected sequence number", sequence );
+        lost_records += sequence - expected_sequence;
+    }
+
+    while ( p < end ) {
+        u16 set_id;
+        u16 set_length;
+
+        if ( end - p < PACE2_IPFIX_SET_HEADER_LENGTH ) {
+            error( "truncated set header", (u32)( p - message ) );
+            return;
+        }
+        set_id = get_u16( p );
+        set_length = get_u16( p + 2 );
+        if ( set_length < PACE2_IPFIX_SET_HEADER_LENGTH || set_length > end - p ) {
+            error( "invalid set length", set_length );
+            return;
+        }
+
+        if ( set_id == PACE2_IPFIX_TEMPLATE_SET_ID ) {
+            if ( !parse_template_set( p + PACE2_IPFIX_SET_HEADER_LENGTH, p + set_length ) ) {
+                return;
+            }
+        } else if ( set_id >= 256 ) {
+            const int count = parse_data_set( set_id, p + PACE2_IPFIX_SET_HEADER_LENGTH, p + set_length );
+
+            if ( count < 0 ) {
+                return;
+            }
+            message_records += count;
+        } else {
+            error( "unsupported set", set_id );
+        }
+
+        p += set_length;
+    }
+
+    records += message_records;
+    expected_sequence = sequence + message_records;
+    have_sequence = 1;
+}
+
+int main( int argc, char **argv )
+{
+    u16 port = PACE2_IPFIX_DEFAULT_PORT;
+    u64 max_messages = 0;
+    struct sockaddr_in6 addr;
+    struct sigaction action;
+    const int off = 0;
+    u8 buffer[65536];
+    int fd;
+    int c;
+
+    while ( ( c = getopt( argc, argv, "p:c:qh" ) ) != -1 ) {
+        switch ( c ) {
+            case 'p':
+                port = atoi( optarg );
+                break;
+            case 'c':
+                max_messages = strtoull( optarg, NULL, 10 );
+                break;
+            case 'q':
+                quiet = 1;
+                break;
+            default:
+                printf( "Usage: %s [-p port] [-c messages] [-q]\n\n", argv[0] );
+                printf( "  -p\tUDP port (default %u).\n", PACE2_IPFIX_DEFAULT_PORT );
+                printf( "  -c\tStop after this number of messages (default: run until SIGINT).\n" );
+                printf( "  -q\tDo not print the records, only check them.\n" );
+                return 0;
+        }
+    }
+
+    /* one IPv6 socket receives IPv4 and IPv6 exporters */
+    fd = socket( AF_INET6, SOCK_DGRAM, 0 );
+    if ( fd < 0 ) {
+        perror( "socket" );
+        return 1;
+    }
+    setsockopt( fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof( off ) );
+
+    memset( &addr, 0, sizeof( addr ) );
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_any;
+    addr.sin6_port = htons( port );
+    if ( bind( fd, (struct sockaddr *)&addr, sizeof( addr ) ) != 0 ) {
+        perror( "bind" );
+        return 1;
+    }
+
+    /* without SA_RESTART, so that the signals interrupt recv() */
+    memset( &action, 0, sizeof( action ) );
+    action.sa_handler = stop;
+    sigaction( SIGINT, &action, NULL );
+    sigaction( SIGTERM, &action, NULL );
+
+    while ( running && ( max_messages == 0 || messages < max_messages ) ) {
+        const ssize_t length = recv( fd, buffer, sizeof( buffer ), 0 );
+
+        if ( length < 0 ) {
+            continue;
+        }
+        parse_message( buffer, (u32)length );
+        fflush( stdout );
+    }
+
+    close( fd );
+
+    fprintf( stderr, "%llu messages, %llu records, %u templates, %llu lost records, %llu errors\n",
+             messages, records, template_count, lost_records, errors );
+
+    return errors > 0 ? 1 : 0;
+}
@@ -0,0 +1,192 @@
+/********************************************************************************/
+/**
+ ** \file       pace2_log_reader.c
+ ** \brief      Reads the compressed event logs of pace2_integration_example -z.
+ **
+ ** The tool reads the block index <file>.idx of every given file and
+ ** decompresses only the blocks whose records were written in the requested
+ ** time range, the others are skipped without reading them. With -l the
+ ** blocks are listed instead. Every block is checked against its index
+ ** entry; the tool exits with 1 if a file or block is damaged.
+ **/
+/********************************************************************************/
+
+#include <pace2.h>
+#include "pace2_compressed_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include <getopt.h>
+
+static int list = 0;
+static u64 from_ms = 0;
+static u64 to_ms = ~0ull;
+
+static u64 errors = 0;
+
+static void error( const char * const file, const char * const msg, u64 value )
+{
+    fprintf( stderr, "%s: %s (%llu)\n", file, msg, (unsigned long long)value );
+    errors++;
+}
+
+/* decompresses one block into buffer, returns 0 if it matches its index entry */
+static int read_block( const char * const file, FILE *f, const struct pace2_compressed_log_index_entry * const entry,
+                       u8 *compressed, u8 *buffer )
+{
+    z_stream stream;
+    int result;
+
+    if ( fseeko( f, (off_t)entry->offset, SEEK_SET ) != 0 ||
+         fread( compressed, 1, entry->compressed_length, f ) != entry->compressed_length ) {
+        error( file, "truncated block", entry->offset );
+        return 1;
+    }
+
+    memset( &stream, 0, sizeof( stream ) );
+    if ( inflateInit2( &stream, 15 + 16 ) != Z_OK ) {
+        error( file, "inflateInit2 failed", 0 );
+        return 1;
+    }
+
+    stream.next_in = compressed;
+    stream.avail_in = entry->compressed_length;
+    stream.next_out = buffer;
+    stream.avail_out = entry->length;
+    result = inflate( &stream, Z_FINISH );
+    inflateEnd( &stream );
+
+    if ( result != Z_STREAM_END || stream.avail_in != 0 || stream.avail_out != 0 ) {
+        error( file, "block does not match its index entry", entry->offset );
+        return 1;
+    }
+
+    return 0;
+}
+
+static void read_file( const char * const file )
+{
+    struct pace2_compressed_log_index_header header;
+    struct pace2_compressed_log_index_entry entry;
+    char *index_path;
+    FILE *index;
+    FILE *f;
+    u8 *compressed = NULL;
+    u8 *buffer = NULL;
+    u64 next_offset = 0;
+    u64 next_uncompressed_offset = 0;
+    u64 blocks = 0;
+    u64 selected = 0;
+
+    index_path = malloc( strlen( file ) + 5 );
+    if ( index_path == NULL ) {
+        return;
+    }
+    sprintf( index_path, "%s.idx", file );
+
+    index = fopen( index_path, "rb" );
+    f = fopen( file, "rb" );
+    if ( index == NULL || f == NULL ) {
+        error( index == NULL ? index_path : file, "cannot open", 0 );
+        goto out;
+    }
+
+    if ( fread( &header, sizeof( header ), 1, index ) != 1 ||
+         memcmp( header.magic, PACE2_COMPRESSED_LOG_INDEX_MAGIC, sizeof( header.magic ) ) != 0 ) {
+        error( index_path, "no block index", 0 );
+        goto out;
+    }
+    if ( header.version != PACE2_COMPRESSED_LOG_INDEX_VERSION ) {
+        error( index_path, "unsupported index version", header.version );
+        goto out;
+    }
+
+    compressed = malloc( compressBound( header.block_size ) + 64 );
+    buffer = malloc( header.block_size );
+    if ( compressed == NULL || buffer == NULL ) {
+        goto out;
+    }
+
+    while ( fread( &entry, sizeof( entry ), 1, index ) == 1 ) {
+        blocks++;
+
+        if ( entry.offset != next_offset || entry.uncompressed_offset != next_uncompressed_offset ||
+             entry.length > header.block_size || entry.compressed_length > compressBound( header.block_size ) + 64 ) {
+            error( index_path, "invalid index entry", blocks );
+            goto out;
+        }
+        next_offset += entry.compressed_length;
+        next_uncompressed_offset += entry.length;
+
+        /* blocks without records hold only the file header */
+        if ( entry.first_ms != 0 && ( entry.last_ms < from_ms || entry.first_ms > to_ms ) ) {
+            continue;
+        }
+        selected++;
+
+        if ( list ) {
+            printf( "%s: block %llu at %llu, %u -> %u bytes, %llu - %llu ms\n", file, (unsigned long long)blocks - 1,
+                    (unsigned long long)entry.offset, entry.compressed_length, entry.length,
+                    (unsigned long long)entry.first_ms, (unsigned long long)entry.last_ms );
+            continue;
+        }
+
+        if ( read_block( file, f, &entry, compressed, buffer ) != 0 ) {
+            goto out;
+        }
+        fwrite( buffer, 1, entry.length, stdout );
+    }
+
+    if ( list ) {
+        printf( "%s: %llu blocks, %llu selected, %llu bytes compressed, %llu bytes uncompressed\n", file,
+                (unsigned long long)blocks, (unsigned long long)selected,
+                (unsigned long long)next_offset, (unsigned long long)next_uncompressed_offset );
+    }
+
+out:
+    if ( index != NULL ) {
+        fclose( index );
+    }
+    if ( f != NULL ) {
+        fclose( f );
+    }
+    free( compressed );
+    free( buffer );
+    free( index_path );
+}
+
+int main( int argc, char **argv )
+{
+    int c;
+
+    while ( ( c = getopt( argc, argv, "lf:t:h" ) ) != -1 ) {
+        switch ( c ) {
+            case 'l':
+                list = 1;
+                break;
+            case 'f':
+                from_ms = strtoull( optarg, NULL, 10 ) * 1000;
+                break;
+            case 't':
+                to_ms = strtoull( optarg, NULL, 10 ) * 1000 + 999;
+                break;
+            default:
+                printf( "Usage: %s [-l] [-f from] [-t to] file.gz ...\n\n", argv[0] );
+                printf( "  -l\tList the blocks instead of writing their content.\n" );
+                printf( "  -f\tOnly blocks with records written at or after this time (seconds since the epoch).\n" );
+                printf( "  -t\tOnly blocks with records written at or before this time (seconds since the epoch).\n" );
+                return 0;
+        }
+    }
+
+    for ( ; optind < argc; optind++ ) {
+        read_file( argv[optind] );
+    }
+
+    fflush( stdout );
+
+    return errors > 0 ? 1 : 0;
+}
@@ -0,0 +1,254 @@
+/*
+ * pace2_shm_stats.c
+ *
+ * Named POSIX shared memory segment with the classification counters,
+ * see pace2_shm_stats.h for the layout.
+ */
+
+#include "pace2_shm_stats.h"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* keep the records cache line aligned */
+#define PACE2_SHM_STATS_ALIGN(x) (((x) + 63) & ~63u)
+
+static inline u32 pace2_shm_stats_record_index(const struct pace2_shm_stats_header *hdr,
+                                               enum pace2_shm_stats_section section, u32 index)
+{
+    return (hdr->section_offset[section] - hdr->header_size) / hdr->record_size + index;
+}
+
+static u8 pace2_shm_stats_map(struct pace2_shm_stats *stats, int prot)
+{
+    void *base = mmap(NULL, stats->size, prot, MAP_SHARED, stats->fd, 0);
+
+    if (base == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    stats->hdr = base;
+    stats->records = (struct pace2_shm_stats_record *)((u8 *)base + stats->hdr->header_size);
+    stats->bitmap = (u8 *)base + stats->hdr->bitmap_offset;
+
+    return 0;
+}
+
+u8 pace2_shm_stats_create(struct pace2_shm_stats *stats, const char *name,
+                          const u32 section_count[PACE2_SHM_STATS_NUMBER_OF_SECTIONS])
+{
+    struct pace2_shm_stats_header hdr;
+    u32 records = 0;
+    u32 s;
+
+    if (NULL == stats || NULL == name) {
+        return 1;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    memset(&hdr, 0, sizeof(hdr));
+    strncpy(stats->name, name, sizeof(stats->name) - 1);
+
+    hdr.magic = PACE2_SHM_STATS_MAGIC;
+    hdr.version_major = PACE2_SHM_STATS_VERSION_MAJOR;
+    hdr.version_minor = PACE2_SHM_STATS_VERSION_MINOR;
+    hdr.header_size = PACE2_SHM_STATS_ALIGN(sizeof(struct pace2_shm_stats_header));
+    hdr.record_size = sizeof(struct pace2_shm_stats_record);
+    hdr.writer_pid = getpid();
+
+    for (s = 0; s < PACE2_SHM_STATS_NUMBER_OF_SECTIONS; s++) {
+        hdr.section_count[s] = section_count[s];
+        hdr.section_offset[s] = hdr.header_size + records * hdr.record_size;
+        records += section_count[s];
+    }
+
+    hdr.bitmap_offset = PACE2_SHM_STATS_ALIGN(hdr.header_size + records * hdr.record_size);
+    hdr.total_size = hdr.bitmap_offset + (records + 7) / 8;
+    stats->size = hdr.total_size;
+
+    /* a segment of a previous run may still exist with a different size */
+    shm_unlink(name);
+
+    stats->fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (stats->fd < 0) {
+        perror("shm_open");
+        return 1;
+    }
+
+    if (ftruncate(stats->fd, stats->size) != 0) {
+        perror("ftruncate");
+        close(stats->fd);
+        shm_unlink(name);
+        return 1;
+    }
+
+    /* the mapping is zero filled, so only the header has to be written */
+    if (pwrite(stats->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+        pace2_shm_stats_map(stats, PROT_READ | PROT_WRITE) != 0) {
+        close(stats->fd);
+        shm_unlink(name);
+        return 1;
+    }
+
+    stats->writable = 1;
+
+    return 0;
+}
+
+u8 pace2_shm_stats_open(struct pace2_shm_stats *stats, const char *name)
+{
+    struct pace2_shm_stats_header hdr;
+
+    if (NULL == stats || NULL == name) {
+        return 1;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    strncpy(stats->name, name, sizeof(stats->name) - 1);
+
+    stats->fd = shm_open(name, O_RDONLY, 0);
+    if (stats->fd < 0) {
+        perror("shm_open");
+        return 1;
+    }
+
+    if (pread(stats->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+        hdr.magic != PACE2_SHM_STATS_MAGIC ||
+        hdr.version_major != PACE2_SHM_STATS_VERSION_MAJOR ||
+        hdr.record_size != sizeof(struct pace2_shm_stats_record)) {
+        fprintf(stderr, "%s is not a compatible statistics segment.\n", name);
+        close(stats->fd);
+        return 1;
+    }
+
+    stats->size = hdr.total_size;
+
+    if (pace2_shm_stats_map(stats, PROT_READ) != 0) {
+        close(stats->fd);
+        return 1;
+    }
+
+    return 0;
+}
+
+void pace2_shm_stats_close(struct pace2_shm_stats *stats)
+{
+    if (NULL == stats || NULL == stats->hdr) {
+        return;
+    }
+
+    munmap(stats->hdr, stats->size);
+    close(stats->fd);
+
+    if (stats->writable) {
+        shm_unlink(stats->name);
+    }
+
+    stats->hdr = NULL;
+    stats->records = NULL;
+    stats->bitmap = NULL;
+}
+
+void pace2_shm_stats_write_begin(struct pace2_shm_stats *stats)
+{
+    if (NULL == stats->hdr) {
+        return;
+    }
+
+    stats->hdr->seq++;
+    __sync_synchronize();
+}
+
+void pace2_shm_stats_set(struct pace2_shm_stats *stats, enum pace2_shm_stats_section section,
+                         u32 index, u64 packets, u64 bytes)
+{
+    struct pace2_shm_stats_record *record;
+    u32 i;
+
+    if (NULL == stats->hdr || index >= stats->hdr->section_count[section]) {
+        return;
+    }
+
+    i = pace2_shm_stats_record_index(stats->hdr, section, index);
+    record = &stats->records[i];
+
+    record->packets = packets;
+    record->bytes = bytes;
+
+    if (packets != 0 || bytes != 0) {
+        stats->bitmap[i / 8] |= 1 << (i & 7);
+    } else {
+        stats->bitmap[i / 8] &= ~(1 << (i & 7));
+    }
+}
+
+void pace2_shm_stats_write_end(struct pace2_shm_stats *stats, u64 timestamp)
+{
+    if (NULL == stats->hdr) {
+        return;
+    }
+
+    stats->hdr->timestamp = timestamp;
+    stats->hdr->update_count++;
+
+    __sync_synchronize();
+    stats->hdr->seq++;
+}
+
+u8 pace2_shm_stats_snapshot(const struct pace2_shm_stats *stats, void *buffer, u32 max_retries)
+{
+    u32 retry;
+
+    if (NULL == stats || NULL == stats->hdr || NULL == buffer) {
+        return 1;
+    }
+
+    for (retry = 0; retry <= max_retries; retry++) {
+        const u32 seq = stats->hdr->seq;
+
+        __sync_synchronize();
+
+        if (seq & 1) {
+            /* writer is in the middle of an update */
+            sched_yield();
+            continue;
+        }
+
+        memcpy(buffer, stats->hdr, stats->size);
+
+        __sync_synchronize();
+
+        if (stats->hdr->seq == seq) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+const struct pace2_shm_stats_record *pace2_shm_stats_get(const void *snapshot,
+                                                         enum pace2_shm_stats_section section,
+                                                         u32 index)
+{
+    const struct pace2_shm_stats_header * const hdr = snapshot;
+    const u8 * const bitmap = (const u8 *)snapshot + hdr->bitmap_offset;
+    u32 i;
+
+    if (index >= hdr->section_count[section]) {
+        return NULL;
+    }
+
+    i = pace2_shm_stats_record_index(hdr, section, index);
+
+    if ((bitmap[i / 8] & (1 << (i & 7))) == 0) {
+        return NULL;
+    }
+
+    return (const struct pace2_shm_stats_record *)((const u8 *)snapshot + hdr->header_size) + i;
+}
@@ -0,0 +1,152 @@
+/*
+ * pace2_shm_stats.h
+ *
+ * Publishes the classification counters of the daemon into a named POSIX
+ * shared memory segment. Readers (CLI tools, the python control plane) take
+ * consistent snapshots through a sequence lock and never block the writer.
+ *
+ * layout of the segment:
+ * 1) header (versioned, describes the sizes and offsets of the sections)
+ * 2) array of records (protocols, stack lengths, applications, attributes)
+ * 3) bitmap with one bit per record, set if the record is non-zero
+ */
+
+#ifndef PACE2_SHM_STATS_H
+#define PACE2_SHM_STATS_H
+
+#include <stddef.h>
+#include <pace2.h>
+
+#define PACE2_SHM_STATS_DEFAULT_NAME "/pace2_stats"
+
+#define PACE2_SHM_STATS_MAGIC 0x50325354 /* "P2ST" */
+#define PACE2_SHM_STATS_VERSION_MAJOR 1
+#define PACE2_SHM_STATS_VERSION_MINOR 0
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum pace2_shm_stats_section {
+    PACE2_SHM_STATS_PROTOCOLS = 0,
+    PACE2_SHM_STATS_STACK_LENGTHS,
+    PACE2_SHM_STATS_APPLICATIONS,
+    PACE2_SHM_STATS_ATTRIBUTES,
+    PACE2_SHM_STATS_NUMBER_OF_SECTIONS
+};
+
+struct pace2_shm_stats_record {
+    u64 packets;
+    u64 bytes;
+};
+
+struct pace2_shm_stats_header {
+    u32 magic;
+    u16 version_major;
+    u16 version_minor;
+    u32 header_size;
+    u32 record_size;
+    u32 total_size;
+    /* offset of the bitmap from the start of the segment */
+    u32 bitmap_offset;
+    /* number of records and offset of the first record of every section */
+    u32 section_count[PACE2_SHM_STATS_NUMBER_OF_SECTIONS];
+    u32 section_offset[PACE2_SHM_STATS_NUMBER_OF_SECTIONS];
+
+    /* odd while the writer is updating the segment */
+    volatile u32 seq;
+    u32 writer_pid;
+
+    /* number of completed updates and PACE 2 timestamp of the last one */
+    u64 update_count;
+    u64 timestamp;
+
+    u64 packet_counter;
+    u64 byte_counter;
+    u64 http_response_payload_bytes;
+    u64 license_exceeded_packets;
+};
+
+struct pace2_shm_stats {
+    int fd;
+    u8 writable;
+    size_t size;
+    char name[64];
+    struct pace2_shm_stats_header *hdr;
+    struct pace2_shm_stats_record *records;
+    u8 *bitmap;
+};
+
+/**
+ * creates (or recreates) the named segment and initializes its header
+ * @param stats stats handle to initialize
+ * @param name shm name of the segment, e.g. PACE2_SHM_STATS_DEFAULT_NAME
+ * @param section_count number of records per section
+ * @return 0 on success; !=0 on error
+ */
+u8 pace2_shm_stats_create(struct pace2_shm_stats *stats, const char *name,
+                          const u32 section_count[PACE2_SHM_STATS_NUMBER_OF_SECTIONS]);
+
+/**
+ * opens an existing segment read-only and validates its header
+ * @param stats stats handle to initialize
+ * @param name shm name of the segment
+ * @return 0 on success; !=0 on error (missing segment or version mismatch)
+ */
+u8 pace2_shm_stats_open(struct pace2_shm_stats *stats, const char *name);
+
+/**
+ * unmaps the segment; the writer also unlinks the name
+ * @param stats stats handle to close
+ */
+void pace2_shm_stats_close(struct pace2_shm_stats *stats);
+
+/**
+ * starts an update, readers retry until pace2_shm_stats_write_end is called
+ * @param stats writable stats handle
+ */
+void pace2_shm_stats_write_begin(struct pace2_shm_stats *stats);
+
+/**
+ * stores one record and maintains the bitmap, only valid inside an update
+ * @param stats writable stats handle
+ * @param section section of the record
+ * @param index index inside the section
+ * @param packets packet counter
+ * @param bytes byte counter
+ */
+void pace2_shm_stats_set(struct pace2_shm_stats *stats, enum pace2_shm_stats_section section,
+                         u32 index, u64 packets, u64 bytes);
+
+/**
+ * finishes an update and makes it visible to readers
+ * @param stats writable stats handle
+ * @param timestamp PACE 2 timestamp of the update
+ */
+void pace2_shm_stats_write_end(struct pace2_shm_stats *stats, u64 timestamp);
+
+/**
+ * copies a consistent snapshot of the whole segment
+ * @param stats stats handle opened with pace2_shm_stats_open
+ * @param buffer destination, at least stats->size bytes
+ * @param max_retries number of retries if the writer is updating concurrently
+ * @return 0 on success; !=0 if no consistent copy could be taken
+ */
+u8 pace2_shm_stats_snapshot(const struct pace2_shm_stats *stats, void *buffer, u32 max_retries);
+
+/**
+ * returns a record of a snapshot taken with pace2_shm_stats_snapshot
+ * @param snapshot snapshot buffer
+ * @param section section of the record
+ * @param index index inside the section
+ * @return pointer to the record or NULL if the record is zero or out of range
+ */
+const struct pace2_shm_stats_record *pace2_shm_stats_get(const void *snapshot,
+                                                         enum pace2_shm_stats_section section,
+                                                         u32 index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PACE2_SHM_STATS_H */
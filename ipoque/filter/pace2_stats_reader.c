@@ -0,0 +1,118 @@
+/********************************************************************************/
+/**
+ ** \file       pace2_stats_reader.c
+ ** \brief      Prints the counters published by pace2_integration_example.
+ **
+ ** The tool takes a consistent snapshot of the statistics segment and prints
+ ** it in the same format as the daemon does on exit. With -i the snapshot is
+ ** repeated every given number of seconds.
+ **/
+/********************************************************************************/
+
+#include <pace2.h>
+#include "pace2_shm_stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <getopt.h>
+
+/* Protocol and application name strings */
+static const char *prot_long_str[] = { PACE2_PROTOCOLS_LONG_STRS };
+static const char *app_str[] = { PACE2_APPLICATIONS_SHORT_STRS };
+
+static void print_section( const void * const snapshot, enum pace2_shm_stats_section section,
+                           const char * const title, const char * const * const names, u32 names_count )
+{
+    const struct pace2_shm_stats_header * const hdr = snapshot;
+    const struct pace2_shm_stats_record *record;
+    u32 c;
+
+    printf( "  %-20s %-15s %s\n\n", title, "Packets", "Bytes" );
+    for ( c = 0; c < hdr->section_count[section]; c++ ) {
+        if ( ( record = pace2_shm_stats_get( snapshot, section, c ) ) == NULL ) {
+            continue;
+        }
+
+        if ( names != NULL && c < names_count ) {
+            printf( "  %-20s %-15llu %llu\n", names[c], record->packets, record->bytes );
+        } else if ( section == PACE2_SHM_STATS_ATTRIBUTES ) {
+            printf( "  %-20s %-15llu %llu\n", pace2_get_application_attribute_str( c ), record->packets, record->bytes );
+        } else {
+            printf( "  %-20u %-15llu %llu\n", c, record->packets, record->bytes );
+        }
+    }
+    printf( "\n\n" );
+}
+
+static void print_snapshot( const void * const snapshot )
+{
+    const struct pace2_shm_stats_header * const hdr = snapshot;
+
+    print_section( snapshot, PACE2_SHM_STATS_PROTOCOLS, "Protocol",
+                   prot_long_str, sizeof( prot_long_str ) / sizeof( prot_long_str[0] ) );
+    print_section( snapshot, PACE2_SHM_STATS_STACK_LENGTHS, "Stack length", NULL, 0 );
+    print_section( snapshot, PACE2_SHM_STATS_APPLICATIONS, "Application",
+                   app_str, sizeof( app_str ) / sizeof( app_str[0] ) );
+    print_section( snapshot, PACE2_SHM_STATS_ATTRIBUTES, "Attribute", NULL, 0 );
+
+    printf( "HTTP response payload bytes: %llu\n", hdr->http_response_payload_bytes );
+    printf( "Packet counter: %llu\n", hdr->packet_counter );
+    printf( "Byte counter: %llu\n", hdr->byte_counter );
+    if ( hdr->license_exceeded_packets > 0 ) {
+        printf( "License exceeded packets: %llu.\n", hdr->license_exceeded_packets );
+    }
+    printf( "Update %llu of pid %u at timestamp %llu\n\n", hdr->update_count, hdr->writer_pid, hdr->timestamp );
+}
+
+int main( int argc, char **argv )
+{
+    const char *name = PACE2_SHM_STATS_DEFAULT_NAME;
+    unsigned int interval = 0;
+    struct pace2_shm_stats stats;
+    void *snapshot;
+    int c;
+
+    while ( ( c = getopt( argc, argv, "i:h" ) ) != -1 ) {
+        switch ( c ) {
+            case 'i':
+                interval = atoi( optarg );
+                break;
+            default:
+                printf( "Usage: pace2_stats_reader [-i seconds] [segment name]\n" );
+                return 0;
+        }
+    }
+
+    if ( optind < argc ) {
+        name = argv[optind];
+    }
+
+    if ( pace2_shm_stats_open( &stats, name ) != 0 ) {
+        return 1;
+    }
+
+    snapshot = malloc( stats.size );
+    if ( snapshot == NULL ) {
+        pace2_shm_stats_close( &stats );
+        return 1;
+    }
+
+    do {
+        if ( pace2_shm_stats_snapshot( &stats, snapshot, 1000 ) != 0 ) {
+            fprintf( stderr, "Could not take a consistent snapshot of %s.\n", name );
+        } else {
+            print_snapshot( snapshot );
+        }
+
+        if ( interval > 0 ) {
+            sleep( interval );
+        }
+    } while ( interval > 0 );
+
+    free( snapshot );
+    pace2_shm_stats_close( &stats );
+
+    return 0;
+}
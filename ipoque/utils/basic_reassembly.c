@@ -12,95 +12,985 @@
 #endif
 #include "basic_reassembly.h"
 
-u8 br_add_data(struct reassembly_flow_data *rfd, u32 seq, const u8* data, u64 data_len, u8 direction, u8 is_tcp_syn)
+/* signed distance between two sequence numbers, handles wraparound */
+#define BR_SEQ_DIFF(a, b) ((int)((u32)(a) - (u32)(b)))
+
+static struct br_config br_config = {
+    64,                 /* max_segments */
+    1024 * 1024,        /* max_segment_bytes */
+    0,                  /* gap_timeout */
+    BR_OVERLAP_FIRST,   /* overlap_policy */
+    0,                  /* zero_copy */
+    4096                /* linearize_window */
+};
+
+static struct br_stats br_stats;
+
+void br_init_default_config(struct br_config *config)
+{
+    if (NULL == config) {
+        return;
+    }
+
+    config->max_segments = 64;
+    config->max_segment_bytes = 1024 * 1024;
+    config->gap_timeout = 0;
+    config->overlap_policy = BR_OVERLAP_FIRST;
+    config->zero_copy = 0;
+    config->linearize_window = 4096;
+}
+
+void br_set_config(const struct br_config *config)
+{
+    if (NULL != config) {
+        br_config = *config;
+    }
+}
+
+void br_get_stats(struct br_stats *stats)
+{
+    if (NULL != stats) {
+        *stats = br_stats;
+    }
+}
+
+static inline u8 *br_stored_data(struct reassembly_flow_data *rfd, u8 direction)
+{
+    return rfd->buf[direction] + rfd->offset[direction];
+}
+
+/* number of in order bytes stored in the buffer and the chunks */
+static inline u64 br_stored_length(const struct reassembly_flow_data *rfd, u8 direction)
+{
+    return rfd->data_length[direction] + rfd->chunk_bytes[direction];
+}
+
+static inline u32 br_expected_seq(const struct reassembly_flow_data *rfd, u8 direction)
+{
+    return rfd->base_seq[direction] + (u32)br_stored_length(rfd, direction);
+}
+
+/* buffers are recycled per power of two size class, up to BR_POOL_DEPTH each */
+#define BR_POOL_MIN_SHIFT   12
+#define BR_POOL_MAX_SHIFT   20
+#define BR_POOL_DEPTH       16
+
+/* remaining data up to this size is moved to the front by br_remove_data */
+#define BR_COMPACT_BYTES    4096
+
+struct br_pool_class {
+    u32 count;
+    u8 *buffers[BR_POOL_DEPTH];
+};
+
+static struct br_pool_class br_pool[BR_POOL_MAX_SHIFT - BR_POOL_MIN_SHIFT + 1];
+
+static u8 br_size_shift(u64 size)
+{
+    u8 shift = BR_POOL_MIN_SHIFT;
+
+    while (((u64)1 << shift) < size && shift < 63) {
+        shift++;
+    }
+
+    return shift;
+}
+
+static u8 *br_buffer_get(u64 size, u64 *allocated)
+{
+    const u8 shift = br_size_shift(size);
+    u8 *buf;
+
+    *allocated = (u64)1 << shift;
+
+    if (shift <= BR_POOL_MAX_SHIFT) {
+        struct br_pool_class * const pool = &br_pool[shift - BR_POOL_MIN_SHIFT];
+
+        if (pool->count > 0) {
+            return pool->buffers[--pool->count];
+        }
+    }
+
+    buf = malloc(*allocated);
+    if (NULL == buf) {
+        *allocated = 0;
+    }
+
+    return buf;
+}
+
+static void br_buffer_put(u8 *buf, u64 size)
+{
+    const u8 shift = br_size_shift(size);
+
+    if (((u64)1 << shift) == size && shift <= BR_POOL_MAX_SHIFT) {
+        struct br_pool_class * const pool = &br_pool[shift - BR_POOL_MIN_SHIFT];
+
+        if (pool->count < BR_POOL_DEPTH) {
+            pool->buffers[pool->count++] = buf;
+            return;
+        }
+    }
+
+    free(buf);
+}
+
+void br_pool_cleanup(void)
+{
+    u32 i;
+
+    for (i = 0; i < sizeof(br_pool) / sizeof(br_pool[0]); i++) {
+        while (br_pool[i].count > 0) {
+            free(br_pool[i].buffers[--br_pool[i].count]);
+        }
+    }
+}
+
+/* makes room for data_len more bytes behind the stored data of a direction */
+static u8 br_reserve(struct reassembly_flow_data *rfd, u8 direction, u64 data_len)
+{
+    const u64 needed = rfd->data_length[direction] + data_len;
+    u64 allocated;
+    u8 *new_buf;
+
+    if (rfd->offset[direction] + needed <= rfd->bufsize[direction]) {
+        return BR_SUCCESS;
+    }
+
+    /*
+     * moving the stored data to the front is cheaper than a new buffer as
+     * long as the consumed part is at least as large as the part to move,
+     * every byte is moved at most once per doubling of the consumed bytes
+     */
+    if (needed <= rfd->bufsize[direction] && rfd->offset[direction] >= rfd->data_length[direction]) {
+        memmove(rfd->buf[direction], rfd->buf[direction] + rfd->offset[direction], rfd->data_length[direction]);
+        rfd->offset[direction] = 0;
+        return BR_SUCCESS;
+    }
+
+    new_buf = br_buffer_get(needed > 2 * rfd->bufsize[direction] ? needed : 2 * rfd->bufsize[direction], &allocated);
+    if (NULL == new_buf) {
+        return BR_ERROR;
+    }
+
+    if (NULL != rfd->buf[direction]) {
+        memcpy(new_buf, rfd->buf[direction] + rfd->offset[direction], rfd->data_length[direction]);
+        br_buffer_put(rfd->buf[direction], rfd->bufsize[direction]);
+    }
+
+    rfd->buf[direction] = new_buf;
+    rfd->bufsize[direction] = allocated;
+    rfd->offset[direction] = 0;
+
+    return BR_SUCCESS;
+}
+
+/* appends a segment to the in order chunks behind the buffer, the data is not copied */
+static void br_link_chunk(struct reassembly_flow_data *rfd, u8 direction, struct br_segment *chunk)
+{
+    chunk->next = NULL;
+
+    if (NULL != rfd->chunks_tail[direction]) {
+        rfd->chunks_tail[direction]->next = chunk;
+    } else {
+        rfd->chunks[direction] = chunk;
+    }
+    rfd->chunks_tail[direction] = chunk;
+
+    rfd->chunk_bytes[direction] += chunk->length;
+    rfd->chunk_memory[direction] += sizeof(struct br_segment) + chunk->length;
+}
+
+/* frees the first chunk, the not yet consumed bytes of it have to be accounted by the caller */
+static void br_unlink_chunk(struct reassembly_flow_data *rfd, u8 direction)
+{
+    struct br_segment * const chunk = rfd->chunks[direction];
+
+    rfd->chunks[direction] = chunk->next;
+    if (NULL == chunk->next) {
+        rfd->chunks_tail[direction] = NULL;
+    }
+
+    rfd->chunk_offset[direction] = 0;
+    rfd->chunk_memory[direction] -= sizeof(struct br_segment) + chunk->length;
+    free(chunk);
+}
+
+static void br_free_chunks(struct reassembly_flow_data *rfd, u8 direction)
+{
+    while (NULL != rfd->chunks[direction]) {
+        br_unlink_chunk(rfd, direction);
+    }
+
+    rfd->chunk_bytes[direction] = 0;
+}
+
+static u8 br_append(struct reassembly_flow_data *rfd, u8 direction, const u8 *data, u64 data_len)
+{
+    if (NULL != rfd->chunks[direction]) {
+        /* the buffer is followed by chunks, new data has to go behind them */
+        struct br_segment * const chunk = malloc(sizeof(struct br_segment) + data_len);
+
+        if (NULL == chunk) {
+            return BR_ERROR;
+        }
+
+        chunk->seq = br_expected_seq(rfd, direction);
+        chunk->length = data_len;
+        memcpy(chunk->data, data, data_len);
+        br_link_chunk(rfd, direction, chunk);
+
+        return BR_SUCCESS;
+    }
+
+    if (br_reserve(rfd, direction, data_len) != BR_SUCCESS) {
+        return BR_ERROR;
+    }
+
+    memcpy(br_stored_data(rfd, direction) + rfd->data_length[direction], data, data_len);
+
+    rfd->data_length[direction] += data_len;
+
+    return BR_SUCCESS;
+}
+
+/* replaces bytes that are still stored in the in-order buffer or chunks (BR_OVERLAP_LAST) */
+static void br_overwrite(struct reassembly_flow_data *rfd, u8 direction, u32 seq, const u8 *data, u64 data_len)
+{
+    const u64 stored = br_stored_length(rfd, direction);
+    int diff = BR_SEQ_DIFF(seq, rfd->base_seq[direction]);
+    struct br_segment *chunk;
+    u64 offset = 0;
+    u64 skip = 0;
+    u32 start;
+
+    if (diff < 0) {
+        skip = -diff;
+    } else {
+        offset = diff;
+    }
+
+    if (skip >= data_len || offset >= stored) {
+        return;
+    }
+
+    data += skip;
+    data_len -= skip;
+    if (offset + data_len > stored) {
+        data_len = stored - offset;
+    }
+
+    if (offset < rfd->data_length[direction]) {
+        const u64 n = data_len < rfd->data_length[direction] - offset ? data_len : rfd->data_length[direction] - offset;
+
+        memcpy(br_stored_data(rfd, direction) + offset, data, n);
+        data += n;
+        data_len -= n;
+        offset = 0;
+    } else {
+        offset -= rfd->data_length[direction];
+    }
+
+    start = rfd->chunk_offset[direction];
+    for (chunk = rfd->chunks[direction]; NULL != chunk && data_len > 0; chunk = chunk->next) {
+        const u64 available = chunk->length - start;
+        u64 n;
+
+        if (offset >= available) {
+            offset -= available;
+            start = 0;
+            continue;
+        }
+
+        n = data_len < available - offset ? data_len : available - offset;
+        memcpy(chunk->data + start + offset, data, n);
+        data += n;
+        data_len -= n;
+        offset = 0;
+        start = 0;
+    }
+}
+
+/* appends every queued segment which became in order */
+static u8 br_drain(struct reassembly_flow_data *rfd, u8 direction)
+{
+    struct br_segment *segment;
+
+    while (NULL != (segment = rfd->segments[direction])) {
+        const int diff = BR_SEQ_DIFF(segment->seq, br_expected_seq(rfd, direction));
+        u32 skip;
+
+        if (diff > 0) {
+            break;
+        }
+
+        rfd->segments[direction] = segment->next;
+        rfd->segment_count[direction]--;
+        rfd->segment_bytes[direction] -= segment->length;
+
+        /* bytes already in the in-order buffer win, see the policy handling in br_add_data */
+        skip = -diff;
+        if (0 == skip && (NULL != rfd->chunks[direction] || segment->length >= br_config.linearize_window)) {
+            /* the segment itself becomes a chunk, it is not copied again; small ones are cheaper to copy */
+            br_stats.chunked_bytes += segment->length;
+            br_link_chunk(rfd, direction, segment);
+            continue;
+        }
+
+        if (skip < segment->length &&
+            br_append(rfd, direction, segment->data + skip, segment->length - skip) != BR_SUCCESS) {
+            free(segment);
+            return BR_ERROR;
+        }
+
+        free(segment);
+    }
+
+    return BR_SUCCESS;
+}
+
+static struct br_segment *br_new_segment(struct reassembly_flow_data *rfd, u8 direction,
+                                         u32 seq, const u8 *data, u32 data_len)
+{
+    struct br_segment *segment;
+
+    if (rfd->segment_count[direction] >= br_config.max_segments ||
+        rfd->segment_bytes[direction] + data_len > br_config.max_segment_bytes) {
+        return NULL;
+    }
+
+    segment = malloc(sizeof(struct br_segment) + data_len);
+    if (NULL == segment) {
+        return NULL;
+    }
+
+    segment->seq = seq;
+    segment->length = data_len;
+    memcpy(segment->data, data, data_len);
+
+    rfd->segment_count[direction]++;
+    rfd->segment_bytes[direction] += data_len;
+
+    return segment;
+}
+
+/* stores data behind a hole, only the parts not covered by other segments are inserted */
+static u8 br_queue(struct reassembly_flow_data *rfd, u8 direction, u32 seq, const u8 *data, u32 data_len)
+{
+    struct br_segment **link = &rfd->segments[direction];
+
+    while (data_len > 0) {
+        struct br_segment * const current = *link;
+        struct br_segment *piece;
+        int diff = 0;
+        u32 n;
+
+        if (NULL != current) {
+            diff = BR_SEQ_DIFF(current->seq, seq);
+        }
+
+        if (NULL == current || diff >= (int)data_len) {
+            /* nothing left to overlap, insert the remainder */
+            n = data_len;
+        } else if (diff > 0) {
+            /* part in front of the current segment */
+            n = diff;
+        } else if (BR_SEQ_DIFF(current->seq + current->length, seq) <= 0) {
+            /* current segment lies completely in front */
+            link = &current->next;
+            continue;
+        } else {
+            /* overlapping part */
+            const u32 offset = -diff;
+
+            n = current->length - offset;
+            if (n > data_len) {
+                n = data_len;
+            }
+
+            if (BR_OVERLAP_LAST == br_config.overlap_policy) {
+                memcpy(current->data + offset, data, n);
+            }
+
+            seq += n;
+            data += n;
+            data_len -= n;
+            link = &current->next;
+            continue;
+        }
+
+        piece = br_new_segment(rfd, direction, seq, data, n);
+        if (NULL == piece) {
+            return BR_DROPPED;
+        }
+
+        piece->next = current;
+        *link = piece;
+        link = &piece->next;
+
+        seq += n;
+        data += n;
+        data_len -= n;
+    }
+
+    return BR_QUEUED;
+}
+
+/* bytes of memory held by a reassembly, buffers are counted with their full size */
+static u64 br_memory(const struct reassembly_flow_data *rfd)
+{
+    return rfd->bufsize[0] + rfd->bufsize[1] + rfd->segment_bytes[0] + rfd->segment_bytes[1] +
+           (u64)(rfd->segment_count[0] + rfd->segment_count[1]) * sizeof(struct br_segment) +
+           rfd->chunk_memory[0] + rfd->chunk_memory[1];
+}
+
+/* removes the memory of a reassembly from its budget, also unlinks it from the lru list */
+static void br_unaccount(struct reassembly_flow_data *rfd)
 {
-    u8 reassembly_init_flow = 0;
+    struct br_budget * const budget = rfd->budget;
+
+    if (0 == rfd->accounted_bytes) {
+        return;
+    }
+
+    if (NULL != rfd->lru_prev) {
+        rfd->lru_prev->lru_next = rfd->lru_next;
+    } else {
+        budget->lru_head = rfd->lru_next;
+    }
+
+    if (NULL != rfd->lru_next) {
+        rfd->lru_next->lru_prev = rfd->lru_prev;
+    } else {
+        budget->lru_tail = rfd->lru_prev;
+    }
+
+    rfd->lru_prev = NULL;
+    rfd->lru_next = NULL;
+
+    budget->used_bytes -= rfd->accounted_bytes;
+    rfd->accounted_bytes = 0;
+    budget->flows--;
+}
+
+/* updates the memory of a reassembly in its budget and marks it as most recently used */
+static void br_account(struct reassembly_flow_data *rfd)
+{
+    struct br_budget * const budget = rfd->budget;
+    const u64 memory = br_memory(rfd);
+
+    br_unaccount(rfd);
+
+    if (0 == memory) {
+        return;
+    }
+
+    rfd->lru_prev = budget->lru_tail;
+    rfd->lru_next = NULL;
+    if (NULL != budget->lru_tail) {
+        budget->lru_tail->lru_next = rfd;
+    } else {
+        budget->lru_head = rfd;
+    }
+    budget->lru_tail = rfd;
+
+    budget->used_bytes += memory;
+    rfd->accounted_bytes = memory;
+    budget->flows++;
+
+    if (budget->used_bytes > budget->peak_bytes) {
+        budget->peak_bytes = budget->used_bytes;
+    }
+}
+
+/*
+ * drops everything buffered for a direction and continues behind the last
+ * buffered byte, the next br_add_data of the direction returns BR_GAP
+ * @return number of dropped payload bytes
+ */
+static u64 br_evict_direction(struct reassembly_flow_data *rfd, u8 direction)
+{
+    const u32 expected = br_expected_seq(rfd, direction);
+    const u64 stored = br_stored_length(rfd, direction);
+    const u64 dropped = stored + rfd->segment_bytes[direction];
+    u32 next_seq = expected;
+    struct br_segment *segment;
+
+    while (NULL != (segment = rfd->segments[direction])) {
+        next_seq = segment->seq + segment->length;
+        rfd->segments[direction] = segment->next;
+        free(segment);
+    }
+
+    if (0 == dropped) {
+        return 0;
+    }
+
+    /* the decoder misses the stored bytes, the hole in front of the segments and the segments */
+    rfd->gap_length[direction] = stored + BR_SEQ_DIFF(next_seq, expected);
+    rfd->gaps[direction]++;
+    rfd->gap_bytes[direction] += rfd->gap_length[direction];
+    rfd->gap_pending[direction] = 1;
+
+    rfd->segment_count[direction] = 0;
+    rfd->segment_bytes[direction] = 0;
+    rfd->gap_deferred[direction] = 0;
+    rfd->base_seq[direction] = next_seq;
+    rfd->data_length[direction] = 0;
+    rfd->offset[direction] = 0;
+    br_free_chunks(rfd, direction);
+
+    if (NULL != rfd->buf[direction]) {
+        br_buffer_put(rfd->buf[direction], rfd->bufsize[direction]);
+        rfd->buf[direction] = NULL;
+        rfd->bufsize[direction] = 0;
+    }
+
+    return dropped;
+}
+
+/* evicts the least recently used reassemblies until the budget is met, current is kept */
+static void br_enforce_budget(struct reassembly_flow_data *current)
+{
+    struct br_budget * const budget = current->budget;
+
+    if (0 == budget->max_bytes) {
+        return;
+    }
+
+    while (budget->used_bytes > budget->max_bytes &&
+           NULL != budget->lru_head && budget->lru_head != current) {
+        struct reassembly_flow_data * const victim = budget->lru_head;
+
+        budget->evictions++;
+        budget->evicted_bytes += br_evict_direction(victim, 0);
+        budget->evicted_bytes += br_evict_direction(victim, 1);
+
+        br_account(victim);
+    }
+}
+
+void br_budget_init(struct br_budget *budget, u64 max_bytes, u64 max_flow_bytes)
+{
+    if (NULL == budget) {
+        return;
+    }
+
+    memset(budget, 0, sizeof(*budget));
+    budget->max_bytes = max_bytes;
+    budget->max_flow_bytes = max_flow_bytes;
+}
+
+void br_set_budget(struct reassembly_flow_data *rfd, struct br_budget *budget)
+{
+    if (NULL == rfd || rfd->budget == budget) {
+        return;
+    }
+
+    if (NULL != rfd->budget) {
+        br_unaccount(rfd);
+    }
+
+    rfd->budget = budget;
+
+    if (NULL != budget) {
+        br_account(rfd);
+    }
+}
+
+/* copies the unconsumed part of packet data handed to the decoder without copying */
+static u8 br_store_direct(struct reassembly_flow_data *rfd, u8 direction, u64 consumed)
+{
+    const u8 * const data = rfd->direct[direction];
+    const u64 data_len = rfd->direct_length[direction];
+
+    rfd->direct[direction] = NULL;
+    rfd->direct_length[direction] = 0;
+    rfd->base_seq[direction] += consumed;
+
+    if (consumed >= data_len) {
+        return BR_SUCCESS;
+    }
+
+    br_stats.tail_bytes += data_len - consumed;
+
+    return br_append(rfd, direction, data + consumed, data_len - consumed);
+}
+
+static u8 br_insert(struct reassembly_flow_data *rfd, u32 seq, const u8* data, u64 data_len, u8 direction, u64 ts)
+{
+    u32 expected;
+    int diff;
+    u64 skip;
+    u8 ret;
+
+    // data of the previous packet was not removed, it has to be stored before the packet goes away
+    if (NULL != rfd->direct[direction] && br_store_direct(rfd, direction, 0) != BR_SUCCESS) {
+        return BR_ERROR;
+    }
+
+    if (0 == data_len) {
+        return br_check_gap(rfd, direction, ts);
+    }
+
+    expected = br_expected_seq(rfd, direction);
+    diff = BR_SEQ_DIFF(seq, expected);
+
+    // in order and nothing stored: the decoder can read the packet itself
+    if (br_config.zero_copy && 0 == diff && 0 == br_stored_length(rfd, direction) && NULL == rfd->segments[direction]) {
+        rfd->direct[direction] = data;
+        rfd->direct_length[direction] = data_len;
+        br_stats.direct_packets++;
+        br_stats.direct_bytes += data_len;
+        return BR_DIRECT;
+    }
+
+    // the flow may not buffer more, the decoder skips what it has not seen yet
+    if (NULL != rfd->budget && 0 != rfd->budget->max_flow_bytes &&
+        br_stored_length(rfd, direction) + rfd->segment_bytes[direction] + data_len > rfd->budget->max_flow_bytes) {
+        rfd->budget->flow_limit_hits++;
+        rfd->budget->evicted_bytes += br_evict_direction(rfd, direction);
+
+        expected = br_expected_seq(rfd, direction);
+        diff = BR_SEQ_DIFF(seq, expected);
+    }
+
+    br_stats.copied_packets++;
+
+    // there is a lost or reordered packet in front of this one
+    if (diff > 0) {
+        if (NULL == rfd->segments[direction]) {
+            rfd->gap_start_ts[direction] = ts;
+        }
+
+        ret = br_queue(rfd, direction, seq, data, data_len);
+        br_stats.copied_bytes += data_len;
+
+        if (br_check_gap(rfd, direction, ts) == BR_GAP) {
+            return BR_GAP;
+        }
+
+        return ret;
+    }
+
+    // retransmission, at least partially overlapping already stored data
+    skip = -diff;
+    if (BR_OVERLAP_LAST == br_config.overlap_policy) {
+        br_overwrite(rfd, direction, seq, data, skip < data_len ? skip : data_len);
+    }
+
+    if (skip >= data_len) {
+        return br_check_gap(rfd, direction, ts);
+    }
+
+    data += skip;
+    data_len -= skip;
+    seq = expected;
+
+    while (data_len > 0) {
+        struct br_segment * const next = rfd->segments[direction];
+        u64 n = data_len;
+
+        // queued bytes overlapping the new data were received first
+        if (BR_OVERLAP_FIRST == br_config.overlap_policy && NULL != next &&
+            (u64)BR_SEQ_DIFF(next->seq, seq) < data_len) {
+            n = BR_SEQ_DIFF(next->seq, seq);
+        }
+
+        if (br_append(rfd, direction, data, n) != BR_SUCCESS || br_drain(rfd, direction) != BR_SUCCESS) {
+            return BR_ERROR;
+        }
+        br_stats.copied_bytes += n;
+
+        // continue behind everything that has been appended
+        skip = BR_SEQ_DIFF(br_expected_seq(rfd, direction), seq);
+        if (0 == skip || skip >= data_len) {
+            break;
+        }
+
+        data += skip;
+        data_len -= skip;
+        seq += skip;
+    }
+
+    if (NULL != rfd->segments[direction]) {
+        // the hole moved, restart the timeout for the next one
+        rfd->gap_start_ts[direction] = ts;
+    }
+
+    return BR_SUCCESS;
+}
+
+u8 br_add_data(struct reassembly_flow_data *rfd, u32 seq, const u8* data, u64 data_len, u8 direction, u8 is_tcp_syn, u64 ts)
+{
+    u8 ret;
 
     if (NULL == rfd) {
-        return 1;
+        return BR_ERROR;
     }
 
     // direction has to be 0 or 1
     if (1 < direction) {
-        return 1;
+        return BR_ERROR;
     }
 
-    if (NULL == rfd->buf[direction]) {
-        rfd->buf[direction] = malloc(data_len);
-        if (NULL == rfd->buf[direction]) {
-            return 1;
-        }
-        rfd->bufsize[direction] = data_len;
+    if (NULL == data && 0 < data_len) {
+        return BR_ERROR;
+    }
+
+    if (!rfd->initialized[direction]) {
+        rfd->initialized[direction] = 1;
 
         if (is_tcp_syn && 0 == data_len) {
             rfd->base_seq[direction] = seq + 1;
-            reassembly_init_flow = 1;
         } else {
             rfd->base_seq[direction] = seq;
         }
     }
 
-    // there is a lost or reordered packet
-    if (!reassembly_init_flow && (seq != rfd->base_seq[direction] + rfd->data_length[direction])) {
-        return 1;
+    ret = br_insert(rfd, seq, data, data_len, direction, ts);
+
+    if (NULL != rfd->budget) {
+        br_account(rfd);
+        br_enforce_budget(rfd);
     }
 
-    if (rfd->bufsize[direction] < rfd->data_length[direction] + data_len) {
-        u8 *new_data = realloc(rfd->buf[direction], rfd->data_length[direction] + data_len);
+    // data buffered for this direction was evicted since the last call
+    if (BR_ERROR != ret && rfd->gap_pending[direction]) {
+        rfd->gap_pending[direction] = 0;
+        return BR_GAP;
+    }
 
-        rfd->bufsize[direction] = rfd->data_length[direction] + data_len;
-        rfd->buf[direction] = new_data;
+    return ret;
+}
+
+/* continues the stream of a direction at the first out of order segment, dropped counts the stored bytes */
+static u8 br_skip_gap(struct reassembly_flow_data *rfd, u8 direction, u64 *dropped)
+{
+    rfd->gap_deferred[direction] = 0;
+    *dropped = 0;
+
+    /* the hole has been filled in the meantime */
+    if (NULL == rfd->segments[direction] ||
+        BR_SEQ_DIFF(rfd->segments[direction]->seq, br_expected_seq(rfd, direction)) <= 0) {
+        return br_drain(rfd, direction);
     }
 
-    memcpy(rfd->buf[direction] + rfd->data_length[direction], data, data_len);
+    *dropped = br_stored_length(rfd, direction);
+    rfd->base_seq[direction] = rfd->segments[direction]->seq;
+    rfd->data_length[direction] = 0;
+    rfd->offset[direction] = 0;
+    br_free_chunks(rfd, direction);
 
-    rfd->data_length[direction] += data_len;
+    return br_drain(rfd, direction);
+}
 
-    return 0;
+u8 br_check_gap(struct reassembly_flow_data *rfd, u8 direction, u64 ts)
+{
+    struct br_segment *first;
+    u64 dropped;
+
+    if (NULL == rfd || 1 < direction || rfd->gap_deferred[direction]) {
+        return BR_SUCCESS;
+    }
+
+    first = rfd->segments[direction];
+
+    if (NULL == first || 0 == br_config.gap_timeout ||
+        ts - rfd->gap_start_ts[direction] < br_config.gap_timeout) {
+        return BR_SUCCESS;
+    }
+
+    rfd->gap_length[direction] = BR_SEQ_DIFF(first->seq, br_expected_seq(rfd, direction));
+    rfd->gaps[direction]++;
+    rfd->gap_bytes[direction] += rfd->gap_length[direction];
+    rfd->gap_start_ts[direction] = ts;
+
+    /* in order data in front of the gap goes to the decoder first, br_remove_data skips the gap afterwards */
+    if (br_stored_length(rfd, direction) > 0) {
+        rfd->gap_deferred[direction] = 1;
+        return BR_GAP;
+    }
+
+    if (br_skip_gap(rfd, direction, &dropped) != BR_SUCCESS) {
+        return BR_ERROR;
+    }
+
+    if (NULL != rfd->budget) {
+        br_account(rfd);
+    }
+
+    return BR_GAP;
 }
 
 u8 br_remove_data(struct reassembly_flow_data *rfd, u64 data_length[2])
 {
+    u8 direction;
+
     if (NULL == rfd) {
         return 1;
     }
 
-    if (NULL == rfd->buf[0] || NULL == rfd->buf[1]) {
-        return 1;
+    for (direction = 0; direction < 2; direction++) {
+        const u64 available = rfd->direct[direction] ? rfd->direct_length[direction] : br_stored_length(rfd, direction);
+
+        if (data_length[direction] > available) {
+            return 1;
+        }
     }
 
-    if (data_length[0] > rfd->data_length[0] || data_length[1] > rfd->data_length[1]) {
-        return 1;
+    for (direction = 0; direction < 2; direction++) {
+        u64 remove = data_length[direction];
+        u64 from_buffer;
+
+        if (0 != rfd->viewed[direction]) {
+            /* a decoder that consumed nothing waits for more contiguous data */
+            if (0 == remove && rfd->viewed[direction] < br_stored_length(rfd, direction)) {
+                rfd->window[direction] = 2 * rfd->viewed[direction];
+            } else {
+                rfd->window[direction] = 0;
+            }
+            rfd->viewed[direction] = 0;
+        }
+
+        if (NULL != rfd->direct[direction]) {
+            if (br_store_direct(rfd, direction, remove) != BR_SUCCESS) {
+                return 1;
+            }
+            continue;
+        }
+
+        if (0 == remove) {
+            continue;
+        }
+
+        rfd->base_seq[direction] += remove;
+
+        from_buffer = remove < rfd->data_length[direction] ? remove : rfd->data_length[direction];
+        if (from_buffer > 0) {
+            rfd->data_length[direction] -= from_buffer;
+
+            if (rfd->data_length[direction] <= BR_COMPACT_BYTES) {
+                /* a small tail is moved to the front right away, this keeps the used part of the buffer in cache */
+                memmove(rfd->buf[direction], rfd->buf[direction] + rfd->offset[direction] + from_buffer,
+                        rfd->data_length[direction]);
+                rfd->offset[direction] = 0;
+            } else {
+                rfd->offset[direction] += from_buffer;
+            }
+            remove -= from_buffer;
+        }
+
+        /* the rest is consumed from the chunks */
+        while (remove > 0) {
+            const u64 in_chunk = rfd->chunks[direction]->length - rfd->chunk_offset[direction];
+
+            if (remove < in_chunk) {
+                rfd->chunk_offset[direction] += remove;
+                rfd->chunk_bytes[direction] -= remove;
+                break;
+            }
+
+            rfd->chunk_bytes[direction] -= in_chunk;
+            remove -= in_chunk;
+            br_unlink_chunk(rfd, direction);
+        }
     }
 
-    if (data_length[0] > 0) {
-        memmove(rfd->buf[0], rfd->buf[0] + data_length[0], rfd->data_length[0] - data_length[0]);
-        rfd->data_length[0] -= data_length[0];
-        rfd->base_seq[0] += data_length[0];
+    /* the decoder has seen the data in front of a declared gap, what it left is skipped with the gap */
+    for (direction = 0; direction < 2; direction++) {
+        if (rfd->gap_deferred[direction]) {
+            u64 dropped;
+
+            if (br_skip_gap(rfd, direction, &dropped) != BR_SUCCESS) {
+                return 1;
+            }
+            rfd->gap_length[direction] += (u32)dropped;
+            rfd->gap_bytes[direction] += dropped;
+        }
     }
 
-    if (data_length[1] > 0) {
-        memmove(rfd->buf[1], rfd->buf[1] + data_length[1], rfd->data_length[1] - data_length[1]);
-        rfd->data_length[1] -= data_length[1];
-        rfd->base_seq[1] += data_length[1];
+    if (NULL != rfd->budget) {
+        br_account(rfd);
+        br_enforce_budget(rfd);
     }
 
     return 0;
 }
 
+u64 br_get_view(struct reassembly_flow_data *rfd, u8 direction)
+{
+    u64 window;
+
+    if (NULL == rfd || 1 < direction) {
+        return 0;
+    }
+
+    if (NULL != rfd->direct[direction]) {
+        rfd->viewed[direction] = rfd->direct_length[direction];
+        return rfd->viewed[direction];
+    }
+
+    window = rfd->window[direction] ? rfd->window[direction] : br_config.linearize_window;
+    if (window > br_stored_length(rfd, direction) || rfd->gap_deferred[direction]) {
+        window = br_stored_length(rfd, direction);
+    }
+
+    /* copy whole chunks behind the buffer until the window is contiguous */
+    while (br_get_length(rfd, direction) < window) {
+        struct br_segment * const chunk = rfd->chunks[direction];
+        const u8 * const data = chunk->data + rfd->chunk_offset[direction];
+        const u64 n = chunk->length - rfd->chunk_offset[direction];
+
+        if (br_reserve(rfd, direction, n) != BR_SUCCESS) {
+            break;
+        }
+
+        memcpy(br_stored_data(rfd, direction) + rfd->data_length[direction], data, n);
+        rfd->data_length[direction] += n;
+        rfd->chunk_bytes[direction] -= n;
+        br_unlink_chunk(rfd, direction);
+
+        br_stats.linearized_bytes += n;
+    }
+
+    if (NULL != rfd->budget) {
+        br_account(rfd);
+    }
+
+    rfd->viewed[direction] = br_get_length(rfd, direction);
+
+    return rfd->viewed[direction];
+}
+
 u8 br_destroy_data(struct reassembly_flow_data *rfd)
 {
+    u8 direction;
+
     if (NULL == rfd) {
         return 1;
     }
 
-    if (NULL != rfd->buf[0]) {
-        free(rfd->buf[0]);
+    if (NULL != rfd->budget) {
+        br_unaccount(rfd);
     }
 
-    if (NULL != rfd->buf[1]) {
-        free(rfd->buf[1]);
+    for (direction = 0; direction < 2; direction++) {
+        while (NULL != rfd->segments[direction]) {
+            struct br_segment * const segment = rfd->segments[direction];
+
+            rfd->segments[direction] = segment->next;
+            free(segment);
+        }
+
+        br_free_chunks(rfd, direction);
+
+        if (NULL != rfd->buf[direction]) {
+            br_buffer_put(rfd->buf[direction], rfd->bufsize[direction]);
+        }
     }
+
+    memset(rfd, 0, sizeof(*rfd));
+
     return 0;
 }
-
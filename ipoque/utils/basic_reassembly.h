@@ -11,17 +11,228 @@
 
 #include <pace2.h>
 
+/* return values of br_add_data */
+#define BR_SUCCESS  0   /* data was appended to the stream */
+#define BR_ERROR    1   /* invalid parameters or allocation failure */
+#define BR_QUEUED   2   /* data was stored out of order, the stream did not grow */
+#define BR_GAP      3   /* missing or evicted data was skipped, see gap_length */
+#define BR_DROPPED  4   /* out of order data did not fit into the configured limits */
+#define BR_DIRECT   5   /* the stream refers to the packet data, nothing was copied (zero_copy) */
+
+/* handling of bytes which have been received more than once */
+enum br_overlap_policy {
+    BR_OVERLAP_FIRST = 0,   /* keep the bytes received first */
+    BR_OVERLAP_LAST         /* replace them by the bytes received last */
+};
+
+struct br_config {
+    /* maximum number of out of order segments per direction */
+    u32 max_segments;
+    /* maximum number of out of order bytes per direction */
+    u64 max_segment_bytes;
+    /* time in ticks to wait for missing data before it is skipped, 0 waits forever */
+    u64 gap_timeout;
+    enum br_overlap_policy overlap_policy;
+    /*
+     * hand in order data to the decoder without copying it, only the part the
+     * decoder did not consume is stored; br_remove_data has to be called after
+     * decoding every packet, while the packet data is still valid
+     */
+    u8 zero_copy;
+    /*
+     * minimum number of contiguous bytes br_get_view presents to a decoder;
+     * in order data behind it stays in separate chunks until a decoder that
+     * consumed nothing asks for more, the window then doubles
+     */
+    u64 linearize_window;
+};
+
+/* copy avoidance counters of all reassemblies */
+struct br_stats {
+    /* packets and bytes handed to the decoder without copying */
+    u64 direct_packets;
+    u64 direct_bytes;
+    /* bytes of those packets stored afterwards because the decoder did not consume them */
+    u64 tail_bytes;
+    /* packets and bytes copied because they were out of order or data was already stored */
+    u64 copied_packets;
+    u64 copied_bytes;
+    /* out of order bytes that became in order without being copied again */
+    u64 chunked_bytes;
+    /* bytes copied from chunks into the buffer to present a contiguous view */
+    u64 linearized_bytes;
+};
+
+struct reassembly_flow_data;
+
+/*
+ * memory budget shared by a set of reassemblies, e.g. all flows of one
+ * packet thread; not thread safe, every thread needs its own budget
+ */
+struct br_budget {
+    /* limit for all reassemblies of the budget in bytes, 0 for no limit */
+    u64 max_bytes;
+    /* limit of buffered payload per flow and direction in bytes, 0 for no limit */
+    u64 max_flow_bytes;
+
+    /* memory currently held, including buffer slack and segment headers */
+    u64 used_bytes;
+    u64 peak_bytes;
+    /* number of reassemblies holding memory */
+    u64 flows;
+    /* reassemblies evicted to meet max_bytes */
+    u64 evictions;
+    /* directions evicted because they reached max_flow_bytes */
+    u64 flow_limit_hits;
+    /* buffered payload bytes dropped by evictions */
+    u64 evicted_bytes;
+
+    /* reassemblies holding memory, least recently used first */
+    struct reassembly_flow_data *lru_head;
+    struct reassembly_flow_data *lru_tail;
+};
+
+/* out of order segment, list is sorted by seq and segments never overlap */
+struct br_segment {
+    struct br_segment *next;
+    u32 seq;
+    u32 length;
+    u8 data[];
+};
+
 struct reassembly_flow_data {
     /* the current size of every buffer per direction */
     u64 bufsize[2];
+    /* offset of the first stored byte in the buffer per direction, consumed data is skipped instead of moved */
+    u64 offset[2];
     /* length of stored data per direction */
     u64 data_length[2];
     /* the seq of the first byte stored per direction */
     u32 base_seq[2];
-    /* the pointer to the allocated memory per direction */
+    /* set once the initial seq of a direction is known */
+    u8 initialized[2];
+    /* the pointer to the allocated memory per direction, buffers grow by powers of two */
     u8 *buf[2];
+    /* in order data behind the buffer, kept as received; chunk_offset bytes of the first one are consumed */
+    struct br_segment *chunks[2];
+    struct br_segment *chunks_tail[2];
+    u32 chunk_offset[2];
+    u64 chunk_bytes[2];
+    u64 chunk_memory[2];
+    /* current view window (0 uses the configured one) and length of the last view per direction */
+    u64 window[2];
+    u64 viewed[2];
+
+    /* packet data referenced instead of stored (BR_DIRECT), valid until br_remove_data */
+    const u8 *direct[2];
+    u64 direct_length[2];
+
+    /* out of order segments waiting for missing data per direction */
+    struct br_segment *segments[2];
+    u32 segment_count[2];
+    u64 segment_bytes[2];
+    /* timestamp of the first out of order segment of the current gap */
+    u64 gap_start_ts[2];
+
+    /* length of the last skipped gap, valid if br_add_data returned BR_GAP */
+    u32 gap_length[2];
+    /* number of skipped gaps and bytes per direction */
+    u64 gaps[2];
+    u64 gap_bytes[2];
+    /* buffered data was evicted, reported by the next br_add_data of the direction */
+    u8 gap_pending[2];
+    /* a gap was declared while in order data was stored, it is skipped by br_remove_data */
+    u8 gap_deferred[2];
+
+    /* budget the memory is accounted to, NULL if unlimited */
+    struct br_budget *budget;
+    u64 accounted_bytes;
+    struct reassembly_flow_data *lru_prev;
+    struct reassembly_flow_data *lru_next;
 };
 
+/**
+ * fills a configuration with default values
+ * @param config configuration to initialize
+ */
+void br_init_default_config(struct br_config *config);
+
+/**
+ * sets the configuration used by all reassemblies
+ * @param config configuration to copy
+ */
+void br_set_config(const struct br_config *config);
+
+/**
+ * initializes an empty memory budget
+ * @param budget budget to initialize
+ * @param max_bytes limit for all reassemblies of the budget, 0 for no limit
+ * @param max_flow_bytes limit of buffered payload per flow and direction, 0 for no limit
+ */
+void br_budget_init(struct br_budget *budget, u64 max_bytes, u64 max_flow_bytes);
+
+/**
+ * accounts the memory of a reassembly to a budget; if the budget is exceeded,
+ * the data of the least recently used reassemblies is evicted and their next
+ * br_add_data returns BR_GAP
+ * @param rfd reassembly, usually called right after it was zeroed
+ * @param budget budget to use, NULL to remove the reassembly from its budget
+ */
+void br_set_budget(struct reassembly_flow_data *rfd, struct br_budget *budget);
+
+/**
+ * copies the copy avoidance counters
+ * @param stats destination
+ */
+void br_get_stats(struct br_stats *stats);
+
+/**
+ * returns the first contiguous piece of data of a direction, br_get_length bytes are valid
+ * @param rfd reassembly to read
+ * @param direction direction to read
+ * @return pointer to the first byte (packet data after BR_DIRECT); NULL if nothing was stored yet
+ */
+static inline const u8 *br_get_data(const struct reassembly_flow_data *rfd, u8 direction)
+{
+    if (rfd->direct[direction]) {
+        return rfd->direct[direction];
+    }
+
+    if (0 == rfd->data_length[direction] && rfd->chunks[direction]) {
+        return rfd->chunks[direction]->data + rfd->chunk_offset[direction];
+    }
+
+    return rfd->buf[direction] ? rfd->buf[direction] + rfd->offset[direction] : NULL;
+}
+
+/**
+ * returns the length of the first contiguous piece of data of a direction
+ * @param rfd reassembly to read
+ * @param direction direction to read
+ * @return length of the data returned by br_get_data
+ */
+static inline u64 br_get_length(const struct reassembly_flow_data *rfd, u8 direction)
+{
+    if (rfd->direct[direction]) {
+        return rfd->direct_length[direction];
+    }
+
+    if (0 == rfd->data_length[direction] && rfd->chunks[direction]) {
+        return rfd->chunks[direction]->length - rfd->chunk_offset[direction];
+    }
+
+    return rfd->data_length[direction];
+}
+
+/**
+ * prepares the contiguous view of a direction for a decoder, chunks are only
+ * copied into the buffer up to the current window
+ * @param rfd reassembly to read
+ * @param direction direction to read
+ * @return number of contiguous bytes at br_get_data, call br_get_data afterwards
+ */
+u64 br_get_view(struct reassembly_flow_data *rfd, u8 direction);
+
 /**
  * adds data of a (tcp) packet to the reassembled memory area
  * @param rfd reassembly to add data to
@@ -30,23 +241,43 @@ struct reassembly_flow_data {
  * @param data_len legth of payload
  * @param direction direction of payload
  * @param is_tcp_syn enables special handling of tcp syn requests (increases seq without data)
- * @return 0 on success; !=0 on error
+ * @param ts timestamp of the packet, used for the gap timeout
+ * @return BR_SUCCESS, BR_DIRECT, BR_QUEUED, BR_GAP or BR_DROPPED on success; BR_ERROR on error
  */
-u8 br_add_data(struct reassembly_flow_data *rfd, u32 seq, const u8* data, u64 data_len, u8 direction, u8 is_tcp_syn);
+u8 br_add_data(struct reassembly_flow_data *rfd, u32 seq, const u8* data, u64 data_len, u8 direction, u8 is_tcp_syn, u64 ts);
 
 /**
- * removes given number of bytes from the beginning of the reassembled memory
+ * skips missing data of a direction if the gap timeout expired; in order data
+ * stored in front of the gap is presented completely by the next br_get_view,
+ * the gap is skipped by the following br_remove_data
+ * @param rfd reassembly to check
+ * @param direction direction to check
+ * @param ts current timestamp
+ * @return BR_GAP if data was skipped; BR_SUCCESS otherwise
+ */
+u8 br_check_gap(struct reassembly_flow_data *rfd, u8 direction, u64 ts);
+
+/**
+ * removes given number of bytes from the beginning of the reassembled memory,
+ * the rest of referenced packet data (BR_DIRECT) is stored; if nothing is removed
+ * after br_get_view, the next view of the direction is twice as large
  * @param rfd reassembly to remove data from
  * @param data_len number of bytes to remove from each direction
  * @return 0 on success; !=0 on error
  */
 u8 br_remove_data(struct reassembly_flow_data *rfd, u64 data_length[2]);
 
+/**
+ * frees the buffers kept for reuse by destroyed reassemblies
+ * @note the pool is shared by all reassemblies and not thread safe, like the configuration
+ */
+void br_pool_cleanup(void);
+
 /**
  * destroys a reassembly and frees memory
  * @param rfd reassembly to destroy
  * @return 0 on success; !=0 on error
- * @note reassembly itself has to be freed on the outside
+ * @note reassembly itself has to be freed on the outside, the buffers are returned to the pool
  */
 u8 br_destroy_data(struct reassembly_flow_data *rfd);
 
@@ -0,0 +1,225 @@
+/*
+ * basic_reassembly_benchmark.c
+ *
+ * Measures the throughput of basic_reassembly for large HTTP transfers.
+ * A response with a multi-MB body is split into MSS sized segments and fed
+ * into br_add_data; the simulated decoder consumes the headers and complete
+ * body chunks only, so a partial tail stays in the buffer after most packets.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "basic_reassembly.h"
+
+#define MAX_REORDER_DEPTH 63
+
+/* segment size, large values simulate captures with segmentation offload */
+static u64 mss = 1448;
+
+/* the decoder only consumes complete chunks of this size */
+static u64 decoder_chunk = 4096;
+/* consume at most one chunk per call, like a decoder returning after every message */
+static u8 single_message = 0;
+
+static double now( void )
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static u8 *create_response( u64 body_length, u64 *length )
+{
+    char header[256];
+    u8 *response;
+    int header_length;
+    u64 i;
+
+    header_length = snprintf(header, sizeof(header),
+                             "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: %llu\r\n\r\n",
+                             (unsigned long long)body_length);
+
+    *length = header_length + body_length;
+    response = malloc(*length);
+    if (NULL == response) {
+        return NULL;
+    }
+
+    memcpy(response, header, header_length);
+    for (i = header_length; i < *length; i++) {
+        response[i] = (u8)i;
+    }
+
+    return response;
+}
+
+/* consumes the header and all complete chunks, returns the number of consumed bytes */
+static u64 decode( const u8 *data, u64 length, u8 *in_body )
+{
+    if (!*in_body) {
+        u64 i;
+
+        for (i = 3; i < length; i++) {
+            if (data[i - 3] == '\r' && data[i - 2] == '\n' && data[i - 1] == '\r' && data[i] == '\n') {
+                *in_body = 1;
+                return i + 1;
+            }
+        }
+        return 0;
+    }
+
+    if (single_message) {
+        return length < decoder_chunk ? 0 : decoder_chunk;
+    }
+
+    return length - length % decoder_chunk;
+}
+
+int main( int argc, char **argv )
+{
+    u64 body_mb = 16;
+    u32 transfers = 32;
+    u32 reorder = 0;
+    u32 depth = 1;
+    struct br_config config;
+    struct br_stats stats;
+    u64 response_length;
+    u64 total_bytes = 0;
+    u8 *response;
+    double start, elapsed;
+    u32 t;
+    int opt;
+
+    br_init_default_config(&config);
+
+    while ((opt = getopt(argc, argv, "s:n:r:d:c:mzM:")) != -1) {
+        switch (opt) {
+            case 's':
+                body_mb = strtoull(optarg, NULL, 10);
+                break;
+            case 'n':
+                transfers = strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                reorder = strtoul(optarg, NULL, 10);
+                break;
+            case 'd':
+                depth = strtoul(optarg, NULL, 10);
+                break;
+            case 'c':
+                decoder_chunk = strtoull(optarg, NULL, 10);
+                break;
+            case 'm':
+                single_message = 1;
+                break;
+            case 'z':
+                config.zero_copy = 1;
+                break;
+            case 'M':
+                mss = strtoull(optarg, NULL, 10);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-s body size in MB] [-n transfers] [-r delay every nth segment] [-d segments sent before a delayed one] [-c decoder chunk size] [-m one chunk per call] [-z zero copy] [-M segment size]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (0 == decoder_chunk) {
+        decoder_chunk = 1;
+    }
+
+    if (0 == mss) {
+        mss = 1448;
+    }
+
+    if (0 == depth || MAX_REORDER_DEPTH < depth) {
+        depth = MAX_REORDER_DEPTH;
+    }
+
+    br_set_config(&config);
+
+    response = create_response(body_mb * 1024 * 1024, &response_length);
+    if (NULL == response) {
+        fprintf(stderr, "Not enough memory for a %llu MB response.\n", (unsigned long long)body_mb);
+        return 1;
+    }
+
+    start = now();
+
+    for (t = 0; t < transfers; t++) {
+        struct reassembly_flow_data rfd;
+        const u32 isn = 0xfffff000u + t; /* wraps around during the transfer */
+        u64 consumed = 0;
+        u64 offset = 0;
+        u32 segment = 0;
+        u8 in_body = 0;
+
+        memset(&rfd, 0, sizeof(rfd));
+        br_add_data(&rfd, isn, NULL, 0, 0, 1, 0);
+
+        while (offset < response_length) {
+            u64 order[MAX_REORDER_DEPTH + 1];
+            u32 count = 1;
+            u32 i;
+
+            order[0] = offset;
+            if (reorder && ++segment % reorder == 0) {
+                /* deliver the following segments first, this one arrives late */
+                while (count <= depth && offset + count * mss < response_length) {
+                    order[count - 1] = offset + count * mss;
+                    count++;
+                }
+                order[count - 1] = offset;
+            }
+
+            for (i = 0; i < count; i++) {
+                const u64 length = response_length - order[i] < mss ? response_length - order[i] : mss;
+                u64 remove[2] = { 0, 0 };
+                u64 view;
+
+                if (br_add_data(&rfd, isn + 1 + (u32)order[i], response + order[i], length, 0, 0, 0) == BR_ERROR) {
+                    fprintf(stderr, "br_add_data failed.\n");
+                    return 1;
+                }
+
+                view = br_get_view(&rfd, 0);
+                remove[0] = decode(br_get_data(&rfd, 0), view, &in_body);
+                if (remove[0] > 0) {
+                    if (memcmp(br_get_data(&rfd, 0), response + consumed, remove[0]) != 0) {
+                        fprintf(stderr, "Reassembled data differs at offset %llu.\n", (unsigned long long)consumed);
+                        return 1;
+                    }
+                    consumed += remove[0];
+                }
+                br_remove_data(&rfd, remove);
+            }
+
+            offset += count * mss;
+        }
+
+        total_bytes += response_length;
+        br_destroy_data(&rfd);
+    }
+
+    elapsed = now() - start;
+
+    printf("%u transfers of %llu MB, %llu bytes in %.3f s: %.1f MB/s\n",
+           transfers, (unsigned long long)body_mb, (unsigned long long)total_bytes,
+           elapsed, total_bytes / elapsed / (1024 * 1024));
+
+    br_get_stats(&stats);
+    printf("not copied: %llu packets, %llu bytes (%llu bytes stored later), copied: %llu packets, %llu bytes\n",
+           stats.direct_packets, stats.direct_bytes, stats.tail_bytes, stats.copied_packets, stats.copied_bytes);
+    printf("chunks: %llu bytes kept as received, %llu bytes linearized\n", stats.chunked_bytes, stats.linearized_bytes);
+
+    br_pool_cleanup();
+    free(response);
+
+    return 0;
+}
@@ -0,0 +1,285 @@
+/*
+ * event_batch.c
+ *
+ * Batched event dispatching, see event_batch.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "event_handler.h"
+#include "event_batch.h"
+
+static u64 eb_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+static inline u32 eb_type_index(const PACE2_event *event)
+{
+    const int type = event->header.type;
+
+    return type >= 0 && type < PACE2_NUMBER_OF_EVENTS ? (u32)type : EB_UNKNOWN_TYPE;
+}
+
+static const char *eb_type_name(u32 type)
+{
+    return EB_UNKNOWN_TYPE == type ? "unknown" : pace2_get_event_type_str(type);
+}
+
+static inline u32 eb_batch_size_bucket(u32 size)
+{
+    u32 bucket = 0;
+
+    while (bucket < EB_BATCH_SIZE_BUCKETS - 1 && (1u << bucket) < size) {
+        bucket++;
+    }
+
+    return bucket;
+}
+
+int eb_init(struct event_batch *eb, PACE2_module *pace2, int thread_ID, u32 batch_size)
+{
+    memset(eb, 0, sizeof(*eb));
+
+    eb->pace2 = pace2;
+    eb->thread_ID = thread_ID;
+    eb->batch_size = batch_size > 0 ? batch_size : 1;
+
+    eb->sorted = malloc(eb->batch_size * sizeof(*eb->sorted));
+    if (NULL == eb->sorted) {
+        return -1;
+    }
+
+    return 0;
+}
+
+void eb_destroy(struct event_batch *eb)
+{
+    free(eb->sorted);
+    eb->sorted = NULL;
+}
+
+int eb_add_consumer(struct event_batch *eb, const char *name)
+{
+    if (eb->consumer_count == EB_MAX_CONSUMERS) {
+        return -1;
+    }
+
+    eb->consumers[eb->consumer_count].name = name;
+
+    return (int)eb->consumer_count++;
+}
+
+int eb_subscribe(struct event_batch *eb, int consumer, int type, eb_handler handler, void *user_data)
+{
+    struct eb_chain *chain;
+    struct eb_entry *entry;
+
+    if (consumer < 0 || (u32)consumer >= eb->consumer_count || type < 0 || type > EB_UNKNOWN_TYPE ||
+        NULL == handler) {
+        return -1;
+    }
+
+    chain = &eb->chain[type];
+    if (chain->length == EB_MAX_CHAIN_LENGTH) {
+        return -1;
+    }
+
+    entry = &chain->entries[chain->length++];
+    memset(entry, 0, sizeof(*entry));
+    entry->handler = handler;
+    entry->user_data = user_data;
+    entry->consumer = (u32)consumer;
+
+    return 0;
+}
+
+void eb_subscribe_default(struct event_batch *eb, int consumer, eb_handler handler, void *user_data)
+{
+    int type;
+
+    for (type = 0; type < EB_NUMBER_OF_TYPES; type++) {
+        if (0 == eb->chain[type].length) {
+            eb_subscribe(eb, consumer, type, handler, user_data);
+        }
+    }
+}
+
+/* sorts one batch by type and calls every handler of a type once */
+static void eb_dispatch(struct event_batch *eb, PACE2_event **events, u32 n, PACE2_packet_descriptor const *pd)
+{
+    u32 offset[EB_NUMBER_OF_TYPES];
+    u32 start = 0;
+    u32 type;
+    u32 i;
+
+    /* counting sort, stable within a type */
+    memset(eb->count, 0, sizeof(eb->count));
+    for (i = 0; i < n; i++) {
+        eb->count[eb_type_index(events[i])]++;
+    }
+
+    for (type = 0; type < EB_NUMBER_OF_TYPES; type++) {
+        offset[type] = start;
+        start += eb->count[type];
+    }
+
+    for (i = 0; i < n; i++) {
+        eb->sorted[offset[eb_type_index(events[i])]++] = events[i];
+    }
+
+    start = 0;
+    for (type = 0; type < EB_NUMBER_OF_TYPES; type++) {
+        const u32 count = eb->count[type];
+        struct eb_chain * const chain = &eb->chain[type];
+
+        if (0 == count) {
+            continue;
+        }
+
+        eb->type_events[type] += count;
+
+        if (0 == chain->length) {
+            eb->dropped_events += count;
+            start += count;
+            continue;
+        }
+
+        /* every handler of the type between two readings of the clock */
+        {
+            u64 begin = eb_now_ns();
+
+            for (i = 0; i < chain->length; i++) {
+                struct eb_entry * const entry = &chain->entries[i];
+                u64 end;
+
+                entry->handler(eb->sorted + start, count, pd, entry->user_data);
+                end = eb_now_ns();
+
+                entry->events += count;
+                entry->calls++;
+                entry->ns += end - begin;
+                begin = end;
+            }
+        }
+
+        start += count;
+    }
+}
+
+u32 eb_drain(struct event_batch *eb, PACE2_packet_descriptor const *pd)
+{
+    u32 drained = 0;
+
+    eb->drains++;
+
+    for (;;) {
+        u32 n = 0;
+        PACE2_event ** const events = pace2_get_next_n_events(eb->pace2, eb->thread_ID, eb->batch_size, &n);
+
+        if (NULL == events) {
+            break;
+        }
+
+        if (n > 0) {
+            eb_dispatch(eb, events, n, pd);
+
+            eb->batches++;
+            eb->events += n;
+            eb->batch_sizes[eb_batch_size_bucket(n)]++;
+            if (n > eb->max_batch) {
+                eb->max_batch = n;
+            }
+            drained += n;
+        }
+
+        pace2_free_event_list(eb->pace2, eb->thread_ID, events);
+
+        /* a short batch emptied the queue */
+        if (n < eb->batch_size) {
+            break;
+        }
+    }
+
+    return drained;
+}
+
+void eb_print_stats(const struct event_batch *eb, FILE *f)
+{
+    u32 consumer;
+    u32 bucket;
+    u32 type;
+    u32 i;
+
+    fprintf(f, "  Event batches: %llu drains, %llu batches, %llu events (%.1f per batch, at most %u of %u), %llu dropped\n\n",
+            (unsigned long long)eb->drains, (unsigned long long)eb->batches, (unsigned long long)eb->events,
+            eb->batches > 0 ? (double)eb->events / eb->batches : 0.0, eb->max_batch, eb->batch_size,
+            (unsigned long long)eb->dropped_events);
+
+    fprintf(f, "  %-20s %s\n\n", "Batch size", "Batches");
+    for (bucket = 0; bucket < EB_BATCH_SIZE_BUCKETS; bucket++) {
+        char range[32];
+
+        if (0 == eb->batch_sizes[bucket]) {
+            continue;
+        }
+
+        if (bucket < 2) {
+            snprintf(range, sizeof(range), "%u", 1u << bucket);
+        } else if (bucket < EB_BATCH_SIZE_BUCKETS - 1) {
+            snprintf(range, sizeof(range), "%u-%u", (1u << (bucket - 1)) + 1, 1u << bucket);
+        } else {
+            snprintf(range, sizeof(range), "> %u", 1u << (bucket - 1));
+        }
+        fprintf(f, "  %-20s %llu\n", range, (unsigned long long)eb->batch_sizes[bucket]);
+    }
+
+    fprintf(f, "\n  %-40s %-12s %-10s %-12s %s\n\n", "Consumer / event type", "Events", "Calls", "Events/call", "ns/event");
+    for (consumer = 0; consumer < eb->consumer_count; consumer++) {
+        u64 events = 0;
+        u64 calls = 0;
+        u64 ns = 0;
+
+        for (type = 0; type < EB_NUMBER_OF_TYPES; type++) {
+            for (i = 0; i < eb->chain[type].length; i++) {
+                const struct eb_entry * const entry = &eb->chain[type].entries[i];
+
+                if (entry->consumer == consumer) {
+                    events += entry->events;
+                    calls += entry->calls;
+                    ns += entry->ns;
+                }
+            }
+        }
+
+        fprintf(f, "  %-40s %-12llu %-10llu %-12.1f %.1f\n", eb->consumers[consumer].name,
+                (unsigned long long)events, (unsigned long long)calls,
+                calls > 0 ? (double)events / calls : 0.0, events > 0 ? (double)ns / events : 0.0);
+
+        for (type = 0; type < EB_NUMBER_OF_TYPES; type++) {
+            for (i = 0; i < eb->chain[type].length; i++) {
+                const struct eb_entry * const entry = &eb->chain[type].entries[i];
+
+                if (entry->consumer != consumer || 0 == entry->calls) {
+                    continue;
+                }
+
+                fprintf(f, "    %-38s %-12llu %-10llu %-12.1f %.1f\n", eb_type_name(type),
+                        (unsigned long long)entry->events, (unsigned long long)entry->calls,
+                        (double)entry->events / entry->calls, (double)entry->ns / entry->events);
+            }
+        }
+    }
+
+    for (type = 0; type < EB_NUMBER_OF_TYPES; type++) {
+        if (0 != eb->type_events[type] && 0 == eb->chain[type].length) {
+            fprintf(f, "  %-40s %-12llu %s\n", eb_type_name(type), (unsigned long long)eb->type_events[type], "dropped");
+        }
+    }
+    fprintf(f, "\n");
+}
@@ -0,0 +1,149 @@
+/*
+ * event_batch.h
+ *
+ * Dispatches PACE 2 events to registered handlers instead of an if/else
+ * chain over the event type in every program. The event queue is drained
+ * in batches: pace2_get_next_n_events returns up to batch_size events at
+ * once; they are sorted by event type and every handler of a type gets the
+ * events of the type as one array, so a handler runs once per batch
+ * instead of once per event and its code stays hot in the i-cache while it
+ * works through the events of its type. Within one type the order of the
+ * queue is kept, between types it is not.
+ *
+ * Each consumer (counters, exporters, policy, ...) registers its handlers
+ * per event type; all handlers of one type form a chain in a small array
+ * indexed by the type and are called in registration order.
+ *
+ * The sizes of the drained batches and the events, calls and time of every
+ * handler are counted, eb_print_stats reports them per consumer.
+ */
+
+#ifndef EVENT_BATCH_H
+#define EVENT_BATCH_H
+
+#include <stdio.h>
+#include <pace2.h>
+
+/* index of the events with an unknown type */
+#define EB_UNKNOWN_TYPE PACE2_NUMBER_OF_EVENTS
+#define EB_NUMBER_OF_TYPES (PACE2_NUMBER_OF_EVENTS + 1)
+
+#define EB_MAX_CONSUMERS 16
+#define EB_MAX_CHAIN_LENGTH 8
+
+/* batch size histogram: bucket n counts batches of 2^(n-1) + 1 to 2^n events */
+#define EB_BATCH_SIZE_BUCKETS 16
+
+/**
+ * handles the events of one type of a batch
+ * @param events events of the type in queue order, valid until the handler returns
+ * @param count number of events, at least 1
+ * @param pd packet whose processing generated the events; NULL if not known
+ * @param user_data user data given at registration
+ */
+typedef void (*eb_handler)(PACE2_event * const *events, u32 count, PACE2_packet_descriptor const *pd,
+                           void *user_data);
+
+struct eb_entry {
+    eb_handler handler;
+    void *user_data;
+    u32 consumer;
+
+    /* statistics */
+    u64 events;
+    u64 calls;
+    u64 ns;
+};
+
+struct eb_chain {
+    u32 length;
+    struct eb_entry entries[EB_MAX_CHAIN_LENGTH];
+};
+
+struct eb_consumer {
+    const char *name;
+};
+
+struct event_batch {
+    PACE2_module *pace2;
+    int thread_ID;
+    u32 batch_size;
+
+    struct eb_chain chain[EB_NUMBER_OF_TYPES];
+    struct eb_consumer consumers[EB_MAX_CONSUMERS];
+    u32 consumer_count;
+
+    /* events of the current batch sorted by type */
+    PACE2_event **sorted;
+    u32 count[EB_NUMBER_OF_TYPES];
+
+    /* statistics */
+    u64 drains;
+    u64 batches;
+    u64 events;
+    u64 dropped_events;
+    u32 max_batch;
+    u64 batch_sizes[EB_BATCH_SIZE_BUCKETS];
+    u64 type_events[EB_NUMBER_OF_TYPES];
+};
+
+/**
+ * initializes a dispatcher without consumers
+ * @param eb dispatcher
+ * @param pace2 module whose event queue is drained
+ * @param thread_ID thread which drains the queue
+ * @param batch_size maximum number of events requested at once
+ * @return 0 on success, -1 if the sort buffer could not be allocated
+ */
+int eb_init(struct event_batch *eb, PACE2_module *pace2, int thread_ID, u32 batch_size);
+
+/**
+ * frees the sort buffer of a dispatcher
+ * @param eb dispatcher
+ */
+void eb_destroy(struct event_batch *eb);
+
+/**
+ * adds a consumer, its handlers are accounted together
+ * @param eb dispatcher
+ * @param name name in the statistics, must stay valid
+ * @return id of the consumer; -1 if there are EB_MAX_CONSUMERS consumers
+ */
+int eb_add_consumer(struct event_batch *eb, const char *name);
+
+/**
+ * appends a handler to the chain of an event type; events without handler are dropped
+ * @param eb dispatcher
+ * @param consumer consumer of the handler
+ * @param type event type, EB_UNKNOWN_TYPE for types outside of PACE2_event_type
+ * @param handler handler
+ * @param user_data passed to the handler
+ * @return 0 on success; -1 if the type or consumer is invalid or the chain is full
+ */
+int eb_subscribe(struct event_batch *eb, int consumer, int type, eb_handler handler, void *user_data);
+
+/**
+ * sets the handler of every event type which has none yet
+ * @param eb dispatcher
+ * @param consumer consumer of the handler
+ * @param handler handler
+ * @param user_data passed to the handler
+ */
+void eb_subscribe_default(struct event_batch *eb, int consumer, eb_handler handler, void *user_data);
+
+/**
+ * drains the event queue of the thread and dispatches the events
+ * @param eb dispatcher
+ * @param pd packet whose processing generated the events; NULL if not known
+ * @return number of drained events
+ */
+u32 eb_drain(struct event_batch *eb, PACE2_packet_descriptor const *pd);
+
+/**
+ * prints the batch size histogram and the cost of every consumer and handler
+ * @param eb dispatcher
+ * @param f output
+ */
+void eb_print_stats(const struct event_batch *eb, FILE *f);
+
+#endif /* EVENT_BATCH_H */
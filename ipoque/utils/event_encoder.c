@@ -0,0 +1,801 @@
+/*
+ * event_encoder.c
+ *
+ * Binary event records, see event_encoder.h.
+ */
+
+/* Includes *********************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "event_encoder.h"
+
+/* Private Types ****************************************************************/
+
+enum ee_field_kind {
+    EE_UNSIGNED = 0,        /* integer of 1, 2, 4 or 8 bytes */
+    EE_SIGNED,              /* signed integer or enum */
+    EE_BUFFER,              /* PACE2_byte_buffer */
+    EE_STRING,              /* const char *, stored with the terminating 0 */
+    EE_METADATA_STRING,     /* struct metadata_string of the dissectors */
+    EE_RAW                  /* structure without pointers, stored without trailing zero bytes */
+};
+
+enum ee_wire_type {
+    EE_WIRE_INTEGER = 0,
+    EE_WIRE_BYTES = 1
+};
+
+/* A member of an event structure, or count members which are stride bytes apart */
+struct ee_field {
+    u8 kind;
+    u16 size;
+    u16 count;
+    u32 offset;
+    u32 stride;
+    /* only encoded if the variant member of the event has this value, -1 for always */
+    int variant;
+};
+
+struct ee_event_fields {
+    struct ee_field const * fields;
+    u16 count;
+    /* offset of the enum which selects the variant fields, -1 if there is none */
+    int variant_offset;
+};
+
+/* Private Macros ***************************************************************/
+
+#define EE_MEMBER_SIZE(type, member) ((u16)sizeof(((type *)0)->member))
+
+#define EE_FIELD(kind, type, member) \
+    { kind, EE_MEMBER_SIZE(type, member), 1, offsetof(type, member), 0, -1 }
+
+/* member of every element of an array, e.g. line[i].content */
+#define EE_ARRAY(kind, type, array, member, n) \
+    { kind, EE_MEMBER_SIZE(type, array[0] member), n, offsetof(type, array[0] member), EE_MEMBER_SIZE(type, array[0]), -1 }
+
+#define EE_VARIANT(variant, kind, type, member) \
+    { kind, EE_MEMBER_SIZE(type, member), 1, offsetof(type, member), 0, variant }
+
+#define EE_VARIANT_ARRAY(variant, kind, type, array, member, n) \
+    { kind, EE_MEMBER_SIZE(type, array[0] member), n, offsetof(type, array[0] member), EE_MEMBER_SIZE(type, array[0]), variant }
+
+/* the elements of an array of structures from a member on, to leave out the pointers before it */
+#define EE_VARIANT_ARRAY_TAIL(variant, type, array, first, n) \
+    { EE_RAW, (u16)(EE_MEMBER_SIZE(type, array[0]) - (offsetof(type, array[0].first) - offsetof(type, array[0]))), \
+      n, offsetof(type, array[0].first), EE_MEMBER_SIZE(type, array[0]), variant }
+
+#define EE_EVENT(fields) { fields, PACE2_STATIC_ARRAY_SIZE(fields), -1 }
+#define EE_VARIANT_EVENT(fields, type, member) { fields, PACE2_STATIC_ARRAY_SIZE(fields), offsetof(type, member) }
+
+/* Private Constants ************************************************************/
+
+static struct ee_field const ee_flow_started_fields[] = {
+    EE_FIELD(EE_UNSIGNED, PACE2_flow_started, flow_id)
+};
+
+static struct ee_field const ee_flow_dropped_fields[] = {
+    EE_FIELD(EE_UNSIGNED, PACE2_flow_dropped, flow_id),
+    EE_FIELD(EE_SIGNED, PACE2_flow_dropped, removal_reason)
+};
+
+static struct ee_field const ee_flow_info_fields[] = {
+    EE_FIELD(EE_UNSIGNED, PACE2_flow_info, flow_id),
+    EE_FIELD(EE_UNSIGNED, PACE2_flow_info, src_id),
+    EE_FIELD(EE_UNSIGNED, PACE2_flow_info, dst_id),
+    EE_FIELD(EE_UNSIGNED, PACE2_flow_info, src_port),
+    EE_FIELD(EE_UNSIGNED, PACE2_flow_info, dst_port)
+};
+
+static struct ee_field const ee_flow_process_fields[] = {
+    EE_FIELD(EE_UNSIGNED, PACE2_flow_process, flow_id),
+    EE_FIELD(EE_UNSIGNED, PACE2_flow_process, bytes),
+    EE_FIELD(EE_UNSIGNED, PACE2_flow_process, total_bytes),
+    EE_FIELD(EE_UNSIGNED, PACE2_flow_process, missing_bytes),
+    EE_FIELD(EE_UNSIGNED, PACE2_flow_process, start_ts),
+    EE_FIELD(EE_UNSIGNED, PACE2_flow_process, last_packet_ts)
+};
+
+static struct ee_field const ee_subscriber_started_fields[] = {
+    EE_FIELD(EE_UNSIGNED, PACE2_subscriber_started, track_dst),
+    /* the pointer value is printed */
+    EE_FIELD(EE_UNSIGNED, PACE2_subscriber_started, subscriber_user_data),
+    EE_FIELD(EE_UNSIGNED, PACE2_subscriber_started, subscriber_id),
+    EE_FIELD(EE_RAW, PACE2_subscriber_started, ip)
+};
+
+static struct ee_field const ee_subscriber_dropped_fields[] = {
+    EE_FIELD(EE_UNSIGNED, PACE2_subscriber_dropped, subscriber_user_data),
+    EE_FIELD(EE_SIGNED, PACE2_subscriber_dropped, removal_reason),
+    EE_FIELD(EE_UNSIGNED, PACE2_subscriber_dropped, subscriber_id)
+};
+
+static struct ee_field const ee_subscriber_process_fields[] = {
+    EE_FIELD(EE_UNSIGNED, PACE2_subscriber_process, subscriber_id),
+    EE_FIELD(EE_UNSIGNED, PACE2_subscriber_process, bytes_up),
+    EE_FIELD(EE_UNSIGNED, PACE2_subscriber_process, bytes_down),
+    EE_FIELD(EE_UNSIGNED, PACE2_subscriber_process, total_bytes)
+};
+
+static struct ee_field const ee_detection_result_fields[] = {
+    EE_FIELD(EE_UNSIGNED, PACE2DetectionResult, effective_protocol),
+    EE_FIELD(EE_UNSIGNED, PACE2DetectionResult, effective_subprotocol),
+    EE_FIELD(EE_UNSIGNED, PACE2DetectionResult, real_protocol),
+    EE_FIELD(EE_UNSIGNED, PACE2DetectionResult, real_subprotocol),
+    EE_FIELD(EE_UNSIGNED, PACE2DetectionResult, application_id)
+};
+
+static struct ee_field const ee_http_request_fields[] = {
+    EE_FIELD(EE_UNSIGNED, PACE2_basic_HTTP_request_event, meta_data_mask),
+    EE_ARRAY(EE_SIGNED, PACE2_basic_HTTP_request_event, line, .type, PACE2_NUMBER_OF_HTTP_REQUEST_FLAGS),
+    EE_ARRAY(EE_BUFFER, PACE2_basic_HTTP_request_event, line, .content, PACE2_NUMBER_OF_HTTP_REQUEST_FLAGS)
+};
+
+static struct ee_field const ee_http_response_fields[] = {
+    EE_FIELD(EE_UNSIGNED, PACE2_basic_HTTP_response_event, meta_data_mask),
+    EE_ARRAY(EE_SIGNED, PACE2_basic_HTTP_response_event, line, .type, PACE2_NUMBER_OF_HTTP_RESPONSE_FLAGS),
+    EE_ARRAY(EE_BUFFER, PACE2_basic_HTTP_response_event, line, .content, PACE2_NUMBER_OF_HTTP_RESPONSE_FLAGS)
+};
+
+static struct ee_field const ee_citrix_fields[] = {
+    EE_FIELD(EE_UNSIGNED, PACE2_citrix_event, meta_data_mask),
+    EE_FIELD(EE_BUFFER, PACE2_citrix_event, initial_program),
+    EE_FIELD(EE_BUFFER, PACE2_citrix_event, username),
+    EE_FIELD(EE_UNSIGNED, PACE2_citrix_event, address),
+    EE_FIELD(EE_UNSIGNED, PACE2_citrix_event, port),
+    EE_FIELD(EE_UNSIGNED, PACE2_citrix_event, cgp_port)
+};
+
+static struct ee_field const ee_dhcp_fields[] = {
+    EE_FIELD(EE_UNSIGNED, PACE2_basic_DHCP_event, meta_data_mask),
+    EE_FIELD(EE_UNSIGNED, PACE2_basic_DHCP_event, your_ip_addr),
+    EE_FIELD(EE_BUFFER, PACE2_basic_DHCP_event, client_mac_addr),
+    EE_FIELD(EE_UNSIGNED, PACE2_basic_DHCP_event, addr_lease_time),
+    EE_FIELD(EE_UNSIGNED, PACE2_basic_DHCP_event, message_type)
+};
+
+static struct ee_field const ee_os_fields[] = {
+    EE_FIELD(EE_UNSIGNED, PACE2_OS_event, meta_data_mask),
+    EE_FIELD(EE_SIGNED, PACE2_OS_event, os_type),
+    EE_FIELD(EE_BUFFER, PACE2_OS_event, os_version_string)
+};
+
+static struct ee_field const ee_nat_fields[] = {
+    EE_FIELD(EE_UNSIGNED, PACE2_NAT_event, meta_data_mask),
+    EE_FIELD(EE_SIGNED, PACE2_NAT_event, nat_main_os),
+    EE_FIELD(EE_RAW, PACE2_NAT_event, nat_decision)
+};
+
+static struct ee_field const ee_sip_fields[] = {
+    EE_FIELD(EE_UNSIGNED, PACE2_basic_SIP_event, meta_data_mask),
+    EE_FIELD(EE_SIGNED, PACE2_basic_SIP_event, call_state),
+    EE_FIELD(EE_BUFFER, PACE2_basic_SIP_event, call_attr.from),
+    EE_FIELD(EE_BUFFER, PACE2_basic_SIP_event, call_attr.to),
+    EE_FIELD(EE_BUFFER, PACE2_basic_SIP_event, call_attr.id)
+};
+
+static struct ee_field const ee_ssl_client_hello_fields[] = {
+    EE_FIELD(EE_UNSIGNED, PACE2_SSL_client_hello_event, meta_data_mask),
+    EE_ARRAY(EE_SIGNED, PACE2_SSL_client_hello_event, line, .type, PACE2_NUMBER_OF_CLIENT_HELLO_LINES),
+    EE_ARRAY(EE_BUFFER, PACE2_SSL_client_hello_event, line, .content, PACE2_NUMBER_OF_CLIENT_HELLO_LINES)
+};
+
+static struct ee_field const ee_ssl_server_hello_fields[] = {
+    EE_FIELD(EE_UNSIGNED, PACE2_SSL_server_hello_event, meta_data_mask),
+    EE_ARRAY(EE_SIGNED, PACE2_SSL_server_hello_event, line, .type, PACE2_NUMBER_OF_SERVER_HELLO_LINES),
+    EE_ARRAY(EE_BUFFER, PACE2_SSL_server_hello_event, line, .content, PACE2_NUMBER_OF_SERVER_HELLO_LINES)
+};
+
+static struct ee_field const ee_ssl_dns_alt_names_fields[] = {
+    EE_ARRAY(EE_BUFFER, PACE2_SSL_dns_alt_names_event, entries, , IPOQUE_MAX_PARSE_SSL_DNS_ALT_NAMES),
+    EE_FIELD(EE_UNSIGNED, PACE2_SSL_dns_alt_names_event, number_of_entries)
+};
+
+static struct ee_field const ee_sit_fields[] = {
+    EE_FIELD(EE_RAW, PACE2_SIT_event, sit_stats)
+};
+
+static struct ee_field const ee_csi_packet_dir_fields[] = {
+    EE_FIELD(EE_SIGNED, PACE2_csi_packet_dir_event, packet_dir)
+};
+
+static struct ee_field const ee_csi_host_type_fields[] = {
+    EE_FIELD(EE_RAW, PACE2_csi_host_type_event, src),
+    EE_FIELD(EE_RAW, PACE2_csi_host_type_event, dst)
+};
+
+static struct ee_field const ee_rtp_fields[] = {
+    EE_FIELD(EE_UNSIGNED, PACE2_RTP_event, meta_data_mask),
+    EE_FIELD(EE_RAW, PACE2_RTP_event, flow_stats)
+};
+
+static struct ee_field const ee_rtcp_fields[] = {
+    EE_FIELD(EE_RAW, PACE2_RTCP_event, rtcp_report)
+};
+
+static struct ee_field const ee_tcp_fields[] = {
+    EE_FIELD(EE_UNSIGNED, PACE2_TCP_event, meta_data_mask),
+    EE_FIELD(EE_RAW, PACE2_TCP_event, latency_stats),
+    EE_FIELD(EE_RAW, PACE2_TCP_event, out_of_order_stats),
+    EE_FIELD(EE_UNSIGNED, PACE2_TCP_event, retransmission_stats)
+};
+
+static struct ee_field const ee_classification_status_fields[] = {
+    EE_FIELD(EE_UNSIGNED, PACE2_classification_status_event, meta_data_mask),
+    EE_FIELD(EE_UNSIGNED, PACE2_classification_status_event, api_version),
+    EE_FIELD(EE_RAW, PACE2_classification_status_event, version),
+    EE_FIELD(EE_UNSIGNED, PACE2_classification_status_event, license.init_error_code),
+    EE_FIELD(EE_STRING, PACE2_classification_status_event, license.init_error_reason),
+    EE_FIELD(EE_UNSIGNED, PACE2_classification_status_event, license.load_error_code),
+    EE_FIELD(EE_STRING, PACE2_classification_status_event, license.load_error_reason),
+    EE_FIELD(EE_UNSIGNED, PACE2_classification_status_event, license.validation_error_code),
+    EE_FIELD(EE_STRING, PACE2_classification_status_event, license.validation_error_reason),
+    EE_FIELD(EE_UNSIGNED, PACE2_classification_status_event, license.limitation_error_code),
+    EE_FIELD(EE_STRING, PACE2_classification_status_event, license.limitation_error_reason),
+    EE_FIELD(EE_UNSIGNED, PACE2_classification_status_event, license.no_of_mac_addresses_found),
+    EE_FIELD(EE_UNSIGNED, PACE2_classification_status_event, license.current_percentage_bandwidth_limit_usage)
+};
+
+static struct ee_field const ee_fastpath_fields[] = {
+    EE_FIELD(EE_RAW, PACE2_fastpath_event, fastpath)
+};
+
+static struct ee_field const ee_app_fields[] = {
+    EE_FIELD(EE_BUFFER, PACE2_app_event, app_version)
+};
+
+static struct ee_field const ee_classification_result_fields[] = {
+    EE_FIELD(EE_RAW, PACE2_classification_result_event, protocol.stack),
+    EE_FIELD(EE_RAW, PACE2_classification_result_event, protocol.attributes),
+    EE_FIELD(EE_SIGNED, PACE2_classification_result_event, application.type),
+    EE_FIELD(EE_UNSIGNED, PACE2_classification_result_event, application.classification_finished),
+    EE_FIELD(EE_RAW, PACE2_classification_result_event, application.attributes)
+};
+
+static struct ee_field const ee_cdc_result_fields[] = {
+    EE_FIELD(EE_UNSIGNED, PACE2_cdc_result_event, detected_cdc_id)
+};
+
+#ifndef PACE2_DISABLE_DECODER
+/* the layout of cdd_data is private to the custom decoder and may hold pointers, it is not encoded */
+static struct ee_field const ee_cdd_fields[] = {
+    EE_FIELD(EE_UNSIGNED, PACE2_cdd_event, cdd_id),
+    EE_FIELD(EE_UNSIGNED, PACE2_cdd_event, cdd_event_id)
+};
+#endif
+
+static struct ee_field const ee_license_fields[] = {
+    EE_FIELD(EE_UNSIGNED, PACE2_license_event, license.init_error_code),
+    EE_FIELD(EE_STRING, PACE2_license_event, license.init_error_reason),
+    EE_FIELD(EE_UNSIGNED, PACE2_license_event, license.load_error_code),
+    EE_FIELD(EE_STRING, PACE2_license_event, license.load_error_reason),
+    EE_FIELD(EE_UNSIGNED, PACE2_license_event, license.validation_error_code),
+    EE_FIELD(EE_STRING, PACE2_license_event, license.validation_error_reason),
+    EE_FIELD(EE_UNSIGNED, PACE2_license_event, license.limitation_error_code),
+    EE_FIELD(EE_STRING, PACE2_license_event, license.limitation_error_reason),
+    EE_FIELD(EE_UNSIGNED, PACE2_license_event, license.no_of_mac_addresses_found),
+    EE_FIELD(EE_UNSIGNED, PACE2_license_event, license.current_percentage_bandwidth_limit_usage)
+};
+
+static struct ee_field const ee_tcp_closed_fields[] = {
+    EE_FIELD(EE_UNSIGNED, PACE2_TCP_closed_event, flow_id),
+    EE_FIELD(EE_SIGNED, PACE2_TCP_closed_event, close_reason)
+};
+
+static struct ee_field const ee_tcp_started_fields[] = {
+    EE_FIELD(EE_UNSIGNED, PACE2_TCP_started_event, flow_id)
+};
+
+/* Only the member of the result union which belongs to the metadata type is encoded */
+static struct ee_field const ee_dissector_metadata_fields[] = {
+    EE_FIELD(EE_SIGNED, PACE2_dissector_metadata_event, metadata_type),
+    EE_VARIANT(DISSECTOR_IP, EE_RAW, PACE2_dissector_metadata_event, metadata.ip),
+    EE_VARIANT(DISSECTOR_TCP, EE_RAW, PACE2_dissector_metadata_event, metadata.tcp),
+    EE_VARIANT(DISSECTOR_H264, EE_RAW, PACE2_dissector_metadata_event, metadata.h264),
+    EE_VARIANT(DISSECTOR_AMR, EE_RAW, PACE2_dissector_metadata_event, metadata.amr),
+    EE_VARIANT_ARRAY(DISSECTOR_RTP, EE_STRING, PACE2_dissector_metadata_event, metadata.rtp.codec_str, , 2),
+    EE_VARIANT_ARRAY(DISSECTOR_RTP, EE_STRING, PACE2_dissector_metadata_event, metadata.rtp.stream_type_str, , 2),
+    EE_VARIANT(DISSECTOR_RTP, EE_RAW, PACE2_dissector_metadata_event, metadata.rtp.codec),
+    EE_VARIANT(DISSECTOR_RTP, EE_RAW, PACE2_dissector_metadata_event, metadata.rtp.stream_type),
+    EE_VARIANT(DISSECTOR_ID3, EE_METADATA_STRING, PACE2_dissector_metadata_event, metadata.id3.frames.talb),
+    EE_VARIANT(DISSECTOR_ID3, EE_METADATA_STRING, PACE2_dissector_metadata_event, metadata.id3.frames.tpe1),
+    EE_VARIANT(DISSECTOR_ID3, EE_METADATA_STRING, PACE2_dissector_metadata_event, metadata.id3.frames.tpe2),
+    EE_VARIANT(DISSECTOR_ID3, EE_METADATA_STRING, PACE2_dissector_metadata_event, metadata.id3.frames.tpe3),
+    EE_VARIANT(DISSECTOR_ID3, EE_METADATA_STRING, PACE2_dissector_metadata_event, metadata.id3.frames.tpe4),
+    EE_VARIANT(DISSECTOR_ID3, EE_METADATA_STRING, PACE2_dissector_metadata_event, metadata.id3.frames.trck),
+    EE_VARIANT(DISSECTOR_ID3, EE_METADATA_STRING, PACE2_dissector_metadata_event, metadata.id3.frames.tit1),
+    EE_VARIANT(DISSECTOR_ID3, EE_METADATA_STRING, PACE2_dissector_metadata_event, metadata.id3.frames.tit2),
+    EE_VARIANT(DISSECTOR_ID3, EE_METADATA_STRING, PACE2_dissector_metadata_event, metadata.id3.frames.tit3),
+    EE_VARIANT(DISSECTOR_ID3, EE_METADATA_STRING, PACE2_dissector_metadata_event, metadata.id3.frames.tcon),
+    EE_VARIANT(DISSECTOR_ID3, EE_UNSIGNED, PACE2_dissector_metadata_event, metadata.id3.version),
+    EE_VARIANT_ARRAY(DISSECTOR_MP3, EE_STRING, PACE2_dissector_metadata_event, metadata.mp3.codec_str, , 2),
+    EE_VARIANT(DISSECTOR_MP3, EE_RAW, PACE2_dissector_metadata_event, metadata.mp3.codec),
+    EE_VARIANT(DISSECTOR_MP3, EE_RAW, PACE2_dissector_metadata_event, metadata.mp3.audio),
+    EE_VARIANT(DISSECTOR_HTTP, EE_SIGNED, PACE2_dissector_metadata_event, metadata.http.content.type),
+    EE_VARIANT(DISSECTOR_HTTP, EE_STRING, PACE2_dissector_metadata_event, metadata.http.content.type_str),
+    EE_VARIANT(DISSECTOR_HTTP, EE_UNSIGNED, PACE2_dissector_metadata_event, metadata.http.content.done),
+    EE_VARIANT_ARRAY(DISSECTOR_MP4, EE_STRING, PACE2_dissector_metadata_event, metadata.mp4.video, .codec_str, 2),
+    EE_VARIANT_ARRAY_TAIL(DISSECTOR_MP4, PACE2_dissector_metadata_event, metadata.mp4.video, codec, 2),
+    EE_VARIANT_ARRAY(DISSECTOR_MP4, EE_STRING, PACE2_dissector_metadata_event, metadata.mp4.audio, .codec_str, 2),
+    EE_VARIANT_ARRAY_TAIL(DISSECTOR_MP4, PACE2_dissector_metadata_event, metadata.mp4.audio, codec, 2),
+    EE_VARIANT(DISSECTOR_MP4, EE_RAW, PACE2_dissector_metadata_event, metadata.mp4.duration),
+    EE_VARIANT_ARRAY(DISSECTOR_MP4, EE_STRING, PACE2_dissector_metadata_event, metadata.mp4.stream_type_str, , 2),
+    EE_VARIANT(DISSECTOR_MP4, EE_RAW, PACE2_dissector_metadata_event, metadata.mp4.type),
+#ifdef IPOQUE_ENABLE_MOS_CUST
+    EE_VARIANT(DISSECTOR_MOS_CUST, EE_RAW, PACE2_dissector_metadata_event, metadata.mos_cust),
+#endif
+};
+
+/*
+ * Fields of every supported event type; types without fields are not encoded.
+ * These are the advanced and class events: their data are decoder structures
+ * which refer to arrays and lists of further structures, a decoded record has
+ * no memory to rebuild them in.
+ */
+static struct ee_event_fields const ee_events[PACE2_NUMBER_OF_EVENTS] = {
+    [PACE2_DETECTION_RESULT] = EE_EVENT(ee_detection_result_fields),
+    [PACE2_FLOW_STARTED_EVENT] = EE_EVENT(ee_flow_started_fields),
+    [PACE2_FLOW_DROPPED_EVENT] = EE_EVENT(ee_flow_dropped_fields),
+    [PACE2_SUBSCRIBER_STARTED_EVENT] = EE_EVENT(ee_subscriber_started_fields),
+    [PACE2_SUBSCRIBER_DROPPED_EVENT] = EE_EVENT(ee_subscriber_dropped_fields),
+    [PACE2_BASIC_HTTP_REQUEST_EVENT] = EE_EVENT(ee_http_request_fields),
+    [PACE2_BASIC_HTTP_RESPONSE_EVENT] = EE_EVENT(ee_http_response_fields),
+    [PACE2_BASIC_CITRIX_EVENT] = EE_EVENT(ee_citrix_fields),
+    [PACE2_BASIC_DHCP_EVENT] = EE_EVENT(ee_dhcp_fields),
+    [PACE2_OS_EVENT] = EE_EVENT(ee_os_fields),
+    [PACE2_NAT_EVENT] = EE_EVENT(ee_nat_fields),
+    [PACE2_BASIC_SIP_EVENT] = EE_EVENT(ee_sip_fields),
+    [PACE2_BASIC_SSL_CLIENT_HELLO_EVENT] = EE_EVENT(ee_ssl_client_hello_fields),
+    [PACE2_BASIC_SSL_SERVER_HELLO_EVENT] = EE_EVENT(ee_ssl_server_hello_fields),
+    [PACE2_BASIC_SIT_EVENT] = EE_EVENT(ee_sit_fields),
+    [PACE2_CSI_PACKET_DIR_EVENT] = EE_EVENT(ee_csi_packet_dir_fields),
+    [PACE2_CSI_HOST_TYPE_EVENT] = EE_EVENT(ee_csi_host_type_fields),
+    [PACE2_BASIC_RTP_EVENT] = EE_EVENT(ee_rtp_fields),
+    [PACE2_BASIC_RTCP_EVENT] = EE_EVENT(ee_rtcp_fields),
+    [PACE2_TCP_EVENT] = EE_EVENT(ee_tcp_fields),
+    [PACE2_CLASSIFICATION_STATUS] = EE_EVENT(ee_classification_status_fields),
+    [PACE2_FASTPATH_EVENT] = EE_EVENT(ee_fastpath_fields),
+    [PACE2_APP_EVENT] = EE_EVENT(ee_app_fields),
+    [PACE2_CLASSIFICATION_RESULT] = EE_EVENT(ee_classification_result_fields),
+    [PACE2_CDC_RESULT] = EE_EVENT(ee_cdc_result_fields),
+    [PACE2_LICENSE_EXCEEDED_EVENT] = EE_EVENT(ee_license_fields),
+    [PACE2_FLOW_INFO_EVENT] = EE_EVENT(ee_flow_info_fields),
+    [PACE2_FLOW_PROCESS_EVENT] = EE_EVENT(ee_flow_process_fields),
+    [PACE2_SUBSCRIBER_PROCESS_EVENT] = EE_EVENT(ee_subscriber_process_fields),
+#ifndef PACE2_DISABLE_DECODER
+    [PACE2_CDD_EVENT] = EE_EVENT(ee_cdd_fields),
+#endif
+    [PACE2_TCP_STARTED_EVENT] = EE_EVENT(ee_tcp_started_fields),
+    [PACE2_TCP_CLOSED_EVENT] = EE_EVENT(ee_tcp_closed_fields),
+    [PACE2_BASIC_SSL_DNS_ALT_NAMES_EVENT] = EE_EVENT(ee_ssl_dns_alt_names_fields),
+    [PACE2_BASIC_DISSECTOR_METADATA_EVENT] = EE_VARIANT_EVENT(ee_dissector_metadata_fields,
+                                                              PACE2_dissector_metadata_event, metadata_type),
+};
+
+/* Private Definitions **********************************************************/
+
+/* writer which stops at the end of the buffer, overflow is set then */
+struct ee_writer {
+    u8 *pos;
+    u8 *end;
+    int overflow;
+};
+
+static inline void ee_put_varint(struct ee_writer * w, u64 value)
+{
+    if (w->end - w->pos < 10) {
+        /* slow path near the end of the buffer */
+        u8 tmp[10];
+        u32 n = 0;
+
+        do {
+            tmp[n++] = (u8)(value & 0x7f) | (value > 0x7f ? 0x80 : 0);
+            value >>= 7;
+        } while (value != 0);
+
+        if ((u64)(w->end - w->pos) < n) {
+            w->overflow = 1;
+            return;
+        }
+        memcpy(w->pos, tmp, n);
+        w->pos += n;
+        return;
+    }
+
+    while (value > 0x7f) {
+        *w->pos++ = (u8)(value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    *w->pos++ = (u8)value;
+}
+
+static inline void ee_put_bytes(struct ee_writer * w, u32 key, void const * data, u32 len)
+{
+    ee_put_varint(w, key);
+    ee_put_varint(w, len);
+
+    if (w->overflow || (u64)(w->end - w->pos) < len) {
+        w->overflow = 1;
+        return;
+    }
+    memcpy(w->pos, data, len);
+    w->pos += len;
+}
+
+static inline u64 ee_load_unsigned(u8 const * p, u16 size)
+{
+    switch (size) {
+    case 1:
+        return *p;
+    case 2: {
+        u16 v;
+        memcpy(&v, p, 2);
+        return v;
+    }
+    case 4: {
+        u32 v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+    default: {
+        u64 v;
+        memcpy(&v, p, 8);
+        return v;
+    }
+    }
+}
+
+static inline int64_t ee_load_signed(u8 const * p, u16 size)
+{
+    switch (size) {
+    case 1:
+        return *(int8_t const *)p;
+    case 2: {
+        int16_t v;
+        memcpy(&v, p, 2);
+        return v;
+    }
+    case 4: {
+        int32_t v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+    default: {
+        int64_t v;
+        memcpy(&v, p, 8);
+        return v;
+    }
+    }
+}
+
+static inline void ee_store_integer(u8 * p, u16 size, u64 value)
+{
+    switch (size) {
+    case 1:
+        *p = (u8)value;
+        break;
+    case 2: {
+        u16 v = (u16)value;
+        memcpy(p, &v, 2);
+        break;
+    }
+    case 4: {
+        u32 v = (u32)value;
+        memcpy(p, &v, 4);
+        break;
+    }
+    default:
+        memcpy(p, &value, 8);
+        break;
+    }
+}
+
+static inline void ee_encode_field(struct ee_writer * w, u32 tag, struct ee_field const * field, u8 const * p)
+{
+    switch (field->kind) {
+    case EE_UNSIGNED: {
+        u64 const value = ee_load_unsigned(p, field->size);
+
+        if (value != 0) {
+            ee_put_varint(w, tag << 1 | EE_WIRE_INTEGER);
+            ee_put_varint(w, value);
+        }
+        break;
+    }
+    case EE_SIGNED: {
+        int64_t const value = ee_load_signed(p, field->size);
+
+        if (value != 0) {
+            ee_put_varint(w, tag << 1 | EE_WIRE_INTEGER);
+            ee_put_varint(w, ((u64)value << 1) ^ (u64)(value >> 63));
+        }
+        break;
+    }
+    case EE_BUFFER: {
+        PACE2_byte_buffer const * const buffer = (PACE2_byte_buffer const *)p;
+
+        if (buffer->ptr != NULL) {
+            ee_put_bytes(w, tag << 1 | EE_WIRE_BYTES, buffer->ptr, buffer->len);
+        }
+        break;
+    }
+    case EE_STRING: {
+        char const * string;
+
+        memcpy(&string, p, sizeof(string));
+        if (string != NULL) {
+            ee_put_bytes(w, tag << 1 | EE_WIRE_BYTES, string, strlen(string) + 1);
+        }
+        break;
+    }
+    case EE_METADATA_STRING: {
+        struct metadata_string const * const string = (struct metadata_string const *)p;
+
+        if (string->ptr != NULL) {
+            ee_put_bytes(w, tag << 1 | EE_WIRE_BYTES, string->ptr, string->len);
+        }
+        break;
+    }
+    case EE_RAW: {
+        u32 len = field->size;
+
+        while (len > 0 && p[len - 1] == 0) {
+            len--;
+        }
+        if (len > 0) {
+            ee_put_bytes(w, tag << 1 | EE_WIRE_BYTES, p, len);
+        }
+        break;
+    }
+    }
+}
+
+/* reads a varint, returns 0 if it does not end before end */
+static inline int ee_get_varint(u8 const ** pos, u8 const * end, u64 * value)
+{
+    u8 const * p = *pos;
+    u32 shift = 0;
+
+    *value = 0;
+    while (p < end && shift < 64) {
+        u8 const byte = *p++;
+
+        *value |= (u64)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            *pos = p;
+            return 1;
+        }
+        shift += 7;
+    }
+
+    return 0;
+}
+
+/* stores a decoded value in the field of the event, returns 0 if the value does not fit the field */
+static int ee_decode_field(struct ee_field const * field, u8 * p, u32 wire, u64 value, u8 const * data)
+{
+    switch (field->kind) {
+    case EE_UNSIGNED:
+        if (wire != EE_WIRE_INTEGER) {
+            return 0;
+        }
+        ee_store_integer(p, field->size, value);
+        return 1;
+    case EE_SIGNED:
+        if (wire != EE_WIRE_INTEGER) {
+            return 0;
+        }
+        ee_store_integer(p, field->size, (value >> 1) ^ (0 - (value & 1)));
+        return 1;
+    case EE_BUFFER: {
+        PACE2_byte_buffer * const buffer = (PACE2_byte_buffer *)p;
+
+        if (wire != EE_WIRE_BYTES) {
+            return 0;
+        }
+        buffer->ptr = (char const *)data;
+        buffer->len = (u32)value;
+        return 1;
+    }
+    case EE_STRING: {
+        char const * const string = (char const *)data;
+
+        /* stored with the terminating 0 */
+        if (wire != EE_WIRE_BYTES || value == 0 || data[value - 1] != 0) {
+            return 0;
+        }
+        memcpy(p, &string, sizeof(string));
+        return 1;
+    }
+    case EE_METADATA_STRING: {
+        struct metadata_string * const string = (struct metadata_string *)p;
+
+        if (wire != EE_WIRE_BYTES || value > 0xffff) {
+            return 0;
+        }
+        string->ptr = data;
+        string->len = (u16)value;
+        return 1;
+    }
+    case EE_RAW:
+        if (wire != EE_WIRE_BYTES || value > field->size) {
+            return 0;
+        }
+        memcpy(p, data, value);
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Public Definitions ***********************************************************/
+
+void pace2_init_event_log_header(struct pace2_event_log_header * header)
+{
+    header->magic = PACE2_EVENT_LOG_MAGIC;
+    header->version_major = PACE2_EVENT_LOG_VERSION_MAJOR;
+    header->version_minor = PACE2_EVENT_LOG_VERSION_MINOR;
+}
+
+int pace2_check_event_log_header(struct pace2_event_log_header const * const header)
+{
+    if (header->magic != PACE2_EVENT_LOG_MAGIC || header->version_major != PACE2_EVENT_LOG_VERSION_MAJOR) {
+        return 1;
+    }
+
+    return 0;
+}
+
+int pace2_can_encode_event_type(int type)
+{
+    return type > PACE2_NO_EVENT && type < PACE2_NUMBER_OF_EVENTS && ee_events[type].fields != NULL;
+}
+
+u32 pace2_encode_event(PACE2_event const * const event, u8 * buffer, u32 size)
+{
+    struct ee_event_fields const * type;
+    struct ee_writer w;
+    u8 const * const base = (u8 const *)event;
+    int variant = -1;
+    u32 tag = 1;
+    u32 body_len;
+    u32 prefix_len;
+    u32 i;
+
+    if (event == NULL || event->header.type <= PACE2_NO_EVENT || event->header.type >= PACE2_NUMBER_OF_EVENTS ||
+        size < 2) {
+        return 0;
+    }
+
+    type = &ee_events[event->header.type];
+    if (type->fields == NULL) {
+        return 0;
+    }
+
+    if (type->variant_offset >= 0) {
+        variant = (int)ee_load_signed(base + type->variant_offset, sizeof(int));
+    }
+
+    /* the body starts after a one byte length, it is moved if the length needs more */
+    w.pos = buffer + 1;
+    w.end = buffer + size;
+    w.overflow = 0;
+
+    ee_put_varint(&w, (u64)event->header.type);
+
+    for (i = 0; i < type->count; i++) {
+        struct ee_field const * const field = &type->fields[i];
+        u32 n;
+
+        if (field->variant >= 0 && field->variant != variant) {
+            tag += field->count;
+            continue;
+        }
+
+        for (n = 0; n < field->count; n++, tag++) {
+            ee_encode_field(&w, tag, field, base + field->offset + n * field->stride);
+        }
+    }
+
+    if (w.overflow) {
+        return 0;
+    }
+
+    body_len = (u32)(w.pos - buffer - 1);
+    if (body_len < 0x80) {
+        buffer[0] = (u8)body_len;
+        return body_len + 1;
+    }
+
+    {
+        struct ee_writer prefix = { NULL, NULL, 0 };
+        u8 length[5];
+
+        prefix.pos = length;
+        prefix.end = length + sizeof(length);
+        ee_put_varint(&prefix, body_len);
+        prefix_len = (u32)(prefix.pos - length);
+
+        if (prefix_len + body_len > size) {
+            return 0;
+        }
+
+        memmove(buffer + prefix_len, buffer + 1, body_len);
+        memcpy(buffer, length, prefix_len);
+    }
+
+    return prefix_len + body_len;
+}
+
+u32 pace2_decode_event(u8 const * buffer, u32 size, PACE2_event * event)
+{
+    struct ee_event_fields const * type = NULL;
+    u8 const * pos = buffer;
+    u8 const * end;
+    u64 body_len;
+    u64 value;
+
+    if (!ee_get_varint(&pos, buffer + size, &body_len) || body_len > (u64)(buffer + size - pos)) {
+        return 0;
+    }
+    end = pos + body_len;
+
+    if (!ee_get_varint(&pos, end, &value) || value >= PACE2_NUMBER_OF_EVENTS) {
+        return 0;
+    }
+
+    memset(event, 0, sizeof(*event));
+    event->header.type = (int)value;
+    if (ee_events[value].fields != NULL) {
+        type = &ee_events[value];
+    }
+
+    while (pos < end) {
+        u8 const * data = NULL;
+        u64 key;
+        u32 wire;
+        u64 tag;
+
+        if (!ee_get_varint(&pos, end, &key) || !ee_get_varint(&pos, end, &value)) {
+            return 0;
+        }
+
+        wire = (u32)(key & 1);
+        tag = key >> 1;
+
+        if (wire == EE_WIRE_BYTES) {
+            if (value > (u64)(end - pos)) {
+                return 0;
+            }
+            data = pos;
+            pos += value;
+        }
+
+        if (type != NULL) {
+            u32 first = 1;
+            u32 i;
+
+            /* find the field of the tag, unknown tags are skipped */
+            for (i = 0; i < type->count; i++) {
+                struct ee_field const * const field = &type->fields[i];
+
+                /* tags start at 1, a smaller one would address memory before the field */
+                if (tag < first) {
+                    return 0;
+                }
+                if (tag < first + field->count) {
+                    if (!ee_decode_field(field, (u8 *)event + field->offset + (tag - first) * field->stride,
+                                         wire, value, data)) {
+                        return 0;
+                    }
+                    break;
+                }
+                first += field->count;
+            }
+        }
+    }
+
+    return (u32)(end - buffer);
+}
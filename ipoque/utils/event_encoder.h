@@ -0,0 +1,73 @@
+/*
+ * event_encoder.h
+ *
+ * Compact binary encoding of PACE 2 events, as a cheap replacement for
+ * pace2_debug_event in production. Every event becomes one length
+ * prefixed record in a caller supplied buffer; no stdio, no locale.
+ * pace2_decode_event turns a record back into a PACE2_event, which
+ * pace2_debug_event prints exactly like the original one.
+ *
+ * record layout, all integers are LEB128 varints:
+ * 1) length of the rest of the record
+ * 2) event type
+ * 3) fields: key = tag << 1 | wire type, then the value. Wire type 0 is an
+ *    integer (zigzag encoded if signed), wire type 1 a length and as many
+ *    bytes. Integers that are 0 and buffers without data are left out.
+ * The tags are numbered per event type, unknown tags are skipped.
+ *
+ * Nested structures are stored as raw bytes in host byte order, so a log is
+ * decoded on the architecture which wrote it. All events except the
+ * advanced and class events are supported; of custom decoder events only the
+ * IDs are stored, not cdd_data.
+ */
+
+#ifndef EVENT_ENCODER_H
+#define EVENT_ENCODER_H
+
+#include <pace2.h>
+
+#define PACE2_EVENT_LOG_MAGIC 0x56453250 /* "P2EV" */
+#define PACE2_EVENT_LOG_VERSION_MAJOR 1
+#define PACE2_EVENT_LOG_VERSION_MINOR 0
+
+/* header at the start of an event log file, followed by the records */
+struct pace2_event_log_header {
+    u32 magic;
+    u16 version_major;
+    u16 version_minor;
+};
+
+/** Initializes the header of an event log file.
+ * @param header header to fill.
+ */
+void pace2_init_event_log_header(struct pace2_event_log_header * header);
+
+/** Checks the header of an event log file.
+ * @param header header read from the file.
+ * @return 0 if the log can be decoded; != 0 otherwise.
+ */
+int pace2_check_event_log_header(struct pace2_event_log_header const * const header);
+
+/** Checks whether events of a type can be encoded.
+ * @param type PACE 2 event type.
+ * @return 1 if pace2_encode_event supports the type; 0 otherwise.
+ */
+int pace2_can_encode_event_type(int type);
+
+/** Encodes an event as binary record.
+ * @param event event to encode.
+ * @param buffer buffer for the record.
+ * @param size size of the buffer.
+ * @return length of the record; 0 if the buffer is too small or the event type is not supported.
+ */
+u32 pace2_encode_event(PACE2_event const * const event, u8 * buffer, u32 size);
+
+/** Decodes a binary record. The byte buffers and strings of the event point into the record.
+ * @param buffer buffer starting with a record.
+ * @param size number of bytes in the buffer.
+ * @param event decoded event, fields which were not encoded are 0.
+ * @return length of the record; 0 if the buffer does not hold a complete, valid record.
+ */
+u32 pace2_decode_event(u8 const * buffer, u32 size, PACE2_event * event);
+
+#endif /* EVENT_ENCODER_H */
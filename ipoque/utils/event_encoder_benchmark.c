@@ -0,0 +1,283 @@
+/*
+ * event_encoder_benchmark.c
+ *
+ * Compares the throughput of the text event log of pace2_debug_event with
+ * the binary records of pace2_encode_event. A mix of typical events is
+ * written to /dev/null both ways; the binary records are then decoded and
+ * printed again to check that they reproduce the text output. Every event
+ * type is checked to be supported unless it is an advanced or class event,
+ * and to decode into an event which encodes to the same record. Records
+ * with the invalid field tag 0 have to be rejected.
+ *
+ * usage: event_encoder_benchmark [number of events]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "event_handler.h"
+#include "event_encoder.h"
+
+#define NUMBER_OF_SAMPLE_EVENTS 6
+
+/* records are collected in a buffer of this size and written with one fwrite */
+#define WRITE_BUFFER_SIZE (64 * 1024)
+
+static PACE2_event sample_events[NUMBER_OF_SAMPLE_EVENTS];
+
+static double now( void )
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void set_buffer( PACE2_byte_buffer *buffer, const char *string )
+{
+    buffer->ptr = string;
+    buffer->len = strlen(string);
+}
+
+static void create_sample_events( void )
+{
+    PACE2_flow_process *flow_process = &sample_events[0].flow_process;
+    PACE2_basic_HTTP_request_event *http = &sample_events[1].http_basic_request_meta_data;
+    PACE2DetectionResult *detection = &sample_events[2].detection_result;
+    PACE2_TCP_closed_event *tcp_closed = &sample_events[3].tcp_dropped_meta_data;
+    PACE2_cdc_result_event *cdc = &sample_events[4].cdc_data;
+    PACE2_cdd_event *cdd = &sample_events[5].cdd_meta_data;
+
+    memset(sample_events, 0, sizeof(sample_events));
+
+    flow_process->type = PACE2_FLOW_PROCESS_EVENT;
+    flow_process->flow_id = 123456;
+    flow_process->bytes = 48213;
+    flow_process->total_bytes = 52871;
+    flow_process->start_ts = 1476871234123ull;
+    flow_process->last_packet_ts = 1476871239876ull;
+
+    http->type = PACE2_BASIC_HTTP_REQUEST_EVENT;
+    http->meta_data_mask = 1 << PACE2_HTTP_REQUEST_METHOD | 1 << PACE2_HTTP_REQUEST_URI |
+                           1 << PACE2_HTTP_HOST | 1 << PACE2_HTTP_USER_AGENT;
+    http->line[PACE2_HTTP_REQUEST_METHOD].type = PACE2_HTTP_REQUEST_METHOD;
+    set_buffer(&http->line[PACE2_HTTP_REQUEST_METHOD].content, "GET");
+    http->line[PACE2_HTTP_REQUEST_URI].type = PACE2_HTTP_REQUEST_URI;
+    set_buffer(&http->line[PACE2_HTTP_REQUEST_URI].content, "/index.html?session=0123456789abcdef");
+    http->line[PACE2_HTTP_HOST].type = PACE2_HTTP_HOST;
+    set_buffer(&http->line[PACE2_HTTP_HOST].content, "www.example.com");
+    http->line[PACE2_HTTP_USER_AGENT].type = PACE2_HTTP_USER_AGENT;
+    set_buffer(&http->line[PACE2_HTTP_USER_AGENT].content, "Mozilla/5.0 (X11; Linux x86_64; rv:49.0) Gecko/20100101 Firefox/49.0");
+
+    detection->type = PACE2_DETECTION_RESULT;
+    detection->effective_protocol = 7;
+    detection->real_protocol = 7;
+    detection->application_id = 42;
+
+    tcp_closed->type = PACE2_TCP_CLOSED_EVENT;
+    tcp_closed->flow_id = 123456;
+
+    cdc->type = PACE2_CDC_RESULT;
+    cdc->detected_cdc_id = 3;
+
+    cdd->type = PACE2_CDD_EVENT;
+    cdd->cdd_id = 2;
+    cdd->cdd_event_id = 17;
+}
+
+static double run_text( FILE *out, u64 events )
+{
+    double start = now();
+    u64 i;
+
+    for (i = 0; i < events; i++) {
+        pace2_debug_event(out, &sample_events[i % NUMBER_OF_SAMPLE_EVENTS]);
+    }
+    fflush(out);
+
+    return now() - start;
+}
+
+static double run_binary( FILE *out, u64 events, u64 *bytes )
+{
+    static u8 buffer[WRITE_BUFFER_SIZE];
+    double start = now();
+    u32 used = 0;
+    u64 i;
+
+    *bytes = 0;
+    for (i = 0; i < events; i++) {
+        PACE2_event const * const event = &sample_events[i % NUMBER_OF_SAMPLE_EVENTS];
+        u32 length = pace2_encode_event(event, buffer + used, sizeof(buffer) - used);
+
+        if (length == 0) {
+            fwrite(buffer, 1, used, out);
+            used = 0;
+            length = pace2_encode_event(event, buffer, sizeof(buffer));
+        }
+        used += length;
+        *bytes += length;
+    }
+    fwrite(buffer, 1, used, out);
+    fflush(out);
+
+    return now() - start;
+}
+
+/* prints every sample event directly and decoded from its record, returns 0 if both texts are equal */
+static int check_round_trip( void )
+{
+    int i;
+
+    for (i = 0; i < NUMBER_OF_SAMPLE_EVENTS; i++) {
+        u8 record[4096];
+        PACE2_event decoded;
+        char *expected = NULL;
+        char *actual = NULL;
+        size_t expected_size = 0;
+        size_t actual_size = 0;
+        FILE *f;
+        u32 length;
+        int equal;
+
+        length = pace2_encode_event(&sample_events[i], record, sizeof(record));
+        if (length == 0 || pace2_decode_event(record, length, &decoded) != length) {
+            fprintf(stderr, "event %i could not be encoded\n", i);
+            return 1;
+        }
+
+        f = open_memstream(&expected, &expected_size);
+        pace2_debug_event(f, &sample_events[i]);
+        fclose(f);
+
+        f = open_memstream(&actual, &actual_size);
+        pace2_debug_event(f, &decoded);
+        fclose(f);
+
+        equal = expected_size == actual_size && memcmp(expected, actual, expected_size) == 0;
+        if (!equal) {
+            fprintf(stderr, "decoded event %i differs:\n%s---\n%s", i, expected, actual);
+        }
+
+        free(expected);
+        free(actual);
+
+        if (!equal) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* returns 0 if exactly the advanced and class events are not supported and every other type survives a round trip */
+static int check_event_types( void )
+{
+    int type;
+
+    for (type = PACE2_NO_EVENT + 1; type < PACE2_NUMBER_OF_EVENTS; type++) {
+        PACE2_event_groups group;
+        PACE2_event event;
+        PACE2_event decoded;
+        u8 record[4096];
+        u8 again[4096];
+        u32 length;
+        int expected;
+
+        if (pace2_get_group_of_event((PACE2_event_type)type, &group) != PACE2_SUCCESS) {
+            fprintf(stderr, "event type %i has no group\n", type);
+            return 1;
+        }
+        expected = group != PACE2_ADVANCED_PROTOCOL_META_DATA_GROUP && group != PACE2_CLASS_PROTOCOL_META_DATA_GROUP;
+
+        memset(&event, 0, sizeof(event));
+        event.header.type = type;
+        length = pace2_encode_event(&event, record, sizeof(record));
+
+        if (pace2_can_encode_event_type(type) != expected || (length != 0) != expected) {
+            fprintf(stderr, "event type %i is %ssupported\n", type, expected ? "not " : "");
+            return 1;
+        }
+        if (!expected) {
+            continue;
+        }
+
+        if (pace2_decode_event(record, length, &decoded) != length || decoded.header.type != type ||
+            pace2_encode_event(&decoded, again, sizeof(again)) != length || memcmp(record, again, length) != 0) {
+            fprintf(stderr, "event type %i does not survive a round trip\n", type);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* returns 0 if records with the tag 0 are rejected and the same records with the tag 1 are decoded */
+static int check_invalid_tags( void )
+{
+    /* body length, event type, key (tag << 1 | wire), value or length and bytes; the first field of the
+       HTTP request is an integer, the one of the DNS alt names an array of buffers */
+    const u8 integer_field[] = { 3, PACE2_BASIC_HTTP_REQUEST_EVENT, 0 << 1 | 0, 1 };
+    const u8 bytes_field[] = { 5, PACE2_BASIC_SSL_DNS_ALT_NAMES_EVENT, 0 << 1 | 1, 2, 'a', 'b' };
+    const u8 * const records[] = { integer_field, bytes_field };
+    const u32 sizes[] = { sizeof(integer_field), sizeof(bytes_field) };
+    u32 i;
+
+    for (i = 0; i < sizeof(records) / sizeof(records[0]); i++) {
+        PACE2_event decoded;
+        u8 record[16];
+
+        if (pace2_decode_event(records[i], sizes[i], &decoded) != 0) {
+            fprintf(stderr, "record %u with tag 0 is decoded\n", i);
+            return 1;
+        }
+
+        memcpy(record, records[i], sizes[i]);
+        record[2] |= 1 << 1;
+        if (pace2_decode_event(record, sizes[i], &decoded) != sizes[i]) {
+            fprintf(stderr, "record %u with tag 1 is not decoded\n", i);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int main( int argc, char **argv )
+{
+    u64 events = 1000000;
+    double text_time;
+    double binary_time;
+    u64 bytes;
+    FILE *out;
+
+    if (argc > 1) {
+        events = strtoull(argv[1], NULL, 10);
+    }
+
+    create_sample_events();
+
+    if (check_round_trip() != 0 || check_event_types() != 0 || check_invalid_tags() != 0) {
+        return 1;
+    }
+
+    out = fopen("/dev/null", "wb");
+    if (out == NULL) {
+        perror("/dev/null");
+        return 1;
+    }
+
+    text_time = run_text(out, events);
+    binary_time = run_binary(out, events, &bytes);
+
+    fclose(out);
+
+    printf("%llu events\n", (unsigned long long)events);
+    printf("text:   %10.0f events/s\n", events / text_time);
+    printf("binary: %10.0f events/s, %.1f bytes/event\n", events / binary_time, (double)bytes / events);
+
+    return 0;
+}
@@ -648,7 +648,14 @@ static inline void ipq_pace2_ssl_server_hello_event_handler (FILE * f, PACE2_SSL
             {
                 ipq_pace2_print_event_raw(f, &ssl_meta_data->line[iter].content);
             } else if (ssl_meta_data->line[iter].type == PACE2_SSL_CIPHER_SUITE) {
-                ipq_pace2_print_event_value_hex(f, *((u64 *)ssl_meta_data->line[iter].content.ptr));
+                /* the cipher suite has 2 bytes, not 8 */
+                PACE2_byte_buffer const * const content = &ssl_meta_data->line[iter].content;
+                u64 cipher_suite = 0;
+
+                if (content->ptr != NULL) {
+                    memcpy(&cipher_suite, content->ptr, content->len < sizeof(cipher_suite) ? content->len : sizeof(cipher_suite));
+                }
+                ipq_pace2_print_event_value_hex(f, cipher_suite);
             } else {
                 ipq_pace2_print_event_string(f, &ssl_meta_data->line[iter].content);
             }
@@ -1249,6 +1256,15 @@ static inline void ipq_pace2_basic_dissector_metadata_event(FILE * f,
 
 /* Public Definitions ***********************************************************/
 
+char const * pace2_get_event_type_str(int type)
+{
+    if (type < 0 || type >= PACE2_NUMBER_OF_EVENTS) {
+        type = PACE2_NUMBER_OF_EVENTS;
+    }
+
+    return pace_event_type_to_string[type];
+}
+
 void pace2_debug_event(FILE * f, PACE2_event const * const event)
 {
     if (event == NULL) {
@@ -28,4 +28,10 @@
  */
 void pace2_debug_event(FILE * f, PACE2_event const * const event);
 
+/** Returns the name of an event type.
+ * @param type event type, see @ref PACE2_event_type.
+ * @return name of the type; "PACE2_NUMBER_OF_EVENTS" for unknown types.
+ */
+char const * pace2_get_event_type_str(int type);
+
 #endif /* EVENT_HANDLER_H_ */
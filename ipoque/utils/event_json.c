@@ -0,0 +1,797 @@
+/*
+ * event_json.c
+ *
+ * NDJSON encoding of PACE 2 events, see event_json.h.
+ */
+
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+
+#include "event_json.h"
+
+/* constant JSON text and its length */
+struct json_text {
+    const char *text;
+    u32 length;
+};
+
+#define JSON_TEXT(s) { s, sizeof(s) - 1 }
+/* key of a member which is not the first one of its object */
+#define JSON_KEY(s) JSON_TEXT(",\"" s "\":")
+
+/* output position, a write which does not fit sets overflow and leaves the rest of the buffer alone */
+struct json_writer {
+    char *p;
+    char *end;
+    int overflow;
+};
+
+static const char json_digit_pairs[200] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static const char json_hex_digits[16] = "0123456789abcdef";
+
+/* 0: copied unchanged; 1: start of a multi byte UTF-8 sequence or invalid; otherwise the character after the backslash */
+static const u8 json_escape[256] = {
+    [0x00 ... 0x07] = 'u',
+    ['\b'] = 'b',
+    ['\t'] = 't',
+    ['\n'] = 'n',
+    [0x0b] = 'u',
+    ['\f'] = 'f',
+    ['\r'] = 'r',
+    [0x0e ... 0x1f] = 'u',
+    ['"'] = '"',
+    ['\\'] = '\\',
+    [0x80 ... 0xff] = 1
+};
+
+static const struct json_text json_event_names[PACE2_NUMBER_OF_EVENTS] = {
+    [PACE2_FLOW_STARTED_EVENT] = JSON_TEXT("{\"type\":\"flow_started\""),
+    [PACE2_FLOW_DROPPED_EVENT] = JSON_TEXT("{\"type\":\"flow_dropped\""),
+    [PACE2_FLOW_INFO_EVENT] = JSON_TEXT("{\"type\":\"flow_info\""),
+    [PACE2_FLOW_PROCESS_EVENT] = JSON_TEXT("{\"type\":\"flow_process\""),
+    [PACE2_CLASSIFICATION_RESULT] = JSON_TEXT("{\"type\":\"classification\""),
+    [PACE2_BASIC_HTTP_REQUEST_EVENT] = JSON_TEXT("{\"type\":\"http_request\""),
+    [PACE2_BASIC_HTTP_RESPONSE_EVENT] = JSON_TEXT("{\"type\":\"http_response\""),
+    [PACE2_BASIC_SSL_CLIENT_HELLO_EVENT] = JSON_TEXT("{\"type\":\"ssl_client_hello\""),
+    [PACE2_BASIC_SSL_SERVER_HELLO_EVENT] = JSON_TEXT("{\"type\":\"ssl_server_hello\""),
+    [PACE2_BASIC_SSL_DNS_ALT_NAMES_EVENT] = JSON_TEXT("{\"type\":\"ssl_alt_names\""),
+#ifndef PACE2_DISABLE_DECODER
+    [PACE2_ADVANCED_DNS_EVENT] = JSON_TEXT("{\"type\":\"dns\""),
+#endif
+};
+
+static const struct json_text json_http_request_keys[PACE2_NUMBER_OF_HTTP_REQUEST_FLAGS] = {
+    [PACE2_HTTP_REQUEST_METHOD] = JSON_KEY("method"),
+    [PACE2_HTTP_REQUEST_URI] = JSON_KEY("uri"),
+    [PACE2_HTTP_HOST] = JSON_KEY("host"),
+    [PACE2_HTTP_USER_AGENT] = JSON_KEY("user_agent"),
+    [PACE2_HTTP_REFERER] = JSON_KEY("referer"),
+    [PACE2_HTTP_CONTENT_TYPE] = JSON_KEY("content_type"),
+    [PACE2_HTTP_CONTENT_LENGTH] = JSON_KEY("content_length"),
+    [PACE2_HTTP_ACCEPT] = JSON_KEY("accept"),
+    [PACE2_HTTP_ORIGIN] = JSON_KEY("origin"),
+    [PACE2_HTTP_COOKIE] = JSON_KEY("cookie"),
+    [PACE2_HTTP_SOAP_ACTION] = JSON_KEY("soap_action"),
+    [PACE2_HTTP_X_FORWARDED_FOR] = JSON_KEY("x_forwarded_for"),
+    [PACE2_HTTP_X_SESSION_TYPE] = JSON_KEY("x_session_type"),
+    [PACE2_HTTP_X_STREAM_TYPE] = JSON_KEY("x_stream_type"),
+    [PACE2_HTTP_X_ONLINE_HOST] = JSON_KEY("x_online_host"),
+};
+
+static const struct json_text json_http_response_keys[PACE2_NUMBER_OF_HTTP_RESPONSE_FLAGS] = {
+    [PACE2_HTTP_SERVER_RESPONSE] = JSON_KEY("response"),
+    [PACE2_HTTP_SERVER_CONTENT_TYPE] = JSON_KEY("content_type"),
+    [PACE2_HTTP_SERVER_CONTENT_ENCODING] = JSON_KEY("content_encoding"),
+    [PACE2_HTTP_SERVER_CONTENT_LENGTH] = JSON_KEY("content_length"),
+    [PACE2_HTTP_TRANSFER_ENCODING] = JSON_KEY("transfer_encoding"),
+    [PACE2_HTTP_SERVER] = JSON_KEY("server"),
+    [PACE2_HTTP_SET_COOKIE_LINE] = JSON_KEY("set_cookie"),
+};
+
+static const struct json_text json_ssl_client_hello_keys[PACE2_NUMBER_OF_CLIENT_HELLO_LINES] = {
+    [PACE2_SSL_SERVER_NAME] = JSON_KEY("server_name"),
+    [PACE2_SSL_CLIENT_SESSION_ID] = JSON_KEY("session_id"),
+};
+
+static const struct json_text json_ssl_server_hello_keys[PACE2_NUMBER_OF_SERVER_HELLO_LINES] = {
+    [PACE2_SSL_SERIAL_NUMBER] = JSON_KEY("serial_number"),
+    [PACE2_SSL_VALIDITY_NOT_BEFORE] = JSON_KEY("not_before"),
+    [PACE2_SSL_VALIDITY_NOT_AFTER] = JSON_KEY("not_after"),
+    [PACE2_SSL_COUNTRY_NAME] = JSON_KEY("country"),
+    [PACE2_SSL_POSTAL_CODE] = JSON_KEY("postal_code"),
+    [PACE2_SSL_STATE_OR_PROVINCE_NAME] = JSON_KEY("state"),
+    [PACE2_SSL_LOCALITY_NAME] = JSON_KEY("locality"),
+    [PACE2_SSL_STREET_ADDRESS] = JSON_KEY("street"),
+    [PACE2_SSL_ORGANIZATION_NAME] = JSON_KEY("organization"),
+    [PACE2_SSL_ORGANIZATIONAL_UNIT_NAME] = JSON_KEY("organizational_unit"),
+    [PACE2_SSL_COMMON_NAME] = JSON_KEY("common_name"),
+    [PACE2_SSL_SERVER_SESSION_ID] = JSON_KEY("session_id"),
+    [PACE2_SSL_CIPHER_SUITE] = JSON_KEY("cipher_suite"),
+};
+
+#ifndef PACE2_DISABLE_DECODER
+static const struct json_text json_dns_types[PACE2_NUMBER_OF_ADVANCED_DNS_EVENT_TYPES] = {
+    [PACE2_ADVANCED_DNS_QUERY] = JSON_TEXT("\"query\""),
+    [PACE2_ADVANCED_DNS_QUERY_RESPONSE] = JSON_TEXT("\"query_response\""),
+    [PACE2_ADVANCED_DNS_ANSWER_IPV4] = JSON_TEXT("\"answer_ipv4\""),
+    [PACE2_ADVANCED_DNS_ANSWER_IPV6] = JSON_TEXT("\"answer_ipv6\""),
+    [PACE2_ADVANCED_DNS_ANSWER_CANONICAL_NAME] = JSON_TEXT("\"answer_canonical_name\""),
+    [PACE2_ADVANCED_DNS_ANSWER_MAIL_EXCHANGE] = JSON_TEXT("\"answer_mail_exchange\""),
+    [PACE2_ADVANCED_DNS_ANSWER_OTHER] = JSON_TEXT("\"answer_other\""),
+    [PACE2_ADVANCED_DNS_INVALID] = JSON_TEXT("\"invalid\""),
+};
+#endif
+
+/* Formatting *******************************************************************/
+
+static inline char *json_put_u64(char *p, u64 value)
+{
+    char digits[20];
+    char *d = digits + sizeof(digits);
+
+    while (value >= 100) {
+        const u32 pair = (u32)(value % 100);
+
+        value /= 100;
+        d -= 2;
+        memcpy(d, json_digit_pairs + 2 * pair, 2);
+    }
+
+    if (value >= 10) {
+        d -= 2;
+        memcpy(d, json_digit_pairs + 2 * value, 2);
+    } else {
+        *--d = (char)('0' + value);
+    }
+
+    memcpy(p, d, digits + sizeof(digits) - d);
+
+    return p + (digits + sizeof(digits) - d);
+}
+
+static inline char *json_put_octet(char *p, u32 octet)
+{
+    if (octet >= 100) {
+        *p++ = (char)('0' + octet / 100);
+        memcpy(p, json_digit_pairs + 2 * (octet % 100), 2);
+        return p + 2;
+    }
+
+    if (octet >= 10) {
+        memcpy(p, json_digit_pairs + 2 * octet, 2);
+        return p + 2;
+    }
+
+    *p++ = (char)('0' + octet);
+
+    return p;
+}
+
+static inline char *json_put_ipv4_bytes(char *p, u8 const * const bytes)
+{
+    p = json_put_octet(p, bytes[0]);
+    *p++ = '.';
+    p = json_put_octet(p, bytes[1]);
+    *p++ = '.';
+    p = json_put_octet(p, bytes[2]);
+    *p++ = '.';
+    return json_put_octet(p, bytes[3]);
+}
+
+/* hexadecimal group of an IPv6 address without leading zeros */
+static inline char *json_put_hex16(char *p, u32 value)
+{
+    if (value >= 0x1000) {
+        *p++ = json_hex_digits[value >> 12];
+    }
+    if (value >= 0x100) {
+        *p++ = json_hex_digits[(value >> 8) & 0xf];
+    }
+    if (value >= 0x10) {
+        *p++ = json_hex_digits[(value >> 4) & 0xf];
+    }
+    *p++ = json_hex_digits[value & 0xf];
+
+    return p;
+}
+
+u32 pace2_json_format_ipv4(u32 address, char * buffer)
+{
+    return (u32)(json_put_ipv4_bytes(buffer, (u8 const *)&address) - buffer);
+}
+
+u32 pace2_json_format_ipv6(u8 const * address, char * buffer)
+{
+    u32 words[8];
+    int best_base = -1;
+    int best_length = 0;
+    int base = -1;
+    int length = 0;
+    char *p = buffer;
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        words[i] = (u32)address[2 * i] << 8 | address[2 * i + 1];
+    }
+
+    /* the longest run of zero groups, the first one of equal runs, is shortened to :: */
+    for (i = 0; i < 8; i++) {
+        if (0 == words[i]) {
+            if (base < 0) {
+                base = i;
+                length = 0;
+            }
+            length++;
+            if (length > best_length) {
+                best_base = base;
+                best_length = length;
+            }
+        } else {
+            base = -1;
+        }
+    }
+    if (best_length < 2) {
+        best_base = -1;
+    }
+
+    for (i = 0; i < 8; i++) {
+        if (best_base >= 0 && i >= best_base && i < best_base + best_length) {
+            if (i == best_base) {
+                *p++ = ':';
+            }
+            continue;
+        }
+
+        if (i != 0) {
+            *p++ = ':';
+        }
+
+        /* IPv4 compatible and IPv4 mapped addresses end in dotted decimal */
+        if (6 == i && 0 == best_base && (6 == best_length || (5 == best_length && 0xffff == words[5]))) {
+            p = json_put_ipv4_bytes(p, address + 12);
+            return (u32)(p - buffer);
+        }
+
+        p = json_put_hex16(p, words[i]);
+    }
+
+    if (best_base >= 0 && best_base + best_length == 8) {
+        *p++ = ':';
+    }
+
+    return (u32)(p - buffer);
+}
+
+/* Writer ***********************************************************************/
+
+static inline int json_room(struct json_writer *w, u64 need)
+{
+    if ((u64)(w->end - w->p) < need) {
+        w->overflow = 1;
+        return 0;
+    }
+
+    return 1;
+}
+
+static inline void json_raw(struct json_writer *w, const char *text, u32 length)
+{
+    if (json_room(w, length)) {
+        memcpy(w->p, text, length);
+        w->p += length;
+    }
+}
+
+static inline void json_text(struct json_writer *w, const struct json_text *text)
+{
+    json_raw(w, text->text, text->length);
+}
+
+#define json_literal(w, s) json_raw(w, s, sizeof(s) - 1)
+
+static inline void json_u64(struct json_writer *w, u64 value)
+{
+    char digits[20];
+
+    if (w->end - w->p >= 20) {
+        w->p = json_put_u64(w->p, value);
+        return;
+    }
+
+    /* close to the end of the buffer: the number has to fit exactly */
+    json_raw(w, digits, (u32)(json_put_u64(digits, value) - digits));
+}
+
+/* ",key":value */
+#define json_member_u64(w, key, value) do { json_literal(w, ",\"" key "\":"); json_u64(w, value); } while (0)
+
+/* length of the valid UTF-8 sequence at s; 0 if the bytes are no valid sequence */
+static inline u32 json_utf8_length(const u8 *s, u64 available)
+{
+    const u8 c = s[0];
+    u8 low = 0x80;
+    u8 high = 0xbf;
+    u32 length;
+    u32 i;
+
+    if (c >= 0xc2 && c <= 0xdf) {
+        length = 2;
+    } else if (c >= 0xe0 && c <= 0xef) {
+        length = 3;
+        if (0xe0 == c) {
+            low = 0xa0;
+        } else if (0xed == c) {
+            high = 0x9f;
+        }
+    } else if (c >= 0xf0 && c <= 0xf4) {
+        length = 4;
+        if (0xf0 == c) {
+            low = 0x90;
+        } else if (0xf4 == c) {
+            high = 0x8f;
+        }
+    } else {
+        return 0;
+    }
+
+    if (available < length || s[1] < low || s[1] > high) {
+        return 0;
+    }
+    for (i = 2; i < length; i++) {
+        if (s[i] < 0x80 || s[i] > 0xbf) {
+            return 0;
+        }
+    }
+
+    return length;
+}
+
+static void json_string(struct json_writer *w, const u8 *s, u64 length)
+{
+    const u8 * const end = s + length;
+
+    if (!json_room(w, 1)) {
+        return;
+    }
+    *w->p++ = '"';
+
+    while (s < end) {
+        const u8 *run = s;
+        u8 escape;
+
+        /* copy the bytes which need no escape at once */
+        while (run < end && 0 == json_escape[*run]) {
+            run++;
+        }
+        if (run > s) {
+            if (!json_room(w, run - s)) {
+                return;
+            }
+            memcpy(w->p, s, run - s);
+            w->p += run - s;
+            s = run;
+            if (s == end) {
+                break;
+            }
+        }
+
+        escape = json_escape[*s];
+        if (1 == escape) {
+            const u32 sequence = json_utf8_length(s, end - s);
+
+            if (sequence > 0) {
+                json_raw(w, (const char *)s, sequence);
+                s += sequence;
+                continue;
+            }
+            escape = 'u';
+        }
+
+        if ('u' == escape) {
+            if (!json_room(w, 6)) {
+                return;
+            }
+            memcpy(w->p, "\\u00", 4);
+            w->p[4] = json_hex_digits[*s >> 4];
+            w->p[5] = json_hex_digits[*s & 0xf];
+            w->p += 6;
+        } else {
+            if (!json_room(w, 2)) {
+                return;
+            }
+            w->p[0] = '\\';
+            w->p[1] = (char)escape;
+            w->p += 2;
+        }
+        s++;
+    }
+
+    json_literal(w, "\"");
+}
+
+static inline void json_buffer(struct json_writer *w, PACE2_byte_buffer const * const buffer)
+{
+    json_string(w, (const u8 *)buffer->ptr, NULL != buffer->ptr ? buffer->len : 0);
+}
+
+static inline void json_c_string(struct json_writer *w, const char *s)
+{
+    if (NULL == s) {
+        json_literal(w, "null");
+        return;
+    }
+    json_string(w, (const u8 *)s, strlen(s));
+}
+
+static void json_hex(struct json_writer *w, PACE2_byte_buffer const * const buffer)
+{
+    const u8 * const bytes = (const u8 *)buffer->ptr;
+    const u32 length = NULL != bytes ? buffer->len : 0;
+    u32 i;
+
+    if (!json_room(w, 2 + 2 * (u64)length)) {
+        return;
+    }
+
+    *w->p++ = '"';
+    for (i = 0; i < length; i++) {
+        *w->p++ = json_hex_digits[bytes[i] >> 4];
+        *w->p++ = json_hex_digits[bytes[i] & 0xf];
+    }
+    *w->p++ = '"';
+}
+
+static inline void json_ipv4(struct json_writer *w, u32 address)
+{
+    char text[17];
+
+    text[0] = '"';
+    json_raw(w, text, pace2_json_format_ipv4(address, text + 1) + 1);
+    json_literal(w, "\"");
+}
+
+static inline void json_ipv6(struct json_writer *w, u8 const * const address)
+{
+    char text[PACE2_JSON_IPV6_MAX_LENGTH + 1];
+
+    text[0] = '"';
+    json_raw(w, text, pace2_json_format_ipv6(address, text + 1) + 1);
+    json_literal(w, "\"");
+}
+
+/* Events ***********************************************************************/
+
+/* time stamp, addresses and ports of the innermost IP frame of the packet */
+static void json_packet(struct json_writer *w, PACE2_packet_descriptor const * const pd)
+{
+    const PACE2_packet_stack * const framing = pd->framing;
+    const PACE2_packet_frame_descriptor *frame;
+    u32 l4_protocol;
+
+    json_member_u64(w, "ts", pd->packet_ts);
+
+    if (NULL == framing || framing->inner_ip_index >= framing->stack_size) {
+        return;
+    }
+
+    frame = &framing->stack[framing->inner_ip_index];
+    if (IPv4 == frame->type) {
+        json_literal(w, ",\"src_ip\":");
+        json_ipv4(w, frame->frame_data.ipv4->saddr);
+        json_literal(w, ",\"dst_ip\":");
+        json_ipv4(w, frame->frame_data.ipv4->daddr);
+        l4_protocol = frame->frame_data.ipv4->protocol;
+    } else if (IPv6 == frame->type) {
+        json_literal(w, ",\"src_ip\":");
+        json_ipv6(w, frame->frame_data.ipv6->ip6_src.s6_addr);
+        json_literal(w, ",\"dst_ip\":");
+        json_ipv6(w, frame->frame_data.ipv6->ip6_dst.s6_addr);
+        l4_protocol = frame->frame_layer_protocol;
+    } else {
+        return;
+    }
+
+    if ((u32)framing->inner_ip_index + 1 < framing->stack_size) {
+        frame = &framing->stack[framing->inner_ip_index + 1];
+        if (TCP == frame->type) {
+            l4_protocol = IPPROTO_TCP;
+            json_member_u64(w, "src_port", ntohs(frame->frame_data.tcp->source));
+            json_member_u64(w, "dst_port", ntohs(frame->frame_data.tcp->dest));
+        } else if (UDP == frame->type) {
+            l4_protocol = IPPROTO_UDP;
+            json_member_u64(w, "src_port", ntohs(frame->frame_data.udp->source));
+            json_member_u64(w, "dst_port", ntohs(frame->frame_data.udp->dest));
+        }
+    }
+
+    json_member_u64(w, "l4_protocol", l4_protocol);
+}
+
+static void json_classification(struct json_writer *w, PACE2_classification_result_event const * const result)
+{
+    u8 i;
+
+    json_literal(w, ",\"protocol_stack\":[");
+    for (i = 0; i < result->protocol.stack.length && i < PACE2_PROTOCOL_STACK_MAX_DEPTH; i++) {
+        if (i > 0) {
+            json_literal(w, ",");
+        }
+        json_c_string(w, pace2_get_protocol_short_str(result->protocol.stack.entry[i]));
+    }
+
+    json_literal(w, "],\"protocol_attributes\":[");
+    for (i = 0; i < result->protocol.attributes.length && i < PACE2_PROTOCOL_ATTRIBUTE_LIST_MAX_SIZE; i++) {
+        if (i > 0) {
+            json_literal(w, ",");
+        }
+        json_c_string(w, pace2_get_protocol_attribute_str(result->protocol.attributes.list[i]));
+    }
+
+    json_literal(w, "],\"application\":");
+    json_c_string(w, pace2_get_application_short_str(result->application.type));
+    if (result->application.classification_finished) {
+        json_literal(w, ",\"application_finished\":true");
+    } else {
+        json_literal(w, ",\"application_finished\":false");
+    }
+
+    json_literal(w, ",\"application_attributes\":[");
+    for (i = 0; i < result->application.attributes.length && i < PACE2_APPLICATION_ATTRIBUTE_LIST_MAX_SIZE; i++) {
+        if (i > 0) {
+            json_literal(w, ",");
+        }
+        json_c_string(w, pace2_get_application_attribute_str(result->application.attributes.list[i]));
+    }
+    json_literal(w, "]");
+}
+
+/* lines of a basic event whose flag is set in the mask, as members named by the type of the line */
+#define JSON_LINES(w, meta_data, keys, count, value)                                        \
+    do {                                                                                    \
+        u32 line_;                                                                          \
+        for (line_ = 0; line_ < (count); line_++) {                                         \
+            const u32 type_ = (meta_data)->line[line_].type;                                \
+            if (!PACE2_MASK_INCLUDES_FLAG((meta_data)->meta_data_mask, line_) ||            \
+                type_ >= (count)) {                                                         \
+                continue;                                                                   \
+            }                                                                               \
+            json_text(w, &(keys)[type_]);                                                   \
+            value(w, type_, &(meta_data)->line[line_].content);                             \
+        }                                                                                   \
+    } while (0)
+
+static inline void json_line_string(struct json_writer *w, u32 type, PACE2_byte_buffer const * const content)
+{
+    (void)type;
+    json_buffer(w, content);
+}
+
+static inline void json_client_hello_line(struct json_writer *w, u32 type, PACE2_byte_buffer const * const content)
+{
+    if (PACE2_SSL_CLIENT_SESSION_ID == type) {
+        json_hex(w, content);
+    } else {
+        json_buffer(w, content);
+    }
+}
+
+static inline void json_server_hello_line(struct json_writer *w, u32 type, PACE2_byte_buffer const * const content)
+{
+    if (PACE2_SSL_SERIAL_NUMBER == type || PACE2_SSL_SERVER_SESSION_ID == type) {
+        json_hex(w, content);
+    } else if (PACE2_SSL_CIPHER_SUITE == type) {
+        u64 cipher_suite = 0;
+
+        if (NULL != content->ptr) {
+            memcpy(&cipher_suite, content->ptr, content->len < sizeof(cipher_suite) ? content->len : sizeof(cipher_suite));
+        }
+        json_u64(w, cipher_suite);
+    } else {
+        json_buffer(w, content);
+    }
+}
+
+#ifndef PACE2_DISABLE_DECODER
+static inline void json_charset_string(struct json_writer *w, const struct ipd_charset_string *s)
+{
+    json_string(w, s->content.buffer, NULL != s->content.buffer ? s->content.length : 0);
+}
+
+/* members common to all DNS answers */
+#define JSON_DNS_ANSWER(w, answer)                                          \
+    do {                                                                    \
+        json_member_u64(w, "transaction_id", (answer)->transaction_id);     \
+        json_member_u64(w, "rr_type", (answer)->type);                      \
+        json_member_u64(w, "rr_class", (answer)->rr_class);                 \
+        json_member_u64(w, "ttl", (answer)->ttl);                           \
+        json_literal(w, ",\"name\":");                                      \
+        json_charset_string(w, &(answer)->name);                            \
+    } while (0)
+
+static void json_dns(struct json_writer *w, PACE2_advanced_DNS_event const * const dns)
+{
+    if ((u32)dns->meta_data_type >= PACE2_NUMBER_OF_ADVANCED_DNS_EVENT_TYPES) {
+        return;
+    }
+
+    json_literal(w, ",\"dns\":");
+    json_text(w, &json_dns_types[dns->meta_data_type]);
+
+    switch (dns->meta_data_type) {
+        case PACE2_ADVANCED_DNS_QUERY:
+        case PACE2_ADVANCED_DNS_QUERY_RESPONSE: {
+            const struct ipd_dns_query * const query = &dns->event_data.query;
+
+            json_member_u64(w, "transaction_id", query->transaction_id);
+            json_member_u64(w, "qtype", query->type);
+            json_member_u64(w, "qclass", query->qclass);
+            json_member_u64(w, "flags", query->flag);
+            json_member_u64(w, "rcode", query->rcode);
+            json_literal(w, ",\"name\":");
+            json_charset_string(w, &query->name);
+            break;
+        }
+        case PACE2_ADVANCED_DNS_ANSWER_IPV4:
+            JSON_DNS_ANSWER(w, &dns->event_data.answer_ipv4);
+            json_literal(w, ",\"address\":");
+            json_ipv4(w, dns->event_data.answer_ipv4.ipv4_address);
+            break;
+        case PACE2_ADVANCED_DNS_ANSWER_IPV6:
+            JSON_DNS_ANSWER(w, &dns->event_data.answer_ipv6);
+            json_literal(w, ",\"address\":");
+            json_ipv6(w, dns->event_data.answer_ipv6.ipv6_address.s6_addr);
+            break;
+        case PACE2_ADVANCED_DNS_ANSWER_CANONICAL_NAME:
+            JSON_DNS_ANSWER(w, &dns->event_data.answer_canonical_name);
+            json_literal(w, ",\"canonical_name\":");
+            json_charset_string(w, &dns->event_data.answer_canonical_name.canonical_name);
+            break;
+        case PACE2_ADVANCED_DNS_ANSWER_MAIL_EXCHANGE:
+            JSON_DNS_ANSWER(w, &dns->event_data.answer_mail_exchange);
+            json_member_u64(w, "preference", dns->event_data.answer_mail_exchange.preference);
+            json_literal(w, ",\"mail_exchange\":");
+            json_charset_string(w, &dns->event_data.answer_mail_exchange.mail_exchange_name);
+            break;
+        case PACE2_ADVANCED_DNS_ANSWER_OTHER:
+            JSON_DNS_ANSWER(w, &dns->event_data.answer_other);
+            json_literal(w, ",\"data\":");
+            json_charset_string(w, &dns->event_data.answer_other.generic_data);
+            break;
+        case PACE2_ADVANCED_DNS_INVALID:
+            json_literal(w, ",\"reason\":");
+            json_c_string(w, dns->event_data.invalid);
+            break;
+        default:
+            break;
+    }
+}
+#endif
+
+/* Public Definitions ***********************************************************/
+
+int pace2_can_json_event_type(int type)
+{
+    return type >= 0 && type < PACE2_NUMBER_OF_EVENTS && json_event_names[type].length > 0;
+}
+
+u32 pace2_event_to_json(PACE2_event const * const event, PACE2_packet_descriptor const * const pd, char * buffer, u32 size)
+{
+    struct json_writer w;
+    u16 i;
+
+    if (NULL == event || !pace2_can_json_event_type(event->header.type)) {
+        return 0;
+    }
+
+    w.p = buffer;
+    w.end = buffer + size;
+    w.overflow = 0;
+
+    json_text(&w, &json_event_names[event->header.type]);
+
+    if (NULL != pd) {
+        json_packet(&w, pd);
+    }
+
+    switch (event->header.type) {
+        case PACE2_FLOW_STARTED_EVENT:
+            json_member_u64(&w, "flow_id", event->flow_started.flow_id);
+            break;
+        case PACE2_FLOW_DROPPED_EVENT:
+            json_member_u64(&w, "flow_id", event->flow_dropped.flow_id);
+            json_member_u64(&w, "reason", event->flow_dropped.removal_reason);
+            break;
+        case PACE2_FLOW_INFO_EVENT:
+            json_member_u64(&w, "flow_id", event->flow_info.flow_id);
+            json_member_u64(&w, "src_subscriber_id", event->flow_info.src_id);
+            json_member_u64(&w, "dst_subscriber_id", event->flow_info.dst_id);
+            json_member_u64(&w, "flow_src_port", ntohs(event->flow_info.src_port));
+            json_member_u64(&w, "flow_dst_port", ntohs(event->flow_info.dst_port));
+            break;
+        case PACE2_FLOW_PROCESS_EVENT:
+            json_member_u64(&w, "flow_id", event->flow_process.flow_id);
+            json_member_u64(&w, "bytes", event->flow_process.bytes);
+            json_member_u64(&w, "total_bytes", event->flow_process.total_bytes);
+            json_member_u64(&w, "missing_bytes", event->flow_process.missing_bytes);
+            json_member_u64(&w, "start_ts", event->flow_process.start_ts);
+            json_member_u64(&w, "last_packet_ts", event->flow_process.last_packet_ts);
+            break;
+        case PACE2_CLASSIFICATION_RESULT:
+            if (NULL != pd) {
+                json_member_u64(&w, "flow_id", pd->flow_id);
+            }
+            json_classification(&w, &event->classification_result_data);
+            break;
+        case PACE2_BASIC_HTTP_REQUEST_EVENT:
+            if (NULL != pd) {
+                json_member_u64(&w, "flow_id", pd->flow_id);
+            }
+            JSON_LINES(&w, &event->http_basic_request_meta_data, json_http_request_keys,
+                       PACE2_NUMBER_OF_HTTP_REQUEST_FLAGS, json_line_string);
+            break;
+        case PACE2_BASIC_HTTP_RESPONSE_EVENT:
+            if (NULL != pd) {
+                json_member_u64(&w, "flow_id", pd->flow_id);
+            }
+            JSON_LINES(&w, &event->http_basic_response_meta_data, json_http_response_keys,
+                       PACE2_NUMBER_OF_HTTP_RESPONSE_FLAGS, json_line_string);
+            break;
+        case PACE2_BASIC_SSL_CLIENT_HELLO_EVENT:
+            if (NULL != pd) {
+                json_member_u64(&w, "flow_id", pd->flow_id);
+            }
+            JSON_LINES(&w, &event->ssl_client_hello_meta_data, json_ssl_client_hello_keys,
+                       PACE2_NUMBER_OF_CLIENT_HELLO_LINES, json_client_hello_line);
+            break;
+        case PACE2_BASIC_SSL_SERVER_HELLO_EVENT:
+            if (NULL != pd) {
+                json_member_u64(&w, "flow_id", pd->flow_id);
+            }
+            JSON_LINES(&w, &event->ssl_server_hello_meta_data, json_ssl_server_hello_keys,
+                       PACE2_NUMBER_OF_SERVER_HELLO_LINES, json_server_hello_line);
+            break;
+        case PACE2_BASIC_SSL_DNS_ALT_NAMES_EVENT: {
+            PACE2_SSL_dns_alt_names_event const * const alt_names = &event->ssl_dns_alt_names_meta_data;
+
+            if (NULL != pd) {
+                json_member_u64(&w, "flow_id", pd->flow_id);
+            }
+            json_literal(&w, ",\"alt_names\":[");
+            for (i = 0; i < alt_names->number_of_entries && i < IPOQUE_MAX_PARSE_SSL_DNS_ALT_NAMES; i++) {
+                if (i > 0) {
+                    json_literal(&w, ",");
+                }
+                json_buffer(&w, &alt_names->entries[i]);
+            }
+            json_literal(&w, "]");
+            break;
+        }
+#ifndef PACE2_DISABLE_DECODER
+        case PACE2_ADVANCED_DNS_EVENT:
+            json_member_u64(&w, "flow_id", event->dns_advanced_meta_data.flow_id);
+            json_dns(&w, &event->dns_advanced_meta_data);
+            break;
+#endif
+        default:
+            break;
+    }
+
+    json_literal(&w, "}\n");
+
+    if (w.overflow) {
+        return 0;
+    }
+
+    return (u32)(w.p - buffer);
+}
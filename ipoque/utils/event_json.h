@@ -0,0 +1,58 @@
+/*
+ * event_json.h
+ *
+ * NDJSON encoding of the PACE 2 events a SIEM is interested in: flow
+ * lifecycle, classification results, basic HTTP request and response, DNS
+ * and SSL hello events. Every event becomes one JSON object terminated by a
+ * newline in a caller supplied buffer, usually one preallocated buffer per
+ * packet thread. No stdio, no locale and no allocation: integers are
+ * formatted with a two digit table, IPv4 and IPv6 addresses (RFC 5952, like
+ * inet_ntop) from the address bytes, and strings are escaped through a
+ * table which copies runs of plain bytes at once.
+ *
+ * Strings are written as they are if they are valid UTF-8; every byte
+ * which is not part of a valid UTF-8 sequence is written as \u00XX, so the
+ * output is always valid JSON.
+ *
+ * With a packet descriptor the object also holds the time stamp of the
+ * packet and the addresses and ports of its innermost IP frame.
+ */
+
+#ifndef EVENT_JSON_H
+#define EVENT_JSON_H
+
+#include <pace2.h>
+
+/* longest text of an IPv6 address */
+#define PACE2_JSON_IPV6_MAX_LENGTH 45
+
+/** Checks whether events of a type can be encoded as JSON.
+ * @param type PACE 2 event type.
+ * @return 1 if pace2_event_to_json supports the type; 0 otherwise.
+ */
+int pace2_can_json_event_type(int type);
+
+/** Encodes an event as one line of JSON.
+ * @param event event to encode.
+ * @param pd packet which generated the event; NULL if not known.
+ * @param buffer buffer for the line.
+ * @param size size of the buffer.
+ * @return length of the line including the newline; 0 if the buffer is too small or the event type is not supported.
+ */
+u32 pace2_event_to_json(PACE2_event const * const event, PACE2_packet_descriptor const * const pd, char * buffer, u32 size);
+
+/** Formats an IPv4 address.
+ * @param address address in network byte order.
+ * @param buffer buffer of at least 15 bytes, not terminated.
+ * @return length of the text.
+ */
+u32 pace2_json_format_ipv4(u32 address, char * buffer);
+
+/** Formats an IPv6 address like inet_ntop.
+ * @param address 16 address bytes.
+ * @param buffer buffer of at least PACE2_JSON_IPV6_MAX_LENGTH bytes, not terminated.
+ * @return length of the text.
+ */
+u32 pace2_json_format_ipv6(u8 const * address, char * buffer);
+
+#endif /* EVENT_JSON_H */
@@ -0,0 +1,364 @@
+/*
+ * event_json_benchmark.c
+ *
+ * Measures the throughput of the NDJSON encoding of pace2_event_to_json
+ * against the text event log of pace2_debug_event. A mix of typical events
+ * with their packet descriptors is encoded into one preallocated buffer and
+ * written to /dev/null. Before that the address formatting is compared
+ * with inet_ntop and the string escaping with a straightforward reference.
+ *
+ * usage: event_json_benchmark [number of events]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+
+#include "event_handler.h"
+#include "event_json.h"
+
+#define NUMBER_OF_SAMPLE_EVENTS 5
+
+/* lines are collected in a buffer of this size and written with one fwrite */
+#define WRITE_BUFFER_SIZE (64 * 1024)
+
+static PACE2_event sample_events[NUMBER_OF_SAMPLE_EVENTS];
+static PACE2_packet_descriptor sample_pds[NUMBER_OF_SAMPLE_EVENTS];
+
+/* frames of the sample packets: IPv4/TCP and IPv6/UDP */
+static struct iphdr ipv4_header;
+static struct ip6_hdr ipv6_header;
+static struct tcphdr tcp_header;
+static struct udphdr udp_header;
+static PACE2_packet_frame_descriptor ipv4_frames[2];
+static PACE2_packet_frame_descriptor ipv6_frames[2];
+static PACE2_packet_stack ipv4_stack = { ipv4_frames, 2, 0, 0 };
+static PACE2_packet_stack ipv6_stack = { ipv6_frames, 2, 0, 0 };
+
+static double now( void )
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void set_buffer( PACE2_byte_buffer *buffer, const char *string )
+{
+    buffer->ptr = string;
+    buffer->len = strlen(string);
+}
+
+static void create_sample_packets( void )
+{
+    ipv4_header.protocol = IPPROTO_TCP;
+    ipv4_header.saddr = htonl(0xc0a8010a);
+    ipv4_header.daddr = htonl(0x5db8d822);
+    tcp_header.source = htons(51234);
+    tcp_header.dest = htons(80);
+    ipv4_frames[0].type = IPv4;
+    ipv4_frames[0].frame_data.ipv4 = &ipv4_header;
+    ipv4_frames[1].type = TCP;
+    ipv4_frames[1].frame_data.tcp = &tcp_header;
+
+    inet_pton(AF_INET6, "2001:db8::1", &ipv6_header.ip6_src);
+    inet_pton(AF_INET6, "2001:4860:4860::8888", &ipv6_header.ip6_dst);
+    udp_header.source = htons(40000);
+    udp_header.dest = htons(53);
+    ipv6_frames[0].type = IPv6;
+    ipv6_frames[0].frame_data.ipv6 = &ipv6_header;
+    ipv6_frames[0].frame_layer_protocol = IPPROTO_UDP;
+    ipv6_frames[1].type = UDP;
+    ipv6_frames[1].frame_data.udp = &udp_header;
+}
+
+static void create_sample_events( void )
+{
+    PACE2_flow_process *flow_process = &sample_events[0].flow_process;
+    PACE2_basic_HTTP_request_event *http = &sample_events[1].http_basic_request_meta_data;
+    PACE2_classification_result_event *classification = &sample_events[2].classification_result_data;
+    PACE2_SSL_client_hello_event *client_hello = &sample_events[3].ssl_client_hello_meta_data;
+    PACE2_flow_dropped *flow_dropped = &sample_events[4].flow_dropped;
+    int i;
+
+    memset(sample_events, 0, sizeof(sample_events));
+    memset(sample_pds, 0, sizeof(sample_pds));
+
+    flow_process->type = PACE2_FLOW_PROCESS_EVENT;
+    flow_process->flow_id = 123456;
+    flow_process->bytes = 48213;
+    flow_process->total_bytes = 52871;
+    flow_process->start_ts = 1476871234123ull;
+    flow_process->last_packet_ts = 1476871239876ull;
+
+    http->type = PACE2_BASIC_HTTP_REQUEST_EVENT;
+    http->meta_data_mask = 1 << PACE2_HTTP_REQUEST_METHOD | 1 << PACE2_HTTP_REQUEST_URI |
+                           1 << PACE2_HTTP_HOST | 1 << PACE2_HTTP_USER_AGENT;
+    http->line[PACE2_HTTP_REQUEST_METHOD].type = PACE2_HTTP_REQUEST_METHOD;
+    set_buffer(&http->line[PACE2_HTTP_REQUEST_METHOD].content, "GET");
+    http->line[PACE2_HTTP_REQUEST_URI].type = PACE2_HTTP_REQUEST_URI;
+    set_buffer(&http->line[PACE2_HTTP_REQUEST_URI].content, "/index.html?session=0123456789abcdef");
+    http->line[PACE2_HTTP_HOST].type = PACE2_HTTP_HOST;
+    set_buffer(&http->line[PACE2_HTTP_HOST].content, "www.example.com");
+    http->line[PACE2_HTTP_USER_AGENT].type = PACE2_HTTP_USER_AGENT;
+    set_buffer(&http->line[PACE2_HTTP_USER_AGENT].content, "Mozilla/5.0 (X11; Linux x86_64; rv:49.0) Gecko/20100101 Firefox/49.0");
+
+    classification->type = PACE2_CLASSIFICATION_RESULT;
+    classification->protocol.stack.length = 2;
+    classification->protocol.stack.entry[0] = PACE2_PROTOCOL_LAYER4_TCP;
+    classification->protocol.stack.entry[1] = PACE2_PROTOCOL_HTTP;
+    classification->application.type = PACE2_APPLICATION_UNKNOWN;
+    classification->application.classification_finished = 1;
+
+    client_hello->type = PACE2_BASIC_SSL_CLIENT_HELLO_EVENT;
+    client_hello->meta_data_mask = 1 << PACE2_SSL_SERVER_NAME | 1 << PACE2_SSL_CLIENT_SESSION_ID;
+    client_hello->line[PACE2_SSL_SERVER_NAME].type = PACE2_SSL_SERVER_NAME;
+    set_buffer(&client_hello->line[PACE2_SSL_SERVER_NAME].content, "login.example.org");
+    client_hello->line[PACE2_SSL_CLIENT_SESSION_ID].type = PACE2_SSL_CLIENT_SESSION_ID;
+    set_buffer(&client_hello->line[PACE2_SSL_CLIENT_SESSION_ID].content, "\x3e\x91\x07\xaa\x5c\x00\x12\xf0");
+
+    flow_dropped->type = PACE2_FLOW_DROPPED_EVENT;
+    flow_dropped->flow_id = 123456;
+
+    create_sample_packets();
+    for (i = 0; i < NUMBER_OF_SAMPLE_EVENTS; i++) {
+        sample_pds[i].packet_ts = 1476871239876ull + i;
+        sample_pds[i].flow_id = 123456;
+        sample_pds[i].framing = i % 2 == 0 ? &ipv4_stack : &ipv6_stack;
+    }
+}
+
+static double run_text( FILE *out, u64 events )
+{
+    double start = now();
+    u64 i;
+
+    for (i = 0; i < events; i++) {
+        pace2_debug_event(out, &sample_events[i % NUMBER_OF_SAMPLE_EVENTS]);
+    }
+    fflush(out);
+
+    return now() - start;
+}
+
+static double run_json( FILE *out, u64 events, u64 *bytes )
+{
+    static char buffer[WRITE_BUFFER_SIZE];
+    double start = now();
+    u32 used = 0;
+    u64 i;
+
+    *bytes = 0;
+    for (i = 0; i < events; i++) {
+        PACE2_event const * const event = &sample_events[i % NUMBER_OF_SAMPLE_EVENTS];
+        PACE2_packet_descriptor const * const pd = &sample_pds[i % NUMBER_OF_SAMPLE_EVENTS];
+        u32 length = pace2_event_to_json(event, pd, buffer + used, sizeof(buffer) - used);
+
+        if (length == 0) {
+            fwrite(buffer, 1, used, out);
+            used = 0;
+            length = pace2_event_to_json(event, pd, buffer, sizeof(buffer));
+        }
+        used += length;
+        *bytes += length;
+    }
+    fwrite(buffer, 1, used, out);
+    fflush(out);
+
+    return now() - start;
+}
+
+/* compares the address formatting with inet_ntop, returns 0 if all addresses are equal */
+static int check_addresses( void )
+{
+    static const char * const ipv6_samples[] = {
+        "::", "::1", "1::", "1:2:3:4:5:6:7:8", "1:0:0:2::3", "1::2:0:0:3", "0:1:0:1:0:1:0:1",
+        "::ffff:10.1.2.3", "::10.1.2.3", "::ffff:0:10.1.2.3", "fe80::1:0:0:0", "2001:db8:0:0:1::1"
+    };
+    char expected[INET6_ADDRSTRLEN];
+    char actual[PACE2_JSON_IPV6_MAX_LENGTH + 1];
+    u8 address[16];
+    u32 i;
+    u32 j;
+
+    srand(1);
+    for (i = 0; i < 100000; i++) {
+        u32 ipv4 = (u32)rand() ^ (u32)rand() << 16;
+
+        /* zero groups are rare in random addresses */
+        for (j = 0; j < 16; j++) {
+            address[j] = rand() % 3 == 0 ? 0 : (u8)rand();
+        }
+        if (i < sizeof(ipv6_samples) / sizeof(ipv6_samples[0])) {
+            inet_pton(AF_INET6, ipv6_samples[i], address);
+            ipv4 = i;
+        }
+
+        inet_ntop(AF_INET, &ipv4, expected, sizeof(expected));
+        actual[pace2_json_format_ipv4(ipv4, actual)] = '\0';
+        if (strcmp(expected, actual) != 0) {
+            fprintf(stderr, "IPv4 address %s formatted as %s\n", expected, actual);
+            return 1;
+        }
+
+        inet_ntop(AF_INET6, address, expected, sizeof(expected));
+        actual[pace2_json_format_ipv6(address, actual)] = '\0';
+        if (strcmp(expected, actual) != 0) {
+            fprintf(stderr, "IPv6 address %s formatted as %s\n", expected, actual);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* escapes a string byte by byte, every non ASCII byte is escaped */
+static void escape_reference( char *out, const u8 *s, u32 length )
+{
+    u32 i;
+
+    *out++ = '"';
+    for (i = 0; i < length; i++) {
+        switch (s[i]) {
+            case '"': out += sprintf(out, "\\\""); break;
+            case '\\': out += sprintf(out, "\\\\"); break;
+            case '\b': out += sprintf(out, "\\b"); break;
+            case '\t': out += sprintf(out, "\\t"); break;
+            case '\n': out += sprintf(out, "\\n"); break;
+            case '\f': out += sprintf(out, "\\f"); break;
+            case '\r': out += sprintf(out, "\\r"); break;
+            default:
+                if (s[i] < 0x20 || s[i] >= 0x80) {
+                    out += sprintf(out, "\\u%04x", s[i]);
+                } else {
+                    *out++ = s[i];
+                }
+                break;
+        }
+    }
+    *out++ = '"';
+    *out = '\0';
+}
+
+/* encodes a server name and returns the JSON value of it, NULL if it could not be encoded */
+static const char *encode_server_name( const char *name, u32 length )
+{
+    static char line[4096];
+    PACE2_event event;
+    const char *value;
+    u32 line_length;
+
+    memset(&event, 0, sizeof(event));
+    event.ssl_client_hello_meta_data.type = PACE2_BASIC_SSL_CLIENT_HELLO_EVENT;
+    event.ssl_client_hello_meta_data.meta_data_mask = 1 << PACE2_SSL_SERVER_NAME;
+    event.ssl_client_hello_meta_data.line[0].type = PACE2_SSL_SERVER_NAME;
+    event.ssl_client_hello_meta_data.line[0].content.ptr = name;
+    event.ssl_client_hello_meta_data.line[0].content.len = length;
+
+    line_length = pace2_event_to_json(&event, NULL, line, sizeof(line) - 1);
+    if (line_length < 3 || line[line_length - 1] != '\n' || line[line_length - 2] != '}') {
+        return NULL;
+    }
+    line[line_length - 2] = '\0';
+
+    value = strstr(line, "\"server_name\":");
+
+    return value != NULL ? value + strlen("\"server_name\":") : NULL;
+}
+
+/* compares the string escaping with the reference, returns 0 if all strings are equal */
+static int check_escaping( void )
+{
+    static const char * const utf8_samples[] = {
+        "gr\xc3\xbc\xc3\x9f", "\xe2\x82\xac", "\xf0\x9f\x98\x80", "\xed\x9f\xbf", "\xf4\x8f\xbf\xbf"
+    };
+    static const char * const invalid_samples[] = {
+        "\xc0\xaf", "\xe0\x80\xaf", "\xed\xa0\x80", "\xf4\x90\x80\x80", "\xc3", "\x80", "\xe2\x82"
+    };
+    char all_bytes[256];
+    char expected[2048];
+    const char *actual;
+    u32 i;
+
+    for (i = 0; i < 256; i++) {
+        all_bytes[i] = (char)i;
+    }
+    escape_reference(expected, (const u8 *)all_bytes, sizeof(all_bytes));
+    actual = encode_server_name(all_bytes, sizeof(all_bytes));
+    if (actual == NULL || strcmp(expected, actual) != 0) {
+        fprintf(stderr, "escaped bytes differ:\n%s\n%s\n", expected, actual);
+        return 1;
+    }
+
+    /* valid UTF-8 is copied, invalid sequences are escaped byte by byte */
+    for (i = 0; i < sizeof(utf8_samples) / sizeof(utf8_samples[0]); i++) {
+        snprintf(expected, sizeof(expected), "\"%s\"", utf8_samples[i]);
+        actual = encode_server_name(utf8_samples[i], strlen(utf8_samples[i]));
+        if (actual == NULL || strcmp(expected, actual) != 0) {
+            fprintf(stderr, "UTF-8 sample %u differs: %s\n", i, actual);
+            return 1;
+        }
+    }
+    for (i = 0; i < sizeof(invalid_samples) / sizeof(invalid_samples[0]); i++) {
+        escape_reference(expected, (const u8 *)invalid_samples[i], strlen(invalid_samples[i]));
+        actual = encode_server_name(invalid_samples[i], strlen(invalid_samples[i]));
+        if (actual == NULL || strcmp(expected, actual) != 0) {
+            fprintf(stderr, "invalid UTF-8 sample %u differs: %s\n", i, actual);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int main( int argc, char **argv )
+{
+    u64 events = 1000000;
+    double text_time;
+    double json_time;
+    u64 bytes;
+    FILE *out;
+    char line[4096];
+    int i;
+
+    if (argc > 1) {
+        events = strtoull(argv[1], NULL, 10);
+    }
+
+    create_sample_events();
+
+    if (check_addresses() != 0 || check_escaping() != 0) {
+        return 1;
+    }
+
+    for (i = 0; i < NUMBER_OF_SAMPLE_EVENTS; i++) {
+        const u32 length = pace2_event_to_json(&sample_events[i], &sample_pds[i], line, sizeof(line));
+
+        fwrite(line, 1, length, stdout);
+    }
+
+    out = fopen("/dev/null", "wb");
+    if (out == NULL) {
+        perror("/dev/null");
+        return 1;
+    }
+
+    text_time = run_text(out, events);
+    json_time = run_json(out, events, &bytes);
+
+    fclose(out);
+
+    printf("%llu events\n", (unsigned long long)events);
+    printf("text: %10.0f events/s\n", events / text_time);
+    printf("json: %10.0f events/s, %.1f bytes/event\n", events / json_time, (double)bytes / events);
+
+    return 0;
+}
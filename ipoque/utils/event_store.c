@@ -0,0 +1,698 @@
+/*
+ * event_store.c
+ *
+ * Append-only, indexed store of binary event records, see event_store.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+
+#include "event_encoder.h"
+#include "event_store.h"
+
+/* "-YYYYmmdd-HHMMSS-<sequence>.seg" */
+#define PACE2_EVENT_STORE_SUFFIX_LENGTH 64
+
+static const u8 pace2_event_store_padding[8];
+
+/* grows an index table to hold at least needed entries */
+static u8 pace2_event_store_reserve(void **table, u64 *capacity, u64 needed, size_t entry_size)
+{
+    u64 new_capacity = *capacity;
+    void *new_table;
+
+    if (needed <= *capacity) {
+        return 0;
+    }
+
+    if (new_capacity < 1024) {
+        new_capacity = 1024;
+    }
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+
+    new_table = realloc(*table, new_capacity * entry_size);
+    if (NULL == new_table) {
+        return 1;
+    }
+
+    *table = new_table;
+    *capacity = new_capacity;
+
+    return 0;
+}
+
+static u8 pace2_event_store_open_segment(struct pace2_event_store *store)
+{
+    struct pace2_event_segment_header header;
+    const size_t prefix_length = strlen(store->config.prefix);
+    const time_t now = time(NULL);
+    struct tm tm;
+
+    localtime_r(&now, &tm);
+    strcpy(store->path, store->config.prefix);
+    strftime(store->path + prefix_length, PACE2_EVENT_STORE_SUFFIX_LENGTH, "-%Y%m%d-%H%M%S", &tm);
+    sprintf(store->path + strlen(store->path), "-%06llu.seg", (unsigned long long)store->segment_sequence++);
+
+    store->file = fopen(store->path, "wb");
+    if (NULL == store->file) {
+        perror(store->path);
+        store->errors++;
+        return 1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PACE2_EVENT_SEGMENT_MAGIC, sizeof(header.magic));
+    header.version = PACE2_EVENT_SEGMENT_VERSION;
+    header.block_records = store->config.block_records;
+    header.ticks_per_second = store->config.ticks_per_second;
+    header.created = (u64)now;
+    if (fwrite(&header, sizeof(header), 1, store->file) != 1) {
+        store->errors++;
+    }
+
+    store->segment_opened = (u64)now;
+    store->segment_offset = sizeof(header);
+    store->segment_records = 0;
+    store->min_ts = ~(PACE2_timestamp)0;
+    store->max_ts = 0;
+    store->block_count = 0;
+    store->flow_count = 0;
+    store->address_count = 0;
+
+    return 0;
+}
+
+static int pace2_event_store_compare_flows(const void *a, const void *b)
+{
+    const struct pace2_event_segment_flow * const x = a;
+    const struct pace2_event_segment_flow * const y = b;
+
+    if (x->flow_id != y->flow_id) {
+        return x->flow_id < y->flow_id ? -1 : 1;
+    }
+
+    return x->block < y->block ? -1 : x->block > y->block;
+}
+
+static int pace2_event_store_compare_addresses(const void *a, const void *b)
+{
+    const struct pace2_event_segment_address * const x = a;
+    const struct pace2_event_segment_address * const y = b;
+    const int c = memcmp(x->address, y->address, sizeof(x->address));
+
+    if (0 != c) {
+        return c;
+    }
+
+    return x->block < y->block ? -1 : x->block > y->block;
+}
+
+/* writes the index and the footer and closes the segment, a segment without records is removed */
+static void pace2_event_store_seal_segment(struct pace2_event_store *store)
+{
+    struct pace2_event_segment_footer footer;
+    PACE2_timestamp ts;
+    u64 b;
+
+    if (NULL == store->file) {
+        return;
+    }
+
+    if (0 == store->segment_records) {
+        fclose(store->file);
+        store->file = NULL;
+        unlink(store->path);
+        return;
+    }
+
+    ts = 0;
+    for (b = 0; b < store->block_count; b++) {
+        if (store->blocks[b].max_ts > ts) {
+            ts = store->blocks[b].max_ts;
+        }
+        store->blocks[b].prefix_max_ts = ts;
+    }
+    ts = ~(PACE2_timestamp)0;
+    for (b = store->block_count; b > 0; b--) {
+        if (store->blocks[b - 1].min_ts < ts) {
+            ts = store->blocks[b - 1].min_ts;
+        }
+        store->blocks[b - 1].suffix_min_ts = ts;
+    }
+
+    qsort(store->flows, store->flow_count, sizeof(*store->flows), pace2_event_store_compare_flows);
+    qsort(store->addresses, store->address_count, sizeof(*store->addresses), pace2_event_store_compare_addresses);
+
+    memset(&footer, 0, sizeof(footer));
+    memcpy(footer.magic, PACE2_EVENT_SEGMENT_INDEX_MAGIC, sizeof(footer.magic));
+    footer.version = PACE2_EVENT_SEGMENT_VERSION;
+    footer.records = store->segment_records;
+    footer.min_ts = store->min_ts;
+    footer.max_ts = store->max_ts;
+    footer.blocks_offset = store->segment_offset;
+    footer.block_count = store->block_count;
+    footer.flows_offset = footer.blocks_offset + store->block_count * sizeof(*store->blocks);
+    footer.flow_count = store->flow_count;
+    footer.addresses_offset = footer.flows_offset + store->flow_count * sizeof(*store->flows);
+    footer.address_count = store->address_count;
+
+    if (fwrite(store->blocks, sizeof(*store->blocks), store->block_count, store->file) != store->block_count ||
+        fwrite(store->flows, sizeof(*store->flows), store->flow_count, store->file) != store->flow_count ||
+        fwrite(store->addresses, sizeof(*store->addresses), store->address_count, store->file) != store->address_count ||
+        fwrite(&footer, sizeof(footer), 1, store->file) != 1) {
+        store->errors++;
+    }
+
+    if (fclose(store->file) != 0) {
+        store->errors++;
+    }
+    store->file = NULL;
+    store->segments++;
+}
+
+static void pace2_event_store_rotate(struct pace2_event_store *store)
+{
+    pace2_event_store_seal_segment(store);
+    pace2_event_store_open_segment(store);
+}
+
+/* adds an index entry for the current block unless it has one already */
+static void pace2_event_store_index_flow(struct pace2_event_store *store, u64 flow_id)
+{
+    const u32 block = (u32)(store->block_count - 1);
+    u64 i;
+
+    for (i = store->block_first_flow; i < store->flow_count; i++) {
+        if (store->flows[i].flow_id == flow_id) {
+            return;
+        }
+    }
+
+    store->flows[store->flow_count].flow_id = flow_id;
+    store->flows[store->flow_count].block = block;
+    store->flows[store->flow_count].reserved = 0;
+    store->flow_count++;
+}
+
+static void pace2_event_store_index_address(struct pace2_event_store *store, const u8 *address)
+{
+    const u32 block = (u32)(store->block_count - 1);
+    u64 i;
+
+    /* unknown addresses are not indexed */
+    if (0 == memcmp(address, pace2_event_store_padding, 8) && 0 == memcmp(address + 8, pace2_event_store_padding, 8)) {
+        return;
+    }
+
+    for (i = store->block_first_address; i < store->address_count; i++) {
+        if (0 == memcmp(store->addresses[i].address, address, 16)) {
+            return;
+        }
+    }
+
+    memcpy(store->addresses[store->address_count].address, address, 16);
+    store->addresses[store->address_count].block = block;
+    store->addresses[store->address_count].reserved = 0;
+    store->address_count++;
+}
+
+/* copies an address of the inner IP frame, IPv4-mapped for IPv4 */
+static void pace2_event_store_ipv4_mapped(u8 *address, u32 ipv4)
+{
+    memset(address, 0, 10);
+    address[10] = 0xff;
+    address[11] = 0xff;
+    memcpy(address + 12, &ipv4, 4);
+}
+
+void pace2_event_store_init_default_config(struct pace2_event_store_config *config, const char *prefix,
+                                           u64 ticks_per_second)
+{
+    if (NULL == config) {
+        return;
+    }
+
+    config->prefix = prefix;
+    config->ticks_per_second = ticks_per_second;
+    config->block_records = PACE2_EVENT_STORE_DEFAULT_BLOCK_RECORDS;
+    config->max_segment_records = PACE2_EVENT_STORE_DEFAULT_SEGMENT_RECORDS;
+    config->max_segment_seconds = PACE2_EVENT_STORE_DEFAULT_SEGMENT_SECONDS;
+}
+
+u8 pace2_event_store_open(struct pace2_event_store *store, const struct pace2_event_store_config *config)
+{
+    if (NULL == store || NULL == config || NULL == config->prefix) {
+        return 1;
+    }
+
+    memset(store, 0, sizeof(*store));
+    store->config = *config;
+    if (0 == store->config.block_records) {
+        store->config.block_records = PACE2_EVENT_STORE_DEFAULT_BLOCK_RECORDS;
+    }
+
+    store->path = malloc(strlen(config->prefix) + PACE2_EVENT_STORE_SUFFIX_LENGTH);
+    if (NULL == store->path || pace2_event_store_open_segment(store) != 0) {
+        pace2_event_store_close(store);
+        return 1;
+    }
+
+    return 0;
+}
+
+u32 pace2_event_store_encode(PACE2_event const * const event, PACE2_packet_descriptor const * const pd,
+                             u8 *buffer, u32 size)
+{
+    struct pace2_event_store_record record;
+    const PACE2_packet_stack *framing;
+    const PACE2_packet_frame_descriptor *frame;
+    u32 length;
+
+    if (size < sizeof(record)) {
+        return 0;
+    }
+
+    length = pace2_encode_event(event, buffer + sizeof(record), size - (u32)sizeof(record));
+    if (0 == length) {
+        return 0;
+    }
+
+    memset(&record, 0, sizeof(record));
+    record.length = (u32)sizeof(record) + length;
+
+    switch (event->header.type) {
+        case PACE2_FLOW_STARTED_EVENT:
+            record.flow_id = event->flow_started.flow_id;
+            break;
+        case PACE2_FLOW_DROPPED_EVENT:
+            record.flow_id = event->flow_dropped.flow_id;
+            break;
+        case PACE2_FLOW_INFO_EVENT:
+            record.flow_id = event->flow_info.flow_id;
+            break;
+        case PACE2_FLOW_PROCESS_EVENT:
+            record.flow_id = event->flow_process.flow_id;
+            break;
+        default:
+            if (NULL != pd) {
+                record.flow_id = pd->flow_id;
+            }
+            break;
+    }
+
+    if (NULL != pd) {
+        record.ts = pd->packet_ts;
+
+        framing = pd->framing;
+        if (NULL != framing && framing->inner_ip_index < framing->stack_size) {
+            frame = &framing->stack[framing->inner_ip_index];
+            if (IPv4 == frame->type) {
+                pace2_event_store_ipv4_mapped(record.src, frame->frame_data.ipv4->saddr);
+                pace2_event_store_ipv4_mapped(record.dst, frame->frame_data.ipv4->daddr);
+            } else if (IPv6 == frame->type) {
+                memcpy(record.src, frame->frame_data.ipv6->ip6_src.s6_addr, 16);
+                memcpy(record.dst, frame->frame_data.ipv6->ip6_dst.s6_addr, 16);
+            }
+        }
+    }
+
+    memcpy(buffer, &record, sizeof(record));
+
+    return record.length;
+}
+
+void pace2_event_store_append(struct pace2_event_store *store, const u8 *data, u32 length)
+{
+    struct pace2_event_store_record record;
+    struct pace2_event_segment_block *block;
+    const u32 padding = (u32)(PACE2_EVENT_STORE_ALIGN(length) - length);
+
+    if (0 != store->config.max_segment_seconds && NULL != store->file && 0 != store->segment_records &&
+        (u64)time(NULL) - store->segment_opened >= store->config.max_segment_seconds) {
+        pace2_event_store_rotate(store);
+    }
+
+    if (NULL == store->file || length < sizeof(record)) {
+        store->errors++;
+        return;
+    }
+
+    /* the index has to have room for the record before it is written */
+    if (pace2_event_store_reserve((void **)&store->blocks, &store->block_capacity, store->block_count + 1,
+                                  sizeof(*store->blocks)) != 0 ||
+        pace2_event_store_reserve((void **)&store->flows, &store->flow_capacity, store->flow_count + 1,
+                                  sizeof(*store->flows)) != 0 ||
+        pace2_event_store_reserve((void **)&store->addresses, &store->address_capacity, store->address_count + 2,
+                                  sizeof(*store->addresses)) != 0) {
+        store->errors++;
+        return;
+    }
+
+    memcpy(&record, data, sizeof(record));
+    record.length = length;
+    if (0 == record.ts) {
+        record.ts = store->last_ts;
+    }
+    store->last_ts = record.ts;
+
+    if (fwrite(&record, sizeof(record), 1, store->file) != 1 ||
+        fwrite(data + sizeof(record), 1, length - sizeof(record), store->file) != length - sizeof(record) ||
+        fwrite(pace2_event_store_padding, 1, padding, store->file) != padding) {
+        store->errors++;
+    }
+
+    if (0 == store->segment_records % store->config.block_records) {
+        block = &store->blocks[store->block_count++];
+        memset(block, 0, sizeof(*block));
+        block->offset = store->segment_offset;
+        block->min_ts = record.ts;
+        block->max_ts = record.ts;
+        store->block_first_flow = store->flow_count;
+        store->block_first_address = store->address_count;
+    }
+
+    block = &store->blocks[store->block_count - 1];
+    if (record.ts < block->min_ts) {
+        block->min_ts = record.ts;
+    }
+    if (record.ts > block->max_ts) {
+        block->max_ts = record.ts;
+    }
+    block->records++;
+
+    pace2_event_store_index_flow(store, record.flow_id);
+    pace2_event_store_index_address(store, record.src);
+    pace2_event_store_index_address(store, record.dst);
+
+    if (record.ts < store->min_ts) {
+        store->min_ts = record.ts;
+    }
+    if (record.ts > store->max_ts) {
+        store->max_ts = record.ts;
+    }
+
+    store->segment_offset += length + padding;
+    store->segment_records++;
+    store->records++;
+    store->bytes += length + padding;
+
+    if (0 != store->config.max_segment_records && store->segment_records >= store->config.max_segment_records) {
+        pace2_event_store_rotate(store);
+    }
+}
+
+void pace2_event_store_tick(struct pace2_event_store *store)
+{
+    if (NULL == store->file) {
+        return;
+    }
+
+    /* segments without records are not sealed */
+    if (0 != store->config.max_segment_seconds && 0 != store->segment_records &&
+        (u64)time(NULL) - store->segment_opened >= store->config.max_segment_seconds) {
+        pace2_event_store_rotate(store);
+        return;
+    }
+
+    /* queries of the open segment see the records written so far */
+    fflush(store->file);
+}
+
+void pace2_event_store_close(struct pace2_event_store *store)
+{
+    if (NULL == store) {
+        return;
+    }
+
+    pace2_event_store_seal_segment(store);
+
+    free(store->addresses);
+    free(store->flows);
+    free(store->blocks);
+    free(store->path);
+
+    store->addresses = NULL;
+    store->flows = NULL;
+    store->blocks = NULL;
+    store->path = NULL;
+    store->address_capacity = 0;
+    store->flow_capacity = 0;
+    store->block_capacity = 0;
+}
+
+void pace2_event_store_print_stats(const struct pace2_event_store *store, FILE *f)
+{
+    fprintf(f, "  event store %s: %llu records, %llu segments sealed, %llu bytes, %llu errors\n",
+            store->config.prefix, (unsigned long long)store->records, (unsigned long long)store->segments,
+            (unsigned long long)store->bytes, (unsigned long long)store->errors);
+}
+
+/* checks that the tables of the footer lie between the records and the footer */
+static int pace2_event_segment_check_footer(const struct pace2_event_segment_footer *footer, u64 size)
+{
+    const u64 end = size - sizeof(*footer);
+
+    if (0 != memcmp(footer->magic, PACE2_EVENT_SEGMENT_INDEX_MAGIC, sizeof(footer->magic)) ||
+        footer->version != PACE2_EVENT_SEGMENT_VERSION) {
+        return 1;
+    }
+
+    if (footer->blocks_offset < sizeof(struct pace2_event_segment_header) || 0 != footer->blocks_offset % 8 ||
+        footer->blocks_offset > end || footer->block_count > (end - footer->blocks_offset) / sizeof(struct pace2_event_segment_block) ||
+        footer->flows_offset != footer->blocks_offset + footer->block_count * sizeof(struct pace2_event_segment_block) ||
+        footer->flow_count > (end - footer->flows_offset) / sizeof(struct pace2_event_segment_flow) ||
+        footer->addresses_offset != footer->flows_offset + footer->flow_count * sizeof(struct pace2_event_segment_flow) ||
+        footer->address_count != (end - footer->addresses_offset) / sizeof(struct pace2_event_segment_address) ||
+        footer->addresses_offset + footer->address_count * sizeof(struct pace2_event_segment_address) != end) {
+        return 1;
+    }
+
+    return 0;
+}
+
+u8 pace2_event_segment_map(struct pace2_event_segment *segment, const char *path)
+{
+    const struct pace2_event_segment_footer *footer;
+    struct stat st;
+    void *base;
+    int fd;
+
+    memset(segment, 0, sizeof(*segment));
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 1;
+    }
+    if (fstat(fd, &st) != 0 || (u64)st.st_size < sizeof(struct pace2_event_segment_header)) {
+        close(fd);
+        return 1;
+    }
+
+    base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == base) {
+        return 1;
+    }
+
+    segment->base = base;
+    segment->size = (u64)st.st_size;
+    segment->header = base;
+
+    if (0 != memcmp(segment->header->magic, PACE2_EVENT_SEGMENT_MAGIC, sizeof(segment->header->magic)) ||
+        segment->header->version != PACE2_EVENT_SEGMENT_VERSION) {
+        pace2_event_segment_unmap(segment);
+        return 1;
+    }
+
+    if (segment->size >= sizeof(struct pace2_event_segment_header) + sizeof(*footer)) {
+        footer = (const struct pace2_event_segment_footer *)(segment->base + segment->size - sizeof(*footer));
+        if (pace2_event_segment_check_footer(footer, segment->size) == 0) {
+            segment->footer = footer;
+            segment->blocks = (const struct pace2_event_segment_block *)(segment->base + footer->blocks_offset);
+            segment->flows = (const struct pace2_event_segment_flow *)(segment->base + footer->flows_offset);
+            segment->addresses = (const struct pace2_event_segment_address *)(segment->base + footer->addresses_offset);
+            /* queries touch a few blocks and index pages */
+            madvise(base, (size_t)segment->size, MADV_RANDOM);
+        }
+    }
+
+    return 0;
+}
+
+void pace2_event_segment_unmap(struct pace2_event_segment *segment)
+{
+    if (NULL != segment->base) {
+        munmap((void *)segment->base, (size_t)segment->size);
+    }
+
+    memset(segment, 0, sizeof(*segment));
+}
+
+static int pace2_event_segment_record_matches(const struct pace2_event_store_record *record,
+                                              const struct pace2_event_store_query *query)
+{
+    if (record->ts < query->from_ts || record->ts > query->to_ts) {
+        return 0;
+    }
+    if (query->by_flow && record->flow_id != query->flow_id) {
+        return 0;
+    }
+    if (query->by_address && 0 != memcmp(record->src, query->address, 16) &&
+        0 != memcmp(record->dst, query->address, 16)) {
+        return 0;
+    }
+
+    return 1;
+}
+
+/* reads up to count records from offset on, stops at the first incomplete one */
+static u64 pace2_event_segment_scan(const struct pace2_event_segment *segment, u64 offset, u64 end, u64 count,
+                                    const struct pace2_event_store_query *query, pace2_event_store_match match,
+                                    void *user_data, struct pace2_event_store_query_stats *stats)
+{
+    const struct pace2_event_store_record *record;
+    u64 matches = 0;
+
+    for (; count > 0 && offset + sizeof(*record) <= end; count--) {
+        record = (const struct pace2_event_store_record *)(segment->base + offset);
+        if (record->length < sizeof(*record) || record->length > end - offset) {
+            break;
+        }
+
+        stats->records++;
+        if (pace2_event_segment_record_matches(record, query)) {
+            matches++;
+            if (NULL != match) {
+                match(record, (const u8 *)(record + 1), record->length - (u32)sizeof(*record), user_data);
+            }
+        }
+
+        offset += PACE2_EVENT_STORE_ALIGN(record->length);
+    }
+
+    return matches;
+}
+
+static u64 pace2_event_segment_scan_block(const struct pace2_event_segment *segment, u64 b,
+                                          const struct pace2_event_store_query *query, pace2_event_store_match match,
+                                          void *user_data, struct pace2_event_store_query_stats *stats)
+{
+    const struct pace2_event_segment_block * const block = &segment->blocks[b];
+
+    if (block->max_ts < query->from_ts || block->min_ts > query->to_ts ||
+        block->offset >= segment->footer->blocks_offset) {
+        return 0;
+    }
+
+    stats->blocks++;
+
+    return pace2_event_segment_scan(segment, block->offset, segment->footer->blocks_offset, block->records,
+                                    query, match, user_data, stats);
+}
+
+u64 pace2_event_segment_query(const struct pace2_event_segment *segment, const struct pace2_event_store_query *query,
+                              pace2_event_store_match match, void *user_data,
+                              struct pace2_event_store_query_stats *stats)
+{
+    const struct pace2_event_segment_footer * const footer = segment->footer;
+    struct pace2_event_store_query_stats local_stats;
+    u64 first, last, low, high, middle;
+    u64 matches = 0;
+
+    if (NULL == stats) {
+        memset(&local_stats, 0, sizeof(local_stats));
+        stats = &local_stats;
+    }
+    stats->segments++;
+
+    if (NULL == footer) {
+        stats->segments_scanned++;
+        matches = pace2_event_segment_scan(segment, sizeof(*segment->header), segment->size, ~0ull,
+                                           query, match, user_data, stats);
+        stats->matches += matches;
+        return matches;
+    }
+
+    if (0 == footer->records || footer->max_ts < query->from_ts || footer->min_ts > query->to_ts) {
+        stats->segments_skipped++;
+        return 0;
+    }
+
+    /* blocks [first, last) can hold records of the time range, prefix_max_ts and suffix_min_ts are sorted */
+    low = 0;
+    high = footer->block_count;
+    while (low < high) {
+        middle = low + (high - low) / 2;
+        if (segment->blocks[middle].prefix_max_ts < query->from_ts) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    first = low;
+
+    high = footer->block_count;
+    while (low < high) {
+        middle = low + (high - low) / 2;
+        if (segment->blocks[middle].suffix_min_ts <= query->to_ts) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    last = low;
+
+    if (query->by_flow) {
+        low = 0;
+        high = footer->flow_count;
+        while (low < high) {
+            middle = low + (high - low) / 2;
+            if (segment->flows[middle].flow_id < query->flow_id ||
+                (segment->flows[middle].flow_id == query->flow_id && segment->flows[middle].block < first)) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        for (; low < footer->flow_count && segment->flows[low].flow_id == query->flow_id &&
+               segment->flows[low].block < last; low++) {
+            matches += pace2_event_segment_scan_block(segment, segment->flows[low].block, query, match, user_data, stats);
+        }
+    } else if (query->by_address) {
+        low = 0;
+        high = footer->address_count;
+        while (low < high) {
+            int c;
+
+            middle = low + (high - low) / 2;
+            c = memcmp(segment->addresses[middle].address, query->address, 16);
+            if (c < 0 || (0 == c && segment->addresses[middle].block < first)) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        for (; low < footer->address_count && 0 == memcmp(segment->addresses[low].address, query->address, 16) &&
+               segment->addresses[low].block < last; low++) {
+            matches += pace2_event_segment_scan_block(segment, segment->addresses[low].block, query, match, user_data, stats);
+        }
+    } else {
+        for (low = first; low < last; low++) {
+            matches += pace2_event_segment_scan_block(segment, low, query, match, user_data, stats);
+        }
+    }
+
+    stats->matches += matches;
+
+    return matches;
+}
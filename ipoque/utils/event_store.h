@@ -0,0 +1,297 @@
+/*
+ * event_store.h
+ *
+ * Append-only, indexed store of binary event records. Finding the events of
+ * one flow or subscriber in an event log means reading all of it; the store
+ * writes the records into segments with a sparse index instead, so a query
+ * maps a segment and reads only the blocks of records which can match.
+ *
+ * segment <prefix>-<start time>-<sequence>.seg, all integers in host byte order:
+ * 1) struct pace2_event_segment_header
+ * 2) records, each 8 byte aligned: struct pace2_event_store_record with the
+ *    packet timestamp, the flow ID and the addresses of the inner IP frame,
+ *    followed by the event as encoded by pace2_encode_event
+ * 3) the index, written when the segment is sealed:
+ *    - one struct pace2_event_segment_block per block_records records with
+ *      its offset and time range, and the running maximum of the last and
+ *      the running minimum of the first timestamps, which are sorted even
+ *      if the records are not, so the blocks of a time range are found by
+ *      binary search
+ *    - struct pace2_event_segment_flow, one per flow and block, sorted
+ *    - struct pace2_event_segment_address, one per address and block,
+ *      sorted; IPv4 addresses are stored IPv4-mapped (::ffff:a.b.c.d)
+ * 4) struct pace2_event_segment_footer with the positions of the tables
+ *
+ * A segment is sealed when it holds max_segment_records records, when it is
+ * older than max_segment_seconds and when the store is closed. Segments
+ * without footer, e.g. the one being written, are scanned completely.
+ */
+
+#ifndef EVENT_STORE_H
+#define EVENT_STORE_H
+
+#include <stdio.h>
+#include <pace2.h>
+
+#define PACE2_EVENT_SEGMENT_MAGIC "P2EVSEG\0"
+#define PACE2_EVENT_SEGMENT_INDEX_MAGIC "P2EVIDX\0"
+#define PACE2_EVENT_SEGMENT_VERSION 1
+
+#define PACE2_EVENT_STORE_DEFAULT_BLOCK_RECORDS 128
+#define PACE2_EVENT_STORE_DEFAULT_SEGMENT_RECORDS (1024 * 1024)
+#define PACE2_EVENT_STORE_DEFAULT_SEGMENT_SECONDS 3600
+
+/* records are aligned to this in a segment */
+#define PACE2_EVENT_STORE_ALIGN(length) (((length) + 7) & ~(u64)7)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* start of a segment */
+struct pace2_event_segment_header {
+    char magic[8];
+    u32 version;
+    u32 block_records;
+    /* timestamps of the records are in these units */
+    u64 ticks_per_second;
+    /* wall clock time in seconds when the segment was started */
+    u64 created;
+};
+
+/* start of every record, followed by the encoded event */
+struct pace2_event_store_record {
+    /* length of the record including this header, without alignment */
+    u32 length;
+    u32 reserved;
+    PACE2_timestamp ts;
+    u64 flow_id;
+    /* addresses of the inner IP frame, IPv4-mapped for IPv4; all 0 if unknown */
+    u8 src[16];
+    u8 dst[16];
+};
+
+/* index entry of a block of records */
+struct pace2_event_segment_block {
+    u64 offset;
+    PACE2_timestamp min_ts;
+    PACE2_timestamp max_ts;
+    /* maximum of max_ts of this and all previous blocks */
+    PACE2_timestamp prefix_max_ts;
+    /* minimum of min_ts of this and all following blocks */
+    PACE2_timestamp suffix_min_ts;
+    u32 records;
+    u32 reserved;
+};
+
+/* a flow has records in a block */
+struct pace2_event_segment_flow {
+    u64 flow_id;
+    u32 block;
+    u32 reserved;
+};
+
+/* an address is the source or destination of records in a block */
+struct pace2_event_segment_address {
+    u8 address[16];
+    u32 block;
+    u32 reserved;
+};
+
+/* end of a sealed segment */
+struct pace2_event_segment_footer {
+    char magic[8];
+    u32 version;
+    u32 reserved;
+    u64 records;
+    PACE2_timestamp min_ts;
+    PACE2_timestamp max_ts;
+    u64 blocks_offset;
+    u64 block_count;
+    u64 flows_offset;
+    u64 flow_count;
+    u64 addresses_offset;
+    u64 address_count;
+};
+
+struct pace2_event_store_config {
+    /* path and name prefix of the segments */
+    const char *prefix;
+    /* units of the packet timestamps, stored in the segments for the queries */
+    u64 ticks_per_second;
+    /* records per index block; larger blocks make a smaller index and longer scans */
+    u32 block_records;
+    /* records per segment, 0 for no limit */
+    u64 max_segment_records;
+    /* age of a segment in seconds, 0 for no limit */
+    u32 max_segment_seconds;
+};
+
+/* writer of a store */
+struct pace2_event_store {
+    struct pace2_event_store_config config;
+
+    /* current segment */
+    FILE *file;
+    char *path;
+    u64 segment_sequence;
+    u64 segment_opened;
+    u64 segment_offset;
+    u64 segment_records;
+    PACE2_timestamp min_ts;
+    PACE2_timestamp max_ts;
+    PACE2_timestamp last_ts;
+
+    /* index of the current segment */
+    struct pace2_event_segment_block *blocks;
+    u64 block_count;
+    u64 block_capacity;
+    struct pace2_event_segment_flow *flows;
+    u64 flow_count;
+    u64 flow_capacity;
+    struct pace2_event_segment_address *addresses;
+    u64 address_count;
+    u64 address_capacity;
+    /* index entries of the current block start here */
+    u64 block_first_flow;
+    u64 block_first_address;
+
+    /* statistics */
+    u64 records;
+    u64 segments;
+    u64 bytes;
+    u64 errors;
+};
+
+/* a segment mapped for queries */
+struct pace2_event_segment {
+    const u8 *base;
+    u64 size;
+    const struct pace2_event_segment_header *header;
+    /* NULL if the segment is not sealed */
+    const struct pace2_event_segment_footer *footer;
+    const struct pace2_event_segment_block *blocks;
+    const struct pace2_event_segment_flow *flows;
+    const struct pace2_event_segment_address *addresses;
+};
+
+/* records matching all given conditions */
+struct pace2_event_store_query {
+    PACE2_timestamp from_ts;
+    PACE2_timestamp to_ts;
+    u8 by_flow;
+    u64 flow_id;
+    /* source or destination, IPv4-mapped for IPv4 */
+    u8 by_address;
+    u8 address[16];
+};
+
+/* work done by queries, added up over all segments */
+struct pace2_event_store_query_stats {
+    u64 segments;
+    u64 segments_skipped;
+    /* segments without index, read completely */
+    u64 segments_scanned;
+    u64 blocks;
+    u64 records;
+    u64 matches;
+};
+
+/**
+ * called for every record matching a query, in the order of the segment
+ * @param record header of the record
+ * @param event encoded event, see pace2_decode_event
+ * @param length length of the encoded event
+ * @param user_data as given to pace2_event_segment_query
+ */
+typedef void (*pace2_event_store_match)(const struct pace2_event_store_record *record, const u8 *event,
+                                        u32 length, void *user_data);
+
+/**
+ * fills a configuration with default values
+ * (128 records per block, 1Mi records or one hour per segment)
+ * @param config configuration to initialize
+ * @param prefix path and name prefix of the segments
+ * @param ticks_per_second units of the packet timestamps
+ */
+void pace2_event_store_init_default_config(struct pace2_event_store_config *config, const char *prefix,
+                                           u64 ticks_per_second);
+
+/**
+ * opens the first segment
+ * @param store store to initialize
+ * @param config configuration
+ * @return 0 on success; !=0 on error
+ */
+u8 pace2_event_store_open(struct pace2_event_store *store, const struct pace2_event_store_config *config);
+
+/**
+ * encodes an event and the keys of its packet as store record
+ * @param event event to encode
+ * @param pd packet which caused the event; NULL if unknown
+ * @param buffer buffer for the record
+ * @param size size of the buffer
+ * @return length of the record; 0 if the buffer is too small or the event type is not supported
+ */
+u32 pace2_event_store_encode(PACE2_event const * const event, PACE2_packet_descriptor const * const pd,
+                             u8 *buffer, u32 size);
+
+/**
+ * appends a record to the current segment, seals it when it is full
+ * @param store store
+ * @param record record from pace2_event_store_encode; a timestamp of 0 is replaced by the previous one
+ * @param length length of the record
+ */
+void pace2_event_store_append(struct pace2_event_store *store, const u8 *record, u32 length);
+
+/**
+ * seals the segment after max_segment_seconds, called regularly while no records are written
+ * @param store store
+ */
+void pace2_event_store_tick(struct pace2_event_store *store);
+
+/**
+ * seals the current segment and frees the store
+ * @param store store
+ */
+void pace2_event_store_close(struct pace2_event_store *store);
+
+/**
+ * prints the counters of the store
+ * @param store store
+ * @param f output
+ */
+void pace2_event_store_print_stats(const struct pace2_event_store *store, FILE *f);
+
+/**
+ * maps a segment read only and checks its header and index
+ * @param segment segment to initialize
+ * @param path file name
+ * @return 0 on success; !=0 if the file cannot be mapped or is no segment
+ */
+u8 pace2_event_segment_map(struct pace2_event_segment *segment, const char *path);
+
+/**
+ * unmaps a segment
+ * @param segment segment
+ */
+void pace2_event_segment_unmap(struct pace2_event_segment *segment);
+
+/**
+ * finds the records of a segment matching a query
+ * @param segment mapped segment
+ * @param query conditions
+ * @param match called for every matching record
+ * @param user_data passed to match
+ * @param stats work done, added to the counters; NULL if not needed
+ * @return number of matching records
+ */
+u64 pace2_event_segment_query(const struct pace2_event_segment *segment, const struct pace2_event_store_query *query,
+                              pace2_event_store_match match, void *user_data,
+                              struct pace2_event_store_query_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EVENT_STORE_H */
@@ -0,0 +1,301 @@
+/*
+ * event_store_benchmark.c
+ *
+ * Writes a synthetic day of flow events into an event store (see
+ * event_store.h) and checks the indexed queries of pace2_event_segment_query
+ * against a scan of all records: random time ranges alone and combined with
+ * a flow ID or an address, and every segment once more without its index.
+ * Afterwards the write rate and the time of the queries are printed. The
+ * segments are removed at the end.
+ *
+ * usage: event_store_benchmark [number of events] [directory]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <glob.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+
+#include "event_encoder.h"
+#include "event_store.h"
+
+#define TICKS_PER_SECOND 1000
+#define DAY_SECONDS 86400
+#define SUBSCRIBERS 20000
+#define EVENTS_PER_FLOW 8
+#define NUMBER_OF_QUERIES 400
+
+/* the store starts a new segment after this many records so that a day spans several */
+#define SEGMENT_RECORDS (256 * 1024)
+
+/* query and result of the scan of all records */
+struct reference_scan {
+    const struct pace2_event_store_query *query;
+    u64 matches;
+};
+
+static double now( void )
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void ipv4_mapped( u8 *address, u32 ipv4 )
+{
+    memset(address, 0, 10);
+    address[10] = 0xff;
+    address[11] = 0xff;
+    memcpy(address + 12, &ipv4, 4);
+}
+
+/* events of a flow follow each other closely, some packets are late by up to 3 seconds */
+static u32 write_day( struct pace2_event_store *store, u64 events, u64 start )
+{
+    PACE2_packet_frame_descriptor frame;
+    PACE2_packet_stack stack = { &frame, 1, 0, 0 };
+    PACE2_packet_descriptor pd;
+    struct iphdr ip;
+    PACE2_event event;
+    u8 record[512];
+    u64 i;
+
+    memset(&frame, 0, sizeof(frame));
+    frame.type = IPv4;
+    frame.frame_data.ipv4 = &ip;
+    memset(&pd, 0, sizeof(pd));
+    pd.framing = &stack;
+
+    for (i = 0; i < events; i++) {
+        const u64 flow = i / EVENTS_PER_FLOW + rand() % 3;
+        u32 length;
+
+        memset(&ip, 0, sizeof(ip));
+        ip.saddr = htonl(0x0a010000 | (rand() % SUBSCRIBERS));
+        ip.daddr = htonl(0x5d000000 | (rand() & 0xffff));
+        if (rand() & 1) {
+            const u32 swap = ip.saddr;
+
+            ip.saddr = ip.daddr;
+            ip.daddr = swap;
+        }
+        pd.packet_ts = (start + i * DAY_SECONDS / events) * TICKS_PER_SECOND + rand() % TICKS_PER_SECOND;
+        if (rand() % 4 == 0 && pd.packet_ts > 3 * TICKS_PER_SECOND) {
+            pd.packet_ts -= rand() % (3 * TICKS_PER_SECOND);
+        }
+        pd.flow_id = flow;
+
+        memset(&event, 0, sizeof(event));
+        if (i % 97 == 0) {
+            /* flows dropped by the timeout handling have no packet */
+            event.header.type = PACE2_FLOW_DROPPED_EVENT;
+            event.flow_dropped.flow_id = flow;
+            length = pace2_event_store_encode(&event, NULL, record, sizeof(record));
+        } else {
+            event.header.type = PACE2_FLOW_PROCESS_EVENT;
+            event.flow_process.flow_id = flow;
+            event.flow_process.bytes = rand() % 1500;
+            event.flow_process.total_bytes = i;
+            length = pace2_event_store_encode(&event, &pd, record, sizeof(record));
+        }
+
+        if (length == 0) {
+            fprintf(stderr, "event %llu could not be encoded\n", (unsigned long long)i);
+            return 1;
+        }
+        pace2_event_store_append(store, record, length);
+    }
+
+    return 0;
+}
+
+/* applies the conditions of the query to every record, the query of the scan itself selects all */
+static void reference_match( const struct pace2_event_store_record *record, const u8 *event, u32 length,
+                             void *user_data )
+{
+    struct reference_scan * const scan = user_data;
+    const struct pace2_event_store_query * const query = scan->query;
+    PACE2_event decoded;
+
+    if (pace2_decode_event(event, length, &decoded) != length) {
+        fprintf(stderr, "invalid event record\n");
+        exit(1);
+    }
+
+    if (record->ts < query->from_ts || record->ts > query->to_ts ||
+        (query->by_flow && record->flow_id != query->flow_id) ||
+        (query->by_address && memcmp(record->src, query->address, 16) != 0 &&
+         memcmp(record->dst, query->address, 16) != 0)) {
+        return;
+    }
+
+    scan->matches++;
+}
+
+static u64 reference_query( const struct pace2_event_segment *segments, size_t count,
+                            const struct pace2_event_store_query *query )
+{
+    struct pace2_event_store_query all;
+    struct reference_scan scan;
+    size_t s;
+
+    memset(&all, 0, sizeof(all));
+    all.to_ts = ~0ull;
+    scan.query = query;
+    scan.matches = 0;
+
+    for (s = 0; s < count; s++) {
+        struct pace2_event_segment unindexed = segments[s];
+
+        /* the same records without footer are read completely */
+        unindexed.size = segments[s].footer->blocks_offset;
+        unindexed.footer = NULL;
+        pace2_event_segment_query(&unindexed, &all, reference_match, &scan, NULL);
+    }
+
+    return scan.matches;
+}
+
+static void random_query( struct pace2_event_store_query *query, u64 start, u32 kind, u64 events )
+{
+    const u64 from = start + rand() % DAY_SECONDS;
+    const u64 seconds = rand() % 5 == 0 ? DAY_SECONDS : (u64)(rand() % 600);
+
+    memset(query, 0, sizeof(*query));
+    query->from_ts = from * TICKS_PER_SECOND;
+    query->to_ts = (from + seconds) * TICKS_PER_SECOND + TICKS_PER_SECOND - 1;
+
+    if (kind == 1 || kind == 3) {
+        query->by_address = 1;
+        ipv4_mapped(query->address, htonl(0x0a010000 | (rand() % SUBSCRIBERS)));
+    }
+    if (kind == 2 || kind == 3) {
+        /* a flow with events in the range */
+        query->by_flow = 1;
+        query->flow_id = (from + seconds / 2 - start) * events / DAY_SECONDS / EVENTS_PER_FLOW;
+    }
+}
+
+int main( int argc, char **argv )
+{
+    const u64 events = argc > 1 ? strtoull(argv[1], NULL, 10) : 5000000;
+    const char * const directory = argc > 2 ? argv[2] : "/tmp";
+    const u64 start = 1790000000;
+    struct pace2_event_store_config config;
+    struct pace2_event_store store;
+    struct pace2_event_store_query query;
+    struct pace2_event_store_query_stats stats;
+    struct pace2_event_segment *segments;
+    char prefix[4096];
+    char pattern[4200];
+    double write_time;
+    double query_time[4] = { 0, 0, 0, 0 };
+    u32 queries[4] = { 0, 0, 0, 0 };
+    u64 matches;
+    u64 expected;
+    glob_t files;
+    size_t s;
+    u32 q;
+    int result = 0;
+
+    if (events == 0) {
+        fprintf(stderr, "usage: event_store_benchmark [number of events] [directory]\n");
+        return 1;
+    }
+
+    snprintf(prefix, sizeof(prefix), "%s/event_store_benchmark", directory);
+    snprintf(pattern, sizeof(pattern), "%s-*.seg", prefix);
+    srand(1);
+
+    pace2_event_store_init_default_config(&config, prefix, TICKS_PER_SECOND);
+    config.max_segment_records = SEGMENT_RECORDS;
+    config.max_segment_seconds = 0;
+    if (pace2_event_store_open(&store, &config) != 0) {
+        fprintf(stderr, "could not open the store %s\n", prefix);
+        return 1;
+    }
+
+    write_time = now();
+    if (write_day(&store, events, start) != 0) {
+        pace2_event_store_close(&store);
+        return 1;
+    }
+    pace2_event_store_close(&store);
+    write_time = now() - write_time;
+    pace2_event_store_print_stats(&store, stdout);
+
+    if (glob(pattern, 0, NULL, &files) != 0) {
+        fprintf(stderr, "no segments %s\n", pattern);
+        return 1;
+    }
+    segments = calloc(files.gl_pathc, sizeof(*segments));
+    if (segments == NULL) {
+        return 1;
+    }
+    for (s = 0; s < files.gl_pathc; s++) {
+        if (pace2_event_segment_map(&segments[s], files.gl_pathv[s]) != 0 || segments[s].footer == NULL) {
+            fprintf(stderr, "%s is no sealed segment\n", files.gl_pathv[s]);
+            result = 1;
+            goto out;
+        }
+    }
+
+    /* every record is found once */
+    memset(&query, 0, sizeof(query));
+    query.to_ts = ~0ull;
+    expected = reference_query(segments, files.gl_pathc, &query);
+    if (expected != events) {
+        fprintf(stderr, "%llu of %llu records stored\n", (unsigned long long)expected, (unsigned long long)events);
+        result = 1;
+        goto out;
+    }
+
+    for (q = 0; q < NUMBER_OF_QUERIES; q++) {
+        const u32 kind = q % 4;
+        double t;
+
+        random_query(&query, start, kind, events);
+        memset(&stats, 0, sizeof(stats));
+
+        t = now();
+        matches = 0;
+        for (s = 0; s < files.gl_pathc; s++) {
+            matches += pace2_event_segment_query(&segments[s], &query, NULL, NULL, &stats);
+        }
+        query_time[kind] += now() - t;
+        queries[kind]++;
+
+        expected = reference_query(segments, files.gl_pathc, &query);
+        if (matches != expected) {
+            fprintf(stderr, "query %u (kind %u): %llu matches, %llu expected\n", q, kind,
+                    (unsigned long long)matches, (unsigned long long)expected);
+            result = 1;
+            goto out;
+        }
+    }
+
+    printf("%llu events in %llu segments, %.0f events/s written\n", (unsigned long long)events,
+           (unsigned long long)files.gl_pathc, events / write_time);
+    printf("time range:           %8.3f ms/query\n", query_time[0] * 1000 / queries[0]);
+    printf("time range + address: %8.3f ms/query\n", query_time[1] * 1000 / queries[1]);
+    printf("time range + flow:    %8.3f ms/query\n", query_time[2] * 1000 / queries[2]);
+    printf("address + flow:       %8.3f ms/query\n", query_time[3] * 1000 / queries[3]);
+    printf("%u queries match the scan of all records\n", NUMBER_OF_QUERIES);
+
+out:
+    for (s = 0; s < files.gl_pathc; s++) {
+        pace2_event_segment_unmap(&segments[s]);
+        unlink(files.gl_pathv[s]);
+    }
+    free(segments);
+    globfree(&files);
+
+    return result;
+}
@@ -0,0 +1,423 @@
+/*
+ * flow_checkpoint.c
+ *
+ * Flow and subscriber snapshot files, see flow_checkpoint.h.
+ */
+
+#include "flow_checkpoint.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#define FC_ALIGN8(x) (((x) + 7) & ~7u)
+#define FC_ALIGN64(x) (((x) + 63) & ~63u)
+
+/* stdio buffer of the writer */
+#define FC_WRITE_BUFFER_SIZE (1024 * 1024)
+
+/* zlib takes 32 bit lengths */
+#define FC_CRC_CHUNK (1u << 30)
+
+static u32 fc_crc(u32 crc, const u8 *data, u64 length)
+{
+    while (length > 0) {
+        const u32 chunk = length > FC_CRC_CHUNK ? FC_CRC_CHUNK : (u32)length;
+
+        crc = crc32(crc, data, chunk);
+        data += chunk;
+        length -= chunk;
+    }
+
+    return crc;
+}
+
+static u32 fc_header_crc(const struct fc_header *hdr)
+{
+    struct fc_header copy = *hdr;
+
+    copy.header_crc = 0;
+
+    return crc32(0, (const u8 *)&copy, sizeof(copy));
+}
+
+u8 fc_writer_open(struct fc_writer *writer, const char *path, u32 flow_key_size, u32 subscriber_key_size, u64 timestamp)
+{
+    static const u8 zero[FC_ALIGN64(sizeof(struct fc_header))];
+    struct fc_header * const hdr = &writer->hdr;
+    u32 s;
+
+    memset(writer, 0, sizeof(*writer));
+
+    if (strlen(path) >= sizeof(writer->path)) {
+        return 1;
+    }
+
+    strcpy(writer->path, path);
+    snprintf(writer->tmp_path, sizeof(writer->tmp_path), "%s.tmp", path);
+
+    hdr->magic = FC_MAGIC;
+    hdr->version_major = FC_VERSION_MAJOR;
+    hdr->version_minor = FC_VERSION_MINOR;
+    hdr->header_size = sizeof(zero);
+    hdr->dump_size = PACE2_PHT_DUMP_DATA_SIZE;
+    hdr->key_size[FC_FLOWS] = flow_key_size;
+    hdr->key_size[FC_SUBSCRIBERS] = subscriber_key_size;
+    hdr->timestamp = timestamp;
+
+    for (s = 0; s < FC_NUMBER_OF_SECTIONS; s++) {
+        hdr->record_size[s] = FC_ALIGN8(hdr->key_size[s]) + sizeof(u64) + FC_ALIGN8(hdr->dump_size);
+    }
+
+    hdr->section_offset[FC_FLOWS] = hdr->header_size;
+    hdr->total_size = hdr->header_size;
+    writer->crc = crc32(0, NULL, 0);
+
+    writer->file = fopen(writer->tmp_path, "wb");
+    if (NULL == writer->file) {
+        perror("fopen");
+        return 1;
+    }
+
+    setvbuf(writer->file, NULL, _IOFBF, FC_WRITE_BUFFER_SIZE);
+
+    /* the header is written when the file is complete */
+    if (fwrite(zero, sizeof(zero), 1, writer->file) != 1) {
+        fc_writer_abort(writer);
+        return 1;
+    }
+
+    return 0;
+}
+
+/* writes data into the current section */
+static void fc_write(struct fc_writer *writer, const void *data, u32 length)
+{
+    if (0 == length) {
+        return;
+    }
+
+    if (fwrite(data, length, 1, writer->file) != 1) {
+        writer->failed = 1;
+    }
+
+    writer->crc = crc32(writer->crc, data, length);
+    writer->hdr.total_size += length;
+}
+
+/* finishes the current section and starts the next one */
+static void fc_next_section(struct fc_writer *writer)
+{
+    writer->hdr.section_crc[writer->section] = writer->crc;
+    writer->section++;
+
+    if (writer->section < FC_NUMBER_OF_SECTIONS) {
+        writer->hdr.section_offset[writer->section] = writer->hdr.total_size;
+        writer->crc = crc32(0, NULL, 0);
+    }
+}
+
+u8 fc_write_record(struct fc_writer *writer, enum fc_section section, const u8 *key, u64 timestamp, const u8 *dump)
+{
+    static const u8 pad[8];
+    struct fc_header * const hdr = &writer->hdr;
+
+    if (NULL == writer->file || (u32)section < writer->section || section >= FC_NUMBER_OF_SECTIONS) {
+        writer->failed = 1;
+        return 1;
+    }
+
+    while (writer->section < (u32)section) {
+        fc_next_section(writer);
+    }
+
+    fc_write(writer, key, hdr->key_size[section]);
+    fc_write(writer, pad, FC_ALIGN8(hdr->key_size[section]) - hdr->key_size[section]);
+    fc_write(writer, &timestamp, sizeof(timestamp));
+    fc_write(writer, dump, hdr->dump_size);
+    fc_write(writer, pad, FC_ALIGN8(hdr->dump_size) - hdr->dump_size);
+
+    hdr->record_count[section]++;
+
+    return writer->failed;
+}
+
+u8 fc_writer_close(struct fc_writer *writer)
+{
+    struct fc_header * const hdr = &writer->hdr;
+
+    if (NULL == writer->file) {
+        return 1;
+    }
+
+    while (writer->section < FC_NUMBER_OF_SECTIONS) {
+        fc_next_section(writer);
+    }
+
+    hdr->header_crc = fc_header_crc(hdr);
+
+    if (writer->failed ||
+        fseek(writer->file, 0, SEEK_SET) != 0 ||
+        fwrite(hdr, sizeof(*hdr), 1, writer->file) != 1 ||
+        fflush(writer->file) != 0 ||
+        fsync(fileno(writer->file)) != 0) {
+        perror("checkpoint write");
+        fc_writer_abort(writer);
+        return 1;
+    }
+
+    fclose(writer->file);
+    writer->file = NULL;
+
+    if (rename(writer->tmp_path, writer->path) != 0) {
+        perror("rename");
+        unlink(writer->tmp_path);
+        return 1;
+    }
+
+    return 0;
+}
+
+void fc_writer_abort(struct fc_writer *writer)
+{
+    if (NULL != writer->file) {
+        fclose(writer->file);
+        writer->file = NULL;
+    }
+
+    unlink(writer->tmp_path);
+}
+
+u8 fc_open(struct fc_snapshot *snapshot, const char *path)
+{
+    const struct fc_header *hdr;
+    struct stat st;
+    u32 s;
+
+    memset(snapshot, 0, sizeof(*snapshot));
+
+    snapshot->fd = open(path, O_RDONLY);
+    if (snapshot->fd < 0) {
+        return 1;
+    }
+
+    if (fstat(snapshot->fd, &st) != 0 || (u64)st.st_size < sizeof(struct fc_header)) {
+        fc_close(snapshot);
+        return 1;
+    }
+
+    snapshot->size = st.st_size;
+    snapshot->base = mmap(NULL, snapshot->size, PROT_READ, MAP_PRIVATE, snapshot->fd, 0);
+    if (MAP_FAILED == (void *)snapshot->base) {
+        perror("mmap");
+        snapshot->base = NULL;
+        fc_close(snapshot);
+        return 1;
+    }
+
+    hdr = (const struct fc_header *)snapshot->base;
+
+    if (hdr->magic != FC_MAGIC || hdr->version_major != FC_VERSION_MAJOR ||
+        hdr->header_crc != fc_header_crc(hdr) || hdr->total_size != snapshot->size ||
+        hdr->dump_size != PACE2_PHT_DUMP_DATA_SIZE) {
+        fprintf(stderr, "Snapshot %s is damaged or was written by an incompatible version.\n", path);
+        fc_close(snapshot);
+        return 1;
+    }
+
+    for (s = 0; s < FC_NUMBER_OF_SECTIONS; s++) {
+        if (hdr->record_size[s] != FC_ALIGN8(hdr->key_size[s]) + sizeof(u64) + FC_ALIGN8(hdr->dump_size) ||
+            hdr->section_offset[s] > snapshot->size ||
+            hdr->record_count[s] > (snapshot->size - hdr->section_offset[s]) / hdr->record_size[s]) {
+            fprintf(stderr, "Snapshot %s has an invalid section %u.\n", path, s);
+            fc_close(snapshot);
+            return 1;
+        }
+    }
+
+    snapshot->hdr = hdr;
+
+    /* every thread reads its part sequentially */
+    madvise(snapshot->base, snapshot->size, MADV_WILLNEED);
+
+    return 0;
+}
+
+void fc_close(struct fc_snapshot *snapshot)
+{
+    if (NULL != snapshot->base) {
+        munmap(snapshot->base, snapshot->size);
+    }
+
+    if (snapshot->fd >= 0) {
+        close(snapshot->fd);
+    }
+
+    memset(snapshot, 0, sizeof(*snapshot));
+    snapshot->fd = -1;
+}
+
+struct fc_thread {
+    pthread_t thread;
+    const struct fc_snapshot *snapshot;
+    u32 index;
+    u32 threads;
+
+    /* verification: CRC and length of the part of every section */
+    u32 crc[FC_NUMBER_OF_SECTIONS];
+    u64 length[FC_NUMBER_OF_SECTIONS];
+
+    /* restore */
+    fc_restore_callback callback;
+    void *user_ptr;
+    u64 restored[FC_NUMBER_OF_SECTIONS];
+};
+
+/* records [first, last) of a section belong to a thread */
+static void fc_thread_range(const struct fc_thread *t, u32 section, u64 *first, u64 *last)
+{
+    const u64 count = t->snapshot->hdr->record_count[section];
+
+    *first = count * t->index / t->threads;
+    *last = count * (t->index + 1) / t->threads;
+}
+
+static void *fc_verify_thread(void *arg)
+{
+    struct fc_thread * const t = arg;
+    u32 s;
+
+    for (s = 0; s < FC_NUMBER_OF_SECTIONS; s++) {
+        u64 first, last;
+
+        fc_thread_range(t, s, &first, &last);
+
+        t->length[s] = (last - first) * t->snapshot->hdr->record_size[s];
+        t->crc[s] = fc_crc(crc32(0, NULL, 0), fc_record(t->snapshot, s, first), t->length[s]);
+    }
+
+    return NULL;
+}
+
+static void *fc_restore_thread(void *arg)
+{
+    struct fc_thread * const t = arg;
+    const struct fc_header * const hdr = t->snapshot->hdr;
+    u32 s;
+
+    for (s = 0; s < FC_NUMBER_OF_SECTIONS; s++) {
+        const u32 timestamp_offset = FC_ALIGN8(hdr->key_size[s]);
+        u64 first, last, i;
+
+        fc_thread_range(t, s, &first, &last);
+
+        for (i = first; i < last; i++) {
+            const u8 * const record = fc_record(t->snapshot, s, i);
+            u64 timestamp;
+
+            memcpy(&timestamp, record + timestamp_offset, sizeof(timestamp));
+
+            if (t->callback(t->index, s, record, timestamp, record + timestamp_offset + sizeof(u64), t->user_ptr) == 0) {
+                t->restored[s]++;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/* runs a function on all threads, the first one is the calling thread */
+static void fc_run(struct fc_thread *threads, u32 count, void *(*function)(void *))
+{
+    u32 i;
+
+    for (i = 1; i < count; i++) {
+        if (pthread_create(&threads[i].thread, NULL, function, &threads[i]) != 0) {
+            /* no more threads, the part is processed by the calling thread */
+            threads[i].thread = 0;
+            function(&threads[i]);
+        }
+    }
+
+    function(&threads[0]);
+
+    for (i = 1; i < count; i++) {
+        if (threads[i].thread != 0) {
+            pthread_join(threads[i].thread, NULL);
+        }
+    }
+}
+
+static u32 fc_init_threads(struct fc_thread *threads, const struct fc_snapshot *snapshot, u32 count)
+{
+    u32 i;
+
+    if (0 == count) {
+        count = 1;
+    } else if (count > FC_MAX_THREADS) {
+        count = FC_MAX_THREADS;
+    }
+
+    memset(threads, 0, sizeof(*threads) * count);
+
+    for (i = 0; i < count; i++) {
+        threads[i].snapshot = snapshot;
+        threads[i].index = i;
+        threads[i].threads = count;
+    }
+
+    return count;
+}
+
+u8 fc_verify(const struct fc_snapshot *snapshot, u32 threads)
+{
+    struct fc_thread t[FC_MAX_THREADS];
+    const u32 count = fc_init_threads(t, snapshot, threads);
+    u32 s, i;
+
+    fc_run(t, count, fc_verify_thread);
+
+    for (s = 0; s < FC_NUMBER_OF_SECTIONS; s++) {
+        u32 crc = t[0].crc[s];
+
+        for (i = 1; i < count; i++) {
+            crc = crc32_combine(crc, t[i].crc[s], t[i].length[s]);
+        }
+
+        if (crc != snapshot->hdr->section_crc[s]) {
+            fprintf(stderr, "Snapshot section %u has a wrong checksum.\n", s);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+void fc_restore(const struct fc_snapshot *snapshot, u32 threads, fc_restore_callback callback, void *user_ptr,
+                u64 restored[FC_NUMBER_OF_SECTIONS])
+{
+    struct fc_thread t[FC_MAX_THREADS];
+    const u32 count = fc_init_threads(t, snapshot, threads);
+    u32 s, i;
+
+    for (i = 0; i < count; i++) {
+        t[i].callback = callback;
+        t[i].user_ptr = user_ptr;
+    }
+
+    fc_run(t, count, fc_restore_thread);
+
+    if (NULL != restored) {
+        for (s = 0; s < FC_NUMBER_OF_SECTIONS; s++) {
+            restored[s] = 0;
+            for (i = 0; i < count; i++) {
+                restored[s] += t[i].restored[s];
+            }
+        }
+    }
+}
@@ -0,0 +1,174 @@
+/*
+ * flow_checkpoint.h
+ *
+ * Snapshot file with the dumps of all tracked flows and subscribers, used to
+ * keep the classification state over a restart. The writer streams records
+ * into a temporary file and renames it when the header is complete, so an
+ * existing snapshot is never replaced by a partial one. The reader maps the
+ * file and hands out the records in place.
+ *
+ * layout of the file:
+ * 1) header (versioned, CRC32 protected, describes the sections)
+ * 2) flow records: key, timestamp, PACE 2 dump (pace2_pht_dump_flow_data)
+ * 3) subscriber records: key, timestamp, PACE 2 dump (pace2_pht_dump_id_data)
+ * Every section has a CRC32 over its records.
+ */
+
+#ifndef FLOW_CHECKPOINT_H
+#define FLOW_CHECKPOINT_H
+
+#include <stdio.h>
+#include <pace2.h>
+
+#define FC_MAGIC 0x50324350 /* "P2CP" */
+#define FC_VERSION_MAJOR 1
+#define FC_VERSION_MINOR 0
+
+/* maximum number of restore threads */
+#define FC_MAX_THREADS 64
+
+enum fc_section {
+    FC_FLOWS = 0,
+    FC_SUBSCRIBERS,
+    FC_NUMBER_OF_SECTIONS
+};
+
+struct fc_header {
+    u32 magic;
+    u16 version_major;
+    u16 version_minor;
+    u32 header_size;
+    /* size of a PACE 2 dump, PACE2_PHT_DUMP_DATA_SIZE of the writer */
+    u32 dump_size;
+    u32 key_size[FC_NUMBER_OF_SECTIONS];
+    u32 record_size[FC_NUMBER_OF_SECTIONS];
+    u64 record_count[FC_NUMBER_OF_SECTIONS];
+    /* offset of the first record of every section from the start of the file */
+    u64 section_offset[FC_NUMBER_OF_SECTIONS];
+    u32 section_crc[FC_NUMBER_OF_SECTIONS];
+    u64 total_size;
+    /* PACE 2 timestamp of the checkpoint */
+    u64 timestamp;
+    /* CRC32 of the header with this field set to 0 */
+    u32 header_crc;
+    u32 pad;
+};
+
+struct fc_writer {
+    FILE *file;
+    char path[256];
+    char tmp_path[272];
+    struct fc_header hdr;
+    /* section currently written, sections are written in order */
+    u32 section;
+    u32 crc;
+    u8 failed;
+};
+
+struct fc_snapshot {
+    int fd;
+    u8 *base;
+    u64 size;
+    const struct fc_header *hdr;
+};
+
+/**
+ * called for every restored record; may be called from several threads at once if fc_restore uses more than one
+ * @param thread_index index of the restore thread
+ * @param section section of the record
+ * @param key key of the record
+ * @param timestamp last access of the element when it was written
+ * @param dump PACE 2 dump
+ * @param user_ptr user pointer given to fc_restore
+ * @return 0 if the record was restored
+ */
+typedef u8 (*fc_restore_callback)(u32 thread_index, enum fc_section section, const u8 *key,
+                                  u64 timestamp, const u8 *dump, void *user_ptr);
+
+/**
+ * creates a temporary snapshot file next to path
+ * @param writer writer to initialize
+ * @param path path of the snapshot
+ * @param flow_key_size key size of the flow records
+ * @param subscriber_key_size key size of the subscriber records
+ * @param timestamp current PACE 2 timestamp
+ * @return 0 on success
+ */
+u8 fc_writer_open(struct fc_writer *writer, const char *path, u32 flow_key_size, u32 subscriber_key_size, u64 timestamp);
+
+/**
+ * appends a record; all flows have to be written before the first subscriber
+ * @param writer writer
+ * @param section section of the record
+ * @param key key of the section's key size
+ * @param timestamp last access of the element
+ * @param dump dump of PACE2_PHT_DUMP_DATA_SIZE bytes
+ * @return 0 on success
+ */
+u8 fc_write_record(struct fc_writer *writer, enum fc_section section, const u8 *key, u64 timestamp, const u8 *dump);
+
+/**
+ * completes the header, syncs the file and replaces the snapshot at path
+ * @param writer writer
+ * @return 0 on success; the temporary file is removed on error
+ */
+u8 fc_writer_close(struct fc_writer *writer);
+
+/**
+ * removes the temporary file without replacing the snapshot
+ * @param writer writer
+ */
+void fc_writer_abort(struct fc_writer *writer);
+
+/**
+ * maps a snapshot and checks its header
+ * @param snapshot snapshot to initialize
+ * @param path path of the snapshot
+ * @return 0 on success
+ */
+u8 fc_open(struct fc_snapshot *snapshot, const char *path);
+
+/**
+ * unmaps a snapshot
+ * @param snapshot snapshot
+ */
+void fc_close(struct fc_snapshot *snapshot);
+
+/**
+ * checks the CRC of all sections, every thread checks one part of each section
+ * @param snapshot snapshot
+ * @param threads number of threads (1 - FC_MAX_THREADS)
+ * @return 0 if the sections are intact
+ */
+u8 fc_verify(const struct fc_snapshot *snapshot, u32 threads);
+
+/**
+ * passes all records to the callback, every thread restores one part of each
+ * section; the snapshot should be checked with fc_verify first
+ * @param snapshot snapshot
+ * @param threads number of threads (1 - FC_MAX_THREADS), the callback has to be thread safe if > 1
+ * @param callback function called for every record
+ * @param user_ptr pointer passed to the callback
+ * @param restored number of records the callback restored, per section (optional)
+ */
+void fc_restore(const struct fc_snapshot *snapshot, u32 threads, fc_restore_callback callback, void *user_ptr,
+                u64 restored[FC_NUMBER_OF_SECTIONS]);
+
+static inline u64 fc_record_count(const struct fc_snapshot *snapshot, enum fc_section section)
+{
+    return snapshot->hdr->record_count[section];
+}
+
+/**
+ * layout of a record: key, padded to 8 bytes, timestamp, dump
+ * @param snapshot snapshot
+ * @param section section
+ * @param index index of the record in the section
+ * @return start of the record, which is the key
+ */
+static inline const u8 *fc_record(const struct fc_snapshot *snapshot, enum fc_section section, u64 index)
+{
+    return snapshot->base + snapshot->hdr->section_offset[section] + index * snapshot->hdr->record_size[section];
+}
+
+#endif /* FLOW_CHECKPOINT_H */
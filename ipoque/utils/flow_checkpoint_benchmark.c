@@ -0,0 +1,239 @@
+/*
+ * flow_checkpoint_benchmark.c
+ *
+ * Measures the time to write and restore a flow checkpoint. The flows are
+ * kept in sharded flow tables (one lock per shard), so the restore can run
+ * with several threads. The PACE 2 dumps are simulated by copying the
+ * PACE2_PHT_DUMP_DATA_SIZE bytes of the user buffer.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "flow_checkpoint.h"
+#include "flow_table.h"
+
+#define KEY_SIZE 40
+#define SHARDS 64
+
+struct shard {
+    pthread_mutex_t lock;
+    struct flow_table *ft;
+};
+
+static struct shard shards[SHARDS];
+
+static double now( void )
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void make_key( u8 *key, u32 i )
+{
+    const u32 src = 0xc0a80000u ^ (i * 2654435761u);
+    const u32 dst = 0x0a000000u ^ i;
+    const u16 port = 443;
+
+    memset(key, 0, KEY_SIZE);
+    memcpy(key, &src, 4);
+    memcpy(key + 16, &dst, 4);
+    memcpy(key + 32, &port, 2);
+    key[36] = 6;
+}
+
+static struct shard *key_shard( const u8 *key )
+{
+    u32 dst;
+
+    memcpy(&dst, key + 16, 4);
+
+    return &shards[(dst * 2654435761u) >> 26];
+}
+
+static int create_shards( u32 flows )
+{
+    struct ft_config config;
+    u32 i;
+
+    ft_init_default_config(&config, 1000);
+    /* room for an uneven distribution */
+    config.max_elements = flows / SHARDS + flows / SHARDS / 8 + 64;
+    config.key_size = KEY_SIZE;
+    config.user_buffer_size = PACE2_PHT_DUMP_DATA_SIZE;
+
+    for (i = 0; i < SHARDS; i++) {
+        pthread_mutex_init(&shards[i].lock, NULL);
+        shards[i].ft = ft_create(&config);
+        if (NULL == shards[i].ft) {
+            fprintf(stderr, "ft_create failed.\n");
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void destroy_shards( void )
+{
+    u32 i;
+
+    for (i = 0; i < SHARDS; i++) {
+        ft_destroy(shards[i].ft);
+        pthread_mutex_destroy(&shards[i].lock);
+    }
+}
+
+static u8 restore_flow( u32 thread_index, enum fc_section section, const u8 *key,
+                        u64 timestamp, const u8 *dump, void *user_ptr )
+{
+    struct shard * const shard = key_shard(key);
+    u8 new_element;
+    u8 *flow;
+
+    (void)thread_index;
+    (void)section;
+    (void)user_ptr;
+
+    pthread_mutex_lock(&shard->lock);
+    ft_set_timestamp(shard->ft, timestamp);
+    flow = ft_insert(shard->ft, key, &new_element);
+    pthread_mutex_unlock(&shard->lock);
+
+    if (NULL == flow || !new_element) {
+        return 1;
+    }
+
+    /* the flow memory is only touched by this thread, like pace2_pht_load_flow_dump */
+    memcpy(flow, dump, PACE2_PHT_DUMP_DATA_SIZE);
+
+    return 0;
+}
+
+int main( int argc, char **argv )
+{
+    const char *path = "flow_checkpoint_benchmark.snapshot";
+    u32 flows = 10000000;
+    u32 threads = 4;
+    u8 keep = 0;
+    struct fc_writer writer;
+    struct fc_snapshot snapshot;
+    u64 restored[FC_NUMBER_OF_SECTIONS];
+    u8 key[KEY_SIZE];
+    double start, write_time, verify_time, restore_time;
+    u32 i;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:t:o:k")) != -1) {
+        switch (opt) {
+            case 'n':
+                flows = strtoul(optarg, NULL, 10);
+                break;
+            case 't':
+                threads = strtoul(optarg, NULL, 10);
+                break;
+            case 'o':
+                path = optarg;
+                break;
+            case 'k':
+                keep = 1;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n flows] [-t restore threads] [-o snapshot path] [-k keep the snapshot]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (create_shards(flows) != 0) {
+        return 1;
+    }
+
+    for (i = 0; i < flows; i++) {
+        u8 new_element;
+        u8 *flow;
+
+        make_key(key, i);
+        flow = ft_insert(key_shard(key)->ft, key, &new_element);
+        if (NULL != flow) {
+            memset(flow, (u8)i, PACE2_PHT_DUMP_DATA_SIZE);
+        }
+    }
+
+    start = now();
+
+    if (fc_writer_open(&writer, path, KEY_SIZE, 16, 0) != 0) {
+        return 1;
+    }
+
+    for (i = 0; i < SHARDS; i++) {
+        u32 iterator = 0;
+        u64 ts;
+        const u8 *flow;
+
+        while ((flow = ft_get_next_element(shards[i].ft, &iterator, &ts))) {
+            fc_write_record(&writer, FC_FLOWS, ft_get_key(shards[i].ft, flow), ts, flow);
+        }
+    }
+
+    if (fc_writer_close(&writer) != 0) {
+        return 1;
+    }
+
+    write_time = now() - start;
+
+    destroy_shards();
+    if (create_shards(flows) != 0) {
+        return 1;
+    }
+
+    start = now();
+
+    if (fc_open(&snapshot, path) != 0) {
+        return 1;
+    }
+
+    if (fc_verify(&snapshot, threads) != 0) {
+        fc_close(&snapshot);
+        return 1;
+    }
+
+    verify_time = now() - start;
+
+    fc_restore(&snapshot, threads, restore_flow, NULL, restored);
+
+    restore_time = now() - start;
+
+    printf("%llu flows, %.1f MB snapshot\n", fc_record_count(&snapshot, FC_FLOWS), snapshot.size / (1024.0 * 1024.0));
+    printf("checkpoint: %8.3f s, %6.2f M flows/s\n", write_time, flows / write_time / 1e6);
+    printf("restore:    %8.3f s, %6.2f M flows/s with %u threads (verification %.3f s), %llu flows restored\n",
+           restore_time, flows / restore_time / 1e6, threads, verify_time, restored[FC_FLOWS]);
+
+    fc_close(&snapshot);
+
+    /* check the restored flow memory */
+    for (i = 0; i < flows; i++) {
+        const u8 *flow;
+
+        make_key(key, i);
+        flow = ft_lookup(key_shard(key)->ft, key);
+        if (NULL == flow || flow[0] != (u8)i || flow[PACE2_PHT_DUMP_DATA_SIZE - 1] != (u8)i) {
+            fprintf(stderr, "Flow %u was not restored correctly.\n", i);
+            return 1;
+        }
+    }
+
+    destroy_shards();
+
+    if (!keep) {
+        unlink(path);
+    }
+
+    return 0;
+}
@@ -0,0 +1,139 @@
+/*
+ * flow_key.h
+ *
+ * Compact flow key for IPv4. pace2_build_flow_key always fills the 40 byte
+ * ipoque_unique_flow_ipv4_and_6_struct_t, of which an IPv4 flow uses 16
+ * bytes. Flow tracking keeps IPv4 flows in a table with the packed key and
+ * only IPv6 flows in a table with the full key, which makes the keys of
+ * the common case fit four times into a cache line.
+ */
+
+#ifndef FLOW_KEY_H
+#define FLOW_KEY_H
+
+#include <string.h>
+#include <pace2.h>
+
+/* size of the key built by pace2_build_flow_key */
+#define FLOW_KEY_FULL_SIZE 40
+
+/* size of struct flow_key_v4 */
+#define FLOW_KEY_V4_SIZE 16
+
+/* index of the flow tables of a dual table tracker */
+enum flow_key_table {
+    FLOW_TABLE_V4 = 0,
+    FLOW_TABLE_V6,
+    FLOW_TABLES
+};
+
+struct flow_key_v4 {
+    u32 lower_ip;
+    u32 upper_ip;
+    u16 lower_port;
+    u16 upper_port;
+    /* 16 bit like in the full key; the remaining 2 bytes are always 0 */
+    u16 protocol;
+    u16 pad;
+};
+
+/**
+ * @param key full flow key
+ * @return the table of the flow: FLOW_TABLE_V4 or FLOW_TABLE_V6
+ */
+static inline enum flow_key_table flow_key_table( const ipoque_unique_flow_ipv4_and_6_struct_t *key )
+{
+    return key->is_ip_v6 ? FLOW_TABLE_V6 : FLOW_TABLE_V4;
+}
+
+/**
+ * packs the full key of an IPv4 flow
+ * @param key full flow key, is_ip_v6 must be 0
+ * @param compact packed key
+ */
+static inline void flow_key_compact( const ipoque_unique_flow_ipv4_and_6_struct_t *key, struct flow_key_v4 *compact )
+{
+    compact->lower_ip = key->ip.ipv4.lower_ip;
+    compact->upper_ip = key->ip.ipv4.upper_ip;
+    compact->lower_port = key->lower_port;
+    compact->upper_port = key->upper_port;
+    compact->protocol = key->protocol;
+    compact->pad = 0;
+}
+
+/**
+ * builds the packed key of an unfragmented IPv4 TCP or UDP packet from its header, without
+ * PACE 2 stage 1; used to prefetch the flow of a packet. The lower address is the numerically
+ * lower one as stored in the packet, the ports are kept in network order.
+ * @param packet IP header
+ * @param length length of the packet
+ * @param compact packed key
+ * @return 1 if the key was built; 0 for other packets
+ */
+static inline u8 flow_key_from_ipv4_header( const u8 *packet, u32 length, struct flow_key_v4 *compact )
+{
+    u32 header_length;
+    u32 saddr;
+    u32 daddr;
+    u16 sport;
+    u16 dport;
+
+    if ( length < 20 || ( packet[0] >> 4 ) != 4 ) {
+        return 0;
+    }
+
+    header_length = ( packet[0] & 0x0f ) * 4;
+
+    /* fragments have the more fragments flag or an offset */
+    if ( ( ( packet[6] & 0x3f ) | packet[7] ) != 0 ) {
+        return 0;
+    }
+
+    if ( ( packet[9] != 6 && packet[9] != 17 ) || header_length < 20 || length < header_length + 4 ) {
+        return 0;
+    }
+
+    memcpy( &saddr, packet + 12, 4 );
+    memcpy( &daddr, packet + 16, 4 );
+    memcpy( &sport, packet + header_length, 2 );
+    memcpy( &dport, packet + header_length + 2, 2 );
+
+    if ( saddr < daddr ) {
+        compact->lower_ip = saddr;
+        compact->upper_ip = daddr;
+        compact->lower_port = sport;
+        compact->upper_port = dport;
+    } else {
+        compact->lower_ip = daddr;
+        compact->upper_ip = saddr;
+        compact->lower_port = dport;
+        compact->upper_port = sport;
+    }
+    compact->protocol = packet[9];
+    compact->pad = 0;
+
+    return 1;
+}
+
+/**
+ * returns the key to use in the table of the flow
+ * @param key full flow key
+ * @param compact storage for the packed key of an IPv4 flow
+ * @param table set to the table of the flow
+ * @return key of FLOW_KEY_V4_SIZE or FLOW_KEY_FULL_SIZE bytes
+ */
+static inline const u8 *flow_key_for_table( const ipoque_unique_flow_ipv4_and_6_struct_t *key, struct flow_key_v4 *compact,
+                                            enum flow_key_table *table )
+{
+    *table = flow_key_table( key );
+
+    if ( *table == FLOW_TABLE_V6 ) {
+        return (const u8 *) key;
+    }
+
+    flow_key_compact( key, compact );
+
+    return (const u8 *) compact;
+}
+
+#endif /* FLOW_KEY_H */
@@ -0,0 +1,104 @@
+/*
+ * flow_migration.c
+ *
+ * Flow migration channels, see flow_migration.h.
+ */
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flow_migration.h"
+
+u8 fm_channel_init(struct fm_channel *channel, u32 capacity)
+{
+    u32 size = 1;
+
+    memset(channel, 0, sizeof(*channel));
+
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    channel->records = malloc((u64)size * sizeof(struct fm_record));
+    if (NULL == channel->records) {
+        return 1;
+    }
+
+    channel->mask = size - 1;
+
+    return 0;
+}
+
+void fm_channel_destroy(struct fm_channel *channel)
+{
+    free(channel->records);
+    channel->records = NULL;
+}
+
+/* returns the next free record, waits for the consumer if the channel is full */
+static struct fm_record *fm_reserve(struct fm_channel *channel)
+{
+    const u32 head = channel->head;
+
+    if (head - channel->tail > channel->mask) {
+        channel->full++;
+
+        while (head - channel->tail > channel->mask) {
+            sched_yield();
+        }
+    }
+
+    /* the slot is written after the consumer released it */
+    __sync_synchronize();
+
+    return &channel->records[head & channel->mask];
+}
+
+static void fm_commit(struct fm_channel *channel)
+{
+    /* the record is visible before the head */
+    __sync_synchronize();
+
+    channel->head = channel->head + 1;
+}
+
+void fm_send_flow(struct fm_channel *channel, PACE2_module *module, int thread_id,
+                  const u8 *key, const void *flow, u32 bucket, u64 timestamp)
+{
+    struct fm_record * const record = fm_reserve(channel);
+
+    record->type = FM_FLOW;
+    record->bucket = bucket;
+    record->timestamp = timestamp;
+    memcpy(record->key, key, FM_KEY_SIZE);
+    pace2_pht_dump_flow_data(module, thread_id, flow, record->dump);
+
+    channel->flows++;
+    fm_commit(channel);
+}
+
+void fm_send_subscriber(struct fm_channel *channel, PACE2_module *module, int thread_id,
+                        const PACE2_subscriber_key *key, void *subscriber, u32 bucket, u64 timestamp)
+{
+    struct fm_record * const record = fm_reserve(channel);
+
+    record->type = FM_SUBSCRIBER;
+    record->bucket = bucket;
+    record->timestamp = timestamp;
+    memset(record->key, 0, FM_KEY_SIZE);
+    memcpy(record->key, key, sizeof(*key));
+    pace2_pht_dump_id_data(module, thread_id, subscriber, record->dump);
+
+    channel->subscribers++;
+    fm_commit(channel);
+}
+
+void fm_send_bucket_done(struct fm_channel *channel, u32 bucket)
+{
+    struct fm_record * const record = fm_reserve(channel);
+
+    record->type = FM_BUCKET_DONE;
+    record->bucket = bucket;
+
+    fm_commit(channel);
+}
@@ -0,0 +1,134 @@
+/*
+ * flow_migration.h
+ *
+ * Moves externally tracked flows between worker threads. The source worker
+ * serializes a flow with pace2_pht_dump_flow_data into a record of a single
+ * producer / single consumer ring, the target worker installs it with
+ * pace2_pht_load_flow_dump. Subscribers of the bucket are moved the same way
+ * with pace2_pht_dump_id_data. A FM_BUCKET_DONE record follows the last flow
+ * and subscriber of a migrated bucket, the target must not process packets
+ * of the bucket before it has received it.
+ *
+ * There is one channel for every pair of source and target worker.
+ */
+
+#ifndef FLOW_MIGRATION_H
+#define FLOW_MIGRATION_H
+
+#include <pace2.h>
+
+/* size of the flow key, see pace2_build_flow_key */
+#define FM_KEY_SIZE 40
+
+enum fm_record_type {
+    FM_FLOW = 0,
+    FM_SUBSCRIBER,
+    FM_BUCKET_DONE
+};
+
+struct fm_record {
+    u32 type;
+    /* dispatcher bucket of the flow */
+    u32 bucket;
+    /* last access of the flow on the source worker */
+    u64 timestamp;
+    /* flow key or PACE2_subscriber_key */
+    u8 key[FM_KEY_SIZE];
+    u8 dump[PACE2_PHT_DUMP_DATA_SIZE];
+};
+
+struct fm_channel {
+    /* written by the producer only */
+    volatile u32 head;
+    u8 pad0[60];
+    /* written by the consumer only */
+    volatile u32 tail;
+    u8 pad1[60];
+
+    u32 mask;
+    struct fm_record *records;
+
+    /* statistics, written by the producer */
+    u64 flows;
+    u64 subscribers;
+    u64 full;
+};
+
+/**
+ * allocates the records of a channel
+ * @param channel channel to initialize
+ * @param capacity number of records, rounded up to a power of two
+ * @return 0 on success
+ */
+u8 fm_channel_init(struct fm_channel *channel, u32 capacity);
+
+/**
+ * frees the records of a channel
+ * @param channel channel
+ */
+void fm_channel_destroy(struct fm_channel *channel);
+
+/**
+ * serializes a flow into the channel, waits while the channel is full
+ * @param channel channel to the target worker
+ * @param module PACE 2 module
+ * @param thread_id thread id of the source worker
+ * @param key flow key of FM_KEY_SIZE bytes
+ * @param flow PACE 2 flow memory
+ * @param bucket dispatcher bucket of the flow
+ * @param timestamp last access of the flow
+ */
+void fm_send_flow(struct fm_channel *channel, PACE2_module *module, int thread_id,
+                  const u8 *key, const void *flow, u32 bucket, u64 timestamp);
+
+/**
+ * serializes a subscriber into the channel, waits while the channel is full
+ * @param channel channel to the target worker
+ * @param module PACE 2 module
+ * @param thread_id thread id of the source worker
+ * @param key subscriber key
+ * @param subscriber PACE 2 subscriber memory
+ * @param bucket dispatcher bucket of the subscriber
+ * @param timestamp last access of the subscriber
+ */
+void fm_send_subscriber(struct fm_channel *channel, PACE2_module *module, int thread_id,
+                        const PACE2_subscriber_key *key, void *subscriber, u32 bucket, u64 timestamp);
+
+/**
+ * marks the end of a migrated bucket, waits while the channel is full
+ * @param channel channel to the target worker
+ * @param bucket migrated bucket
+ */
+void fm_send_bucket_done(struct fm_channel *channel, u32 bucket);
+
+/**
+ * @param channel channel from the source worker
+ * @return the oldest record or NULL if the channel is empty; valid until fm_channel_release
+ */
+static inline const struct fm_record *fm_channel_peek(struct fm_channel *channel)
+{
+    const u32 tail = channel->tail;
+
+    if (tail == channel->head) {
+        return NULL;
+    }
+
+    /* the record is read after the head which published it */
+    __sync_synchronize();
+
+    return &channel->records[tail & channel->mask];
+}
+
+/**
+ * removes the record returned by fm_channel_peek
+ * @param channel channel from the source worker
+ */
+static inline void fm_channel_release(struct fm_channel *channel)
+{
+    /* the record is read completely before its slot is handed back */
+    __sync_synchronize();
+
+    channel->tail = channel->tail + 1;
+}
+
+#endif /* FLOW_MIGRATION_H */
@@ -0,0 +1,634 @@
+/*
+ * flow_table.c
+ *
+ * Open addressing flow table, see flow_table.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "flow_table.h"
+
+#define FT_NONE 0xffffffffu
+
+/* buckets are filled up to this percentage of their slots */
+#define FT_MAX_LOAD 75
+
+void ft_init_default_config(struct ft_config *config, u64 ticks_per_second)
+{
+    if (NULL == config) {
+        return;
+    }
+
+    config->max_elements = 1024 * 1024;
+    config->limit_elements = 0;
+    config->key_size = 40;
+    config->user_buffer_size = 0;
+    config->timeout = 10 * 60 * ticks_per_second;
+}
+
+static inline u64 ft_hash(const u8 *key, u32 key_size)
+{
+    u64 h = 0x9e3779b97f4a7c15ull ^ key_size;
+    u32 i;
+
+    for (i = 0; i + 8 <= key_size; i += 8) {
+        u64 w;
+
+        memcpy(&w, key + i, 8);
+        h = (h ^ w) * 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+    }
+
+    if (i < key_size) {
+        u32 w;
+
+        memcpy(&w, key + i, 4);
+        h = (h ^ w) * 0xff51afd7ed558ccdull;
+    }
+
+    h ^= h >> 29;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 32;
+
+    return h;
+}
+
+/* The flow trackers use 16 byte IPv4 and 40 byte full keys, for these sizes
+   the hash and the compare are inlined with a constant length. */
+static inline u64 ft_key_hash(const u8 *key, u32 key_size)
+{
+    switch (key_size) {
+        case 16:
+            return ft_hash(key, 16);
+        case 40:
+            return ft_hash(key, 40);
+        default:
+            return ft_hash(key, key_size);
+    }
+}
+
+static inline int ft_key_equal(const u8 *a, const u8 *b, u32 key_size)
+{
+    switch (key_size) {
+        case 16: {
+            u64 a0, a1, b0, b1;
+
+            memcpy(&a0, a, 8);
+            memcpy(&a1, a + 8, 8);
+            memcpy(&b0, b, 8);
+            memcpy(&b1, b + 8, 8);
+
+            return ((a0 ^ b0) | (a1 ^ b1)) == 0;
+        }
+        case 40:
+            return memcmp(a, b, 40) == 0;
+        default:
+            return memcmp(a, b, key_size) == 0;
+    }
+}
+
+/* tags are never 0, which marks a free slot */
+static inline u8 ft_tag(u64 hash)
+{
+    const u8 tag = (u8)(hash >> 56);
+
+    return tag ? tag : 1;
+}
+
+/* bit i is set if slot i of the bucket carries the tag */
+static inline u32 ft_match(const struct ft_bucket *bucket, u8 tag)
+{
+#ifdef __SSE2__
+    const __m128i tags = _mm_load_si128((const __m128i *)bucket);
+
+    return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(tags, _mm_set1_epi8((char)tag))) & ((1u << FT_BUCKET_SLOTS) - 1);
+#else
+    u32 mask = 0;
+    u32 i;
+
+    for (i = 0; i < FT_BUCKET_SLOTS; i++) {
+        if (bucket->tags[i] == tag) {
+            mask |= 1u << i;
+        }
+    }
+
+    return mask;
+#endif
+}
+
+static inline u8 *ft_key(const struct flow_table *ft, u32 element)
+{
+    return ft->keys + (u64)element * ft->config.key_size;
+}
+
+static inline void *ft_user_buffer(const struct flow_table *ft, u32 element)
+{
+    return ft->user_buffers + (u64)element * ft->user_buffer_stride;
+}
+
+static void ft_list_unlink(struct flow_table *ft, u32 element)
+{
+    struct ft_element * const e = &ft->elements[element];
+
+    if (FT_NONE != e->prev) {
+        ft->elements[e->prev].next = e->next;
+    } else {
+        ft->oldest = e->next;
+    }
+
+    if (FT_NONE != e->next) {
+        ft->elements[e->next].prev = e->prev;
+    } else {
+        ft->newest = e->prev;
+    }
+}
+
+static void ft_list_append(struct flow_table *ft, u32 element)
+{
+    struct ft_element * const e = &ft->elements[element];
+
+    e->prev = ft->newest;
+    e->next = FT_NONE;
+
+    if (FT_NONE != ft->newest) {
+        ft->elements[ft->newest].next = element;
+    } else {
+        ft->oldest = element;
+    }
+    ft->newest = element;
+}
+
+/* reserves zeroed memory, the pages are only backed when they are touched */
+static void *ft_map(u64 size)
+{
+    void * const memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    return MAP_FAILED != memory ? memory : NULL;
+}
+
+static void ft_unmap(void *memory, u64 size)
+{
+    if (NULL != memory) {
+        munmap(memory, size);
+    }
+}
+
+/* number of buckets for a capacity, a power of two */
+static u64 ft_bucket_count(u32 elements)
+{
+    u64 buckets = 1;
+
+    while (buckets * FT_BUCKET_SLOTS * FT_MAX_LOAD / 100 < elements) {
+        buckets <<= 1;
+    }
+
+    return buckets;
+}
+
+struct flow_table *ft_create(const struct ft_config *config)
+{
+    struct flow_table *ft;
+    u64 buckets;
+
+    if (NULL == config || 0 == config->max_elements || 0 == config->key_size || 0 != config->key_size % 4 ||
+        0 == config->user_buffer_size) {
+        return NULL;
+    }
+
+    ft = calloc(1, sizeof(*ft));
+    if (NULL == ft) {
+        return NULL;
+    }
+
+    ft->config = *config;
+    ft->capacity = config->max_elements;
+    ft->limit = config->limit_elements > config->max_elements ? config->limit_elements : config->max_elements;
+
+    buckets = ft_bucket_count(ft->capacity);
+    ft->bucket_mask = (u32)(buckets - 1);
+
+    /* user buffers are 16 byte aligned, PACE 2 flow memory is accessed with wide loads */
+    ft->user_buffer_stride = (config->user_buffer_size + 15) & ~15ull;
+
+    /* the element arrays are reserved for the limit so that the elements never move */
+    ft->buckets = ft_map(buckets * sizeof(struct ft_bucket));
+    ft->elements = ft_map((u64)ft->limit * sizeof(struct ft_element));
+    ft->keys = ft_map((u64)ft->limit * config->key_size);
+    ft->user_buffers = ft_map((u64)ft->limit * ft->user_buffer_stride + 1);
+
+    if (NULL == ft->buckets || NULL == ft->elements || NULL == ft->keys || NULL == ft->user_buffers) {
+        ft_destroy(ft);
+        return NULL;
+    }
+
+    ft->free_head = FT_NONE;
+    ft->oldest = FT_NONE;
+    ft->newest = FT_NONE;
+
+    return ft;
+}
+
+void ft_destroy(struct flow_table *ft)
+{
+    if (NULL == ft) {
+        return;
+    }
+
+    ft_unmap(ft->buckets, (u64)(ft->bucket_mask + 1) * sizeof(struct ft_bucket));
+    ft_unmap(ft->old_buckets, (u64)(ft->old_bucket_mask + 1) * sizeof(struct ft_bucket));
+    ft_unmap(ft->elements, (u64)ft->limit * sizeof(struct ft_element));
+    ft_unmap(ft->keys, (u64)ft->limit * ft->config.key_size);
+    ft_unmap(ft->user_buffers, (u64)ft->limit * ft->user_buffer_stride + 1);
+    free(ft);
+}
+
+void ft_set_timestamp(struct flow_table *ft, u64 ts)
+{
+    ft->ts = ts;
+}
+
+/* returns the element index of the key in a bucket array or FT_NONE */
+static u32 ft_find_in(struct flow_table *ft, const struct ft_bucket *buckets, u32 bucket_mask, const u8 *key, u64 hash)
+{
+    const u8 tag = ft_tag(hash);
+    u32 b = (u32)hash & bucket_mask;
+    u32 probes = 0;
+
+    for (;;) {
+        const struct ft_bucket * const bucket = &buckets[b];
+        u32 match = ft_match(bucket, tag);
+
+        while (match) {
+            const u32 slot = __builtin_ctz(match);
+            const u32 element = bucket->element[slot];
+
+            if (ft_key_equal(ft_key(ft, element), key, ft->config.key_size)) {
+                ft->probes += probes;
+                return element;
+            }
+
+            ft->tag_misses++;
+            match &= match - 1;
+        }
+
+        if (0 == bucket->displaced || ++probes > bucket_mask) {
+            ft->probes += probes;
+            return FT_NONE;
+        }
+
+        b = (b + 1) & bucket_mask;
+    }
+}
+
+/* returns the element index of the key or FT_NONE */
+static u32 ft_find(struct flow_table *ft, const u8 *key, u64 hash)
+{
+    const u32 element = ft_find_in(ft, ft->buckets, ft->bucket_mask, key, hash);
+
+    /* during a resize, the element may not have been moved yet */
+    if (FT_NONE == element && NULL != ft->old_buckets) {
+        return ft_find_in(ft, ft->old_buckets, ft->old_bucket_mask, key, hash);
+    }
+
+    return element;
+}
+
+/* adds delta to the displaced count of the buckets from the home bucket of a hash up to, excluding, a bucket */
+static void ft_count_displaced(struct ft_bucket *buckets, u32 bucket_mask, u64 hash, u32 bucket, int delta)
+{
+    u32 b;
+
+    for (b = (u32)hash & bucket_mask; b != bucket; b = (b + 1) & bucket_mask) {
+        buckets[b].displaced += delta;
+    }
+}
+
+/* puts an element into the first bucket with a free slot along the probe sequence; returns 0 on success */
+static u8 ft_place(struct flow_table *ft, u32 element, u64 hash)
+{
+    struct ft_element * const e = &ft->elements[element];
+    u32 b = (u32)hash & ft->bucket_mask;
+    u32 probes;
+
+    for (probes = 0; probes <= ft->bucket_mask; probes++) {
+        struct ft_bucket * const bucket = &ft->buckets[b];
+        const u32 free_slots = ft_match(bucket, 0);
+
+        if (free_slots) {
+            const u32 slot = __builtin_ctz(free_slots);
+
+            bucket->tags[slot] = ft_tag(hash);
+            bucket->element[slot] = element;
+
+            /* the full buckets before this one lead lookups to the element */
+            ft_count_displaced(ft->buckets, ft->bucket_mask, hash, b, 1);
+
+            e->bucket = b;
+            e->slot = (u8)slot;
+            e->generation = ft->generation;
+
+            return 0;
+        }
+
+        b = (b + 1) & ft->bucket_mask;
+    }
+
+    return 1;
+}
+
+/* removes an element from its bucket and the access order and puts it on the free list */
+static void ft_release(struct flow_table *ft, u32 element)
+{
+    struct ft_element * const e = &ft->elements[element];
+    const u8 current = e->generation == ft->generation;
+    struct ft_bucket * const buckets = current ? ft->buckets : ft->old_buckets;
+    const u32 bucket_mask = current ? ft->bucket_mask : ft->old_bucket_mask;
+
+    buckets[e->bucket].tags[e->slot] = 0;
+    /* lookups stop early again once no displaced element is left behind a bucket */
+    ft_count_displaced(buckets, bucket_mask, ft_key_hash(ft_key(ft, element), ft->config.key_size), e->bucket, -1);
+    ft_list_unlink(ft, element);
+
+    e->used = 0;
+    e->next = ft->free_head;
+    ft->free_head = element;
+    ft->used--;
+}
+
+u64 ft_hash_key(const struct flow_table *ft, const u8 *key)
+{
+    return ft_key_hash(key, ft->config.key_size);
+}
+
+void ft_prefetch(const struct flow_table *ft, const u8 * const keys[], u64 hashes[], u32 count)
+{
+    u32 i;
+
+    /* the buckets of all keys are requested before the first one is read */
+    for (i = 0; i < count; i++) {
+        hashes[i] = ft_key_hash(keys[i], ft->config.key_size);
+        __builtin_prefetch(&ft->buckets[(u32)hashes[i] & ft->bucket_mask]);
+    }
+
+    /* then the keys and user buffers of the slots with a matching tag */
+    for (i = 0; i < count; i++) {
+        const struct ft_bucket * const bucket = &ft->buckets[(u32)hashes[i] & ft->bucket_mask];
+        u32 match = ft_match(bucket, ft_tag(hashes[i]));
+
+        while (match) {
+            const u32 element = bucket->element[__builtin_ctz(match)];
+
+            __builtin_prefetch(ft_key(ft, element));
+            __builtin_prefetch(&ft->elements[element]);
+            __builtin_prefetch(ft_user_buffer(ft, element));
+            match &= match - 1;
+        }
+    }
+}
+
+void *ft_lookup_hashed(struct flow_table *ft, const u8 *key, u64 hash)
+{
+    u32 element;
+
+    ft->lookups++;
+
+    element = ft_find(ft, key, hash);
+
+    return FT_NONE != element ? ft_user_buffer(ft, element) : NULL;
+}
+
+void *ft_lookup(struct flow_table *ft, const u8 *key)
+{
+    return ft_lookup_hashed(ft, key, ft_key_hash(key, ft->config.key_size));
+}
+
+void *ft_insert(struct flow_table *ft, const u8 *key, u8 *new_element)
+{
+    return ft_insert_hashed(ft, key, ft_key_hash(key, ft->config.key_size), new_element);
+}
+
+void *ft_insert_hashed(struct flow_table *ft, const u8 *key, u64 hash, u8 *new_element)
+{
+    struct ft_element *e;
+    u32 element;
+
+    ft->lookups++;
+    *new_element = 0;
+
+    element = ft_find(ft, key, hash);
+    if (FT_NONE != element) {
+        ft->elements[element].ts = ft->ts;
+        ft_list_unlink(ft, element);
+        ft_list_append(ft, element);
+        return ft_user_buffer(ft, element);
+    }
+
+    if (ft->used == ft->capacity) {
+        /* full and nothing reserved, the oldest element is overwritten */
+        ft_release(ft, ft->oldest);
+    }
+
+    /* a released element or one that was never used */
+    if (FT_NONE != ft->free_head) {
+        element = ft->free_head;
+        ft->free_head = ft->elements[element].next;
+    } else {
+        element = ft->fresh++;
+    }
+
+    if (ft_place(ft, element, hash) != 0) {
+        ft->elements[element].next = ft->free_head;
+        ft->free_head = element;
+        return NULL;
+    }
+
+    e = &ft->elements[element];
+    e->ts = ft->ts;
+    e->used = 1;
+    ft_list_append(ft, element);
+
+    ft->used++;
+    ft->inserts++;
+    if (ft->used > ft->max_used) {
+        ft->max_used = ft->used;
+    }
+
+    memcpy(ft_key(ft, element), key, ft->config.key_size);
+    *new_element = 1;
+
+    return ft_user_buffer(ft, element);
+}
+
+u8 ft_delete(struct flow_table *ft, const u8 *key)
+{
+    const u32 element = ft_find(ft, key, ft_key_hash(key, ft->config.key_size));
+
+    if (FT_NONE == element) {
+        return 1;
+    }
+
+    ft_release(ft, element);
+
+    return 0;
+}
+
+PACE2_pht_return_state ft_reserve_elements(struct flow_table *ft, u32 elements)
+{
+    const u32 available = ft->capacity - ft->used;
+
+    if (elements <= available) {
+        return PACE2_PHT_SUCCESS;
+    }
+
+    ft->overflow_pending = elements - available;
+
+    return PACE2_PHT_OUT_OF_MEMORY;
+}
+
+void *ft_get_next_element_to_remove(struct flow_table *ft, u8 *call_again, enum pace2_pht_removal_reason *removal_reason)
+{
+    enum pace2_pht_removal_reason reason = PHT_NONE;
+    const u32 element = ft->oldest;
+
+    if (FT_NONE == element) {
+        ft->overflow_pending = 0;
+        ft->clear_pending = 0;
+    } else if (ft->clear_pending) {
+        reason = PHT_DELETED;
+    } else if (ft->overflow_pending > 0) {
+        ft->overflow_pending--;
+        reason = PHT_OVERFLOW;
+    } else if (ft->ts - ft->elements[element].ts > ft->config.timeout) {
+        reason = PHT_TIMEOUT;
+    }
+
+    if (PHT_NONE == reason) {
+        if (NULL != call_again) {
+            *call_again = 0;
+        }
+        return NULL;
+    }
+
+    ft_release(ft, element);
+
+    if (NULL != call_again) {
+        const u32 next = ft->oldest;
+
+        *call_again = FT_NONE != next &&
+                      (ft->clear_pending || ft->overflow_pending > 0 || ft->ts - ft->elements[next].ts > ft->config.timeout);
+    }
+
+    if (NULL != removal_reason) {
+        *removal_reason = reason;
+    }
+
+    return ft_user_buffer(ft, element);
+}
+
+void ft_clear(struct flow_table *ft)
+{
+    if (FT_NONE != ft->oldest) {
+        ft->clear_pending = 1;
+    }
+}
+
+void *ft_get_next_element(const struct flow_table *ft, u32 *iterator, u64 *timestamp)
+{
+    while (*iterator < ft->fresh) {
+        const u32 element = (*iterator)++;
+
+        if (ft->elements[element].used) {
+            if (NULL != timestamp) {
+                *timestamp = ft->elements[element].ts;
+            }
+            return ft_user_buffer(ft, element);
+        }
+    }
+
+    return NULL;
+}
+
+const u8 *ft_get_key(const struct flow_table *ft, const void *user_buffer)
+{
+    const u64 element = ((const u8 *)user_buffer - ft->user_buffers) / ft->user_buffer_stride;
+
+    return ft_key(ft, (u32)element);
+}
+
+u8 ft_grow(struct flow_table *ft, u32 elements)
+{
+    u64 buckets;
+
+    if (elements > ft->limit) {
+        return 1;
+    }
+
+    if (elements <= ft->capacity) {
+        return 0;
+    }
+
+    buckets = ft_bucket_count(elements);
+
+    if (buckets > (u64)ft->bucket_mask + 1) {
+        struct ft_bucket * const grown = ft_map(buckets * sizeof(struct ft_bucket));
+
+        if (NULL == grown) {
+            return 1;
+        }
+
+        /* there are never more than two bucket arrays */
+        while (ft_resize_step(ft, ft->old_bucket_mask + 1)) {
+        }
+
+        ft->old_buckets = ft->buckets;
+        ft->old_bucket_mask = ft->bucket_mask;
+        ft->resize_cursor = 0;
+        ft->buckets = grown;
+        ft->bucket_mask = (u32)(buckets - 1);
+        ft->generation++;
+        ft->resizes++;
+    }
+
+    ft->capacity = elements;
+
+    return 0;
+}
+
+u8 ft_resize_step(struct flow_table *ft, u32 buckets)
+{
+    if (NULL == ft->old_buckets) {
+        return 0;
+    }
+
+    while (buckets-- > 0 && ft->resize_cursor <= ft->old_bucket_mask) {
+        struct ft_bucket * const bucket = &ft->old_buckets[ft->resize_cursor++];
+        u32 slot;
+
+        for (slot = 0; slot < FT_BUCKET_SLOTS; slot++) {
+            const u32 element = bucket->element[slot];
+
+            if (0 == bucket->tags[slot]) {
+                continue;
+            }
+
+            bucket->tags[slot] = 0;
+
+            /* the new buckets are sized for the capacity, there is always a free slot */
+            ft_place(ft, element, ft_key_hash(ft_key(ft, element), ft->config.key_size));
+        }
+    }
+
+    if (ft->resize_cursor <= ft->old_bucket_mask) {
+        return 1;
+    }
+
+    ft_unmap(ft->old_buckets, (u64)(ft->old_bucket_mask + 1) * sizeof(struct ft_bucket));
+    ft->old_buckets = NULL;
+    ft->old_bucket_mask = 0;
+
+    return 0;
+}
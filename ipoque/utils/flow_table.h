@@ -0,0 +1,322 @@
+/*
+ * flow_table.h
+ *
+ * Open addressing hash table for external flow tracking, usable instead of
+ * pace2_pht. Every bucket fills one cache line and holds the 8 bit tags of
+ * its slots, so a lookup usually touches one bucket line, one key and the
+ * element meta data. The user buffers (PACE 2 flow memory) are kept in a
+ * separate array and are only touched by the caller.
+ *
+ * Timeout handling follows pace2_pht: the table keeps its elements ordered
+ * by last access, ft_get_next_element_to_remove returns elements that
+ * timed out, were pushed out by ft_reserve_elements or were cleared.
+ *
+ * A burst of keys can be prepared with ft_prefetch: it hashes all keys and
+ * prefetches their buckets, then their candidate keys and user buffers, so
+ * the cache misses of the burst overlap. The lookups and inserts of the
+ * burst are done afterwards with the _hashed functions.
+ *
+ * A table created with limit_elements above max_elements can grow while it
+ * is in use. The element arrays are reserved for the limit up front and are
+ * only backed by memory when they are used, so elements never move and
+ * pointers to user buffers stay valid. ft_grow raises the capacity; if the
+ * buckets get too full, it allocates twice as many and ft_resize_step moves
+ * the elements of a bounded number of old buckets per call. Until all are
+ * moved, lookups search the new and the old buckets.
+ */
+
+#ifndef FLOW_TABLE_H
+#define FLOW_TABLE_H
+
+#include <pace2.h>
+
+/* number of slots of a 64 byte bucket */
+#define FT_BUCKET_SLOTS 12
+
+struct ft_config {
+    /* maximum number of elements, initial capacity of a growing table */
+    u32 max_elements;
+    /* number of elements the table may grow to, 0 disables growth */
+    u32 limit_elements;
+    /* size of the key in bytes, must be a multiple of 4; 16 and 40 byte keys have an inlined hash and compare */
+    u32 key_size;
+    /* size of the user buffer of every element, not 0: elements are found by their user buffer */
+    u32 user_buffer_size;
+    /* element timeout in ticks */
+    u64 timeout;
+};
+
+struct ft_bucket {
+    /* tag of every slot, 0 marks a free slot */
+    u8 tags[FT_BUCKET_SLOTS];
+    /* elements which passed this bucket because it was full and were placed in a later one;
+       a lookup miss stops at the first bucket without such elements */
+    u32 displaced;
+    /* element index of every used slot */
+    u32 element[FT_BUCKET_SLOTS];
+};
+
+/* per element meta data, kept apart from the keys and the user buffers */
+struct ft_element {
+    u64 ts;
+    /* neighbours in the access order list (oldest first), FT_NONE terminates */
+    u32 prev;
+    u32 next;
+    u32 bucket;
+    u8 slot;
+    u8 used;
+    /* generation of the buckets the element is in, see flow_table.generation */
+    u8 generation;
+    u8 pad;
+};
+
+struct flow_table {
+    struct ft_config config;
+
+    struct ft_bucket *buckets;
+    u32 bucket_mask;
+
+    /* buckets before a resize, NULL if no resize is in progress */
+    struct ft_bucket *old_buckets;
+    u32 old_bucket_mask;
+    /* next old bucket whose elements are moved */
+    u32 resize_cursor;
+    /* incremented by every resize, elements of an older generation are in old_buckets */
+    u8 generation;
+
+    /* elements the arrays are reserved for and elements which may be used now */
+    u32 limit;
+    u32 capacity;
+
+    struct ft_element *elements;
+    u8 *keys;
+    u8 *user_buffers;
+    u64 user_buffer_stride;
+
+    /* released elements are chained through ft_element.next */
+    u32 free_head;
+    /* elements from this index on were never used */
+    u32 fresh;
+    u32 used;
+    u32 max_used;
+
+    /* access order list */
+    u32 oldest;
+    u32 newest;
+
+    u64 ts;
+    /* elements that have to be removed for a reservation */
+    u32 overflow_pending;
+    u8 clear_pending;
+
+    /* statistics */
+    u64 lookups;
+    u64 inserts;
+    u64 probes;
+    u64 tag_misses;
+    u64 resizes;
+};
+
+/**
+ * fills a configuration with default values (1M elements, 40 byte keys, 10 minutes timeout)
+ * @param config configuration to initialize
+ * @param ticks_per_second clock ticks per second, used for the timeout
+ */
+void ft_init_default_config(struct ft_config *config, u64 ticks_per_second);
+
+/**
+ * creates a flow table; the memory of all elements up to the limit is reserved at once
+ * @param config configuration, user_buffer_size has to be set
+ * @return new table or NULL on error or an invalid configuration
+ */
+struct flow_table *ft_create(const struct ft_config *config);
+
+/**
+ * frees a flow table
+ * @param ft table to destroy
+ */
+void ft_destroy(struct flow_table *ft);
+
+/**
+ * sets the current timestamp, used for new and accessed elements and for timeouts
+ * @param ft table
+ * @param ts timestamp in ticks
+ */
+void ft_set_timestamp(struct flow_table *ft, u64 ts);
+
+/**
+ * looks up an element without changing its timestamp
+ * @param ft table
+ * @param key key of key_size bytes
+ * @return user buffer of the element or NULL
+ */
+void *ft_lookup(struct flow_table *ft, const u8 *key);
+
+/**
+ * looks up an element and inserts it if it does not exist; the timestamp of the element is updated.
+ * If the table is full, the oldest element is overwritten, use ft_reserve_elements to avoid that.
+ * @param ft table
+ * @param key key of key_size bytes
+ * @param new_element set to 1 if the element was inserted, the user buffer is not initialized then
+ * @return user buffer of the element or NULL on error
+ */
+void *ft_insert(struct flow_table *ft, const u8 *key, u8 *new_element);
+
+/**
+ * @param ft table
+ * @param key key of key_size bytes
+ * @return hash of the key, for ft_lookup_hashed and ft_insert_hashed
+ */
+u64 ft_hash_key(const struct flow_table *ft, const u8 *key);
+
+/**
+ * hashes a burst of keys and prefetches the memory their lookups will touch
+ * @param ft table
+ * @param keys keys of key_size bytes
+ * @param hashes set to the hash of every key
+ * @param count number of keys
+ */
+void ft_prefetch(const struct flow_table *ft, const u8 * const keys[], u64 hashes[], u32 count);
+
+/**
+ * ft_lookup with a hash from ft_hash_key or ft_prefetch
+ * @param ft table
+ * @param key key of key_size bytes
+ * @param hash hash of the key
+ * @return user buffer of the element or NULL
+ */
+void *ft_lookup_hashed(struct flow_table *ft, const u8 *key, u64 hash);
+
+/**
+ * ft_insert with a hash from ft_hash_key or ft_prefetch. An insert of the burst can overwrite the
+ * element of an earlier one if the table is full, reserve the elements of the burst before.
+ * @param ft table
+ * @param key key of key_size bytes
+ * @param hash hash of the key
+ * @param new_element set to 1 if the element was inserted, the user buffer is not initialized then
+ * @return user buffer of the element or NULL on error
+ */
+void *ft_insert_hashed(struct flow_table *ft, const u8 *key, u64 hash, u8 *new_element);
+
+/**
+ * removes an element immediately
+ * @param ft table
+ * @param key key of key_size bytes
+ * @return 0 if the element was removed; !=0 if it did not exist
+ */
+u8 ft_delete(struct flow_table *ft, const u8 *key);
+
+/**
+ * makes sure that the next inserts do not overwrite elements, the oldest elements
+ * are returned by ft_get_next_element_to_remove if there is not enough space
+ * @param ft table
+ * @param elements number of elements that will be inserted
+ * @return PACE2_PHT_SUCCESS if enough space is free; PACE2_PHT_OUT_OF_MEMORY if elements have to be removed first
+ */
+PACE2_pht_return_state ft_reserve_elements(struct flow_table *ft, u32 elements);
+
+/**
+ * removes the next element which timed out, has to make room for a reservation or was cleared
+ * @param ft table
+ * @param call_again set to 1 if more elements have to be removed (optional)
+ * @param removal_reason reason of the removal (optional)
+ * @return user buffer of the removed element, valid until the next insert; NULL if nothing has to be removed
+ */
+void *ft_get_next_element_to_remove(struct flow_table *ft, u8 *call_again, enum pace2_pht_removal_reason *removal_reason);
+
+/**
+ * marks all elements for removal, they are returned by ft_get_next_element_to_remove
+ * @param ft table
+ */
+void ft_clear(struct flow_table *ft);
+
+/**
+ * returns the key of an element
+ * @param ft table
+ * @param user_buffer user buffer of a valid element
+ * @return pointer to the key
+ */
+const u8 *ft_get_key(const struct flow_table *ft, const void *user_buffer);
+
+/**
+ * iterates over all elements, e.g. to write a checkpoint; the table must not be changed meanwhile
+ * @param ft table
+ * @param iterator position, 0 for the first call
+ * @param timestamp set to the last access of the element (optional)
+ * @return user buffer of the next element or NULL if all elements were returned
+ */
+void *ft_get_next_element(const struct flow_table *ft, u32 *iterator, u64 *timestamp);
+
+/**
+ * raises the capacity of a table created with limit_elements; the buckets are doubled if the
+ * load gets too high, their elements are moved by ft_resize_step. A resize which is still in
+ * progress is completed first.
+ * @param ft table
+ * @param elements new capacity, at most limit_elements
+ * @return 0 on success; !=0 if the table cannot grow or the buckets could not be allocated
+ */
+u8 ft_grow(struct flow_table *ft, u32 elements);
+
+/**
+ * moves the elements of old buckets into the new ones after ft_grow
+ * @param ft table
+ * @param buckets maximum number of old buckets to move
+ * @return 1 if old buckets are left; 0 if the resize is complete
+ */
+u8 ft_resize_step(struct flow_table *ft, u32 buckets);
+
+/**
+ * @param ft table
+ * @return 1 while a resize is in progress
+ */
+static inline u8 ft_resizing(const struct flow_table *ft)
+{
+    return NULL != ft->old_buckets;
+}
+
+/**
+ * @param ft table
+ * @return number of elements in the table
+ */
+static inline u32 ft_used_elements(const struct flow_table *ft)
+{
+    return ft->used;
+}
+
+/**
+ * @param ft table
+ * @return largest number of elements the table held at once
+ */
+static inline u32 ft_maximum_number_of_used_elements(const struct flow_table *ft)
+{
+    return ft->max_used;
+}
+
+/**
+ * @param ft table
+ * @return number of elements the table can hold now
+ */
+static inline u32 ft_capacity(const struct flow_table *ft)
+{
+    return ft->capacity;
+}
+
+/**
+ * @param ft table
+ * @return number of elements the table may grow to
+ */
+static inline u32 ft_limit(const struct flow_table *ft)
+{
+    return ft->limit;
+}
+
+/**
+ * @param ft table
+ * @return size of the user buffer of every element
+ */
+static inline u32 ft_get_user_buffer_size(const struct flow_table *ft)
+{
+    return ft->config.user_buffer_size;
+}
+
+#endif /* FLOW_TABLE_H */
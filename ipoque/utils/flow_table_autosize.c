@@ -0,0 +1,108 @@
+/*
+ * flow_table_autosize.c
+ *
+ * Incremental flow table growth, see flow_table_autosize.h.
+ */
+
+#include <string.h>
+#include <time.h>
+#include "flow_table_autosize.h"
+
+static u64 fta_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+void fta_init_default_config(struct fta_config *config)
+{
+    if (NULL == config) {
+        return;
+    }
+
+    config->grow_percent = 80;
+    config->step_buckets = 256;
+    config->log = stderr;
+}
+
+void fta_init(struct flow_table_autosize *fta, const struct fta_config *config, struct flow_table *ft, const char *name)
+{
+    memset(fta, 0, sizeof(*fta));
+
+    fta->config = *config;
+    fta->ft = ft;
+    fta->name = name;
+}
+
+/* accounts the time of one step, logs the end of the resize */
+static void fta_step_done(struct flow_table_autosize *fta, u64 ns)
+{
+    fta->resize_steps++;
+    fta->resize_ns += ns;
+
+    if (ns > fta->longest_step_ns) {
+        fta->longest_step_ns = ns;
+    }
+    if (ns > fta->max_step_ns) {
+        fta->max_step_ns = ns;
+    }
+
+    if (ft_resizing(fta->ft) || NULL == fta->config.log) {
+        return;
+    }
+
+    fprintf(fta->config.log, "flow table %s: resized from %u to %u elements in %llu steps, longest step %.1f us, total %.1f us\n",
+            fta->name, fta->from_capacity, ft_capacity(fta->ft),
+            (unsigned long long)fta->resize_steps, fta->longest_step_ns / 1e3, fta->resize_ns / 1e3);
+}
+
+u8 fta_run(struct flow_table_autosize *fta)
+{
+    struct flow_table * const ft = fta->ft;
+    const u64 start = fta_now_ns();
+    u64 capacity;
+
+    if (ft_resizing(ft)) {
+        ft_resize_step(ft, fta->config.step_buckets);
+        fta_step_done(fta, fta_now_ns() - start);
+
+        return ft_resizing(ft);
+    }
+
+    capacity = ft_capacity(ft);
+
+    if ((u64)ft_used_elements(ft) * 100 <= capacity * fta->config.grow_percent || capacity >= ft_limit(ft)) {
+        return 0;
+    }
+
+    fta->from_capacity = (u32)capacity;
+    capacity = capacity * 2 < ft_limit(ft) ? capacity * 2 : ft_limit(ft);
+
+    if (ft_grow(ft, (u32)capacity) != 0) {
+        /* retried after the next burst, only the first failure is logged */
+        if (0 == fta->failed_resizes++ && NULL != fta->config.log) {
+            fprintf(fta->config.log, "flow table %s: growing from %u to %llu elements failed\n",
+                    fta->name, fta->from_capacity, (unsigned long long)capacity);
+        }
+        return 0;
+    }
+
+    fta->resizes++;
+    fta->resize_steps = 0;
+    fta->resize_ns = 0;
+    fta->longest_step_ns = 0;
+
+    if (NULL != fta->config.log) {
+        fprintf(fta->config.log, "flow table %s: growing from %u to %u elements, %u used, at most %u used\n",
+                fta->name, fta->from_capacity, ft_capacity(ft),
+                ft_used_elements(ft), ft_maximum_number_of_used_elements(ft));
+    }
+
+    /* allocating the buckets is the first step */
+    fta_step_done(fta, fta_now_ns() - start);
+
+    return ft_resizing(ft);
+}
@@ -0,0 +1,67 @@
+/*
+ * flow_table_autosize.h
+ *
+ * Grows a flow table created with limit_elements before it fills up. The
+ * controller is called between packet bursts: when the table is used above
+ * the threshold, ft_grow doubles its capacity, then every call moves a
+ * bounded number of buckets with ft_resize_step, so no call stalls packet
+ * processing for long. Every resize is logged with the time of its longest
+ * step and its total time.
+ */
+
+#ifndef FLOW_TABLE_AUTOSIZE_H
+#define FLOW_TABLE_AUTOSIZE_H
+
+#include <stdio.h>
+#include "flow_table.h"
+
+struct fta_config {
+    /* the table grows when more than this percentage of its capacity is used */
+    u32 grow_percent;
+    /* old buckets moved by one call of fta_run */
+    u32 step_buckets;
+    /* resize log, NULL disables logging */
+    FILE *log;
+};
+
+struct flow_table_autosize {
+    struct fta_config config;
+    struct flow_table *ft;
+    const char *name;
+
+    /* the resize in progress */
+    u32 from_capacity;
+    u64 resize_steps;
+    u64 resize_ns;
+    u64 longest_step_ns;
+
+    /* statistics */
+    u64 resizes;
+    u64 failed_resizes;
+    u64 max_step_ns;
+};
+
+/**
+ * fills a configuration with default values (grow at 80%, 256 buckets per step, log to stderr)
+ * @param config configuration to initialize
+ */
+void fta_init_default_config(struct fta_config *config);
+
+/**
+ * initializes a controller for a table
+ * @param fta controller
+ * @param config configuration
+ * @param ft table, created with limit_elements
+ * @param name name of the table in the log
+ */
+void fta_init(struct flow_table_autosize *fta, const struct fta_config *config, struct flow_table *ft, const char *name);
+
+/**
+ * starts a resize if the table is too full and moves the next buckets of a resize in progress;
+ * called between packet bursts. User buffers stay valid, the buckets of the table change.
+ * @param fta controller
+ * @return 1 while a resize is in progress
+ */
+u8 fta_run(struct flow_table_autosize *fta);
+
+#endif /* FLOW_TABLE_AUTOSIZE_H */
@@ -0,0 +1,484 @@
+/*
+ * flow_table_benchmark.c
+ *
+ * Compares the insert and lookup throughput of flow_table and pace2_pht.
+ * Both tables are filled with random IPv4 flow keys, then the same keys are
+ * looked up in random order. Every run is done with the full 40 byte keys
+ * built by pace2_build_flow_key and with the packed 16 byte keys of
+ * flow_key.h. On Linux the cache misses of the lookups are counted with
+ * perf_event_open.
+ * The flow_table lookups are also run in bursts with ft_prefetch.
+ * Before, a churn test replaces the flows of a flow_table over many rounds
+ * and fails if the probes per insert grow.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include <pace2.h>
+#include "flow_table.h"
+#include "flow_key.h"
+
+/* maximum number of keys prefetched together */
+#define MAX_BURST 64
+
+/* estimated per element overhead of pace2_pht, used to size its memory */
+#define PHT_ELEMENT_OVERHEAD 64
+
+/* churn test: table size, rounds and the allowed probes per insert of a round */
+#define CHURN_FLOWS 100000
+#define CHURN_ROUNDS 200
+#define CHURN_MAX_PROBES 1
+
+static double now( void )
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* hardware cache miss counter of this thread, -1 if it is not available */
+static int cache_miss_fd = -1;
+
+static void cache_misses_open( void )
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    cache_miss_fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+}
+
+static void cache_misses_start( void )
+{
+#ifdef __linux__
+    if (cache_miss_fd >= 0) {
+        ioctl(cache_miss_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(cache_miss_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+/* returns the cache misses since cache_misses_start or -1 */
+static long long cache_misses_stop( void )
+{
+#ifdef __linux__
+    u64 count;
+
+    if (cache_miss_fd >= 0) {
+        ioctl(cache_miss_fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(cache_miss_fd, &count, sizeof(count)) == sizeof(count)) {
+            return (long long)count;
+        }
+    }
+#endif
+    return -1;
+}
+
+static u64 xorshift( u64 *state )
+{
+    u64 x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+
+    return x;
+}
+
+static void *malloc_wrapper( u64 size, int thread_ID, void *user_ptr, int scope )
+{
+    (void)thread_ID;
+    (void)user_ptr;
+    (void)scope;
+
+    return malloc(size);
+}
+
+static void free_wrapper( void *ptr, int thread_ID, void *user_ptr, int scope )
+{
+    (void)thread_ID;
+    (void)user_ptr;
+    (void)scope;
+
+    free(ptr);
+}
+
+/* unique key of a counter below 2^24, address and port are mixed to spread the keys over the address space */
+static void create_key( u32 i, u64 *state, u32 key_size, u8 *buffer )
+{
+    ipoque_unique_flow_ipv4_and_6_struct_t key;
+
+    memset(&key, 0, sizeof(key));
+    key.protocol = 6;
+    key.ip.ipv4.lower_ip = (u32)xorshift(state) & 0xffff0000u;
+    key.ip.ipv4.upper_ip = 0x0a000000u ^ i;
+    key.lower_port = 1024 + (u16)(xorshift(state) % 60000);
+    key.upper_port = 443;
+
+    if (FLOW_KEY_V4_SIZE == key_size) {
+        flow_key_compact(&key, (struct flow_key_v4 *)buffer);
+    } else {
+        memcpy(buffer, &key, key_size);
+    }
+}
+
+static u8 *create_keys( u32 flows, u32 key_size )
+{
+    u8 * const keys = calloc(flows, key_size);
+    u64 state = 0x2545f4914f6cdd1dull;
+    u32 i;
+
+    if (NULL == keys) {
+        return NULL;
+    }
+
+    for (i = 0; i < flows; i++) {
+        create_key(i, &state, key_size, keys + (u64)i * key_size);
+    }
+
+    return keys;
+}
+
+/* random permutation of the key indices for the lookup phase */
+static u32 *create_order( u32 flows )
+{
+    u32 * const order = malloc((u64)flows * sizeof(u32));
+    u64 state = 0x9e3779b97f4a7c15ull;
+    u32 i;
+
+    if (NULL == order) {
+        return NULL;
+    }
+
+    for (i = 0; i < flows; i++) {
+        order[i] = i;
+    }
+
+    for (i = flows - 1; i > 0; i--) {
+        const u32 j = (u32)(xorshift(&state) % (i + 1));
+        const u32 t = order[i];
+
+        order[i] = order[j];
+        order[j] = t;
+    }
+
+    return order;
+}
+
+static void report( const char *name, const char *phase, u32 operations, u32 hits, double elapsed, long long misses )
+{
+    printf("%-10s %-7s %10u ops, %10u found: %8.3f s, %7.2f Mops/s, %6.1f ns/op",
+           name, phase, operations, hits, elapsed, operations / elapsed / 1e6, elapsed * 1e9 / operations);
+
+    if (misses >= 0) {
+        printf(", %5.2f cache misses/op", (double)misses / operations);
+    }
+
+    printf("\n");
+}
+
+static int run_flow_table( const u8 *keys, u32 key_size, const u32 *order, u32 flows, u32 user_buffer_size, u32 burst )
+{
+    struct ft_config config;
+    struct flow_table *ft;
+    u32 hits = 0;
+    double start;
+    u32 i;
+
+    ft_init_default_config(&config, 1000);
+    config.max_elements = flows;
+    config.key_size = key_size;
+    config.user_buffer_size = user_buffer_size;
+
+    ft = ft_create(&config);
+    if (NULL == ft) {
+        fprintf(stderr, "ft_create failed for %u flows.\n", flows);
+        return 1;
+    }
+
+    start = now();
+    for (i = 0; i < flows; i++) {
+        u8 new_element;
+        u8 * const p = ft_insert(ft, keys + (u64)i * key_size, &new_element);
+
+        if (NULL != p && new_element) {
+            p[0] = (u8)i;
+        }
+    }
+    report("flow_table", "insert", flows, ft_used_elements(ft), now() - start, -1);
+
+    start = now();
+    cache_misses_start();
+    for (i = 0; i < flows; i++) {
+        const u8 * const p = ft_lookup(ft, keys + (u64)order[i] * key_size);
+
+        if (NULL != p && p[0] == (u8)order[i]) {
+            hits++;
+        }
+    }
+    report("flow_table", "lookup", flows, hits, now() - start, cache_misses_stop());
+
+    /* the same lookups, the keys of a burst are hashed and prefetched first */
+    hits = 0;
+    start = now();
+    cache_misses_start();
+    for (i = 0; i < flows; i += burst) {
+        const u8 *burst_keys[MAX_BURST];
+        u64 hashes[MAX_BURST];
+        const u32 count = flows - i < burst ? flows - i : burst;
+        u32 j;
+
+        for (j = 0; j < count; j++) {
+            burst_keys[j] = keys + (u64)order[i + j] * key_size;
+        }
+
+        ft_prefetch(ft, burst_keys, hashes, count);
+
+        for (j = 0; j < count; j++) {
+            const u8 * const p = ft_lookup_hashed(ft, burst_keys[j], hashes[j]);
+
+            if (NULL != p && p[0] == (u8)order[i + j]) {
+                hits++;
+            }
+        }
+    }
+    report("flow_table", "burst", flows, hits, now() - start, cache_misses_stop());
+
+    printf("%-10s probes per lookup: %.3f, tag misses per lookup: %.4f\n", "flow_table",
+           (double)ft->probes / ft->lookups, (double)ft->tag_misses / ft->lookups);
+
+    ft_destroy(ft);
+
+    return 0;
+}
+
+/* Replaces the oldest quarter of a full table by new flows in every round. The probes of the
+   inserts must not grow with the number of rounds, released elements have to shorten the
+   probe sequences again. */
+static int run_churn( void )
+{
+    struct ft_config config;
+    struct flow_table *ft;
+    u64 state = 0x2545f4914f6cdd1dull;
+    u8 key[FLOW_KEY_V4_SIZE];
+    u32 next_key = 0;
+    u32 round;
+    u32 i;
+    int result = 0;
+
+    ft_init_default_config(&config, 1000);
+    config.max_elements = CHURN_FLOWS;
+    config.key_size = FLOW_KEY_V4_SIZE;
+    config.user_buffer_size = 16;
+
+    ft = ft_create(&config);
+    if (NULL == ft) {
+        fprintf(stderr, "ft_create failed for %u flows.\n", CHURN_FLOWS);
+        return 1;
+    }
+
+    for (i = 0; i < CHURN_FLOWS; i++) {
+        u8 new_element;
+
+        create_key(next_key++, &state, FLOW_KEY_V4_SIZE, key);
+        ft_insert(ft, key, &new_element);
+    }
+
+    for (round = 0; round < CHURN_ROUNDS && 0 == result; round++) {
+        const u64 probes = ft->probes;
+        const u64 inserts = ft->inserts;
+        const double start = now();
+        double probes_per_insert;
+
+        ft_reserve_elements(ft, CHURN_FLOWS / 4);
+        while (NULL != ft_get_next_element_to_remove(ft, NULL, NULL)) {
+        }
+
+        for (i = 0; i < CHURN_FLOWS / 4; i++) {
+            u8 new_element;
+
+            create_key(next_key++, &state, FLOW_KEY_V4_SIZE, key);
+            if (NULL == ft_insert(ft, key, &new_element) || !new_element) {
+                fprintf(stderr, "churn round %u: insert failed\n", round);
+                result = 1;
+                break;
+            }
+        }
+
+        probes_per_insert = (double)(ft->probes - probes) / (ft->inserts - inserts);
+        if (0 == (round + 1) % (CHURN_ROUNDS / 4)) {
+            printf("%-10s churn round %3u: %6.3f probes per insert, %8.3f s\n", "flow_table", round + 1,
+                   probes_per_insert, now() - start);
+        }
+        if (probes_per_insert > CHURN_MAX_PROBES) {
+            fprintf(stderr, "churn round %u: %.3f probes per insert, more than %u\n", round + 1, probes_per_insert,
+                    CHURN_MAX_PROBES);
+            result = 1;
+        }
+    }
+
+    ft_destroy(ft);
+
+    return result;
+}
+
+static int run_pht( const u8 *keys, u32 key_size, const u32 *order, u32 flows, u32 user_buffer_size )
+{
+    struct PACE2_pht_config config;
+    struct pace2_pht *pht;
+    u32 hits = 0;
+    double start;
+    u32 i;
+
+    pace2_pht_init_default_config(&config);
+    config.memory_size = (u64)flows * (key_size + user_buffer_size + PHT_ELEMENT_OVERHEAD);
+    config.unique_key_size = key_size;
+    config.user_buffer_size = user_buffer_size;
+    config.timeout = 10 * 60 * 1000;
+    config.ipq_malloc = malloc_wrapper;
+    config.ipq_free = free_wrapper;
+
+    pht = pace2_pht_create(&config, 0);
+    if (NULL == pht) {
+        fprintf(stderr, "pace2_pht_create failed for %u flows.\n", flows);
+        return 1;
+    }
+
+    start = now();
+    for (i = 0; i < flows; i++) {
+        u8 new_element;
+        u8 * const p = pace2_pht_insert(pht, keys + (u64)i * key_size, &new_element);
+
+        if (NULL != p && new_element) {
+            p[0] = (u8)i;
+        }
+    }
+    report("pace2_pht", "insert", flows, pace2_pht_used_elements(pht), now() - start, -1);
+
+    start = now();
+    cache_misses_start();
+    for (i = 0; i < flows; i++) {
+        const u8 * const p = pace2_pht_lookup(pht, keys + (u64)order[i] * key_size);
+
+        if (NULL != p && p[0] == (u8)order[i]) {
+            hits++;
+        }
+    }
+    report("pace2_pht", "lookup", flows, hits, now() - start, cache_misses_stop());
+
+    pace2_pht_destroy(pht);
+
+    return 0;
+}
+
+int main( int argc, char **argv )
+{
+    u32 flows[16];
+    u32 flow_count = 0;
+    u32 user_buffer_size = 64;
+    u32 burst = 16;
+    u8 skip_pht = 0;
+    u32 i;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:u:b:f")) != -1) {
+        switch (opt) {
+            case 'n':
+                if (flow_count < sizeof(flows) / sizeof(flows[0])) {
+                    flows[flow_count++] = strtoul(optarg, NULL, 10);
+                }
+                break;
+            case 'u':
+                user_buffer_size = strtoul(optarg, NULL, 10);
+                break;
+            case 'b':
+                burst = strtoul(optarg, NULL, 10);
+                if (0 == burst || burst > MAX_BURST) {
+                    burst = MAX_BURST;
+                }
+                break;
+            case 'f':
+                skip_pht = 1;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n flows, repeatable] [-u user buffer size] [-b lookup burst size] [-f flow_table only]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (0 == flow_count) {
+        flows[flow_count++] = 1000000;
+        flows[flow_count++] = 10000000;
+        flows[flow_count++] = 50000000;
+    }
+
+    if (run_churn() != 0) {
+        return 1;
+    }
+
+    cache_misses_open();
+    if (cache_miss_fd < 0) {
+        printf("cache miss counter not available\n");
+    }
+
+    for (i = 0; i < flow_count; i++) {
+        static const u32 key_sizes[] = { FLOW_KEY_FULL_SIZE, FLOW_KEY_V4_SIZE };
+        u32 *order;
+        u32 k;
+
+        if (0 == flows[i]) {
+            continue;
+        }
+
+        order = create_order(flows[i]);
+        if (NULL == order) {
+            fprintf(stderr, "Not enough memory for %u flows.\n", flows[i]);
+            return 1;
+        }
+
+        for (k = 0; k < sizeof(key_sizes) / sizeof(key_sizes[0]); k++) {
+            u8 * const keys = create_keys(flows[i], key_sizes[k]);
+
+            if (NULL == keys) {
+                fprintf(stderr, "Not enough memory for %u flows.\n", flows[i]);
+                free(order);
+                return 1;
+            }
+
+            printf("%u flows, %u byte keys, %u byte user buffers\n", flows[i], key_sizes[k], user_buffer_size);
+
+            if (run_flow_table(keys, key_sizes[k], order, flows[i], user_buffer_size, burst) != 0 ||
+                (!skip_pht && run_pht(keys, key_sizes[k], order, flows[i], user_buffer_size) != 0)) {
+                free(keys);
+                free(order);
+                return 1;
+            }
+
+            free(keys);
+        }
+
+        free(order);
+    }
+
+    return 0;
+}
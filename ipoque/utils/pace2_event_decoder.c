@@ -0,0 +1,102 @@
+/*
+ * pace2_event_decoder.c
+ *
+ * Prints an event log written with pace2_encode_event in the text format of
+ * pace2_debug_event.
+ *
+ * usage: pace2_event_decoder <event log>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "event_handler.h"
+#include "event_encoder.h"
+
+/* panic is used for abnormal errors (allocation errors, file not found,...) */
+static void panic( const char *msg )
+{
+    fprintf( stderr, "%s", msg );
+    exit( 1 );
+} /* panic */
+
+/* reads the whole file into a buffer */
+static u8 *read_log( const char *file_name, u64 *length )
+{
+    FILE *f = fopen( file_name, "rb" );
+    u8 *data = NULL;
+    u64 size = 0;
+    size_t n;
+
+    if ( f == NULL ) {
+        return NULL;
+    }
+
+    do {
+        u8 *new_data = realloc( data, size + 1024 * 1024 );
+
+        if ( new_data == NULL ) {
+            free( data );
+            fclose( f );
+            return NULL;
+        }
+        data = new_data;
+        n = fread( data + size, 1, 1024 * 1024, f );
+        size += n;
+    } while ( n > 0 );
+
+    fclose( f );
+
+    *length = size;
+
+    return data;
+}
+
+int main( int argc, char **argv )
+{
+    struct pace2_event_log_header header;
+    PACE2_event event;
+    u64 records = 0;
+    u64 length;
+    u64 pos;
+    u8 *data;
+
+    if ( argc != 2 ) {
+        panic( "usage: pace2_event_decoder <event log>\n" );
+    }
+
+    data = read_log( argv[1], &length );
+    if ( data == NULL ) {
+        panic( "could not read the event log\n" );
+    }
+
+    if ( length < sizeof( header ) ) {
+        panic( "event log too short\n" );
+    }
+    memcpy( &header, data, sizeof( header ) );
+    if ( pace2_check_event_log_header( &header ) != 0 ) {
+        panic( "not an event log of a supported version\n" );
+    }
+
+    pos = sizeof( header );
+    while ( pos < length ) {
+        u32 const size = length - pos > 0xffffffff ? 0xffffffff : (u32)( length - pos );
+        u32 const record_length = pace2_decode_event( data + pos, size, &event );
+
+        if ( record_length == 0 ) {
+            fprintf( stderr, "invalid record at offset %llu, %llu records decoded\n",
+                     (unsigned long long)pos, (unsigned long long)records );
+            free( data );
+            return 1;
+        }
+
+        pace2_debug_event( stdout, &event );
+        pos += record_length;
+        records++;
+    }
+
+    free( data );
+
+    return 0;
+}
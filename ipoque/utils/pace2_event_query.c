@@ -0,0 +1,194 @@
+/*
+ * pace2_event_query.c
+ *
+ * Prints the events of an event store (see event_store.h) of one flow or
+ * address in a time range. Every segment is mapped; segments outside the
+ * time range are skipped by their footer, in the others only the blocks
+ * listed for the flow or address in the index are read.
+ *
+ * usage: pace2_event_query [-c] [-f from] [-t to] [-F flow id] [-a address] segment ...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include <getopt.h>
+
+#include "event_handler.h"
+#include "event_encoder.h"
+#include "event_store.h"
+
+static int count_only = 0;
+
+/* seconds since the epoch, "YYYY-mm-dd HH:MM[:SS]" or "HH:MM[:SS]" of today in local time */
+static u64 parse_time( const char *arg )
+{
+    static const char * const formats[] = { "%Y-%m-%d %H:%M:%S", "%Y-%m-%d %H:%M", "%Y-%m-%dT%H:%M:%S",
+                                            "%Y-%m-%dT%H:%M", "%H:%M:%S", "%H:%M" };
+    const time_t now = time( NULL );
+    struct tm tm;
+    const char *end;
+    char *number_end;
+    unsigned long long seconds;
+    size_t i;
+
+    seconds = strtoull( arg, &number_end, 10 );
+    if ( number_end != arg && *number_end == '\0' ) {
+        return seconds;
+    }
+
+    for ( i = 0; i < sizeof( formats ) / sizeof( formats[0] ); i++ ) {
+        localtime_r( &now, &tm );
+        tm.tm_sec = 0;
+        end = strptime( arg, formats[i], &tm );
+        if ( end != NULL && *end == '\0' ) {
+            tm.tm_isdst = -1;
+            return (u64)mktime( &tm );
+        }
+    }
+
+    fprintf( stderr, "invalid time: %s\n", arg );
+    exit( 1 );
+}
+
+static void parse_address( const char *arg, u8 *address )
+{
+    struct in_addr ipv4;
+
+    if ( inet_pton( AF_INET, arg, &ipv4 ) == 1 ) {
+        memset( address, 0, 10 );
+        address[10] = 0xff;
+        address[11] = 0xff;
+        memcpy( address + 12, &ipv4, 4 );
+    } else if ( inet_pton( AF_INET6, arg, address ) != 1 ) {
+        fprintf( stderr, "invalid address: %s\n", arg );
+        exit( 1 );
+    }
+}
+
+/* prints IPv4-mapped addresses as IPv4 */
+static const char *format_address( const u8 *address, char *buffer )
+{
+    static const u8 mapped[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+
+    if ( memcmp( address, mapped, sizeof( mapped ) ) == 0 ) {
+        return inet_ntop( AF_INET, address + 12, buffer, INET6_ADDRSTRLEN );
+    }
+
+    return inet_ntop( AF_INET6, address, buffer, INET6_ADDRSTRLEN );
+}
+
+static void print_record( const struct pace2_event_store_record *record, const u8 *data, u32 length,
+                          void *user_data )
+{
+    const struct pace2_event_segment_header * const header = user_data;
+    char src[INET6_ADDRSTRLEN];
+    char dst[INET6_ADDRSTRLEN];
+    char date[32];
+    PACE2_event event;
+    struct tm tm;
+    time_t seconds;
+
+    if ( count_only ) {
+        return;
+    }
+
+    if ( header->ticks_per_second != 0 ) {
+        seconds = (time_t)( record->ts / header->ticks_per_second );
+        localtime_r( &seconds, &tm );
+        strftime( date, sizeof( date ), "%Y-%m-%d %H:%M:%S", &tm );
+        printf( "%s.%06llu", date,
+                (unsigned long long)( record->ts % header->ticks_per_second * 1000000 / header->ticks_per_second ) );
+    } else {
+        printf( "%llu", (unsigned long long)record->ts );
+    }
+    printf( " flow %llu %s -> %s\n", (unsigned long long)record->flow_id, format_address( record->src, src ),
+            format_address( record->dst, dst ) );
+
+    if ( pace2_decode_event( data, length, &event ) != length ) {
+        printf( "invalid event record\n" );
+        return;
+    }
+    pace2_debug_event( stdout, &event );
+}
+
+int main( int argc, char **argv )
+{
+    struct pace2_event_store_query query;
+    struct pace2_event_store_query_stats stats;
+    struct pace2_event_segment segment;
+    struct timespec start, end;
+    u64 from = 0;
+    u64 to = ~0ull;
+    u64 tps;
+    u64 errors = 0;
+    int c;
+
+    memset( &query, 0, sizeof( query ) );
+    memset( &stats, 0, sizeof( stats ) );
+
+    while ( ( c = getopt( argc, argv, "cf:t:F:a:h" ) ) != -1 ) {
+        switch ( c ) {
+            case 'c':
+                count_only = 1;
+                break;
+            case 'f':
+                from = parse_time( optarg );
+                break;
+            case 't':
+                to = parse_time( optarg );
+                break;
+            case 'F':
+                query.by_flow = 1;
+                query.flow_id = strtoull( optarg, NULL, 10 );
+                break;
+            case 'a':
+                query.by_address = 1;
+                parse_address( optarg, query.address );
+                break;
+            default:
+                printf( "Usage: %s [-c] [-f from] [-t to] [-F flow id] [-a address] segment ...\n\n", argv[0] );
+                printf( "  -c\tOnly count the matching events.\n" );
+                printf( "  -f\tEvents at or after this time: seconds since the epoch, \"YYYY-mm-dd HH:MM[:SS]\" or \"HH:MM[:SS]\" of today.\n" );
+                printf( "  -t\tEvents at or before this time, in the same formats.\n" );
+                printf( "  -F\tEvents of this flow.\n" );
+                printf( "  -a\tEvents with this IPv4 or IPv6 source or destination address.\n" );
+                return 0;
+        }
+    }
+
+    clock_gettime( CLOCK_MONOTONIC, &start );
+
+    for ( ; optind < argc; optind++ ) {
+        if ( pace2_event_segment_map( &segment, argv[optind] ) != 0 ) {
+            fprintf( stderr, "%s: not an event store segment\n", argv[optind] );
+            errors++;
+            continue;
+        }
+
+        /* the time range is converted into the timestamp units of every segment */
+        tps = segment.header->ticks_per_second != 0 ? segment.header->ticks_per_second : 1;
+        query.from_ts = from > ~0ull / tps ? ~0ull : from * tps;
+        query.to_ts = to >= ~0ull / tps ? ~0ull : to * tps + tps - 1;
+
+        pace2_event_segment_query( &segment, &query, print_record, (void *)segment.header, &stats );
+        pace2_event_segment_unmap( &segment );
+    }
+
+    fflush( stdout );
+    clock_gettime( CLOCK_MONOTONIC, &end );
+
+    if ( count_only ) {
+        printf( "%llu\n", (unsigned long long)stats.matches );
+    }
+    fprintf( stderr, "%llu events, %llu segments (%llu skipped, %llu without index), %llu blocks, %llu records read in %.3f ms\n",
+             (unsigned long long)stats.matches, (unsigned long long)stats.segments,
+             (unsigned long long)stats.segments_skipped, (unsigned long long)stats.segments_scanned,
+             (unsigned long long)stats.blocks, (unsigned long long)stats.records,
+             ( end.tv_sec - start.tv_sec ) * 1000.0 + ( end.tv_nsec - start.tv_nsec ) / 1000000.0 );
+
+    return errors > 0 ? 1 : 0;
+}
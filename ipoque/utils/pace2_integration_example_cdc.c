@@ -24,6 +24,7 @@
 #include <pace2.h>
 #include "read_pcap.h"
 #include "event_handler.h"
+#include "event_batch.h"
 
 #include <stdio.h>
 #include <unistd.h>
@@ -58,6 +59,13 @@ static u64 next_packet_id = 0;
 
 static u64 license_exceeded_packets = 0;
 
+/* Events are drained from the queue in batches of at most this size */
+#define EVENT_BATCH_SIZE 64
+
+/* Event dispatchers of stage 3 and of stages 4 and 5 */
+static struct event_batch s3_events;
+static struct event_batch s4_events;
+
 /* Protocol, application and attribute name strings */
 static const char *prot_long_str[] = { PACE2_PROTOCOLS_LONG_STRS };
 static const char *app_str[] = { PACE2_APPLICATIONS_SHORT_STRS };
@@ -348,27 +356,104 @@ static void pace_configure_and_initialize( const char * const license_file )
     }
 } /* pace_configure_and_initialize */
 
-/* Print out all PACE 2 events currently in the event queue */
-static void process_events(void)
+/* Count the classification results of a batch of stage 3 events */
+static void handle_classification_results( PACE2_event * const *events, u32 count, PACE2_packet_descriptor const *pd, void *user_data )
 {
-    PACE2_event *event;
-
-    while ( ( event = pace2_get_next_event( pace2, 0 ) ) ) {
-        /* some additional processing is necessary */
-        if ( event->header.type == PACE2_CLASS_HTTP_EVENT ) {
-            const PACE2_class_HTTP_event * const http_event = &event->http_class_meta_data;
-            if (http_event->meta_data_type == PACE2_CLASS_HTTP_RESPONSE_DATA_TRANSFER) {
-                const struct ipd_class_http_transfer_payload_struct * const http_payload = &http_event->event_data.response_data_transfer;
-                http_response_payload_bytes += http_payload->data.content.length;
-            }
+    const u32 frame_length = pd->framing->stack[0].frame_length;
+    u32 i;
+
+    for ( i = 0; i < count; i++ ) {
+        PACE2_classification_result_event const * const classification = &events[i]->classification_result_data;
+        u8 attribute_iterator;
+
+        protocol_counter[classification->protocol.stack.entry[classification->protocol.stack.length-1]]++;
+        protocol_counter_bytes[classification->protocol.stack.entry[classification->protocol.stack.length-1]] += frame_length;
+        protocol_stack_length_counter[classification->protocol.stack.length - 1]++;
+        protocol_stack_length_counter_bytes[classification->protocol.stack.length - 1] += frame_length;
+
+        application_counter[classification->application.type]++;
+        application_counter_bytes[classification->application.type] += frame_length;
+
+        for ( attribute_iterator = 0; attribute_iterator < classification->application.attributes.length; attribute_iterator++) {
+            attribute_counter[classification->application.attributes.list[attribute_iterator]]++;
+            attribute_counter_bytes[classification->application.attributes.list[attribute_iterator]] += frame_length;
         }
-        pace2_debug_advanced_event(stdout, event);
     }
+} /* handle_classification_results */
+
+static void handle_license_exceeded( PACE2_event * const *events, u32 count, PACE2_packet_descriptor const *pd, void *user_data )
+{
+    license_exceeded_packets += count;
+} /* handle_license_exceeded */
+
+/* Count the packets and bytes per detected CDC */
+static void handle_cdc_results( PACE2_event * const *events, u32 count, PACE2_packet_descriptor const *pd, void *user_data )
+{
+    const u32 frame_length = pd->framing->stack[0].frame_length;
+    u32 i;
+
+    for ( i = 0; i < count; i++ ) {
+        PACE2_cdc_result_event const * const cdc = &events[i]->cdc_data;
+
+        cdc_packets[cdc->detected_cdc_id]++;
+        cdc_bytes[cdc->detected_cdc_id] += frame_length;
+    }
+} /* handle_cdc_results */
+
+/* Account the HTTP response payload and print out the HTTP class events */
+static void handle_class_http_events( PACE2_event * const *events, u32 count, PACE2_packet_descriptor const *pd, void *user_data )
+{
+    u32 i;
+
+    for ( i = 0; i < count; i++ ) {
+        const PACE2_class_HTTP_event * const http_event = &events[i]->http_class_meta_data;
+
+        if (http_event->meta_data_type == PACE2_CLASS_HTTP_RESPONSE_DATA_TRANSFER) {
+            const struct ipd_class_http_transfer_payload_struct * const http_payload = &http_event->event_data.response_data_transfer;
+            http_response_payload_bytes += http_payload->data.content.length;
+        }
+        pace2_debug_advanced_event(stdout, events[i]);
+    }
+} /* handle_class_http_events */
+
+static void print_events( PACE2_event * const *events, u32 count, PACE2_packet_descriptor const *pd, void *user_data )
+{
+    u32 i;
+
+    for ( i = 0; i < count; i++ ) {
+        pace2_debug_advanced_event(stdout, events[i]);
+    }
+} /* print_events */
+
+/* Set up the event dispatchers of stage 3 and of stages 4 and 5 */
+static void init_event_batches( void )
+{
+    int consumer;
+
+    if ( eb_init( &s3_events, pace2, 0, EVENT_BATCH_SIZE ) != 0 || eb_init( &s4_events, pace2, 0, EVENT_BATCH_SIZE ) != 0 ) {
+        panic( "Allocation of the event batches failed\n" );
+    }
+
+    /* Stage 3 events are only counted, all others are dropped */
+    consumer = eb_add_consumer( &s3_events, "counters" );
+    eb_subscribe( &s3_events, consumer, PACE2_CLASSIFICATION_RESULT, handle_classification_results, NULL );
+    eb_subscribe( &s3_events, consumer, PACE2_LICENSE_EXCEEDED_EVENT, handle_license_exceeded, NULL );
+    eb_subscribe( &s3_events, consumer, PACE2_CDC_RESULT, handle_cdc_results, NULL );
+
+    /* Decoder events are printed out, grouped by type */
+    consumer = eb_add_consumer( &s4_events, "output" );
+    eb_subscribe( &s4_events, consumer, PACE2_CLASS_HTTP_EVENT, handle_class_http_events, NULL );
+    eb_subscribe_default( &s4_events, consumer, print_events, NULL );
+} /* init_event_batches */
+
+/* Print out all PACE 2 events currently in the event queue */
+static void process_events(void)
+{
+    eb_drain( &s4_events, NULL );
 } /* process_events */
 
 static void stage3_to_5( void )
 {
-    const PACE2_event *event;
     PACE2_bitmask pace2_event_mask;
     PACE2_packet_descriptor *out_pd;
 
@@ -385,34 +470,7 @@ static void stage3_to_5( void )
         } /* Stage 3 processing */
 
         /* Get all thrown events of stage 3 */
-        while ( ( event = pace2_get_next_event(pace2, 0) ) ) {
-            /* some additional processing is necessary */
-            if ( event->header.type == PACE2_CLASSIFICATION_RESULT ) {
-                PACE2_classification_result_event const * const classification = &event->classification_result_data;
-                u8 attribute_iterator;
-
-                protocol_counter[classification->protocol.stack.entry[classification->protocol.stack.length-1]]++;
-                protocol_counter_bytes[classification->protocol.stack.entry[classification->protocol.stack.length-1]] += out_pd->framing->stack[0].frame_length;
-                protocol_stack_length_counter[classification->protocol.stack.length - 1]++;
-                protocol_stack_length_counter_bytes[classification->protocol.stack.length - 1] += out_pd->framing->stack[0].frame_length;
-
-                application_counter[classification->application.type]++;
-                application_counter_bytes[classification->application.type] += out_pd->framing->stack[0].frame_length;
-
-                for ( attribute_iterator = 0; attribute_iterator < classification->application.attributes.length; attribute_iterator++) {
-                    attribute_counter[classification->application.attributes.list[attribute_iterator]]++;
-                    attribute_counter_bytes[classification->application.attributes.list[attribute_iterator]] += out_pd->framing->stack[0].frame_length;
-                }
-            } else if ( event->header.type == PACE2_LICENSE_EXCEEDED_EVENT ) {
-                license_exceeded_packets++;
-            } else if ( event->header.type == PACE2_CDC_RESULT ) {
-                PACE2_cdc_result_event const * const cdc = &event->cdc_data;
-
-                cdc_packets[cdc->detected_cdc_id]++;
-                cdc_bytes[cdc->detected_cdc_id] += out_pd->framing->stack[0].frame_length;
-
-            }
-        } /* Stage 3 event processing */
+        eb_drain( &s3_events, out_pd );
 
         /* Process stage 4: protocol decoding */
         if ( pace2_s4_process_packet( pace2, 0, out_pd, NULL, &pace2_event_mask ) != PACE2_S4_SUCCESS ) {
@@ -465,6 +523,9 @@ static void pace_cleanup_and_exit( void )
     /* Output detection results */
     pace_print_results();
 
+    eb_destroy( &s3_events );
+    eb_destroy( &s4_events );
+
     /* Destroy PACE 2 module and free memory */
     pace2_exit_module( pace2 );
 } /* pace_cleanup_and_exit */
@@ -482,6 +543,7 @@ int main( int argc, char **argv )
 
     /* Initialize PACE 2 */
     pace_configure_and_initialize( license_file );
+    init_event_batches();
 
     /* Read the pcap file and pass packets to stage1_and_2 */
     if ( read_pcap_loop( argv[1], config.general.clock_ticks_per_second, &stage1_and_2 ) != 0 ) {
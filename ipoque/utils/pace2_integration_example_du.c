@@ -15,6 +15,7 @@
 #include <pace2.h>
 #include "read_pcap.h"
 #include "event_handler.h"
+#include "event_batch.h"
 
 #include <stdio.h>
 #include <unistd.h>
@@ -45,6 +46,12 @@ static u64 next_packet_id = 0;
 
 static u64 license_exceeded_packets = 0;
 
+/* Events are drained from the queue in batches of at most this size */
+#define EVENT_BATCH_SIZE 64
+
+/* Event dispatcher of stage 3 */
+static struct event_batch s3_events;
+
 static const char * du_library_file = NULL;
 static u64 du_load_at = 100;
 static u64 du_activate_at = 100;
@@ -201,9 +208,53 @@ static void pace_configure_and_initialize( const char * const license_file )
 
 } /* pace_configure_and_initialize */
 
+/* Count the classification results of a batch of stage 3 events */
+static void handle_classification_results( PACE2_event * const *events, u32 count, PACE2_packet_descriptor const *pd, void *user_data )
+{
+    const u32 frame_length = pd->framing->stack[0].frame_length;
+    u32 i;
+
+    for ( i = 0; i < count; i++ ) {
+        PACE2_classification_result_event const * const classification = &events[i]->classification_result_data;
+        u8 attribute_iterator;
+
+        protocol_counter[classification->protocol.stack.entry[classification->protocol.stack.length-1]]++;
+        protocol_counter_bytes[classification->protocol.stack.entry[classification->protocol.stack.length-1]] += frame_length;
+        protocol_stack_length_counter[classification->protocol.stack.length - 1]++;
+        protocol_stack_length_counter_bytes[classification->protocol.stack.length - 1] += frame_length;
+
+        application_counter[classification->application.type]++;
+        application_counter_bytes[classification->application.type] += frame_length;
+
+        for ( attribute_iterator = 0; attribute_iterator < classification->application.attributes.length; attribute_iterator++) {
+            attribute_counter[classification->application.attributes.list[attribute_iterator]]++;
+            attribute_counter_bytes[classification->application.attributes.list[attribute_iterator]] += frame_length;
+        }
+    }
+} /* handle_classification_results */
+
+static void handle_license_exceeded( PACE2_event * const *events, u32 count, PACE2_packet_descriptor const *pd, void *user_data )
+{
+    license_exceeded_packets += count;
+} /* handle_license_exceeded */
+
+/* Set up the event dispatcher of stage 3 */
+static void init_event_batches( void )
+{
+    int consumer;
+
+    if ( eb_init( &s3_events, pace2, 0, EVENT_BATCH_SIZE ) != 0 ) {
+        panic( "Allocation of the event batch failed\n" );
+    }
+
+    /* Stage 3 events are only counted, all others are dropped */
+    consumer = eb_add_consumer( &s3_events, "counters" );
+    eb_subscribe( &s3_events, consumer, PACE2_CLASSIFICATION_RESULT, handle_classification_results, NULL );
+    eb_subscribe( &s3_events, consumer, PACE2_LICENSE_EXCEEDED_EVENT, handle_license_exceeded, NULL );
+} /* init_event_batches */
+
 static void stage3_to_5( void )
 {
-    const PACE2_event *event;
     PACE2_bitmask pace2_event_mask;
     struct pace2_packet_descriptor *out_pd;
 
@@ -220,28 +271,7 @@ static void stage3_to_5( void )
         } /* Stage 3 processing */
 
         /* Get all thrown events of stage 3 */
-        while ( ( event = pace2_get_next_event(pace2, 0) ) ) {
-            /* some additional processing is necessary */
-            if ( event->header.type == PACE2_CLASSIFICATION_RESULT ) {
-                PACE2_classification_result_event const * const classification = &event->classification_result_data;
-                u8 attribute_iterator;
-
-                protocol_counter[classification->protocol.stack.entry[classification->protocol.stack.length-1]]++;
-                protocol_counter_bytes[classification->protocol.stack.entry[classification->protocol.stack.length-1]] += out_pd->framing->stack[0].frame_length;
-                protocol_stack_length_counter[classification->protocol.stack.length - 1]++;
-                protocol_stack_length_counter_bytes[classification->protocol.stack.length - 1] += out_pd->framing->stack[0].frame_length;
-
-                application_counter[classification->application.type]++;
-                application_counter_bytes[classification->application.type] += out_pd->framing->stack[0].frame_length;
-
-                for ( attribute_iterator = 0; attribute_iterator < classification->application.attributes.length; attribute_iterator++) {
-                    attribute_counter[classification->application.attributes.list[attribute_iterator]]++;
-                    attribute_counter_bytes[classification->application.attributes.list[attribute_iterator]] += out_pd->framing->stack[0].frame_length;
-                }
-            } else if ( event->header.type == PACE2_LICENSE_EXCEEDED_EVENT ) {
-                license_exceeded_packets++;
-            }
-        }
+        eb_drain( &s3_events, out_pd );
     } /* Stage 2 packets */
 
     /* Process stage 5: timeout handling */
@@ -299,6 +329,8 @@ static void pace_cleanup_and_exit( void )
     /* Output detection results */
     pace_print_results();
 
+    eb_destroy( &s3_events );
+
     /* Destroy PACE 2 module and free memory */
     pace2_exit_module( pace2 );
 } /* pace_cleanup_and_exit */
@@ -354,6 +386,7 @@ int main( int argc, char **argv )
 
     /* Initialize PACE 2 */
     pace_configure_and_initialize( license_file );
+    init_event_batches();
 
     /* Read the pcap file and pass packets to stage1_and_2 */
     if ( read_pcap_loop( trace_file, config.general.clock_ticks_per_second, &stage1_and_2 ) != 0 ) {
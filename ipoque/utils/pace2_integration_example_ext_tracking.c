@@ -8,6 +8,18 @@
  **
  ** This is a simple program to show the integration of the PACE 2 library.
  ** The program uses external tracking with the PACE 2 polling hash table.
+ ** Flows expire through a timer wheel with separate timeouts for half open
+ ** and established TCP, UDP and other flows.
+ ** If a snapshot path is given as third parameter, the flow and subscriber state
+ ** is restored from it on start and written to it on exit, SIGUSR1 and SIGTERM.
+ ** Built with EXT_TRACKING_FLOW_TABLE, the flows are kept in the open addressing
+ ** table of flow_table.c instead.
+ ** IPv4 flows are kept in a table with the packed 16 byte key of flow_key.h,
+ ** only IPv6 flows use the full 40 byte key.
+ ** With the flow table, packets are processed in bursts: the flows of all
+ ** packets of a burst are prefetched before the first one is processed.
+ ** The flow tables start small and grow between the bursts in bounded steps
+ ** when they fill up, see flow_table_autosize.h.
  **/
 /********************************************************************************/
 #ifdef WIN32
@@ -19,11 +31,25 @@
 #include <pace2.h>
 #include "read_pcap.h"
 #include "event_handler.h"
+#include "event_batch.h"
+#include "timer_wheel.h"
+#include "flow_checkpoint.h"
+#include "flow_key.h"
+#ifdef EXT_TRACKING_FLOW_TABLE
+#include "flow_table.h"
+#include "flow_table_autosize.h"
+#endif
 
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <signal.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <netinet/tcp.h>
+#endif
 
 /* PACE 2 module pointer */
 static PACE2_module *pace2 = NULL;
@@ -31,10 +57,91 @@ static PACE2_module *pace2 = NULL;
 /* PACE 2 configuration structure */
 static struct PACE2_global_config config;
 
-/* Flow and subscriber hash tables */
-static struct pace2_pht *flow_pht;
+/* Flow and subscriber hash tables, the flows are kept in one table for IPv4 and one for IPv6 */
+#ifdef EXT_TRACKING_FLOW_TABLE
+/* Initial and maximum number of flows kept in the open addressing flow tables */
+static const u32 flow_table_elements[FLOW_TABLES] = { 64 * 1024, 16 * 1024 };
+static const u32 flow_table_limit[FLOW_TABLES] = { 4 * 1024 * 1024, 1024 * 1024 };
+static struct flow_table *flow_table[FLOW_TABLES];
+
+/* Grow the flow tables between the bursts */
+static struct flow_table_autosize flow_table_autosize[FLOW_TABLES];
+static const char *flow_table_name[FLOW_TABLES] = { "ipv4", "ipv6" };
+
+/* Packets are collected into bursts, the IPv4 flows of a burst are prefetched together */
+#define PACKET_BURST_SIZE 16
+#define MAX_PACKET_SIZE 65535
+
+struct burst_packet {
+    u64 time;
+    u16 ipsize;
+    /* set if the packed key was built from the IPv4 header and its flow was prefetched */
+    u8 prefetched;
+    struct flow_key_v4 key;
+    u64 hash;
+    u8 data[MAX_PACKET_SIZE];
+};
+
+static struct burst_packet packet_burst[PACKET_BURST_SIZE];
+static u32 packet_burst_count = 0;
+
+/* packet of the burst which is processed, NULL outside of a burst */
+static const struct burst_packet *current_burst_packet = NULL;
+
+/* lookups which used the prefetched key and hash, and those which had to hash again */
+static u64 prefetch_hits = 0;
+static u64 prefetch_misses = 0;
+#else
+/* Memory of the flow hash tables */
+static const u64 flow_pht_memory[FLOW_TABLES] = { 4 * 1024 * 1024, 1024 * 1024 };
+static struct pace2_pht *flow_pht[FLOW_TABLES];
+#endif
 static struct pace2_pht *subscr_pht;
 
+/* Flow timeouts per timeout class in seconds */
+#define FLOW_TIMEOUT_TCP_HALF_OPEN 30
+#define FLOW_TIMEOUT_TCP_ESTABLISHED (10 * 60)
+#define FLOW_TIMEOUT_UDP (2 * 60)
+#define FLOW_TIMEOUT_OTHER 60
+
+/* The hash table timeout is only a fallback, flows expire through the timer wheel */
+#define FLOW_TABLE_TIMEOUT (2 * FLOW_TIMEOUT_TCP_ESTABLISHED)
+
+enum flow_timeout_class {
+    FLOW_CLASS_TCP_HALF_OPEN,
+    FLOW_CLASS_TCP_ESTABLISHED,
+    FLOW_CLASS_UDP,
+    FLOW_CLASS_OTHER
+};
+
+/* Element of the flow hash table, the PACE 2 flow memory follows at EXT_FLOW_HEADER_SIZE */
+struct ext_flow {
+    struct tw_timer timer;
+    ipoque_unique_flow_ipv4_and_6_struct_t key;
+    /* set after a FIN or RST, the flow expires like a half open one then */
+    u8 closing;
+};
+
+#define EXT_FLOW_HEADER_SIZE ( ( sizeof( struct ext_flow ) + 15 ) & ~15 )
+
+static inline void *ext_flow_data( struct ext_flow * const flow )
+{
+    return (u8 *) flow + EXT_FLOW_HEADER_SIZE;
+}
+
+/* Expiry of the tracked flows */
+static struct timer_wheel flow_timers;
+static void flow_expired( struct timer_wheel * const tw, struct tw_timer * const timer, void * const user_ptr );
+static void reserve_flow( const ipoque_unique_flow_ipv4_and_6_struct_t * const key );
+
+/* Flow state snapshot, written on SIGTERM, SIGUSR1 and at exit and restored on start */
+#define CHECKPOINT_VERIFY_THREADS 4
+static const char *checkpoint_path = NULL;
+static volatile sig_atomic_t checkpoint_requested = 0;
+static volatile sig_atomic_t stop_requested = 0;
+static u64 current_time = 0;
+static void pace_cleanup_and_exit( void );
+
 /* Result counters */
 static u64 packet_counter = 0;
 static u64 byte_counter = 0;
@@ -51,6 +158,12 @@ static u64 next_packet_id = 0;
 
 static u64 license_exceeded_packets = 0;
 
+/* Events are drained from the queue in batches of at most this size */
+#define EVENT_BATCH_SIZE 64
+
+/* Event dispatcher of stage 3 */
+static struct event_batch s3_events;
+
 /* Protocol, application and attribute name strings */
 static const char *prot_long_str[] = { PACE2_PROTOCOLS_LONG_STRS };
 static const char *app_str[] = { PACE2_APPLICATIONS_SHORT_STRS };
@@ -124,6 +237,8 @@ static void pace_print_results( void )
 
     fprintf( stderr, "\n" );
     fprintf( stderr, "Packet counter: %llu\n", packet_counter );
+    fprintf( stderr, "Flow timers: %llu armed, %llu expired, %llu cascaded\n",
+             flow_timers.armed, flow_timers.expired, flow_timers.cascaded );
     fprintf( stderr, "\n" );
 
     if ( license_exceeded_packets > 0 ) {
@@ -134,6 +249,8 @@ static void pace_print_results( void )
 /* Configure and initialize PACE 2 module and hash tables. */
 static void pace_configure_and_initialize(  const char * const license_file )
 {
+    u8 t;
+
     /* Initialize configuration with default values */
     pace2_init_default_config( &config );
     pace2_set_license_config( &config, license_file );
@@ -199,38 +316,86 @@ static void pace_configure_and_initialize(  const char * const license_file )
         }
     } /* Licensing */
 
-    { /* Flow hash table */
+#ifdef EXT_TRACKING_FLOW_TABLE
+    for ( t = 0; t < FLOW_TABLES; t++ ) { /* Flow tables */
+        struct ft_config ft_conf;
+
+        /* Initialize config structure */
+        ft_init_default_config( &ft_conf, config.general.clock_ticks_per_second );
+
+        /* IPv4 flows use the packed key, IPv6 flows the one built by pace2_build_flow_key */
+        ft_conf.key_size = t == FLOW_TABLE_V4 ? FLOW_KEY_V4_SIZE : FLOW_KEY_FULL_SIZE;
+
+        /* The table reserves the memory of all elements up to the limit, but starts small */
+        ft_conf.max_elements = flow_table_elements[t];
+        ft_conf.limit_elements = flow_table_limit[t];
+
+        /* The size of memory required for every element. */
+        ft_conf.user_buffer_size = EXT_FLOW_HEADER_SIZE + pace2_get_flow_memory_size( pace2, 0 );
+
+        /* Fallback element timeout. */
+        ft_conf.timeout = FLOW_TABLE_TIMEOUT * config.general.clock_ticks_per_second;
+
+        flow_table[t] = ft_create( &ft_conf );
+
+        if ( flow_table[t] == NULL ) {
+            panic( "Initialization of flow table failed\n" );
+        }
+
+        {
+            struct fta_config fta_conf;
+
+            fta_init_default_config( &fta_conf );
+            fta_init( &flow_table_autosize[t], &fta_conf, flow_table[t], flow_table_name[t] );
+        }
+    } /* Flow tables */
+#else
+    for ( t = 0; t < FLOW_TABLES; t++ ) { /* Flow hash tables */
         struct PACE2_pht_config pht_conf;
 
         /* Initialize config structure */
         pace2_pht_init_default_config( &pht_conf );
 
-        /* Use 4MB memory for the hash table */
-        pht_conf.memory_size = 4 * 1024 * 1024;
+        /* Most of the memory goes to the IPv4 table */
+        pht_conf.memory_size = flow_pht_memory[t];
 
         /* Set the size of the element key. For flows the 5 tuple
            (src ip [16], dst ip [16], src port [2], dst port [2], l4 protocol [1]) is used.
            This makes a total of 37 bytes for the key, however they key size must be
-           a multiple of 4 which is why 40 is used here. The unused bytes will be zeroed out. */
-        pht_conf.unique_key_size = 40;
+           a multiple of 4 which is why 40 is used for IPv6. The unused bytes will be zeroed out.
+           IPv4 flows use the packed 16 byte key of flow_key.h. */
+        pht_conf.unique_key_size = t == FLOW_TABLE_V4 ? FLOW_KEY_V4_SIZE : FLOW_KEY_FULL_SIZE;
 
         /* The size of memory required for every element. */
-        pht_conf.user_buffer_size = pace2_get_flow_memory_size( pace2, 0 );
+        pht_conf.user_buffer_size = EXT_FLOW_HEADER_SIZE + pace2_get_flow_memory_size( pace2, 0 );
 
-        /* 10 Minutes element timeout. */
-        pht_conf.timeout = 10 * 60 * config.general.clock_ticks_per_second;
+        /* Fallback element timeout. */
+        pht_conf.timeout = FLOW_TABLE_TIMEOUT * config.general.clock_ticks_per_second;
 
         /* Set memory allocation/deallocation functions for the hash table */
         pht_conf.ipq_malloc = malloc_wrapper;
         pht_conf.ipq_free = free_wrapper;
 
         /* Initialize the hash table */
-        flow_pht = pace2_pht_create( &pht_conf, 0 );
+        flow_pht[t] = pace2_pht_create( &pht_conf, 0 );
 
-        if ( flow_pht == NULL ) {
+        if ( flow_pht[t] == NULL ) {
             panic( "Initialization of flow hash table failed\n" );
         }
-    } /* Flow hash table */
+    } /* Flow hash tables */
+#endif
+
+    { /* Flow timers */
+        const u64 ticks_per_second = config.general.clock_ticks_per_second;
+
+        /* Expire flows with a resolution of 100ms */
+        tw_init( &flow_timers, ticks_per_second / 10, flow_expired, NULL );
+
+        tw_set_timeout( &flow_timers, FLOW_CLASS_TCP_HALF_OPEN, FLOW_TIMEOUT_TCP_HALF_OPEN * ticks_per_second );
+        tw_set_timeout( &flow_timers, FLOW_CLASS_TCP_ESTABLISHED, FLOW_TIMEOUT_TCP_ESTABLISHED * ticks_per_second );
+        tw_set_timeout( &flow_timers, FLOW_CLASS_UDP, FLOW_TIMEOUT_UDP * ticks_per_second );
+        tw_set_timeout( &flow_timers, FLOW_CLASS_OTHER, FLOW_TIMEOUT_OTHER * ticks_per_second );
+    } /* Flow timers */
 
     { /* Subscriber hash table */
         struct PACE2_pht_config pht_conf;
@@ -280,29 +445,364 @@ static void *pace2_get_subscriber( PACE2_packet_descriptor * const pd, const u8
     return subscr;
 } /* pace2_get_subscriber */
 
-static void *pace2_get_flow( PACE2_packet_descriptor * const pd,
-                             const uint64_t time)
+/* Looks up a flow and inserts it if it does not exist */
+static struct ext_flow *insert_flow( const ipoque_unique_flow_ipv4_and_6_struct_t * const key, u8 * const new_flow )
+{
+    struct flow_key_v4 compact;
+    enum flow_key_table t;
+    const u8 * const table_key = flow_key_for_table( key, &compact, &t );
+#ifdef EXT_TRACKING_FLOW_TABLE
+    struct ext_flow *flow;
+
+    /* The key PACE 2 built for the packet matches the prefetched one unless it was tunneled */
+    if ( current_burst_packet != NULL && current_burst_packet->prefetched && t == FLOW_TABLE_V4 &&
+         memcmp( &current_burst_packet->key, &compact, sizeof( compact ) ) == 0 ) {
+        prefetch_hits++;
+        flow = ft_insert_hashed( flow_table[t], table_key, current_burst_packet->hash, new_flow );
+    } else {
+        if ( current_burst_packet != NULL ) {
+            prefetch_misses++;
+        }
+        flow = ft_insert( flow_table[t], table_key, new_flow );
+    }
+
+    if ( flow != NULL && *new_flow != 0 ) {
+        /* Initialize flow memory */
+        memset( flow, 0, ft_get_user_buffer_size( flow_table[t] ) );
+        flow->key = *key;
+    }
+#else
+    struct ext_flow * const flow = pace2_pht_insert( flow_pht[t], table_key, new_flow );
+
+    if ( flow != NULL && *new_flow != 0 ) {
+        /* Initialize flow memory */
+        memset( flow, 0, pace2_pht_get_user_buffer_size( flow_pht[t] ) );
+        flow->key = *key;
+    }
+#endif
+
+    return flow;
+} /* insert_flow */
+
+/* Removes a flow from its hash table */
+static void delete_flow( struct ext_flow * const flow )
+{
+    struct flow_key_v4 compact;
+    enum flow_key_table t;
+    const u8 * const table_key = flow_key_for_table( &flow->key, &compact, &t );
+
+#ifdef EXT_TRACKING_FLOW_TABLE
+    ft_delete( flow_table[t], table_key );
+#else
+    pace2_pht_delete( flow_pht[t], table_key );
+#endif
+} /* delete_flow */
+
+/* Sets the current timestamp of the flow hash tables */
+static void set_flow_timestamp( const u64 time )
+{
+    u8 t;
+
+    for ( t = 0; t < FLOW_TABLES; t++ ) {
+#ifdef EXT_TRACKING_FLOW_TABLE
+        ft_set_timestamp( flow_table[t], time );
+#else
+        pace2_pht_set_timestamp( flow_pht[t], time );
+#endif
+    }
+} /* set_flow_timestamp */
+
+static struct ext_flow *pace2_get_flow( PACE2_packet_descriptor * const pd,
+                                        const uint64_t time)
 {
     ipoque_unique_flow_ipv4_and_6_struct_t key;
 
     if ( pace2_build_flow_key( pd, &key, NULL, 0 ) == PACE2_SUCCESS ) {
         u8 new_flow;
-        void * const flow = pace2_pht_insert( flow_pht, (u8 *) &key, &new_flow );
 
-        if ( flow != NULL && new_flow != 0 ) {
-            /* Initialize flow memory */
-            memset( flow, 0, pace2_pht_get_user_buffer_size( flow_pht ) );
-        }
-
-        return flow;
+        return insert_flow( &key, &new_flow );
     }
 
     return NULL;
 } /* pace2_get_flow */
 
-static void stage3_to_5( void )
+/* Selects the timeout class of a flow from the packet it saw last */
+static u8 flow_timeout_class( const PACE2_packet_descriptor * const pd, struct ext_flow * const flow )
+{
+    u32 i;
+
+    for ( i = 0; i < pd->framing->stack_size; i++ ) {
+        const PACE2_packet_frame_descriptor * const frame = &pd->framing->stack[i];
+
+        if ( frame->type == TCP ) {
+            if ( frame->frame_data.tcp->fin || frame->frame_data.tcp->rst ) {
+                flow->closing = 1;
+            }
+
+            if ( flow->closing || frame->frame_data.tcp->syn ) {
+                return FLOW_CLASS_TCP_HALF_OPEN;
+            }
+
+            return FLOW_CLASS_TCP_ESTABLISHED;
+        }
+
+        if ( frame->type == UDP ) {
+            return FLOW_CLASS_UDP;
+        }
+    }
+
+    return FLOW_CLASS_OTHER;
+} /* flow_timeout_class */
+
+/* Timeout class of a restored flow, only the protocol is known */
+static u8 restored_flow_timeout_class( const struct ext_flow * const flow )
+{
+    switch ( flow->key.protocol ) {
+        case IPPROTO_TCP:
+            return FLOW_CLASS_TCP_ESTABLISHED;
+        case IPPROTO_UDP:
+            return FLOW_CLASS_UDP;
+        default:
+            return FLOW_CLASS_OTHER;
+    }
+} /* restored_flow_timeout_class */
+
+static double monotonic_seconds( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+} /* monotonic_seconds */
+
+/* Writes the dumps of all flows and subscribers into the snapshot file */
+static void write_checkpoint( void )
+{
+    struct fc_writer writer;
+    u8 dump[PACE2_PHT_DUMP_DATA_SIZE];
+    const double start = monotonic_seconds();
+    u8 *key;
+    void *element;
+    PACE2_timestamp ts;
+    PACE2_pht_return_state state;
+    u8 t;
+
+    if ( fc_writer_open( &writer, checkpoint_path, sizeof( ipoque_unique_flow_ipv4_and_6_struct_t ),
+                         sizeof( PACE2_subscriber_key ), current_time ) != 0 ) {
+        fprintf( stderr, "Could not create checkpoint %s\n", checkpoint_path );
+        return;
+    }
+
+    /* The snapshot keeps the full flow key of the element, it does not depend on the table layout */
+    for ( t = 0; t < FLOW_TABLES; t++ ) {
+#ifdef EXT_TRACKING_FLOW_TABLE
+        u32 iterator = 0;
+
+        while ( ( element = ft_get_next_element( flow_table[t], &iterator, &ts ) ) ) {
+            struct ext_flow * const flow = element;
+
+            pace2_pht_dump_flow_data( pace2, 0, ext_flow_data( flow ), dump );
+            fc_write_record( &writer, FC_FLOWS, (const u8 *) &flow->key, ts, dump );
+        }
+#else
+        pace2_pht_foreach_init( flow_pht[t] );
+        do {
+            element = NULL;
+            state = pace2_pht_foreach_get_next_element( flow_pht[t], &key, &element, &ts );
+
+            if ( element != NULL && ( state == PACE2_PHT_SUCCESS || state == PACE2_PHT_MORE_ELEMENTS ) ) {
+                struct ext_flow * const flow = element;
+
+                pace2_pht_dump_flow_data( pace2, 0, ext_flow_data( flow ), dump );
+                fc_write_record( &writer, FC_FLOWS, (const u8 *) &flow->key, ts, dump );
+            }
+        } while ( state == PACE2_PHT_MORE_ELEMENTS );
+#endif
+    }
+
+    pace2_pht_foreach_init( subscr_pht );
+    do {
+        element = NULL;
+        state = pace2_pht_foreach_get_next_element( subscr_pht, &key, &element, &ts );
+
+        if ( element != NULL && ( state == PACE2_PHT_SUCCESS || state == PACE2_PHT_MORE_ELEMENTS ) ) {
+            pace2_pht_dump_id_data( pace2, 0, element, dump );
+            fc_write_record( &writer, FC_SUBSCRIBERS, key, ts, dump );
+        }
+    } while ( state == PACE2_PHT_MORE_ELEMENTS );
+
+    if ( fc_writer_close( &writer ) != 0 ) {
+        fprintf( stderr, "Could not write checkpoint %s\n", checkpoint_path );
+        return;
+    }
+
+    fprintf( stderr, "Checkpoint of %llu flows and %llu subscribers written in %.3f s\n",
+             writer.hdr.record_count[FC_FLOWS], writer.hdr.record_count[FC_SUBSCRIBERS],
+             monotonic_seconds() - start );
+} /* write_checkpoint */
+
+/* Inserts a flow or subscriber of the snapshot and loads its dump */
+static u8 restore_element( u32 thread_index, enum fc_section section, const u8 *key,
+                           u64 timestamp, const u8 *dump, void *user_ptr )
+{
+    u8 new_element = 0;
+
+    if ( section == FC_FLOWS ) {
+        ipoque_unique_flow_ipv4_and_6_struct_t flow_key;
+        struct ext_flow *flow;
+
+        memcpy( &flow_key, key, sizeof( flow_key ) );
+
+        /* A snapshot may hold more flows than the table, the oldest ones are pushed out and released */
+        reserve_flow( &flow_key );
+        flow = insert_flow( &flow_key, &new_element );
+        if ( flow == NULL || new_element == 0 ) {
+            return 1;
+        }
+
+        pace2_pht_load_flow_dump( pace2, 0, ext_flow_data( flow ), dump );
+        tw_arm( &flow_timers, &flow->timer, restored_flow_timeout_class( flow ) );
+    } else {
+        void * const subscr = pace2_pht_insert( subscr_pht, key, &new_element );
+
+        if ( subscr == NULL || new_element == 0 ) {
+            return 1;
+        }
+
+        memset( subscr, 0, pace2_pht_get_user_buffer_size( subscr_pht ) );
+        pace2_pht_load_id_dump( pace2, 0, subscr, dump );
+    }
+
+    return 0;
+} /* restore_element */
+
+/* Restores the flows and subscribers of the snapshot file, if there is one */
+static void restore_checkpoint( void )
+{
+    struct fc_snapshot snapshot;
+    u64 restored[FC_NUMBER_OF_SECTIONS];
+    const double start = monotonic_seconds();
+    double verified;
+#ifdef EXT_TRACKING_FLOW_TABLE
+    u8 t;
+#endif
+
+    if ( fc_open( &snapshot, checkpoint_path ) != 0 ) {
+        return;
+    }
+
+    /* The file is checked in parallel, the hash tables are filled by one thread */
+    if ( fc_verify( &snapshot, CHECKPOINT_VERIFY_THREADS ) != 0 ) {
+        fprintf( stderr, "Ignoring damaged checkpoint %s\n", checkpoint_path );
+        fc_close( &snapshot );
+        return;
+    }
+    verified = monotonic_seconds();
+
+#ifdef EXT_TRACKING_FLOW_TABLE
+    /* Grow the flow tables for the flows of the snapshot, any of them may get all */
+    for ( t = 0; t < FLOW_TABLES; t++ ) {
+        const u64 wanted = ft_used_elements( flow_table[t] ) + fc_record_count( &snapshot, FC_FLOWS );
+        const u32 capacity = wanted < ft_limit( flow_table[t] ) ? (u32) wanted : ft_limit( flow_table[t] );
+
+        if ( capacity > ft_capacity( flow_table[t] ) && ft_grow( flow_table[t], capacity ) == 0 ) {
+            /* The tables are still empty, moving their buckets is cheap */
+            while ( ft_resize_step( flow_table[t], ft_capacity( flow_table[t] ) ) ) {
+            }
+        }
+    }
+#endif
+
+    /* Restored elements get the timestamp of the checkpoint */
+    current_time = snapshot.hdr->timestamp;
+    set_flow_timestamp( current_time );
+    pace2_pht_set_timestamp( subscr_pht, current_time );
+    tw_advance( &flow_timers, current_time );
+
+    fc_restore( &snapshot, 1, restore_element, NULL, restored );
+
+    fprintf( stderr, "Restored %llu of %llu flows and %llu of %llu subscribers in %.3f s (%.3f s verification)\n",
+             restored[FC_FLOWS], fc_record_count( &snapshot, FC_FLOWS ),
+             restored[FC_SUBSCRIBERS], fc_record_count( &snapshot, FC_SUBSCRIBERS ),
+             monotonic_seconds() - start, verified - start );
+
+    fc_close( &snapshot );
+} /* restore_checkpoint */
+
+static void checkpoint_signal_handler( int signal_number )
+{
+    checkpoint_requested = 1;
+
+    if ( signal_number == SIGTERM ) {
+        stop_requested = 1;
+    }
+} /* checkpoint_signal_handler */
+
+/* Returns the next flow which timed out, was pushed out or cleared */
+static struct ext_flow *next_flow_to_remove( void )
+{
+    struct ext_flow *flow = NULL;
+    u8 t;
+
+    for ( t = 0; t < FLOW_TABLES && flow == NULL; t++ ) {
+#ifdef EXT_TRACKING_FLOW_TABLE
+        flow = ft_get_next_element_to_remove( flow_table[t], NULL, NULL );
+#else
+        flow = pace2_pht_get_next_element_to_remove( flow_pht[t], NULL, NULL );
+#endif
+    }
+
+    return flow;
+} /* next_flow_to_remove */
+
+/* Count the classification results of a batch of stage 3 events */
+static void handle_classification_results( PACE2_event * const *events, u32 count, PACE2_packet_descriptor const *pd, void *user_data )
+{
+    const u32 frame_length = pd->framing->stack[0].frame_length;
+    u32 i;
+
+    for ( i = 0; i < count; i++ ) {
+        PACE2_classification_result_event const * const classification = &events[i]->classification_result_data;
+        u8 attribute_iterator;
+
+        protocol_counter[classification->protocol.stack.entry[classification->protocol.stack.length-1]]++;
+        protocol_counter_bytes[classification->protocol.stack.entry[classification->protocol.stack.length-1]] += frame_length;
+        protocol_stack_length_counter[classification->protocol.stack.length - 1]++;
+        protocol_stack_length_counter_bytes[classification->protocol.stack.length - 1] += frame_length;
+
+        application_counter[classification->application.type]++;
+        application_counter_bytes[classification->application.type] += frame_length;
+
+        for ( attribute_iterator = 0; attribute_iterator < classification->application.attributes.length; attribute_iterator++) {
+            attribute_counter[classification->application.attributes.list[attribute_iterator]]++;
+            attribute_counter_bytes[classification->application.attributes.list[attribute_iterator]] += frame_length;
+        }
+    }
+} /* handle_classification_results */
+
+static void handle_license_exceeded( PACE2_event * const *events, u32 count, PACE2_packet_descriptor const *pd, void *user_data )
+{
+    license_exceeded_packets += count;
+} /* handle_license_exceeded */
+
+/* Set up the event dispatcher of stage 3 */
+static void init_event_batches( void )
+{
+    int consumer;
+
+    if ( eb_init( &s3_events, pace2, 0, EVENT_BATCH_SIZE ) != 0 ) {
+        panic( "Allocation of the event batch failed\n" );
+    }
+
+    /* Stage 3 events are only counted, all others are dropped */
+    consumer = eb_add_consumer( &s3_events, "counters" );
+    eb_subscribe( &s3_events, consumer, PACE2_CLASSIFICATION_RESULT, handle_classification_results, NULL );
+    eb_subscribe( &s3_events, consumer, PACE2_LICENSE_EXCEEDED_EVENT, handle_license_exceeded, NULL );
+} /* init_event_batches */
+
+static void stage3_and_4( void )
 {
-    const PACE2_event *event;
     PACE2_bitmask pace2_event_mask;
     PACE2_packet_descriptor *out_pd;
 
@@ -332,39 +832,91 @@ static void stage3_to_5( void )
         } /* Stage 3 */
 
         /* Get all thrown events of stage 3 */
-        while ( ( event = pace2_get_next_event(pace2, 0) ) ) {
-            /* some additional processing is necessary */
-            if ( event->header.type == PACE2_CLASSIFICATION_RESULT ) {
-                PACE2_classification_result_event const * const classification = &event->classification_result_data;
-                u8 attribute_iterator;
-
-                protocol_counter[classification->protocol.stack.entry[classification->protocol.stack.length-1]]++;
-                protocol_counter_bytes[classification->protocol.stack.entry[classification->protocol.stack.length-1]] += out_pd->framing->stack[0].frame_length;
-                protocol_stack_length_counter[classification->protocol.stack.length - 1]++;
-                protocol_stack_length_counter_bytes[classification->protocol.stack.length - 1] += out_pd->framing->stack[0].frame_length;
-
-                application_counter[classification->application.type]++;
-                application_counter_bytes[classification->application.type] += out_pd->framing->stack[0].frame_length;
-
-                for ( attribute_iterator = 0; attribute_iterator < classification->application.attributes.length; attribute_iterator++) {
-                    attribute_counter[classification->application.attributes.list[attribute_iterator]]++;
-                    attribute_counter_bytes[classification->application.attributes.list[attribute_iterator]] += out_pd->framing->stack[0].frame_length;
-                }
-            } else if ( event->header.type == PACE2_LICENSE_EXCEEDED_EVENT ) {
-                license_exceeded_packets++;
-            }
+        eb_drain( &s3_events, out_pd );
+    }
+}
+
+/* Called by the timer wheel for every flow which timed out */
+static void flow_expired( struct timer_wheel * const tw, struct tw_timer * const timer, void * const user_ptr )
+{
+    struct ext_flow * const flow = (struct ext_flow *) timer;
+
+    pace2_release_flow( pace2, 0, ext_flow_data( flow ) );
+
+    delete_flow( flow );
+
+    stage3_and_4();
+} /* flow_expired */
+
+/* Releases a flow which was removed from the hash table */
+static void release_removed_flow( struct ext_flow * const flow )
+{
+    tw_cancel( &flow_timers, &flow->timer );
+
+    pace2_release_flow( pace2, 0, ext_flow_data( flow ) );
+
+    stage3_and_4();
+} /* release_removed_flow */
+
+/* Reserves an element for the next insert into the table of a key, a full table pushes out its oldest flow */
+static void reserve_flow( const ipoque_unique_flow_ipv4_and_6_struct_t * const key )
+{
+    struct flow_key_v4 compact;
+    enum flow_key_table t;
+    PACE2_pht_return_state reserved;
+
+    flow_key_for_table( key, &compact, &t );
+#ifdef EXT_TRACKING_FLOW_TABLE
+    reserved = ft_reserve_elements( flow_table[t], 1 );
+#else
+    reserved = pace2_pht_reserve_elements( flow_pht[t], 1 );
+#endif
+    if ( reserved == PACE2_PHT_OUT_OF_MEMORY ) {
+        struct ext_flow *p;
+
+        while ( ( p = next_flow_to_remove() ) ) {
+            release_removed_flow( p );
         }
     }
+} /* reserve_flow */
+
+/* Runs once per wheel tick: the timeout handling of stage 5 and the release of the flows
+   which exceeded the fallback timeout of the hash tables */
+static void handle_timeouts( void )
+{
+    PACE2_bitmask pace2_event_mask;
+    struct ext_flow *p;
 
     /* Process stage 5: timeout handling */
-    if ( pace2_s5_handle_timeout( pace2, 0, &pace2_event_mask ) != 0 ) {
-        return;
+    pace2_s5_handle_timeout( pace2, 0, &pace2_event_mask );
+
+    while ( ( p = next_flow_to_remove() ) ) {
+        release_removed_flow( p );
     }
-}
+} /* handle_timeouts */
 
 static void stage1_and_2( const uint64_t time, const struct iphdr *iph, uint16_t ipsize )
 {
     PACE2_packet_descriptor pd;
+    struct ext_flow *flow;
+
+    /* Checkpoints are written between packets */
+    if ( checkpoint_requested ) {
+        checkpoint_requested = 0;
+
+        if ( checkpoint_path != NULL ) {
+            write_checkpoint();
+        }
+
+        if ( stop_requested ) {
+            /* The snapshot is complete, it is not written again at exit */
+            checkpoint_path = NULL;
+            pace_cleanup_and_exit();
+            exit( 0 );
+        }
+    }
+
+    current_time = time;
 
     /* Stage 1: Prepare packet descriptor and run ip defragmentation */
     if (pace2_s1_process_packet( pace2, 0, time, iph, ipsize, PACE2_S1_L3, &pd, NULL, 0 ) != PACE2_S1_SUCCESS) {
@@ -372,50 +924,123 @@ static void stage1_and_2( const uint64_t time, const struct iphdr *iph, uint16_t
     }
 
     /* Set the current timestamp for the hash tables */
-    pace2_pht_set_timestamp( flow_pht, time );
+    set_flow_timestamp( time );
     pace2_pht_set_timestamp( subscr_pht, time );
 
+    /* Expire the flows which timed out and handle the other timeouts once per wheel tick */
+    {
+        const u64 tick = flow_timers.tick;
+
+        tw_advance( &flow_timers, time );
+        if ( flow_timers.tick != tick ) {
+            handle_timeouts();
+        }
+    }
+
     /* Set unique packet id. */
     pd.packet_id = ++next_packet_id;
 
     /* Do flow tracking and set the flow pointer. */
-    pd.flow_data = pace2_get_flow(&pd, time);
+    flow = pace2_get_flow(&pd, time);
 
-    if (pd.flow_data == NULL) {
+    if (flow == NULL) {
         return;
     }
 
+    pd.flow_data = ext_flow_data( flow );
+
+    /* Restart the expiry of the flow */
+    tw_arm( &flow_timers, &flow->timer, flow_timeout_class( &pd, flow ) );
+
     /* Stage 2: Packet reordering */
     if ( pace2_s2_process_packet( pace2, 0, &pd ) != PACE2_S2_SUCCESS ) {
         return;
     }
 
-    stage3_to_5();
+    stage3_and_4();
 
-    /* Reserve flow elements for the next insert */
-    pace2_pht_reserve_elements( flow_pht, 1 );
-    {
-        void *p;
+    /* Reserve an element for the next insert in the table of the flow */
+    reserve_flow( &flow->key );
+} /* stage1_and_2 */
+
+#ifdef EXT_TRACKING_FLOW_TABLE
+/* Prefetches the flows of the collected packets and processes them */
+static void process_packet_burst( void )
+{
+    const u8 *keys[PACKET_BURST_SIZE];
+    u64 hashes[PACKET_BURST_SIZE];
+    u32 key_count = 0;
+    u32 i;
+
+    /* Keys and hashes of all packets first, so the cache misses of their lookups overlap */
+    for ( i = 0; i < packet_burst_count; i++ ) {
+        struct burst_packet * const packet = &packet_burst[i];
+
+        packet->prefetched = flow_key_from_ipv4_header( packet->data, packet->ipsize, &packet->key );
+        if ( packet->prefetched ) {
+            keys[key_count++] = (const u8 *) &packet->key;
+        }
+    }
 
-        while ( ( p = pace2_pht_get_next_element_to_remove( flow_pht, NULL, NULL ) ) ) {
-            pace2_release_flow( pace2, 0, p );
+    ft_prefetch( flow_table[FLOW_TABLE_V4], keys, hashes, key_count );
 
-            stage3_to_5();
+    for ( i = 0, key_count = 0; i < packet_burst_count; i++ ) {
+        struct burst_packet * const packet = &packet_burst[i];
+
+        if ( packet->prefetched ) {
+            packet->hash = hashes[key_count++];
         }
+
+        current_burst_packet = packet;
+        stage1_and_2( packet->time, (const struct iphdr *) packet->data, packet->ipsize );
     }
-} /* stage1_and_2 */
+
+    current_burst_packet = NULL;
+    packet_burst_count = 0;
+
+    /* Grow the flow tables between the bursts, never while flow pointers are in use */
+    for ( i = 0; i < FLOW_TABLES; i++ ) {
+        fta_run( &flow_table_autosize[i] );
+    }
+} /* process_packet_burst */
+
+/* Called for every packet of the pcap file, the packet is only valid during the call */
+static void collect_packet( const uint64_t time, const struct iphdr *iph, uint16_t ipsize )
+{
+    struct burst_packet * const packet = &packet_burst[packet_burst_count];
+
+    packet->time = time;
+    packet->ipsize = ipsize;
+    memcpy( packet->data, iph, ipsize );
+
+    if ( ++packet_burst_count == PACKET_BURST_SIZE ) {
+        process_packet_burst();
+    }
+} /* collect_packet */
+#endif
 
 static void pace_cleanup_and_exit( void )
 {
-    /* Clear the flow hash table and handle each removed flow. */
-    pace2_pht_clear( flow_pht );
-    {
-        void *p;
+    u8 t;
 
-        while ( ( p = pace2_pht_get_next_element_to_remove( flow_pht, NULL, NULL ) ) ) {
-            pace2_release_flow( pace2, 0, p );
+    /* Keep the classification state for the next start */
+    if ( checkpoint_path != NULL ) {
+        write_checkpoint();
+    }
 
-            stage3_to_5();
+    /* Clear the flow hash tables and handle each removed flow. */
+    for ( t = 0; t < FLOW_TABLES; t++ ) {
+#ifdef EXT_TRACKING_FLOW_TABLE
+        ft_clear( flow_table[t] );
+#else
+        pace2_pht_clear( flow_pht[t] );
+#endif
+    }
+    {
+        struct ext_flow *p;
+
+        while ( ( p = next_flow_to_remove() ) ) {
+            release_removed_flow( p );
         }
     }
 
@@ -423,13 +1048,21 @@ static void pace_cleanup_and_exit( void )
     pace2_flush_engine( pace2, 0 );
 
     /* Process packets which are ejected after flushing */
-    stage3_to_5();
+    stage3_and_4();
 
     /* Output detection results */
     pace_print_results();
 
+    eb_destroy( &s3_events );
+
     /* Destroy the hash tables */
-    pace2_pht_destroy( flow_pht );
+    for ( t = 0; t < FLOW_TABLES; t++ ) {
+#ifdef EXT_TRACKING_FLOW_TABLE
+        ft_destroy( flow_table[t] );
+#else
+        pace2_pht_destroy( flow_pht[t] );
+#endif
+    }
     pace2_pht_destroy( subscr_pht );
 
     /* Destroy PACE 2 module and free memory */
@@ -447,13 +1080,48 @@ int main( int argc, char **argv )
         license_file = argv[2];
     }
 
+    if ( argc > 3 ) {
+        checkpoint_path = argv[3];
+    }
+
     /* Initialize PACE 2 */
     pace_configure_and_initialize( license_file );
+    init_event_batches();
+
+    if ( checkpoint_path != NULL ) {
+        restore_checkpoint();
+
+        /* SIGUSR1 writes a checkpoint, SIGTERM writes one and exits */
+        signal( SIGUSR1, checkpoint_signal_handler );
+        signal( SIGTERM, checkpoint_signal_handler );
+    }
+
+#ifdef EXT_TRACKING_FLOW_TABLE
+    /* Read the pcap file and pass bursts of packets to stage1_and_2 */
+    if ( read_pcap_loop( argv[1], config.general.clock_ticks_per_second, &collect_packet ) != 0 ) {
+        panic( "could not open pcap interface / file\n" );
+    }
 
+    /* The last, incomplete burst */
+    process_packet_burst();
+
+    fprintf( stderr, "Flow lookups with prefetched key: %llu, without: %llu\n", prefetch_hits, prefetch_misses );
+
+    {
+        u8 t;
+
+        for ( t = 0; t < FLOW_TABLES; t++ ) {
+            fprintf( stderr, "Flow table %s: capacity %u, at most %u used, %llu resizes, longest resize step %.1f us\n",
+                     flow_table_name[t], ft_capacity( flow_table[t] ), ft_maximum_number_of_used_elements( flow_table[t] ),
+                     flow_table_autosize[t].resizes, flow_table_autosize[t].max_step_ns / 1e3 );
+        }
+    }
+#else
     /* Read the pcap file and pass packets to stage1_and_2 */
     if ( read_pcap_loop( argv[1], config.general.clock_ticks_per_second, &stage1_and_2 ) != 0 ) {
         panic( "could not open pcap interface / file\n" );
     }
+#endif
 
     pace_cleanup_and_exit();
 
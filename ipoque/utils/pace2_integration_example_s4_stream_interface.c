@@ -31,6 +31,7 @@
 #endif
 
 #include "event_handler.h"
+#include "event_batch.h"
 #include "basic_reassembly.h"
 #ifdef WIN32
 #include "windows_compat.h"
@@ -66,6 +67,22 @@ static u64 next_packet_id = 0;
 
 static u64 license_exceeded_packets = 0;
 
+/* Events are drained from the queue in batches of at most this size */
+#define EVENT_BATCH_SIZE 64
+
+/* Event dispatchers of stage 3 and of stages 4 and 5 */
+static struct event_batch s3_events;
+static struct event_batch s4_events;
+
+static u64 reassembly_gaps = 0;
+static u64 reassembly_gap_bytes = 0;
+
+/* Memory limits of the TCP reassembly */
+#define REASSEMBLY_MEMORY_LIMIT (256 * 1024 * 1024)
+#define REASSEMBLY_FLOW_LIMIT (8 * 1024 * 1024)
+
+static struct br_budget reassembly_budget;
+
 /* Protocol, application and attribute name strings */
 static const char *prot_long_str[] = { PACE2_PROTOCOLS_LONG_STRS };
 static const char *app_str[] = { PACE2_APPLICATIONS_SHORT_STRS };
@@ -105,13 +122,7 @@ static void panic( const char *msg )
 
 static void process_events(void)
 {
-    PACE2_event *event;
-
-    while ( ( event = pace2_get_next_event( pace2, 0 ) ) ) {
-        /* call generic event handler */
-        pace2_debug_event(stdout, event);
-
-    }
+    eb_drain( &s4_events, NULL );
 }
 
 /* Print classification results to stderr */
@@ -155,6 +166,31 @@ static void pace_print_results( void )
     if ( license_exceeded_packets > 0 ) {
         fprintf( stderr, "License exceeded packets: %llu.\n\n", license_exceeded_packets );
     }
+
+    if ( reassembly_gaps > 0 ) {
+        fprintf( stderr, "Skipped reassembly gaps: %llu (%llu bytes).\n\n", reassembly_gaps, reassembly_gap_bytes );
+    }
+
+    {
+        struct br_stats br_stats;
+
+        br_get_stats( &br_stats );
+        if ( br_stats.direct_packets + br_stats.copied_packets > 0 ) {
+            fprintf( stderr, "Reassembly without copy: %llu packets, %llu bytes (%llu bytes stored for later).\n",
+                     br_stats.direct_packets, br_stats.direct_bytes, br_stats.tail_bytes );
+            fprintf( stderr, "Reassembly with copy: %llu packets, %llu bytes.\n",
+                     br_stats.copied_packets, br_stats.copied_bytes );
+            fprintf( stderr, "Reassembly chunks: %llu bytes kept as received, %llu bytes linearized.\n\n",
+                     br_stats.chunked_bytes, br_stats.linearized_bytes );
+        }
+    }
+
+    if ( reassembly_budget.peak_bytes > 0 ) {
+        fprintf( stderr, "Reassembly memory: %llu bytes used, %llu bytes peak, limit %llu bytes.\n",
+                 reassembly_budget.used_bytes, reassembly_budget.peak_bytes, reassembly_budget.max_bytes );
+        fprintf( stderr, "Reassembly evictions: %llu flows, %llu flow limit hits, %llu bytes.\n\n",
+                 reassembly_budget.evictions, reassembly_budget.flow_limit_hits, reassembly_budget.evicted_bytes );
+    }
 } /* pace_print_results */
 
 /* Configure and initialize PACE 2 module and hash tables. */
@@ -226,6 +262,20 @@ static void pace_configure_and_initialize( const char * const license_file )
         }
     }
 
+    {
+        struct br_config br_conf;
+
+        /* Keep out of order TCP segments and skip missing data after 5 seconds */
+        br_init_default_config(&br_conf);
+        br_conf.gap_timeout = 5 * config.general.clock_ticks_per_second;
+        /* in order payload is decoded in place, br_remove_data is called right after decoding */
+        br_conf.zero_copy = 1;
+        br_set_config(&br_conf);
+
+        /* all flows are handled by one thread, so they share one budget */
+        br_budget_init(&reassembly_budget, REASSEMBLY_MEMORY_LIMIT, REASSEMBLY_FLOW_LIMIT);
+    }
+
     {
         struct PACE2_pht_config pht_conf;
 
@@ -261,9 +311,74 @@ static void pace_configure_and_initialize( const char * const license_file )
 
 } /* pace_initialization */
 
+/* Count the classification results of a batch of stage 3 events */
+static void handle_classification_results( PACE2_event * const *events, u32 count, PACE2_packet_descriptor const *pd, void *user_data )
+{
+    const u32 frame_length = pd->framing->stack[0].frame_length;
+    u32 i;
+
+    for ( i = 0; i < count; i++ ) {
+        PACE2_classification_result_event const * const classification = &events[i]->classification_result_data;
+        u8 attribute_iterator;
+
+        protocol_counter[classification->protocol.stack.entry[classification->protocol.stack.length-1]]++;
+        protocol_counter_bytes[classification->protocol.stack.entry[classification->protocol.stack.length-1]] += frame_length;
+        protocol_stack_length_counter[classification->protocol.stack.length - 1]++;
+        protocol_stack_length_counter_bytes[classification->protocol.stack.length - 1] += frame_length;
+
+        application_counter[classification->application.type]++;
+        application_counter_bytes[classification->application.type] += frame_length;
+
+        for ( attribute_iterator = 0; attribute_iterator < classification->application.attributes.length; attribute_iterator++) {
+            attribute_counter[classification->application.attributes.list[attribute_iterator]]++;
+            attribute_counter_bytes[classification->application.attributes.list[attribute_iterator]] += frame_length;
+        }
+    }
+} /* handle_classification_results */
+
+static void handle_license_exceeded( PACE2_event * const *events, u32 count, PACE2_packet_descriptor const *pd, void *user_data )
+{
+    license_exceeded_packets += count;
+} /* handle_license_exceeded */
+
+/* Print out every stage 3 event, the counted ones as well */
+static void print_events( PACE2_event * const *events, u32 count, PACE2_packet_descriptor const *pd, void *user_data )
+{
+    u32 i;
+
+    for ( i = 0; i < count; i++ ) {
+        pace2_debug_event(stdout, events[i]);
+    }
+} /* print_events */
+
+/* Set up the event dispatchers of stage 3 and of stages 4 and 5 */
+static void init_event_batches( void )
+{
+    int consumer;
+    int type;
+
+    if ( eb_init( &s3_events, pace2, 0, EVENT_BATCH_SIZE ) != 0 || eb_init( &s4_events, pace2, 0, EVENT_BATCH_SIZE ) != 0 ) {
+        panic( "Allocation of the event batches failed\n" );
+    }
+
+    /* Stage 3 events are counted */
+    consumer = eb_add_consumer( &s3_events, "counters" );
+    eb_subscribe( &s3_events, consumer, PACE2_CLASSIFICATION_RESULT, handle_classification_results, NULL );
+    eb_subscribe( &s3_events, consumer, PACE2_LICENSE_EXCEEDED_EVENT, handle_license_exceeded, NULL );
+
+    /* and printed out after they are counted */
+    consumer = eb_add_consumer( &s3_events, "output" );
+    for ( type = 0; type < EB_NUMBER_OF_TYPES; type++ ) {
+        eb_subscribe( &s3_events, consumer, type, print_events, NULL );
+    }
+
+    /* Decoder events are printed out, grouped by type */
+    consumer = eb_add_consumer( &s4_events, "output" );
+    eb_subscribe_default( &s4_events, consumer, print_events, NULL );
+} /* init_event_batches */
+
 static void stage3_to_5( struct custom_flow_data * const flow, ipoque_unique_flow_ipv4_and_6_struct_t *flow_key )
 {
-    const PACE2_event *event;
     PACE2_bitmask pace2_event_mask;
     PACE2_packet_descriptor *out_pd;
     PACE2_stream_descriptor sd;
@@ -290,30 +405,7 @@ static void stage3_to_5( struct custom_flow_data * const flow, ipoque_unique_flo
         }
 
         /* Get all thrown events of stage 3 */
-        while ( ( event = pace2_get_next_event(pace2, 0) ) ) {
-            /* some additional processing is necessary */
-            if ( event->header.type == PACE2_CLASSIFICATION_RESULT ) {
-                PACE2_classification_result_event const * const classification = &event->classification_result_data;
-                u8 attribute_iterator;
-
-                protocol_counter[classification->protocol.stack.entry[classification->protocol.stack.length-1]]++;
-                protocol_counter_bytes[classification->protocol.stack.entry[classification->protocol.stack.length-1]] += out_pd->framing->stack[0].frame_length;
-                protocol_stack_length_counter[classification->protocol.stack.length - 1]++;
-                protocol_stack_length_counter_bytes[classification->protocol.stack.length - 1] += out_pd->framing->stack[0].frame_length;
-
-                application_counter[classification->application.type]++;
-                application_counter_bytes[classification->application.type] += out_pd->framing->stack[0].frame_length;
-
-                for ( attribute_iterator = 0; attribute_iterator < classification->application.attributes.length; attribute_iterator++) {
-                    attribute_counter[classification->application.attributes.list[attribute_iterator]]++;
-                    attribute_counter_bytes[classification->application.attributes.list[attribute_iterator]] += out_pd->framing->stack[0].frame_length;
-                }
-            } else if ( event->header.type == PACE2_LICENSE_EXCEEDED_EVENT ) {
-                license_exceeded_packets++;
-            }
-
-            pace2_debug_event(stdout, event);
-        }
+        eb_drain( &s3_events, out_pd );
 
         pace2_s4_prepare_stream( pace2, 0, out_pd, &sd );
 
@@ -337,11 +429,18 @@ static void stage3_to_5( struct custom_flow_data * const flow, ipoque_unique_flo
         }
 
         if (is_tcp) {
-            br_add_data(&flow->rfd, tcp_seq, payload, payload_length, out_pd->direction, tcp_syn);
-            sd.stream[0] = flow->rfd.buf[0];
-            sd.stream[1] = flow->rfd.buf[1];
-            sd.stream_length[0] = flow->rfd.data_length[0];
-            sd.stream_length[1] = flow->rfd.data_length[1];
+            if (br_add_data(&flow->rfd, tcp_seq, payload, payload_length, out_pd->direction, tcp_syn, out_pd->packet_ts) == BR_GAP) {
+                /* the decoder continues behind data that never arrived */
+                printf("Reassembly gap of %u bytes in direction %u of flow %llu\n",
+                       flow->rfd.gap_length[out_pd->direction], out_pd->direction, out_pd->flow_id);
+                reassembly_gaps++;
+                reassembly_gap_bytes += flow->rfd.gap_length[out_pd->direction];
+            }
+            /* out of order data is only copied into one piece up to the window the decoder needs */
+            sd.stream_length[0] = br_get_view(&flow->rfd, 0);
+            sd.stream_length[1] = br_get_view(&flow->rfd, 1);
+            sd.stream[0] = br_get_data(&flow->rfd, 0);
+            sd.stream[1] = br_get_data(&flow->rfd, 1);
         } else {
             sd.stream[out_pd->direction] = payload;
             sd.stream_length[out_pd->direction] = payload_length;
@@ -392,6 +491,7 @@ static void stage1_and_2( const uint64_t time, const struct iphdr *iph, uint16_t
 
             if ( new_flow != 0 ) {
                 memset(flow, 0, pace2_pht_get_user_buffer_size(flow_pht));
+                br_set_budget(&flow->rfd, &reassembly_budget);
             }
 
             /* Set pointer to the PACE 2 flow data. */
@@ -446,9 +546,15 @@ static void pace_cleanup_and_exit( void )
     /* Output detection results */
     pace_print_results();
 
+    eb_destroy( &s3_events );
+    eb_destroy( &s4_events );
+
     /* Destroy the hash tables */
     pace2_pht_destroy(flow_pht);
 
+    /* Free the buffers kept for reuse by the reassembly */
+    br_pool_cleanup();
+
     /* Destroy PACE 2 module and free memory */
     pace2_exit_module( pace2 );
 } /* pace_cleanup_and_exit */
@@ -469,6 +575,7 @@ int main( int argc, char **argv )
 #endif
     /* Initialize PACE 2 */
     pace_configure_and_initialize( license_file );
+    init_event_batches();
 
     /* Read the pcap file and pass packets to stage1_and_2 */
     if ( read_pcap_loop( argv[1], config.general.clock_ticks_per_second, &stage1_and_2 ) != 0 ) {
@@ -31,7 +31,9 @@
 #include "windows_compat.h"
 #endif /*WIN32*/
 #include "event_handler.h"
+#include "event_batch.h"
 #include "basic_reassembly.h"
+#include "flow_key.h"
 
 /* Custom flow data structure */
 struct custom_flow_data {
@@ -47,8 +49,8 @@ static PACE2_module *pace2_decoding = NULL;
 static struct PACE2_global_config config_p2_s3;
 static struct PACE2_global_config config_p2_s4;
 
-/* Flow and subscriber hash tables */
-static struct pace2_pht *flow_pht;
+/* Flow hash tables, one with the packed key for IPv4 flows and one with the full key for IPv6 flows */
+static struct pace2_pht *flow_pht[FLOW_TABLES];
 
 /* Result counters */
 static u64 packet_counter = 0;
@@ -66,6 +68,23 @@ static u64 next_packet_id = 0;
 
 static u64 license_exceeded_packets = 0;
 
+/* Events are drained from the queue in batches of at most this size */
+#define EVENT_BATCH_SIZE 64
+
+/* Event dispatchers of stage 3, of the decoding module and of the timeout handling of the classification module */
+static struct event_batch s3_events;
+static struct event_batch s4_events;
+static struct event_batch s5_events;
+
+static u64 reassembly_gaps = 0;
+static u64 reassembly_gap_bytes = 0;
+
+/* Memory limits of the TCP reassembly */
+#define REASSEMBLY_MEMORY_LIMIT (256 * 1024 * 1024)
+#define REASSEMBLY_FLOW_LIMIT (8 * 1024 * 1024)
+
+static struct br_budget reassembly_budget;
+
 /* Protocol, application and attribute name strings */
 static const char *prot_long_str[] = { PACE2_PROTOCOLS_LONG_STRS };
 static const char *app_str[] = { PACE2_APPLICATIONS_SHORT_STRS };
@@ -103,15 +122,9 @@ static void panic( const char *msg )
     exit( 1 );
 } /* panic */
 
-static void process_events(PACE2_module *pace)
+static void process_events(struct event_batch *eb)
 {
-    PACE2_event *event;
-
-    while ( ( event = pace2_get_next_event( pace, 0 ) ) ) {
-        /* call generic event handler */
-        pace2_debug_event(stdout, event);
-
-    }
+    eb_drain( eb, NULL );
 }
 
 /* Print classification results to stderr */
@@ -155,11 +168,38 @@ static void pace_print_results( void )
     if ( license_exceeded_packets > 0 ) {
         fprintf( stderr, "License exceeded packets: %llu.\n\n", license_exceeded_packets );
     }
+
+    if ( reassembly_gaps > 0 ) {
+        fprintf( stderr, "Skipped reassembly gaps: %llu (%llu bytes).\n\n", reassembly_gaps, reassembly_gap_bytes );
+    }
+
+    {
+        struct br_stats br_stats;
+
+        br_get_stats( &br_stats );
+        if ( br_stats.direct_packets + br_stats.copied_packets > 0 ) {
+            fprintf( stderr, "Reassembly without copy: %llu packets, %llu bytes (%llu bytes stored for later).\n",
+                     br_stats.direct_packets, br_stats.direct_bytes, br_stats.tail_bytes );
+            fprintf( stderr, "Reassembly with copy: %llu packets, %llu bytes.\n",
+                     br_stats.copied_packets, br_stats.copied_bytes );
+            fprintf( stderr, "Reassembly chunks: %llu bytes kept as received, %llu bytes linearized.\n\n",
+                     br_stats.chunked_bytes, br_stats.linearized_bytes );
+        }
+    }
+
+    if ( reassembly_budget.peak_bytes > 0 ) {
+        fprintf( stderr, "Reassembly memory: %llu bytes used, %llu bytes peak, limit %llu bytes.\n",
+                 reassembly_budget.used_bytes, reassembly_budget.peak_bytes, reassembly_budget.max_bytes );
+        fprintf( stderr, "Reassembly evictions: %llu flows, %llu flow limit hits, %llu bytes.\n\n",
+                 reassembly_budget.evictions, reassembly_budget.flow_limit_hits, reassembly_budget.evicted_bytes );
+    }
 } /* pace_print_results */
 
 /* Configure and initialize PACE 2 module and hash tables. */
 static void pace_configure_and_initialize( const char * const license_file )
 {
+    u8 t;
+
     /* Set generic options required for both instances */
     /* Initialize configuration with default values */
     pace2_init_default_config( &config_p2_s3 );
@@ -232,19 +272,34 @@ static void pace_configure_and_initialize( const char * const license_file )
     }
 
     {
+        struct br_config br_conf;
+
+        /* Keep out of order TCP segments and skip missing data after 5 seconds */
+        br_init_default_config(&br_conf);
+        br_conf.gap_timeout = 5 * config_p2_s3.general.clock_ticks_per_second;
+        /* in order payload is decoded in place, br_remove_data is called right after decoding */
+        br_conf.zero_copy = 1;
+        br_set_config(&br_conf);
+
+        /* all flows are handled by one thread, so they share one budget */
+        br_budget_init(&reassembly_budget, REASSEMBLY_MEMORY_LIMIT, REASSEMBLY_FLOW_LIMIT);
+    }
+
+    for ( t = 0; t < FLOW_TABLES; t++ ) {
         struct PACE2_pht_config pht_conf;
 
         /* Initialize config structure */
         pace2_pht_init_default_config(&pht_conf);
 
-        /* Use 4MB memory for the hash table */
-        pht_conf.memory_size = 4 * 1024 * 1024;
+        /* Use 4MB memory for the IPv4 and 1MB for the IPv6 hash table */
+        pht_conf.memory_size = t == FLOW_TABLE_V4 ? 4 * 1024 * 1024 : 1024 * 1024;
 
         /* Set the size of the element key. For flows the 5 tuple
            (src ip [16], dst ip [16], src port [2], dst port [2], l4 protocol [1]) is used.
            This makes a total of 37 bytes for the key, however they key size must be
-           a multiple of 4 which is why 40 is used here. The unused bytes will be zeroed out. */
-        pht_conf.unique_key_size = 40;
+           a multiple of 4 which is why 40 is used for IPv6. The unused bytes will be zeroed out.
+           IPv4 flows use the packed 16 byte key of flow_key.h. */
+        pht_conf.unique_key_size = t == FLOW_TABLE_V4 ? FLOW_KEY_V4_SIZE : FLOW_KEY_FULL_SIZE;
 
         /* The size of memory required for every element. */
         pht_conf.user_buffer_size = pace2_get_flow_memory_size(pace2_classification, 0) + sizeof(struct custom_flow_data);
@@ -257,9 +312,9 @@ static void pace_configure_and_initialize( const char * const license_file )
         pht_conf.ipq_free = free_wrapper;
 
         /* Initialize the hash table */
-        flow_pht = pace2_pht_create(&pht_conf, 0);
+        flow_pht[t] = pace2_pht_create(&pht_conf, 0);
 
-        if ( flow_pht == NULL ) {
+        if ( flow_pht[t] == NULL ) {
             panic( "Initialization of flow hash table failed\n" );
         }
     }
@@ -310,11 +365,18 @@ static void stage4(struct custom_flow_data * const flow, ipoque_unique_flow_ipv4
 
     /* reassemble payload and amend the stream descriptor. */
     if (is_tcp) {
-        br_add_data(&flow->rfd, tcp_seq, payload, payload_length, pd->direction, tcp_syn);
-        sd.stream[0] = flow->rfd.buf[0];
-        sd.stream[1] = flow->rfd.buf[1];
-        sd.stream_length[0] = flow->rfd.data_length[0];
-        sd.stream_length[1] = flow->rfd.data_length[1];
+        if (br_add_data(&flow->rfd, tcp_seq, payload, payload_length, pd->direction, tcp_syn, pd->packet_ts) == BR_GAP) {
+            /* the decoder continues behind data that never arrived */
+            printf("Reassembly gap of %u bytes in direction %u of flow %llu\n",
+                   flow->rfd.gap_length[pd->direction], pd->direction, pd->flow_id);
+            reassembly_gaps++;
+            reassembly_gap_bytes += flow->rfd.gap_length[pd->direction];
+        }
+        /* out of order data is only copied into one piece up to the window the decoder needs */
+        sd.stream_length[0] = br_get_view(&flow->rfd, 0);
+        sd.stream_length[1] = br_get_view(&flow->rfd, 1);
+        sd.stream[0] = br_get_data(&flow->rfd, 0);
+        sd.stream[1] = br_get_data(&flow->rfd, 1);
     } else {
         sd.stream[pd->direction] = payload;
         sd.stream_length[pd->direction] = payload_length;
@@ -324,7 +386,7 @@ static void stage4(struct custom_flow_data * const flow, ipoque_unique_flow_ipv4
 
     pace2_s4_process_stream( pace2_decoding, 0, &sd, token, &pace2_event_mask );
 
-    process_events(pace2_decoding);
+    process_events(&s4_events);
 
     /* throw away data not required anymore by the decoder */
     if (is_tcp) {
@@ -338,19 +400,89 @@ static void stage4_cleanup(struct custom_flow_data * const flow)
 
     pace2_release_flow(pace2_decoding, 0, flow->flow_data);
 
+    /* the element is reused by the flow table, its reassembly has to leave the budget in any case */
+    br_destroy_data(&flow->rfd);
+
     /* Process stage 5: timeout handling */
     if ( pace2_s5_handle_timeout( pace2_decoding, 0, &pace2_event_mask ) != 0 ) {
         return;
     }
 
-    process_events(pace2_decoding);
-
-    br_destroy_data(&flow->rfd);
+    process_events(&s4_events);
 }
 
+/* Count the classification results of a batch of stage 3 events */
+static void handle_classification_results( PACE2_event * const *events, u32 count, PACE2_packet_descriptor const *pd, void *user_data )
+{
+    const u32 frame_length = pd->framing->stack[0].frame_length;
+    u32 i;
+
+    for ( i = 0; i < count; i++ ) {
+        PACE2_classification_result_event const * const classification = &events[i]->classification_result_data;
+        u8 attribute_iterator;
+
+        protocol_counter[classification->protocol.stack.entry[classification->protocol.stack.length-1]]++;
+        protocol_counter_bytes[classification->protocol.stack.entry[classification->protocol.stack.length-1]] += frame_length;
+        protocol_stack_length_counter[classification->protocol.stack.length - 1]++;
+        protocol_stack_length_counter_bytes[classification->protocol.stack.length - 1] += frame_length;
+
+        application_counter[classification->application.type]++;
+        application_counter_bytes[classification->application.type] += frame_length;
+
+        for ( attribute_iterator = 0; attribute_iterator < classification->application.attributes.length; attribute_iterator++) {
+            attribute_counter[classification->application.attributes.list[attribute_iterator]]++;
+            attribute_counter_bytes[classification->application.attributes.list[attribute_iterator]] += frame_length;
+        }
+    }
+} /* handle_classification_results */
+
+static void handle_license_exceeded( PACE2_event * const *events, u32 count, PACE2_packet_descriptor const *pd, void *user_data )
+{
+    license_exceeded_packets += count;
+} /* handle_license_exceeded */
+
+/* Print out every stage 3 event, the counted ones as well */
+static void print_events( PACE2_event * const *events, u32 count, PACE2_packet_descriptor const *pd, void *user_data )
+{
+    u32 i;
+
+    for ( i = 0; i < count; i++ ) {
+        pace2_debug_event(stdout, events[i]);
+    }
+} /* print_events */
+
+/* Set up the event dispatchers of both modules */
+static void init_event_batches( void )
+{
+    int consumer;
+    int type;
+
+    if ( eb_init( &s3_events, pace2_classification, 0, EVENT_BATCH_SIZE ) != 0 ||
+         eb_init( &s4_events, pace2_decoding, 0, EVENT_BATCH_SIZE ) != 0 ||
+         eb_init( &s5_events, pace2_classification, 0, EVENT_BATCH_SIZE ) != 0 ) {
+        panic( "Allocation of the event batches failed\n" );
+    }
+
+    /* Stage 3 events are counted */
+    consumer = eb_add_consumer( &s3_events, "counters" );
+    eb_subscribe( &s3_events, consumer, PACE2_CLASSIFICATION_RESULT, handle_classification_results, NULL );
+    eb_subscribe( &s3_events, consumer, PACE2_LICENSE_EXCEEDED_EVENT, handle_license_exceeded, NULL );
+
+    /* and printed out after they are counted */
+    consumer = eb_add_consumer( &s3_events, "output" );
+    for ( type = 0; type < EB_NUMBER_OF_TYPES; type++ ) {
+        eb_subscribe( &s3_events, consumer, type, print_events, NULL );
+    }
+
+    /* Decoder and timeout events are printed out, grouped by type */
+    consumer = eb_add_consumer( &s4_events, "output" );
+    eb_subscribe_default( &s4_events, consumer, print_events, NULL );
+    consumer = eb_add_consumer( &s5_events, "output" );
+    eb_subscribe_default( &s5_events, consumer, print_events, NULL );
+} /* init_event_batches */
+
 static void stage3_to_5( struct custom_flow_data * const flow, ipoque_unique_flow_ipv4_and_6_struct_t *flow_key, u8 flush_flow)
 {
-    const PACE2_event *event;
     PACE2_bitmask pace2_event_mask;
     PACE2_packet_descriptor *out_pd;
 
@@ -369,30 +501,7 @@ static void stage3_to_5( struct custom_flow_data * const flow, ipoque_unique_flo
         }
 
         /* Get all thrown events of stage 3 */
-        while ( ( event = pace2_get_next_event(pace2_classification, 0) ) ) {
-            /* some additional processing is necessary */
-            if ( event->header.type == PACE2_CLASSIFICATION_RESULT ) {
-                PACE2_classification_result_event const * const classification = &event->classification_result_data;
-                u8 attribute_iterator;
-
-                protocol_counter[classification->protocol.stack.entry[classification->protocol.stack.length-1]]++;
-                protocol_counter_bytes[classification->protocol.stack.entry[classification->protocol.stack.length-1]] += out_pd->framing->stack[0].frame_length;
-                protocol_stack_length_counter[classification->protocol.stack.length]++;
-                protocol_stack_length_counter_bytes[classification->protocol.stack.length] += out_pd->framing->stack[0].frame_length;
-
-                application_counter[classification->application.type]++;
-                application_counter_bytes[classification->application.type] += out_pd->framing->stack[0].frame_length;
-
-                for ( attribute_iterator = 0; attribute_iterator < classification->application.attributes.length; attribute_iterator++) {
-                    attribute_counter[classification->application.attributes.list[attribute_iterator]]++;
-                    attribute_counter_bytes[classification->application.attributes.list[attribute_iterator]] += out_pd->framing->stack[0].frame_length;
-                }
-            } else if ( event->header.type == PACE2_LICENSE_EXCEEDED_EVENT ) {
-                license_exceeded_packets++;
-            }
-
-            pace2_debug_event(stdout, event);
-        }
+        eb_drain( &s3_events, out_pd );
 
         /* generate a classifier token to be able to call stage 4 with a different PACE 2 instance. */
         pace2_generate_classifier_token( pace2_classification, 0, &token );
@@ -410,12 +519,13 @@ static void stage3_to_5( struct custom_flow_data * const flow, ipoque_unique_flo
     if ( pace2_s5_handle_timeout( pace2_classification, 0, &pace2_event_mask ) != 0 ) {
         return;
     }
-    process_events(pace2_classification);
+    process_events(&s5_events);
 }
 
 static void stage1_and_2( const uint64_t time, const struct iphdr *iph, uint16_t ipsize )
 {
     PACE2_packet_descriptor pd;
+    enum flow_key_table t;
 
     /* Stage 1: Prepare packet descriptor and run ip defragmentation */
     if ( pace2_s1_process_packet( pace2_classification, 0, time, iph, ipsize, PACE2_S1_L3, &pd, NULL, 0 ) != PACE2_S1_SUCCESS ) {
@@ -428,18 +538,23 @@ static void stage1_and_2( const uint64_t time, const struct iphdr *iph, uint16_t
     {
         ipoque_unique_flow_ipv4_and_6_struct_t key;
 
-        pace2_pht_set_timestamp(flow_pht, time);
+        for ( t = 0; t < FLOW_TABLES; t++ ) {
+            pace2_pht_set_timestamp(flow_pht[t], time);
+        }
 
         if ( pace2_build_flow_key( &pd, &key, NULL, 0 ) == 0 ) {
             u8 new_flow;
-            struct custom_flow_data * const flow = (struct custom_flow_data *)pace2_pht_insert( flow_pht, (u8 *) &key, &new_flow );
+            struct flow_key_v4 compact;
+            const u8 * const table_key = flow_key_for_table( &key, &compact, &t );
+            struct custom_flow_data * const flow = (struct custom_flow_data *)pace2_pht_insert( flow_pht[t], table_key, &new_flow );
 
             if ( flow == NULL ) {
                 return;
             }
 
             if ( new_flow != 0 ) {
-                memset(flow, 0, pace2_pht_get_user_buffer_size(flow_pht));
+                memset(flow, 0, pace2_pht_get_user_buffer_size(flow_pht[t]));
+                br_set_budget(&flow->rfd, &reassembly_budget);
             }
 
             /* Set pointer to the PACE 2 flow data. */
@@ -453,11 +568,11 @@ static void stage1_and_2( const uint64_t time, const struct iphdr *iph, uint16_t
             stage3_to_5(flow, &key, 0);
 
             /* Reserve flow elements for the next insert */
-            pace2_pht_reserve_elements(flow_pht, 1);
-            {
+            pace2_pht_reserve_elements(flow_pht[t], 1);
+            for ( t = 0; t < FLOW_TABLES; t++ ) {
                 struct custom_flow_data *p;
 
-                while ( ( p = pace2_pht_get_next_element_to_remove( flow_pht, NULL, NULL ) ) ) {
+                while ( ( p = pace2_pht_get_next_element_to_remove( flow_pht[t], NULL, NULL ) ) ) {
                     pace2_release_flow(pace2_classification, 0, p->flow_data);
 
                     stage3_to_5(p, NULL, 1);
@@ -469,12 +584,15 @@ static void stage1_and_2( const uint64_t time, const struct iphdr *iph, uint16_t
 
 static void pace_cleanup_and_exit( void )
 {
-    /* Clear the flow hash table and handle each removed flow. */
-    pace2_pht_clear( flow_pht );
-    {
+    u8 t;
+
+    /* Clear the flow hash tables and handle each removed flow. */
+    for ( t = 0; t < FLOW_TABLES; t++ ) {
         struct custom_flow_data *p;
 
-        while ( ( p = pace2_pht_get_next_element_to_remove(flow_pht, NULL, NULL) ) ) {
+        pace2_pht_clear( flow_pht[t] );
+
+        while ( ( p = pace2_pht_get_next_element_to_remove(flow_pht[t], NULL, NULL) ) ) {
             pace2_release_flow( pace2_classification, 0, p->flow_data );
 
             stage3_to_5(p, NULL, 1);
@@ -490,8 +608,17 @@ static void pace_cleanup_and_exit( void )
     /* Output detection results */
     pace_print_results();
 
+    eb_destroy( &s3_events );
+    eb_destroy( &s4_events );
+    eb_destroy( &s5_events );
+
     /* Destroy the hash tables */
-    pace2_pht_destroy(flow_pht);
+    for ( t = 0; t < FLOW_TABLES; t++ ) {
+        pace2_pht_destroy(flow_pht[t]);
+    }
+
+    /* Free the buffers kept for reuse by the reassembly */
+    br_pool_cleanup();
 
     /* Destroy PACE 2 module and free memory */
     pace2_exit_module( pace2_decoding );
@@ -514,6 +641,7 @@ int main( int argc, char **argv )
 #endif
     /* Initialize PACE 2 */
     pace_configure_and_initialize( license_file );
+    init_event_batches();
 
     /* Read the pcap file and pass packets to stage1_and_2 */
     if ( read_pcap_loop( argv[1], config_p2_s3.general.clock_ticks_per_second, &stage1_and_2 ) != 0 ) {
@@ -7,7 +7,13 @@
  ** \copyright  ipoque GmbH
  **
  ** This is a simple program to show the integration of the PACE 2 library.
- ** The program uses the internal tracking feature of the library.
+ ** The flows are tracked externally by every worker thread, so the dispatcher
+ ** can move a bucket of flows from one worker to another without losing their
+ ** classification state.
+ ** Subscribers are tracked externally as well: every worker owns the subscribers
+ ** whose address falls into one of its buckets and looks them up without locking.
+ ** The workers publish their subscribers to a read-mostly view, which a control
+ ** thread queries.
  **/
 /********************************************************************************/
 
@@ -15,11 +21,15 @@
 #include <pace2.h>
 #include "read_pcap.h"
 #include "event_handler.h"
+#include "flow_migration.h"
+#include "subscriber_view.h"
+#include "event_batch.h"
 
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sched.h>
 
 #include "pthread.h"
 
@@ -52,17 +62,79 @@ static const char *app_str[] = { PACE2_APPLICATIONS_SHORT_STRS };
 
 /* best performance is achieved, when the worker thread count is 1 less than
    the number of logical cores available, so one thread is free for reading
-   and distributing the packets */
+   and distributing the packets. The number of workers is fixed at compile time,
+   only the buckets of flows move between them at runtime */
 #define EXAMPLE_THREAD_COUNT 3
 
 #define RINGBBUFFER_LAST_WRITTEN_EMPTY -1
 
+/* the dispatcher assigns flows to workers in buckets of the lower IPv4 address */
+#define FLOW_BUCKETS 256
+
+/* the load of the workers is compared after this number of packets */
+#define REBALANCE_INTERVAL 100000
+
+/* a bucket is migrated if the most loaded worker had this percentage more packets than the least loaded one */
+#define REBALANCE_THRESHOLD 25
+
+/* number of flow records which can be in transit between two workers */
+#define MIGRATION_CHANNEL_SIZE 1024
+
+/* Fallback timeout for flows in seconds. */
+#define FLOW_TABLE_TIMEOUT 600
+
+/* Timeout for subscribers in seconds. */
+#define SUBSCRIBER_TABLE_TIMEOUT 600
+
+/* the workers publish their subscribers to the view in this interval (seconds of packet time) */
+#define SUBSCRIBER_VIEW_INTERVAL 1
+
+/* Events are drained from the queue in batches of at most this size */
+#define EVENT_BATCH_SIZE 64
+
+enum ring_element_type {
+    RING_PACKET = 0,
+    /* the worker sends all flows of the bucket to the peer worker */
+    RING_MIGRATE,
+    /* the worker installs the flows of the bucket sent by the peer worker */
+    RING_WAIT
+};
+
 struct packet_struct {
     uint64_t time;
     uint16_t ipsize;
+    u8 type;
+    u8 peer;
+    u16 bucket;
     u8 packet_payload[MAX_PACKET_SIZE];
 };
 
+/* Element of the flow hash tables, the PACE 2 flow memory follows at SMP_FLOW_HEADER_SIZE */
+struct smp_flow {
+    u16 bucket;
+};
+
+#define SMP_FLOW_HEADER_SIZE ( ( sizeof( struct smp_flow ) + 15 ) & ~15 )
+
+static inline void *smp_flow_data( struct smp_flow * const flow )
+{
+    return (u8 *) flow + SMP_FLOW_HEADER_SIZE;
+}
+
+/* Element of the subscriber hash tables, the PACE 2 subscriber memory follows at SMP_SUBSCRIBER_HEADER_SIZE */
+struct smp_subscriber {
+    u16 bucket;
+    u64 last_seen;
+    u64 lookups;
+};
+
+#define SMP_SUBSCRIBER_HEADER_SIZE ( ( sizeof( struct smp_subscriber ) + 15 ) & ~15 )
+
+static inline void *smp_subscriber_data( struct smp_subscriber * const subscriber )
+{
+    return (u8 *) subscriber + SMP_SUBSCRIBER_HEADER_SIZE;
+}
+
 struct pace2_example_thread_struct {
     pthread_t thread;
 
@@ -78,6 +150,29 @@ struct pace2_example_thread_struct {
     u64 attribute_counter_bytes[PACE2_APPLICATION_ATTRIBUTES_COUNT];
     u64 license_exceeded_packets;
     u64 next_packet_id;
+    u64 migrated_flows;
+    u64 installed_flows;
+    u64 migrated_subscribers;
+    u64 installed_subscribers;
+    /* migrated subscribers which already had a copy here, the copy here was kept */
+    u64 merged_subscribers;
+    /* subscriber lookups for flows in buckets of other workers, has to stay 0 */
+    u64 foreign_subscribers;
+
+    /* event dispatchers of stage 3 and of stages 4 and 5 */
+    struct event_batch s3_events;
+    struct event_batch s4_events;
+
+    /* flows of this worker */
+    struct pace2_pht *flow_pht;
+
+    /* subscribers of the buckets owned by this worker */
+    struct pace2_pht *subscr_pht;
+    /* clock of both hash tables, only advances */
+    u64 pht_timestamp;
+    /* buckets owned by this worker, changed in the order of the ring elements */
+    u8 owned_bucket[FLOW_BUCKETS];
+    u64 next_view_publication;
 
     struct packet_struct ring_packet_buffer[RING_BUFFER_MAX_ELEMENTS];
     volatile int ring_buffer_last_written_elem;
@@ -88,6 +183,26 @@ struct pace2_example_thread_struct {
 
 } pace2_example_wt[EXAMPLE_THREAD_COUNT];
 
+/* migration_channel[source][target] */
+static struct fm_channel migration_channel[EXAMPLE_THREAD_COUNT][EXAMPLE_THREAD_COUNT];
+
+/* Dispatcher state */
+static u8 bucket_owner[FLOW_BUCKETS];
+static u64 bucket_packets[FLOW_BUCKETS];
+static u64 dispatched_packets = 0;
+static u64 migrated_buckets = 0;
+
+/* set by the dispatcher when a migration starts, cleared by the target worker */
+static volatile int migration_pending = 0;
+
+/* Published subscribers of all workers, read by the control thread */
+static struct subscriber_view subscriber_view;
+static pthread_t control_thread;
+static volatile int control_thread_done = 0;
+
+/* reader index of the control thread in the subscriber view */
+#define CONTROL_VIEW_READER 0
+
 /* Memory allocation wrappers */
 static void *malloc_wrapper( u64 size,
                              int thread_ID,
@@ -165,19 +280,142 @@ static void pace_print_results( void )
     }
 } /* pace_print_results */
 
-/* Print out all PACE 2 events currently in the event queue */
-static void process_events( u8 t_id)
+/* Count the classification results of a batch of stage 3 events */
+static void handle_classification_results( PACE2_event * const *events, u32 count, PACE2_packet_descriptor const *pd, void *user_data )
 {
-    PACE2_event *event;
+    struct pace2_example_thread_struct * const wt = user_data;
+    const u32 frame_length = pd->framing->stack[0].frame_length;
+    u32 i;
+
+    for ( i = 0; i < count; i++ ) {
+        PACE2_classification_result_event const * const classification = &events[i]->classification_result_data;
+        u8 attribute_iterator;
+
+        wt->protocol_counter[classification->protocol.stack.entry[classification->protocol.stack.length-1]]++;
+        wt->protocol_counter_bytes[classification->protocol.stack.entry[classification->protocol.stack.length-1]] += frame_length;
+        wt->protocol_stack_length_counter[classification->protocol.stack.length - 1]++;
+        wt->protocol_stack_length_counter_bytes[classification->protocol.stack.length - 1] += frame_length;
+
+        wt->application_counter[classification->application.type]++;
+        wt->application_counter_bytes[classification->application.type] += frame_length;
 
-    while ( ( event = pace2_get_next_event( pace2, t_id ) ) ) {
-        /* some additional processing is necessary */
+        for ( attribute_iterator = 0; attribute_iterator < classification->application.attributes.length; attribute_iterator++) {
+            wt->attribute_counter[classification->application.attributes.list[attribute_iterator]]++;
+            wt->attribute_counter_bytes[classification->application.attributes.list[attribute_iterator]] += frame_length;
+        }
     }
+} /* handle_classification_results */
+
+static void handle_license_exceeded( PACE2_event * const *events, u32 count, PACE2_packet_descriptor const *pd, void *user_data )
+{
+    struct pace2_example_thread_struct * const wt = user_data;
+
+    wt->license_exceeded_packets += count;
+} /* handle_license_exceeded */
+
+/* Drain all PACE 2 events currently in the event queue, no handlers are set for decoder events */
+static void process_events( u8 t_id)
+{
+    eb_drain( &pace2_example_wt[t_id].s4_events, NULL );
 } /* process_events */
 
+/* Returns the bucket of a flow from the IPv4 addresses of one of its packets in network byte order */
+static u16 flow_bucket( const u32 saddr, const u32 daddr )
+{
+    return ( ntohl( saddr ) > ntohl( daddr ) ? ntohl( daddr ) : ntohl( saddr ) ) % FLOW_BUCKETS;
+} /* flow_bucket */
+
+/* Returns the dispatcher bucket of the flow of a packet; the subscribers of both sides belong to it,
+ * so they are kept by the worker of the flow. A subscriber with flows in buckets of several workers
+ * has one copy per worker, each with the PACE state of the flows of that worker; the subscriber
+ * view merges the copies. */
+static u16 subscriber_bucket( const PACE2_packet_descriptor * const pd )
+{
+    const PACE2_packet_frame_descriptor * const frame = &pd->framing->stack[pd->framing->outer_ip_index];
+
+    /* The dispatcher uses the outer IPv4 addresses, everything else is bucket 0 */
+    if ( frame->type == IPv4 ) {
+        return flow_bucket( frame->frame_data.ipv4->saddr, frame->frame_data.ipv4->daddr );
+    }
+
+    return 0;
+} /* subscriber_bucket */
+
+/* Looks up a subscriber in the table of the worker, the worker owns the bucket of every flow it gets */
+static void *pace2_get_subscriber( PACE2_packet_descriptor * const pd, const u8 use_dst, u8 t_id )
+{
+    struct pace2_example_thread_struct * const wt = &pace2_example_wt[t_id];
+    const u16 bucket = subscriber_bucket( pd );
+    PACE2_subscriber_key key;
+    struct smp_subscriber *subscr;
+    u8 new_subscr = 0;
+
+    /* Checked at exit: the packet was dispatched to a worker which does not own its flow */
+    if ( !wt->owned_bucket[bucket] ) {
+        wt->foreign_subscribers++;
+        return NULL;
+    }
+
+    if ( pace2_build_subscriber_key( pd, &key, 0, use_dst ) != PACE2_SUCCESS ) {
+        return NULL;
+    }
+
+    subscr = pace2_pht_insert( wt->subscr_pht, (u8 *) &key.buffer[0], &new_subscr );
+    if ( subscr == NULL ) {
+        return NULL;
+    }
+
+    /* A subscriber in flows of several buckets migrates with the bucket of its first flow,
+     * this worker creates it again on its next lookup for a flow of another bucket */
+    if ( new_subscr != 0 ) {
+        memset( subscr, 0, pace2_pht_get_user_buffer_size( wt->subscr_pht ) );
+        subscr->bucket = bucket;
+    }
+
+    subscr->last_seen = pd->packet_ts;
+    subscr->lookups++;
+
+    return smp_subscriber_data( subscr );
+} /* pace2_get_subscriber */
+
+/* Publishes the subscribers of a worker to the subscriber view */
+static void publish_subscribers( u8 t_id )
+{
+    struct pace2_pht * const subscr_pht = pace2_example_wt[t_id].subscr_pht;
+    struct sv_snapshot *snapshot;
+    PACE2_pht_return_state state;
+    u32 capacity = pace2_pht_used_elements( subscr_pht );
+
+    snapshot = sv_snapshot_alloc( capacity );
+    if ( snapshot == NULL ) {
+        return;
+    }
+
+    snapshot->timestamp = pace2_example_wt[t_id].next_view_publication;
+
+    pace2_pht_foreach_init( subscr_pht );
+    do {
+        u8 *key;
+        void *element = NULL;
+        PACE2_timestamp ts;
+
+        state = pace2_pht_foreach_get_next_element( subscr_pht, &key, &element, &ts );
+
+        if ( element != NULL && snapshot->count < capacity ) {
+            struct smp_subscriber * const subscr = element;
+            struct sv_subscriber * const published = &snapshot->subscribers[snapshot->count++];
+
+            memcpy( &published->key, key, sizeof( published->key ) );
+            published->last_seen = subscr->last_seen;
+            published->lookups = subscr->lookups;
+        }
+    } while ( state == PACE2_PHT_MORE_ELEMENTS );
+
+    sv_publish( &subscriber_view, t_id, snapshot );
+} /* publish_subscribers */
+
 static void stage3_to_5( u8 t_id )
 {
-    const PACE2_event *event;
     PACE2_bitmask pace2_event_mask;
     PACE2_packet_descriptor *out_pd;
 
@@ -189,33 +427,26 @@ static void stage3_to_5( u8 t_id )
         pace2_example_wt[t_id].byte_counter += out_pd->framing->stack[0].frame_length;
 
         /* Process stage 3: packet classification */
-        if ( pace2_s3_process_packet( pace2, t_id, out_pd, &pace2_event_mask ) != PACE2_S3_SUCCESS ) {
-            continue;
+        switch ( pace2_s3_process_packet( pace2, t_id, out_pd, &pace2_event_mask ) ) {
+            case PACE2_S3_REQUIRE_SUBSCRIBER:
+                /* Do subscriber lookup for slowpath. */
+                out_pd->src_stage3 = pace2_get_subscriber( out_pd, 0, t_id );
+                out_pd->dst_stage3 = pace2_get_subscriber( out_pd, 1, t_id );
+
+                if ( pace2_s3_process_packet( pace2, t_id, out_pd, &pace2_event_mask ) != PACE2_S3_SUCCESS ) {
+                    continue;
+                }
+
+                break;
+            case PACE2_S3_SUCCESS:
+                break;
+
+            default:
+                continue;
         } /* Stage 3 processing */
 
         /* Get all thrown events of stage 3 */
-        while ( ( event = pace2_get_next_event(pace2, t_id) ) ) {
-            /* some additional processing is necessary */
-            if ( event->header.type == PACE2_CLASSIFICATION_RESULT ) {
-                PACE2_classification_result_event const * const classification = &event->classification_result_data;
-                u8 attribute_iterator;
-
-                pace2_example_wt[t_id].protocol_counter[classification->protocol.stack.entry[classification->protocol.stack.length-1]]++;
-                pace2_example_wt[t_id].protocol_counter_bytes[classification->protocol.stack.entry[classification->protocol.stack.length-1]] += out_pd->framing->stack[0].frame_length;
-                pace2_example_wt[t_id].protocol_stack_length_counter[classification->protocol.stack.length - 1]++;
-                pace2_example_wt[t_id].protocol_stack_length_counter_bytes[classification->protocol.stack.length - 1] += out_pd->framing->stack[0].frame_length;
-
-                pace2_example_wt[t_id].application_counter[classification->application.type]++;
-                pace2_example_wt[t_id].application_counter_bytes[classification->application.type] += out_pd->framing->stack[0].frame_length;
-
-                for ( attribute_iterator = 0; attribute_iterator < classification->application.attributes.length; attribute_iterator++) {
-                    pace2_example_wt[t_id].attribute_counter[classification->application.attributes.list[attribute_iterator]]++;
-                    pace2_example_wt[t_id].attribute_counter_bytes[classification->application.attributes.list[attribute_iterator]] += out_pd->framing->stack[0].frame_length;
-                }
-            } else if ( event->header.type == PACE2_LICENSE_EXCEEDED_EVENT ) {
-                pace2_example_wt[t_id].license_exceeded_packets++;
-            }
-        } /* Stage 3 event processing */
+        eb_drain( &pace2_example_wt[t_id].s3_events, out_pd );
 
         /* Process stage 4: protocol decoding */
         if ( pace2_s4_process_packet( pace2, t_id, out_pd, NULL, &pace2_event_mask ) != PACE2_S4_SUCCESS ) {
@@ -237,26 +468,286 @@ static void stage3_to_5( u8 t_id )
 
 } /* stage3_to_5 */
 
-void stage1_and_2( const uint64_t time, const struct iphdr *iph, uint16_t ipsize, u8 t_id )
+/* Releases the flows removed from the hash table of a worker */
+static void release_removed_flows( u8 t_id )
+{
+    struct smp_flow *flow;
+
+    while ( ( flow = pace2_pht_get_next_element_to_remove( pace2_example_wt[t_id].flow_pht, NULL, NULL ) ) ) {
+        pace2_release_flow( pace2, t_id, smp_flow_data( flow ) );
+        stage3_to_5( t_id );
+    }
+} /* release_removed_flows */
+
+static struct smp_flow *pace2_get_flow( PACE2_packet_descriptor * const pd, u8 t_id, u16 bucket )
+{
+    ipoque_unique_flow_ipv4_and_6_struct_t key;
+    struct pace2_pht * const flow_pht = pace2_example_wt[t_id].flow_pht;
+    struct smp_flow *flow;
+    u8 new_flow;
+
+    if ( pace2_build_flow_key( pd, &key, NULL, 0 ) != PACE2_SUCCESS ) {
+        return NULL;
+    }
+
+    flow = pace2_pht_insert( flow_pht, (const u8 *) &key, &new_flow );
+
+    if ( flow != NULL && new_flow != 0 ) {
+        /* Initialize flow memory */
+        memset( flow, 0, pace2_pht_get_user_buffer_size( flow_pht ) );
+        flow->bucket = bucket;
+    }
+
+    return flow;
+} /* pace2_get_flow */
+
+/* Advances the clock of the hash tables of a worker; the time of a late packet or of a
+   migrated flow record must not move it backwards */
+static void advance_pht_timestamp( u8 t_id, const u64 time )
+{
+    if ( time > pace2_example_wt[t_id].pht_timestamp ) {
+        pace2_example_wt[t_id].pht_timestamp = time;
+        pace2_pht_set_timestamp( pace2_example_wt[t_id].flow_pht, time );
+        pace2_pht_set_timestamp( pace2_example_wt[t_id].subscr_pht, time );
+    }
+} /* advance_pht_timestamp */
+
+void stage1_and_2( const uint64_t time, const struct iphdr *iph, uint16_t ipsize, u8 t_id, u16 bucket )
 {
     PACE2_packet_descriptor pd;
+    struct smp_flow *flow;
 
     /* Stage 1: Prepare packet descriptor and run ip defragmentation */
     if (pace2_s1_process_packet( pace2, t_id, time, iph, ipsize, PACE2_S1_L3, &pd, NULL, 0 ) != PACE2_S1_SUCCESS) {
         return;
     }
 
-    /* Set unique packet id. The flow_id is set by the internal flow tracking */
+    advance_pht_timestamp( t_id, time );
+
+    /* Set unique packet id. */
     pd.packet_id = ++pace2_example_wt[t_id].next_packet_id;
 
+    /* Do flow tracking and set the flow pointer. */
+    flow = pace2_get_flow( &pd, t_id, bucket );
+
+    if ( flow == NULL ) {
+        return;
+    }
+
+    pd.flow_data = smp_flow_data( flow );
+
     /* Stage 2: Packet reordering */
     if ( pace2_s2_process_packet( pace2, t_id, &pd ) != PACE2_S2_SUCCESS ) {
         return;
     }
 
     stage3_to_5( t_id );
+
+    /* Reserve flow elements for the next insert */
+    pace2_pht_reserve_elements( pace2_example_wt[t_id].flow_pht, 1 );
+    release_removed_flows( t_id );
+
+    if ( time >= pace2_example_wt[t_id].next_view_publication ) {
+        pace2_example_wt[t_id].next_view_publication = time + SUBSCRIBER_VIEW_INTERVAL * config.general.clock_ticks_per_second;
+        publish_subscribers( t_id );
+    }
 } /* stage1_and_2 */
 
+/* Sends all subscribers of a bucket to another worker and removes them here */
+static void migrate_subscribers( u8 t_id, u16 bucket, struct fm_channel * const channel )
+{
+    struct pace2_pht * const subscr_pht = pace2_example_wt[t_id].subscr_pht;
+    PACE2_pht_return_state state;
+    PACE2_subscriber_key *keys = NULL;
+    u32 key_count = 0;
+    u32 key_capacity = 0;
+    u32 i;
+
+    /* Packets of the bucket are not processed here anymore */
+    pace2_example_wt[t_id].owned_bucket[bucket] = 0;
+
+    pace2_pht_foreach_init( subscr_pht );
+    do {
+        u8 *key;
+        void *element;
+        PACE2_timestamp ts;
+
+        state = pace2_pht_foreach_get_next_element( subscr_pht, &key, &element, &ts );
+        if ( element == NULL || ( (struct smp_subscriber *) element )->bucket != bucket ) {
+            continue;
+        }
+
+        if ( key_count == key_capacity ) {
+            key_capacity = key_capacity ? key_capacity * 2 : 64;
+            keys = realloc( keys, (u64) key_capacity * sizeof( *keys ) );
+            if ( keys == NULL ) {
+                panic( "Allocation of migrated subscriber keys failed\n" );
+            }
+        }
+        memcpy( &keys[key_count], key, sizeof( *keys ) );
+
+        fm_send_subscriber( channel, pace2, t_id, &keys[key_count], smp_subscriber_data( element ), bucket, ts );
+        key_count++;
+    } while ( state == PACE2_PHT_MORE_ELEMENTS );
+
+    for ( i = 0; i < key_count; i++ ) {
+        pace2_pht_delete( subscr_pht, keys[i].buffer );
+    }
+
+    pace2_example_wt[t_id].migrated_subscribers += key_count;
+    free( keys );
+} /* migrate_subscribers */
+
+/* Sends all flows of a bucket to another worker and removes them here */
+static void migrate_flows( u8 t_id, u16 bucket, u8 target )
+{
+    struct pace2_pht * const flow_pht = pace2_example_wt[t_id].flow_pht;
+    struct fm_channel * const channel = &migration_channel[t_id][target];
+    PACE2_pht_return_state state;
+    u8 *keys = NULL;
+    u32 key_count = 0;
+    u32 key_capacity = 0;
+    u32 i;
+
+    /* Packets of the bucket buffered in stage 2 are processed before their flows leave */
+    pace2_flush_engine( pace2, t_id );
+    stage3_to_5( t_id );
+
+    pace2_pht_foreach_init( flow_pht );
+    do {
+        u8 *key;
+        void *element;
+        PACE2_timestamp ts;
+
+        state = pace2_pht_foreach_get_next_element( flow_pht, &key, &element, &ts );
+        if ( element == NULL ) {
+            continue;
+        }
+
+        if ( ( (struct smp_flow *) element )->bucket != bucket ) {
+            continue;
+        }
+
+        fm_send_flow( channel, pace2, t_id, key, smp_flow_data( element ), bucket, ts );
+
+        /* The hash table is not modified while it is iterated, the keys are removed afterwards */
+        if ( key_count == key_capacity ) {
+            key_capacity = key_capacity ? key_capacity * 2 : 256;
+            keys = realloc( keys, (u64) key_capacity * FM_KEY_SIZE );
+            if ( keys == NULL ) {
+                panic( "Allocation of migrated flow keys failed\n" );
+            }
+        }
+        memcpy( keys + (u64) key_count * FM_KEY_SIZE, key, FM_KEY_SIZE );
+        key_count++;
+    } while ( state == PACE2_PHT_MORE_ELEMENTS );
+
+    migrate_subscribers( t_id, bucket, channel );
+
+    fm_send_bucket_done( channel, bucket );
+
+    for ( i = 0; i < key_count; i++ ) {
+        u8 * const key = keys + (u64) i * FM_KEY_SIZE;
+        struct smp_flow * const flow = pace2_pht_lookup( flow_pht, key );
+
+        if ( flow != NULL ) {
+            pace2_release_flow( pace2, t_id, smp_flow_data( flow ) );
+            pace2_pht_delete( flow_pht, key );
+        }
+    }
+    stage3_to_5( t_id );
+
+    pace2_example_wt[t_id].migrated_flows += key_count;
+    free( keys );
+} /* migrate_flows */
+
+/* Installs the flows of a bucket sent by another worker, returns after the last one */
+static void install_flows( u8 t_id, u16 bucket, u8 source )
+{
+    struct pace2_pht * const flow_pht = pace2_example_wt[t_id].flow_pht;
+    struct fm_channel * const channel = &migration_channel[source][t_id];
+
+    for (;;) {
+        const struct fm_record * const record = fm_channel_peek( channel );
+        struct smp_flow *flow;
+        u8 new_flow;
+
+        if ( record == NULL ) {
+            sched_yield();
+            continue;
+        }
+
+        if ( record->type == FM_BUCKET_DONE && record->bucket == bucket ) {
+            fm_channel_release( channel );
+            break;
+        }
+
+        if ( record->type == FM_SUBSCRIBER ) {
+            struct pace2_pht * const subscr_pht = pace2_example_wt[t_id].subscr_pht;
+            struct smp_subscriber *subscr;
+            u8 new_subscr;
+
+            advance_pht_timestamp( t_id, record->timestamp );
+
+            subscr = pace2_pht_insert( subscr_pht, record->key, &new_subscr );
+            if ( subscr != NULL && new_subscr == 0 ) {
+                /* A flow of another bucket of this worker created a copy in the meantime, it
+                 * already holds the state of those flows and is kept */
+                if ( subscr->last_seen < record->timestamp ) {
+                    subscr->last_seen = record->timestamp;
+                }
+                pace2_example_wt[t_id].merged_subscribers++;
+            } else if ( subscr != NULL ) {
+                memset( subscr, 0, pace2_pht_get_user_buffer_size( subscr_pht ) );
+                subscr->bucket = record->bucket;
+                subscr->last_seen = record->timestamp;
+                pace2_pht_load_id_dump( pace2, t_id, smp_subscriber_data( subscr ), record->dump );
+                pace2_example_wt[t_id].installed_subscribers++;
+            }
+        }
+
+        if ( record->type == FM_FLOW ) {
+            /* The flow is accessed at the later of its last access and the clock of this worker */
+            advance_pht_timestamp( t_id, record->timestamp );
+
+            pace2_pht_reserve_elements( flow_pht, 1 );
+            release_removed_flows( t_id );
+
+            flow = pace2_pht_insert( flow_pht, record->key, &new_flow );
+            if ( flow != NULL ) {
+                if ( new_flow == 0 ) {
+                    pace2_release_flow( pace2, t_id, smp_flow_data( flow ) );
+                }
+                memset( flow, 0, pace2_pht_get_user_buffer_size( flow_pht ) );
+                flow->bucket = record->bucket;
+                pace2_pht_load_flow_dump( pace2, t_id, smp_flow_data( flow ), record->dump );
+                pace2_example_wt[t_id].installed_flows++;
+            }
+        }
+
+        fm_channel_release( channel );
+    }
+
+    pace2_example_wt[t_id].owned_bucket[bucket] = 1;
+    migration_pending = 0;
+} /* install_flows */
+
+static void process_ring_element( struct pace2_example_thread_struct *thread_struct, const struct packet_struct *element )
+{
+    switch ( element->type ) {
+        case RING_PACKET:
+            stage1_and_2( element->time, (const struct iphdr *)&element->packet_payload[0],
+                          element->ipsize, thread_struct->thread_id, element->bucket );
+            break;
+        case RING_MIGRATE:
+            migrate_flows( thread_struct->thread_id, element->bucket, element->peer );
+            break;
+        case RING_WAIT:
+            install_flows( thread_struct->thread_id, element->bucket, element->peer );
+            break;
+    }
+} /* process_ring_element */
+
 void *worker_thread_main(void *t)
 {
     struct pace2_example_thread_struct *thread_struct = (struct pace2_example_thread_struct *)t;
@@ -277,10 +768,7 @@ void *worker_thread_main(void *t)
 
         next_buffer_id_to_process = (thread_struct->ring_buffer_last_read_elem + 1) % RING_BUFFER_MAX_ELEMENTS;
         // process
-        stage1_and_2( thread_struct->ring_packet_buffer[next_buffer_id_to_process].time,
-                      (const struct iphdr *)&thread_struct->ring_packet_buffer[next_buffer_id_to_process].packet_payload[0],
-                      thread_struct->ring_packet_buffer[next_buffer_id_to_process].ipsize,
-                      thread_struct->thread_id );
+        process_ring_element( thread_struct, &thread_struct->ring_packet_buffer[next_buffer_id_to_process] );
 
         thread_struct->ring_buffer_last_read_elem = next_buffer_id_to_process;
 
@@ -303,20 +791,21 @@ void *worker_thread_main(void *t)
     /* Process packets which are ejected after flushing */
     stage3_to_5( thread_struct->thread_id );
 
+    /* Clear the flow hash table and handle each removed flow. */
+    pace2_pht_clear( thread_struct->flow_pht );
+    release_removed_flows( thread_struct->thread_id );
+
+    /* The final state of the subscribers stays visible in the view */
+    publish_subscribers( thread_struct->thread_id );
+
     return NULL;
 }
 
-void packet_distribution(const uint64_t time, const struct iphdr *iph, uint16_t ipsize)
+/* Returns the next free element of the ring of a worker, it is passed with ring_commit */
+static struct packet_struct *ring_reserve( u8 t_id )
 {
-    u8 t_id = 0;
     u16 next_buffer_id_to_write;
 
-    if (iph->version == 4) {
-        u_int32_t used_addr = ntohl(iph->saddr) > ntohl(iph->daddr) ? ntohl(iph->daddr) : ntohl(iph->saddr);
-        t_id = used_addr % EXAMPLE_THREAD_COUNT;
-    }
-
-    // copy the packet to the corresponding q and wakeup the correspnding worker thread
     next_buffer_id_to_write = (pace2_example_wt[t_id].ring_buffer_last_written_elem + 1) % RING_BUFFER_MAX_ELEMENTS;
 
     // fall asleep if nothing was read so far or the buffer is full
@@ -327,19 +816,149 @@ void packet_distribution(const uint64_t time, const struct iphdr *iph, uint16_t
         usleep( 0 );
     }
 
-    pace2_example_wt[t_id].ring_packet_buffer[next_buffer_id_to_write].time = time;
-    pace2_example_wt[t_id].ring_packet_buffer[next_buffer_id_to_write].ipsize = ipsize;
-    memcpy( &pace2_example_wt[t_id].ring_packet_buffer[next_buffer_id_to_write].packet_payload[0],
-            iph,
-            ipsize );
+    return &pace2_example_wt[t_id].ring_packet_buffer[next_buffer_id_to_write];
+} /* ring_reserve */
+
+static void ring_commit( u8 t_id )
+{
+    pace2_example_wt[t_id].ring_buffer_last_written_elem =
+        (pace2_example_wt[t_id].ring_buffer_last_written_elem + 1) % RING_BUFFER_MAX_ELEMENTS;
+} /* ring_commit */
+
+/* Moves a bucket and the state of its flows to another worker. The source worker
+   sends the flows after the packets already queued for it, the target worker
+   installs them before the packets which are queued for it from now on. */
+static void migrate_bucket( u16 bucket, u8 target )
+{
+    const u8 source = bucket_owner[bucket];
+    struct packet_struct *element;
+
+    if ( source == target ) {
+        return;
+    }
+
+    /* Only one migration is in flight, so a worker never waits for a channel while another one waits for it */
+    while ( migration_pending ) {
+        usleep( 0 );
+    }
+    migration_pending = 1;
+
+    element = ring_reserve( source );
+    element->type = RING_MIGRATE;
+    element->bucket = bucket;
+    element->peer = target;
+    ring_commit( source );
+
+    bucket_owner[bucket] = target;
+
+    element = ring_reserve( target );
+    element->type = RING_WAIT;
+    element->bucket = bucket;
+    element->peer = source;
+    ring_commit( target );
+
+    migrated_buckets++;
+} /* migrate_bucket */
+
+/* Moves a bucket from the most to the least loaded worker if the load differs too much */
+static void rebalance( void )
+{
+    u64 load[EXAMPLE_THREAD_COUNT];
+    u8 max = 0;
+    u8 min = 0;
+    u16 b;
+    u16 best = FLOW_BUCKETS;
+    u64 best_packets = 0;
+    u8 i;
+
+    memset( load, 0, sizeof(load) );
+    for ( b = 0; b < FLOW_BUCKETS; b++ ) {
+        load[bucket_owner[b]] += bucket_packets[b];
+    }
+
+    for ( i = 1; i < EXAMPLE_THREAD_COUNT; i++ ) {
+        if ( load[i] > load[max] ) {
+            max = i;
+        }
+        if ( load[i] < load[min] ) {
+            min = i;
+        }
+    }
+
+    if ( !migration_pending && ( load[max] - load[min] ) * 100 > load[max] * REBALANCE_THRESHOLD ) {
+        /* The largest bucket which does not overload the target */
+        for ( b = 0; b < FLOW_BUCKETS; b++ ) {
+            if ( bucket_owner[b] == max && bucket_packets[b] > best_packets &&
+                 bucket_packets[b] <= ( load[max] - load[min] ) / 2 ) {
+                best = b;
+                best_packets = bucket_packets[b];
+            }
+        }
+
+        if ( best != FLOW_BUCKETS ) {
+            migrate_bucket( best, min );
+        }
+    }
+
+    memset( bucket_packets, 0, sizeof(bucket_packets) );
+} /* rebalance */
 
-    pace2_example_wt[t_id].ring_buffer_last_written_elem = next_buffer_id_to_write;
+void packet_distribution(const uint64_t time, const struct iphdr *iph, uint16_t ipsize)
+{
+    u16 bucket = 0;
+    u8 t_id;
+    struct packet_struct *element;
+
+    if (iph->version == 4) {
+        bucket = flow_bucket( iph->saddr, iph->daddr );
+    }
+
+    bucket_packets[bucket]++;
+    if ( ++dispatched_packets % REBALANCE_INTERVAL == 0 ) {
+        rebalance();
+    }
+
+    t_id = bucket_owner[bucket];
+
+    // copy the packet to the corresponding q and wakeup the correspnding worker thread
+    element = ring_reserve( t_id );
+    element->type = RING_PACKET;
+    element->bucket = bucket;
+    element->time = time;
+    element->ipsize = ipsize;
+    memcpy( &element->packet_payload[0], iph, ipsize );
+
+    ring_commit( t_id );
 }
 
+/* Control plane: reports the subscribers of all workers from the view, without stopping them */
+static void *control_thread_main( void *arg )
+{
+    u32 last_count = 0;
+
+    while ( !control_thread_done ) {
+        u32 count;
+        u64 lookups;
+
+        sleep( 1 );
+
+        /* A subscriber with copies on several workers is counted once */
+        sv_totals( &subscriber_view, CONTROL_VIEW_READER, &count, &lookups );
+
+        if ( count != last_count ) {
+            fprintf( stderr, "subscribers: %u, subscriber lookups: %llu\n", count, lookups );
+            last_count = count;
+        }
+    }
+
+    return NULL;
+} /* control_thread_main */
+
 /* Configure and initialize PACE 2 module */
 static void pace_configure_and_initialize( const char * const license_file )
 {
     u8 i;
+    u16 b;
 
     /* Initialize configuration with default values */
     pace2_init_default_config( &config );
@@ -353,6 +972,10 @@ static void pace_configure_and_initialize( const char * const license_file )
     /* Set number of threads*/
     config.general.number_of_threads = EXAMPLE_THREAD_COUNT;
 
+    /* Enable external flow and subscriber tracking, they can be moved between the threads then */
+    config.tracking.flow.generic.type = EXTERNAL;
+    config.tracking.subscriber.generic.type = EXTERNAL;
+
     /* set size of hash table for flow and subscriber tracking */
     // config.tracking.flow.generic.max_size.memory_size = 400 * 1024 * 1024;
     // config.tracking.subscriber.generic.max_size.memory_size = 400 * 1024 * 1024;
@@ -406,6 +1029,64 @@ static void pace_configure_and_initialize( const char * const license_file )
     }
 
     memset( &pace2_example_wt, 0, sizeof(struct pace2_example_thread_struct) * EXAMPLE_THREAD_COUNT );
+    for ( i = 0; i < EXAMPLE_THREAD_COUNT; ++i ) {
+        struct PACE2_pht_config pht_conf;
+        int counters;
+        u8 j;
+
+        /* Flow hash table of the thread, see pace2_integration_example_ext_tracking.c */
+        pace2_pht_init_default_config( &pht_conf );
+        pht_conf.memory_size = 4 * 1024 * 1024;
+        pht_conf.unique_key_size = FM_KEY_SIZE;
+        pht_conf.user_buffer_size = SMP_FLOW_HEADER_SIZE + pace2_get_flow_memory_size( pace2, i );
+        pht_conf.timeout = FLOW_TABLE_TIMEOUT * config.general.clock_ticks_per_second;
+        pht_conf.ipq_malloc = malloc_wrapper;
+        pht_conf.ipq_free = free_wrapper;
+
+        pace2_example_wt[i].flow_pht = pace2_pht_create( &pht_conf, i );
+        if ( pace2_example_wt[i].flow_pht == NULL ) {
+            panic( "Initialization of flow hash table failed\n" );
+        }
+
+        /* Subscriber hash table of the thread, the key is a single IPv4 or IPv6 address */
+        pace2_pht_init_default_config( &pht_conf );
+        pht_conf.memory_size = 4 * 1024 * 1024;
+        pht_conf.unique_key_size = sizeof( PACE2_subscriber_key );
+        pht_conf.user_buffer_size = SMP_SUBSCRIBER_HEADER_SIZE + pace2_get_subscriber_memory_size( pace2, i );
+        pht_conf.timeout = SUBSCRIBER_TABLE_TIMEOUT * config.general.clock_ticks_per_second;
+        pht_conf.ipq_malloc = malloc_wrapper;
+        pht_conf.ipq_free = free_wrapper;
+
+        pace2_example_wt[i].subscr_pht = pace2_pht_create( &pht_conf, i );
+        if ( pace2_example_wt[i].subscr_pht == NULL ) {
+            panic( "Initialization of subscriber hash table failed\n" );
+        }
+
+        for ( j = 0; j < EXAMPLE_THREAD_COUNT; ++j ) {
+            if ( i != j && fm_channel_init( &migration_channel[i][j], MIGRATION_CHANNEL_SIZE ) != 0 ) {
+                panic( "Initialization of migration channel failed\n" );
+            }
+        }
+
+        if ( eb_init( &pace2_example_wt[i].s3_events, pace2, i, EVENT_BATCH_SIZE ) != 0 ||
+             eb_init( &pace2_example_wt[i].s4_events, pace2, i, EVENT_BATCH_SIZE ) != 0 ) {
+            panic( "Allocation of the event batches failed\n" );
+        }
+        counters = eb_add_consumer( &pace2_example_wt[i].s3_events, "counters" );
+        eb_subscribe( &pace2_example_wt[i].s3_events, counters, PACE2_CLASSIFICATION_RESULT, handle_classification_results, &pace2_example_wt[i] );
+        eb_subscribe( &pace2_example_wt[i].s3_events, counters, PACE2_LICENSE_EXCEEDED_EVENT, handle_license_exceeded, &pace2_example_wt[i] );
+    }
+
+    for ( b = 0; b < FLOW_BUCKETS; ++b ) {
+        bucket_owner[b] = b % EXAMPLE_THREAD_COUNT;
+        pace2_example_wt[bucket_owner[b]].owned_bucket[b] = 1;
+    }
+
+    if ( sv_init( &subscriber_view, EXAMPLE_THREAD_COUNT ) != 0 ) {
+        panic( "Initialization of subscriber view failed\n" );
+    }
+    pthread_create( &control_thread, NULL, control_thread_main, NULL );
+
     for ( i = 0; i < EXAMPLE_THREAD_COUNT; ++i ) {
         pace2_example_wt[i].thread_id = i;
         pace2_example_wt[i].ring_buffer_last_written_elem = RINGBBUFFER_LAST_WRITTEN_EMPTY;
@@ -417,6 +1098,7 @@ static void pace_configure_and_initialize( const char * const license_file )
 
 static void pace_cleanup_and_exit( void )
 {
+    u64 foreign_subscribers = 0;
     u8 i;
 
     /* join processing threads and sum up results */
@@ -426,9 +1108,17 @@ static void pace_cleanup_and_exit( void )
         pthread_join(pace2_example_wt[i].thread, NULL);
 
         packet_counter += pace2_example_wt[i].packet_counter;
-        fprintf(stderr, "thread: %u, had packets: %llu\n",
+        fprintf(stderr, "thread: %u, had packets: %llu, migrated flows: %llu, installed flows: %llu, "
+                "migrated subscribers: %llu, installed subscribers: %llu, merged subscribers: %llu, foreign subscriber lookups: %llu\n",
                 i,
-                pace2_example_wt[i].packet_counter);
+                pace2_example_wt[i].packet_counter,
+                pace2_example_wt[i].migrated_flows,
+                pace2_example_wt[i].installed_flows,
+                pace2_example_wt[i].migrated_subscribers,
+                pace2_example_wt[i].installed_subscribers,
+                pace2_example_wt[i].merged_subscribers,
+                pace2_example_wt[i].foreign_subscribers);
+        foreign_subscribers += pace2_example_wt[i].foreign_subscribers;
         byte_counter += pace2_example_wt[i].byte_counter;
 
         license_exceeded_packets += pace2_example_wt[i].license_exceeded_packets;
@@ -451,12 +1141,43 @@ static void pace_cleanup_and_exit( void )
         }
     }
 
+    fprintf(stderr, "migrated buckets: %llu\n", migrated_buckets);
+
+    control_thread_done = 1;
+    pthread_join( control_thread, NULL );
+
     /* Output detection results */
     pace_print_results();
 
+    for ( i = 0; i < EXAMPLE_THREAD_COUNT; ++i ) {
+        u8 j;
+
+        fprintf( stderr, "Thread %u stage 3 events:\n", i );
+        eb_print_stats( &pace2_example_wt[i].s3_events, stderr );
+        fprintf( stderr, "Thread %u stage 4 and 5 events:\n", i );
+        eb_print_stats( &pace2_example_wt[i].s4_events, stderr );
+        eb_destroy( &pace2_example_wt[i].s3_events );
+        eb_destroy( &pace2_example_wt[i].s4_events );
+
+        pace2_pht_destroy( pace2_example_wt[i].flow_pht );
+        pace2_pht_destroy( pace2_example_wt[i].subscr_pht );
+        for ( j = 0; j < EXAMPLE_THREAD_COUNT; ++j ) {
+            if ( i != j ) {
+                fm_channel_destroy( &migration_channel[i][j] );
+            }
+        }
+    }
+
+    sv_destroy( &subscriber_view );
+
     /* Destroy PACE 2 module and free memory */
     pace2_exit_module( pace2 );
 
+    /* Both subscribers of every flow have to be found by the worker of the flow */
+    if ( foreign_subscribers != 0 ) {
+        panic( "Subscribers were looked up by a worker which does not own the bucket of their flow\n" );
+    }
+
     pthread_exit( 0 );
 } /* pace_cleanup_and_exit */
 
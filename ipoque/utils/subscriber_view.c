@@ -0,0 +1,223 @@
+/*
+ * subscriber_view.c
+ *
+ * Read-mostly subscriber view, see subscriber_view.h.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "subscriber_view.h"
+
+u8 sv_init(struct subscriber_view *view, u32 shards)
+{
+    if (0 == shards || shards > SV_MAX_SHARDS) {
+        return 1;
+    }
+
+    memset(view, 0, sizeof(*view));
+    view->shards = shards;
+    /* readers use 0 as "not reading" */
+    view->epoch = 1;
+
+    return 0;
+}
+
+void sv_destroy(struct subscriber_view *view)
+{
+    u32 i, j;
+
+    for (i = 0; i < view->shards; i++) {
+        struct sv_shard * const shard = &view->shard[i];
+
+        free(shard->current);
+        shard->current = NULL;
+
+        for (j = 0; j < shard->retired_count; j++) {
+            free(shard->retired[j].snapshot);
+        }
+        shard->retired_count = 0;
+    }
+}
+
+struct sv_snapshot *sv_snapshot_alloc(u32 capacity)
+{
+    struct sv_snapshot * const snapshot = malloc(sizeof(*snapshot) + (u64)capacity * sizeof(struct sv_subscriber));
+
+    if (NULL != snapshot) {
+        snapshot->timestamp = 0;
+        snapshot->count = 0;
+    }
+
+    return snapshot;
+}
+
+static int sv_compare(const void *a, const void *b)
+{
+    return memcmp(&((const struct sv_subscriber *)a)->key, &((const struct sv_subscriber *)b)->key, sizeof(PACE2_subscriber_key));
+}
+
+/* frees the retired snapshots no reader can use anymore */
+static void sv_reclaim(struct subscriber_view *view, struct sv_shard *shard)
+{
+    u64 oldest = view->epoch;
+    u32 i, kept = 0;
+
+    __sync_synchronize();
+
+    for (i = 0; i < SV_MAX_READERS; i++) {
+        const u64 epoch = view->reader[i].epoch;
+
+        if (0 != epoch && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+
+    for (i = 0; i < shard->retired_count; i++) {
+        if (shard->retired[i].epoch <= oldest) {
+            free(shard->retired[i].snapshot);
+        } else {
+            shard->retired[kept++] = shard->retired[i];
+        }
+    }
+    shard->retired_count = kept;
+}
+
+void sv_publish(struct subscriber_view *view, u32 shard_index, struct sv_snapshot *snapshot)
+{
+    struct sv_shard * const shard = &view->shard[shard_index];
+    struct sv_snapshot * const old = shard->current;
+
+    qsort(snapshot->subscribers, snapshot->count, sizeof(struct sv_subscriber), sv_compare);
+
+    /* the snapshot is complete before it is visible */
+    __sync_synchronize();
+    shard->current = snapshot;
+
+    if (NULL == old) {
+        return;
+    }
+
+    /* readers which start from now on see the new snapshot */
+    while (shard->retired_count == SV_MAX_RETIRED) {
+        /* a reader holds all retired snapshots, it finishes soon */
+        sv_reclaim(view, shard);
+    }
+
+    shard->retired[shard->retired_count].snapshot = old;
+    shard->retired[shard->retired_count].epoch = __sync_add_and_fetch(&view->epoch, 1);
+    shard->retired_count++;
+
+    sv_reclaim(view, shard);
+}
+
+void sv_read_lock(struct subscriber_view *view, u32 reader)
+{
+    view->reader[reader].epoch = view->epoch;
+
+    /* the epoch is announced before any snapshot pointer is read */
+    __sync_synchronize();
+}
+
+void sv_read_unlock(struct subscriber_view *view, u32 reader)
+{
+    /* all reads of the snapshots are done before they may be freed */
+    __sync_synchronize();
+
+    view->reader[reader].epoch = 0;
+}
+
+u8 sv_query(struct subscriber_view *view, u32 reader, const PACE2_subscriber_key *key, struct sv_subscriber *subscriber)
+{
+    u8 found = 1;
+    u32 i;
+
+    sv_read_lock(view, reader);
+
+    for (i = 0; i < view->shards; i++) {
+        const struct sv_snapshot * const snapshot = sv_current(view, i);
+        struct sv_subscriber wanted;
+        const struct sv_subscriber *match;
+
+        if (NULL == snapshot) {
+            continue;
+        }
+
+        wanted.key = *key;
+        match = bsearch(&wanted, snapshot->subscribers, snapshot->count, sizeof(struct sv_subscriber), sv_compare);
+        if (NULL == match) {
+            continue;
+        }
+
+        if (0 != found) {
+            *subscriber = *match;
+            found = 0;
+        } else {
+            subscriber->lookups += match->lookups;
+            if (subscriber->last_seen < match->last_seen) {
+                subscriber->last_seen = match->last_seen;
+            }
+        }
+    }
+
+    sv_read_unlock(view, reader);
+
+    return found;
+}
+
+void sv_totals(struct subscriber_view *view, u32 reader, u32 *count, u64 *lookups)
+{
+    const struct sv_snapshot *snapshot[SV_MAX_SHARDS];
+    u32 position[SV_MAX_SHARDS];
+    u32 i;
+
+    *count = 0;
+    *lookups = 0;
+
+    sv_read_lock(view, reader);
+
+    for (i = 0; i < view->shards; i++) {
+        snapshot[i] = sv_current(view, i);
+        position[i] = 0;
+    }
+
+    /* merges the sorted snapshots, every step consumes the smallest key of all shards */
+    for (;;) {
+        const struct sv_subscriber *smallest = NULL;
+
+        for (i = 0; i < view->shards; i++) {
+            const struct sv_subscriber *next;
+
+            if (NULL == snapshot[i] || position[i] == snapshot[i]->count) {
+                continue;
+            }
+
+            next = &snapshot[i]->subscribers[position[i]];
+            if (NULL == smallest || sv_compare(next, smallest) < 0) {
+                smallest = next;
+            }
+        }
+
+        if (NULL == smallest) {
+            break;
+        }
+
+        (*count)++;
+
+        for (i = 0; i < view->shards; i++) {
+            const struct sv_subscriber *next;
+
+            if (NULL == snapshot[i] || position[i] == snapshot[i]->count) {
+                continue;
+            }
+
+            /* the copies of the subscriber in all shards, smallest itself included */
+            next = &snapshot[i]->subscribers[position[i]];
+            if (0 == sv_compare(next, smallest)) {
+                *lookups += next->lookups;
+                position[i]++;
+            }
+        }
+    }
+
+    sv_read_unlock(view, reader);
+}
@@ -0,0 +1,143 @@
+/*
+ * subscriber_view.h
+ *
+ * Read-mostly view of the subscribers of all worker threads. Every worker
+ * owns one shard of the subscribers and periodically publishes a sorted
+ * snapshot of it; the control plane reads the snapshots without blocking
+ * the workers. A subscriber may be in several shards, every shard holding a
+ * part of its state; the readers below merge the copies.
+ *
+ * A snapshot which was replaced is freed by its worker once no reader can
+ * still use it: readers announce the epoch they started in, a snapshot
+ * retired in epoch E is freed when every active reader started in E or
+ * later.
+ */
+
+#ifndef SUBSCRIBER_VIEW_H
+#define SUBSCRIBER_VIEW_H
+
+#include <pace2.h>
+
+/* maximum number of shards (workers) and of concurrent readers */
+#define SV_MAX_SHARDS 64
+#define SV_MAX_READERS 8
+
+/* replaced snapshots per shard which wait for the readers */
+#define SV_MAX_RETIRED 8
+
+struct sv_subscriber {
+    PACE2_subscriber_key key;
+    u64 last_seen;
+    /* packets for which the subscriber was looked up by the classification */
+    u64 lookups;
+};
+
+struct sv_snapshot {
+    /* timestamp of the publication */
+    u64 timestamp;
+    u32 count;
+    /* sorted by key */
+    struct sv_subscriber subscribers[];
+};
+
+struct sv_retired {
+    struct sv_snapshot *snapshot;
+    u64 epoch;
+};
+
+/* written by one worker only */
+struct sv_shard {
+    struct sv_snapshot * volatile current;
+    struct sv_retired retired[SV_MAX_RETIRED];
+    u32 retired_count;
+    u8 pad[52];
+};
+
+struct sv_reader {
+    /* epoch the reader started in, 0 if it is not reading */
+    volatile u64 epoch;
+    u8 pad[56];
+};
+
+struct subscriber_view {
+    volatile u64 epoch;
+    u32 shards;
+    struct sv_shard shard[SV_MAX_SHARDS];
+    struct sv_reader reader[SV_MAX_READERS];
+};
+
+/**
+ * initializes an empty view
+ * @param view view
+ * @param shards number of shards, at most SV_MAX_SHARDS
+ * @return 0 on success
+ */
+u8 sv_init(struct subscriber_view *view, u32 shards);
+
+/**
+ * frees all snapshots; no worker or reader may use the view anymore
+ * @param view view
+ */
+void sv_destroy(struct subscriber_view *view);
+
+/**
+ * allocates a snapshot for the owner of a shard
+ * @param capacity number of subscribers
+ * @return snapshot with count 0 or NULL
+ */
+struct sv_snapshot *sv_snapshot_alloc(u32 capacity);
+
+/**
+ * sorts a snapshot and makes it the current one of a shard; called by the owner of the shard only.
+ * The replaced snapshot is freed when the readers are done with it.
+ * @param view view
+ * @param shard shard index
+ * @param snapshot filled snapshot, owned by the view afterwards
+ */
+void sv_publish(struct subscriber_view *view, u32 shard, struct sv_snapshot *snapshot);
+
+/**
+ * starts reading; the snapshots returned by sv_current stay valid until sv_read_unlock
+ * @param view view
+ * @param reader reader index, every concurrent reader uses its own
+ */
+void sv_read_lock(struct subscriber_view *view, u32 reader);
+
+/**
+ * ends reading
+ * @param view view
+ * @param reader reader index
+ */
+void sv_read_unlock(struct subscriber_view *view, u32 reader);
+
+/**
+ * @param view view
+ * @param shard shard index
+ * @return current snapshot of the shard or NULL; only valid between sv_read_lock and sv_read_unlock
+ */
+static inline const struct sv_snapshot *sv_current(const struct subscriber_view *view, u32 shard)
+{
+    return view->shard[shard].current;
+}
+
+/**
+ * looks up a subscriber in all shards and merges its copies: the lookups are summed up,
+ * last_seen is the latest one
+ * @param view view
+ * @param reader reader index
+ * @param key subscriber key
+ * @param subscriber set to the published state of the subscriber
+ * @return 0 if the subscriber was found
+ */
+u8 sv_query(struct subscriber_view *view, u32 reader, const PACE2_subscriber_key *key, struct sv_subscriber *subscriber);
+
+/**
+ * counts the distinct subscribers of all shards
+ * @param view view
+ * @param reader reader index
+ * @param count set to the number of subscribers, a subscriber in several shards is counted once
+ * @param lookups set to the lookups of all subscribers
+ */
+void sv_totals(struct subscriber_view *view, u32 reader, u32 *count, u64 *lookups);
+
+#endif /* SUBSCRIBER_VIEW_H */
@@ -0,0 +1,167 @@
+/*
+ * timer_wheel.c
+ *
+ * Hierarchical timing wheel, see timer_wheel.h.
+ */
+
+#include <string.h>
+#include "timer_wheel.h"
+
+#define TW_SLOT_MASK (TW_SLOTS - 1)
+
+/* largest distance a timer can be placed from the current tick */
+#define TW_MAX_DELTA ((1ull << (TW_LEVELS * TW_SLOT_BITS)) - 1)
+
+void tw_init(struct timer_wheel *tw, u64 resolution, tw_expire_callback callback, void *user_ptr)
+{
+    memset(tw, 0, sizeof(*tw));
+
+    tw->resolution = resolution ? resolution : 1;
+    tw->callback = callback;
+    tw->user_ptr = user_ptr;
+}
+
+void tw_set_timeout(struct timer_wheel *tw, u8 timeout_class, u64 timeout)
+{
+    if (timeout_class >= TW_MAX_CLASSES) {
+        return;
+    }
+
+    /* round up, a timer never fires early */
+    tw->timeouts[timeout_class] = (timeout + tw->resolution - 1) / tw->resolution;
+}
+
+/* links a timer into the slot matching its expiry */
+static void tw_insert(struct timer_wheel *tw, struct tw_timer *timer)
+{
+    u64 delta = timer->expires > tw->tick ? timer->expires - tw->tick : 0;
+    u64 expires;
+    struct tw_timer **slot;
+    u32 level = 0;
+
+    if (delta > TW_MAX_DELTA) {
+        /* placed as far as possible, it is moved again when its slot is cascaded */
+        delta = TW_MAX_DELTA;
+    }
+    expires = tw->tick + delta;
+
+    while (level < TW_LEVELS - 1 && delta >= 1ull << ((level + 1) * TW_SLOT_BITS)) {
+        level++;
+    }
+
+    slot = &tw->slots[level][(expires >> (level * TW_SLOT_BITS)) & TW_SLOT_MASK];
+
+    timer->next = *slot;
+    if (NULL != timer->next) {
+        timer->next->pprev = &timer->next;
+    }
+    timer->pprev = slot;
+    *slot = timer;
+}
+
+static void tw_unlink(struct tw_timer *timer)
+{
+    *timer->pprev = timer->next;
+    if (NULL != timer->next) {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+void tw_arm(struct timer_wheel *tw, struct tw_timer *timer, u8 timeout_class)
+{
+    if (tw_is_armed(timer)) {
+        tw_unlink(timer);
+    } else {
+        tw->pending++;
+    }
+
+    if (timeout_class >= TW_MAX_CLASSES) {
+        timeout_class = TW_MAX_CLASSES - 1;
+    }
+
+    timer->timeout_class = timeout_class;
+    /* at least one tick ahead, the current tick is already processed */
+    timer->expires = tw->tick + (tw->timeouts[timeout_class] ? tw->timeouts[timeout_class] : 1);
+    tw->armed++;
+
+    tw_insert(tw, timer);
+}
+
+void tw_cancel(struct timer_wheel *tw, struct tw_timer *timer)
+{
+    if (!tw_is_armed(timer)) {
+        return;
+    }
+
+    tw_unlink(timer);
+    tw->pending--;
+}
+
+/* moves all timers of a slot one level down, returns the index of the slot */
+static u32 tw_cascade(struct timer_wheel *tw, u32 level)
+{
+    const u32 index = (tw->tick >> (level * TW_SLOT_BITS)) & TW_SLOT_MASK;
+    struct tw_timer *timer = tw->slots[level][index];
+
+    tw->slots[level][index] = NULL;
+
+    while (NULL != timer) {
+        struct tw_timer * const next = timer->next;
+
+        tw_insert(tw, timer);
+        tw->cascaded++;
+        timer = next;
+    }
+
+    return index;
+}
+
+u32 tw_advance(struct timer_wheel *tw, u64 now)
+{
+    const u64 target = now / tw->resolution;
+    u32 expired = 0;
+
+    if (!tw->started) {
+        tw->tick = target;
+        tw->started = 1;
+        return 0;
+    }
+
+    while (tw->tick < target) {
+        u32 index;
+
+        if (0 == tw->pending) {
+            /* nothing can expire, skip the idle ticks */
+            tw->tick = target;
+            break;
+        }
+
+        tw->tick++;
+        index = tw->tick & TW_SLOT_MASK;
+
+        if (0 == index) {
+            u32 level = 1;
+
+            /* the upper levels are cascaded when the level below wraps around */
+            while (level < TW_LEVELS && 0 == tw_cascade(tw, level)) {
+                level++;
+            }
+        }
+
+        /* the callback may cancel or arm other timers, so the list is not detached at once */
+        while (NULL != tw->slots[0][index]) {
+            struct tw_timer * const timer = tw->slots[0][index];
+
+            tw_unlink(timer);
+            tw->pending--;
+            tw->expired++;
+            expired++;
+
+            tw->callback(tw, timer, tw->user_ptr);
+        }
+    }
+
+    return expired;
+}
@@ -0,0 +1,117 @@
+/*
+ * timer_wheel.h
+ *
+ * Hierarchical timing wheel for the expiry of externally tracked state like
+ * flows or reassembly buffers. Timers are embedded in the tracked element,
+ * arming and cancelling are O(1). Expiry is done in batches by tw_advance,
+ * which only has work to do when the wheel tick changes, so it can be called
+ * for every packet or from a periodic timer.
+ *
+ * The wheel has TW_LEVELS levels of TW_SLOTS slots, level n covers
+ * TW_SLOTS^(n+1) ticks. Timers of the upper levels are moved down when the
+ * lower level wraps around.
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <pace2.h>
+
+#define TW_SLOT_BITS 8
+#define TW_SLOTS (1 << TW_SLOT_BITS)
+#define TW_LEVELS 4
+
+/* maximum number of timeout classes */
+#define TW_MAX_CLASSES 8
+
+struct tw_timer {
+    struct tw_timer *next;
+    /* points to the pointer referencing this timer, NULL if the timer is not armed */
+    struct tw_timer **pprev;
+    /* expiry in wheel ticks */
+    u64 expires;
+    u8 timeout_class;
+};
+
+struct timer_wheel;
+
+/**
+ * called for every expired timer; the timer is not armed anymore and may be armed again
+ * @param tw timer wheel
+ * @param timer expired timer
+ * @param user_ptr user pointer given to tw_init
+ */
+typedef void (*tw_expire_callback)(struct timer_wheel *tw, struct tw_timer *timer, void *user_ptr);
+
+struct timer_wheel {
+    struct tw_timer *slots[TW_LEVELS][TW_SLOTS];
+
+    /* clock ticks per wheel tick */
+    u64 resolution;
+    /* timeout of every class in wheel ticks */
+    u64 timeouts[TW_MAX_CLASSES];
+
+    /* last processed wheel tick */
+    u64 tick;
+    u8 started;
+
+    tw_expire_callback callback;
+    void *user_ptr;
+
+    /* statistics */
+    u64 armed;
+    u64 expired;
+    u64 cascaded;
+    u32 pending;
+};
+
+/**
+ * initializes a timer wheel, all timeouts are 0
+ * @param tw timer wheel
+ * @param resolution clock ticks per wheel tick
+ * @param callback function called for expired timers
+ * @param user_ptr pointer passed to the callback
+ */
+void tw_init(struct timer_wheel *tw, u64 resolution, tw_expire_callback callback, void *user_ptr);
+
+/**
+ * sets the timeout of a timeout class; armed timers keep their expiry
+ * @param tw timer wheel
+ * @param timeout_class class between 0 and TW_MAX_CLASSES - 1
+ * @param timeout timeout in clock ticks
+ */
+void tw_set_timeout(struct timer_wheel *tw, u8 timeout_class, u64 timeout);
+
+/**
+ * arms a timer with the timeout of its class; an armed timer is moved
+ * @param tw timer wheel
+ * @param timer timer, has to be zeroed before the first use
+ * @param timeout_class timeout class
+ */
+void tw_arm(struct timer_wheel *tw, struct tw_timer *timer, u8 timeout_class);
+
+/**
+ * cancels a timer, does nothing if it is not armed
+ * @param tw timer wheel
+ * @param timer timer
+ */
+void tw_cancel(struct timer_wheel *tw, struct tw_timer *timer);
+
+/**
+ * advances the wheel to a timestamp and calls the callback for every timer that expired until then
+ * @param tw timer wheel
+ * @param now current timestamp in clock ticks
+ * @return number of expired timers
+ */
+u32 tw_advance(struct timer_wheel *tw, u64 now);
+
+/**
+ * @param timer timer
+ * @return !=0 if the timer is armed
+ */
+static inline u8 tw_is_armed(const struct tw_timer *timer)
+{
+    return timer->pprev != NULL;
+}
+
+#endif /* TIMER_WHEEL_H */
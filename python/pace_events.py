@@ -0,0 +1,176 @@
+#!/usr/bin/env python
+
+'''
+consumer for the event rings exported by the PACE 2 filter daemon
+(ipoque/filter/pace2_event_ring.h), records are fixed size and are
+copied out of the ring in batches, no parsing happens in the daemon
+'''
+
+import mmap
+import os
+import struct
+import sys
+import time
+
+SHM_DIR = '/dev/shm'
+DEFAULT_NAME = '/pace2_events'
+
+MAGIC = 0x50324552
+VERSION_MAJOR = 1
+
+# PACE2_event_type values exported by pace2_event_ring_push_event
+FLOW_STARTED_EVENT = 2
+FLOW_DROPPED_EVENT = 3
+CLASSIFICATION_RESULT = 42
+FLOW_INFO_EVENT = 46
+FLOW_PROCESS_EVENT = 47
+
+# struct pace2_event_ring_header
+HEADER = struct.Struct('=IHHIIIIIIQ')
+# struct pace2_event_ring_control: head, drops, produced ... tail
+CONTROL_SIZE = 128
+HEAD = struct.Struct('=QQQ')
+TAIL = struct.Struct('=Q')
+TAIL_OFFSET = 64
+# struct pace2_event_record: seq, timestamp, flow_id, packet_id, type,
+# thread_id, flags and 24 bytes of type specific data
+RECORD = struct.Struct('=QQQQHHI24s')
+
+DATA = {
+    CLASSIFICATION_RESULT: struct.Struct('=4HBBHH5H'),
+    FLOW_DROPPED_EVENT: struct.Struct('=I20x'),
+    FLOW_INFO_EVENT: struct.Struct('=QQHH4x'),
+    FLOW_PROCESS_EVENT: struct.Struct('=QQQ'),
+}
+
+
+class RingError(Exception): pass
+
+
+def decode(record):
+    '''
+    split the type specific part of a record tuple, returns a dict
+    '''
+    seq, ts, flow_id, packet_id, etype, thread_id, flags, raw = record
+    event = {'seq': seq, 'timestamp': ts, 'flow_id': flow_id,
+             'packet_id': packet_id, 'type': etype, 'thread_id': thread_id}
+    fmt = DATA.get(etype)
+    if fmt is None:
+        return event
+    data = fmt.unpack(raw)
+    if etype == CLASSIFICATION_RESULT:
+        length = data[4]
+        event['stack'] = list(data[0:min(length, 4)])
+        event['finished'] = data[5]
+        event['application'] = data[6]
+        event['attributes'] = list(data[8:8 + min(data[7], 5)])
+    elif etype == FLOW_DROPPED_EVENT:
+        event['removal_reason'] = data[0]
+    elif etype == FLOW_INFO_EVENT:
+        event['src_id'], event['dst_id'] = data[0], data[1]
+        event['src_port'], event['dst_port'] = data[2], data[3]
+    elif etype == FLOW_PROCESS_EVENT:
+        event['bytes'], event['total_bytes'], event['missing_bytes'] = data
+    return event
+
+
+class EventRing(object):
+    '''
+      consumer side of the ring segment, one instance per process
+    '''
+
+    def __init__(self, name=DEFAULT_NAME):
+        self._name = name
+        fd = os.open(os.path.join(SHM_DIR, name.lstrip('/')), os.O_RDWR)
+        try:
+            size = os.fstat(fd).st_size
+            self._mem = mmap.mmap(fd, size, mmap.MAP_SHARED,
+                                  mmap.PROT_READ | mmap.PROT_WRITE)
+        finally:
+            os.close(fd)
+
+        hdr = HEADER.unpack_from(self._mem, 0)
+        if hdr[0] != MAGIC or hdr[1] != VERSION_MAJOR or hdr[5] != RECORD.size:
+            self._mem.close()
+            raise RingError('%s is not a compatible event ring' % name)
+
+        self.ring_count = hdr[3]
+        self.slots = hdr[4]
+        self._ring_offset = hdr[6]
+        self._ring_stride = hdr[7]
+        self.lost = 0
+
+    def close(self):
+        self._mem.close()
+
+    def _control(self, ring):
+        return self._ring_offset + ring * self._ring_stride
+
+    def counters(self, ring=0):
+        '''
+        return (head, drops, produced, tail) of a ring
+        '''
+        base = self._control(ring)
+        head, drops, produced = HEAD.unpack_from(self._mem, base)
+        tail = TAIL.unpack_from(self._mem, base + TAIL_OFFSET)[0]
+        return head, drops, produced, tail
+
+    def read(self, ring=0, max_records=65536):
+        '''
+        return the pending records of a ring as raw tuples and release them
+        '''
+        base = self._control(ring)
+        slots = base + CONTROL_SIZE
+        head = HEAD.unpack_from(self._mem, base)[0]
+        tail = TAIL.unpack_from(self._mem, base + TAIL_OFFSET)[0]
+
+        if head - tail > self.slots:
+            self.lost += head - tail - self.slots
+            tail = head - self.slots
+
+        count = min(head - tail, max_records)
+        records = []
+        while count > 0:
+            # copy the contiguous part up to the end of the ring at once
+            index = tail % self.slots
+            n = min(count, self.slots - index)
+            start = slots + index * RECORD.size
+            chunk = self._mem[start:start + n * RECORD.size]
+            for i in range(n):
+                record = RECORD.unpack_from(chunk, i * RECORD.size)
+                if record[0] != tail + i:
+                    self.lost += 1
+                    continue
+                records.append(record)
+            tail += n
+            count -= n
+
+        TAIL.pack_into(self._mem, base + TAIL_OFFSET, tail)
+        return records
+
+    def poll(self, interval=0.01):
+        '''
+        generator over all rings, sleeps when every ring is empty
+        '''
+        while True:
+            empty = True
+            for ring in range(self.ring_count):
+                records = self.read(ring)
+                if records:
+                    empty = False
+                for record in records:
+                    yield record
+            if empty:
+                time.sleep(interval)
+
+
+if __name__ == "__main__":
+    name = sys.argv[1] if len(sys.argv) > 1 else DEFAULT_NAME
+    events = EventRing(name)
+    try:
+        for record in events.poll():
+            print(decode(record))
+    except KeyboardInterrupt:
+        head, drops, produced, tail = events.counters()
+        print('produced %s dropped %s lost %s' % (produced, drops, events.lost))
+    events.close()
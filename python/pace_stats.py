@@ -0,0 +1,115 @@
+#!/usr/bin/env python
+
+'''
+reader for the statistics segment published by the PACE 2 filter daemon
+(ipoque/filter/pace2_shm_stats.h), snapshots are taken through the
+sequence lock in the segment header, the daemon is never blocked
+'''
+
+import mmap
+import os
+import struct
+import sys
+import time
+
+SHM_DIR = '/dev/shm'
+DEFAULT_NAME = '/pace2_stats'
+
+MAGIC = 0x50325354
+VERSION_MAJOR = 1
+
+SECTIONS = ('protocols', 'stack_lengths', 'applications', 'attributes')
+
+# struct pace2_shm_stats_header
+HEADER = struct.Struct('=IHHIIII4I4IIIQQQQQQ')
+RECORD = struct.Struct('=QQ')
+SEQ_OFFSET = 56
+
+
+class StatsError(Exception): pass
+
+
+class PaceStats(object):
+    '''
+      read-only view on the statistics segment
+    '''
+
+    def __init__(self, name=DEFAULT_NAME):
+        self._name = name
+        fd = os.open(os.path.join(SHM_DIR, name.lstrip('/')), os.O_RDONLY)
+        try:
+            size = os.fstat(fd).st_size
+            self._mem = mmap.mmap(fd, size, mmap.MAP_SHARED, mmap.PROT_READ)
+        finally:
+            os.close(fd)
+
+        hdr = HEADER.unpack_from(self._mem, 0)
+        if hdr[0] != MAGIC or hdr[1] != VERSION_MAJOR or hdr[4] != RECORD.size:
+            self._mem.close()
+            raise StatsError('%s is not a compatible statistics segment' % name)
+        self._size = hdr[5]
+
+    def close(self):
+        self._mem.close()
+
+    def _seq(self):
+        return struct.unpack_from('=I', self._mem, SEQ_OFFSET)[0]
+
+    def raw_snapshot(self, max_retries=1000):
+        '''
+        copy the whole segment while no update is in progress
+        '''
+        for _ in range(max_retries + 1):
+            seq = self._seq()
+            if seq & 1:
+                time.sleep(0)
+                continue
+            data = self._mem[0:self._size]
+            if self._seq() == seq:
+                return data
+        raise StatsError('no consistent snapshot of %s' % self._name)
+
+    def snapshot(self, max_retries=1000):
+        '''
+        return the counters as dict, sections only contain non-zero records
+        '''
+        data = self.raw_snapshot(max_retries)
+        hdr = HEADER.unpack_from(data, 0)
+        header_size, record_size, bitmap_offset = hdr[3], hdr[4], hdr[6]
+        counts, offsets = hdr[7:11], hdr[11:15]
+
+        result = {
+            'update_count': hdr[17],
+            'timestamp': hdr[18],
+            'writer_pid': hdr[16],
+            'packet_counter': hdr[19],
+            'byte_counter': hdr[20],
+            'http_response_payload_bytes': hdr[21],
+            'license_exceeded_packets': hdr[22],
+        }
+
+        bitmap = bytearray(data[bitmap_offset:])
+        for name, count, offset in zip(SECTIONS, counts, offsets):
+            first = (offset - header_size) // record_size
+            section = {}
+            for i in range(count):
+                bit = first + i
+                if not bitmap[bit // 8] & (1 << (bit & 7)):
+                    continue
+                section[i] = RECORD.unpack_from(data, offset + i * record_size)
+            result[name] = section
+
+        return result
+
+
+if __name__ == "__main__":
+    name = sys.argv[1] if len(sys.argv) > 1 else DEFAULT_NAME
+    stats = PaceStats(name)
+    snap = stats.snapshot()
+    for section in SECTIONS:
+        print('%s:' % section)
+        for index, (packets, bytes_) in sorted(snap[section].items()):
+            print('  %-8s %-15s %s' % (index, packets, bytes_))
+    print('packets %s bytes %s (update %s)' %
+          (snap['packet_counter'], snap['byte_counter'], snap['update_count']))
+    stats.close()
@@ -15,6 +15,7 @@ from flask import jsonify
 from flask import make_response 
 
 from netf import TCManager
+from pace_stats import PaceStats, StatsError
 
 
 logger = logging.getLogger(__name__) 
@@ -322,6 +323,27 @@ class ShellEnabled(cmd.Cmd):
         return 
        
 
+    def do_stats(self, line):
+        """
+        show the classification counters of the PACE 2 daemon
+        """
+        l = line.split()
+        name = l[0] if l else '/pace2_stats'
+        try:
+            stats = PaceStats(name)
+            snap = stats.snapshot()
+            stats.close()
+        except (OSError, StatsError) as e:
+            print "no statistics available: %s" % e
+            return
+
+        print "packets %s bytes %s" % (snap['packet_counter'],
+                                       snap['byte_counter'])
+        for app, (packets, nbytes) in sorted(snap['applications'].items()):
+            print "application %-6s packets %-12s bytes %s" % (app, packets,
+                                                                nbytes)
+        return
+
     def do_exit(self, line):
         """
         exit the application 